@@ -523,6 +523,7 @@ _DIM_PROTOE( SLL *sll_search_next_remove, ( SLL *item, int offset, char *data, i
 _DIM_PROTOE( SLL *sll_get_head, 		  ( SLL *head ) );
 
 _DIM_PROTOE( int HashFunction,         ( char *name, int max ) );
+_DIM_PROTOE( unsigned int HashString,  ( char *name ) );
 
 _DIM_PROTOE( int copy_swap_buffer_out, (int format, FORMAT_STR *format_data, 
 					void *buff_out, void *buff_in, int size) );
@@ -0,0 +1,95 @@
+#ifndef __DIMSHMDEFS
+#define __DIMSHMDEFS
+
+#include "dim_common.h"
+
+/*
+ * Shared memory transport for clients on the same host
+ *
+ * The server copies the value of every updated service into a slot of
+ * shared memory region (/dev/shm/dim_shm_<task>). A slot is protected
+ * by a sequence lock: the sequence number is odd while the server
+ * writes, readers retry if it was odd or changed during the read.
+ * Clients hand the write end of a pipe to the server through the unix
+ * socket /tmp/dim_shm_<task>.sock, a byte is written to it on each update.
+ * Commands and subscriptions still go through the normal DIM path.
+ *
+ * The sizes given to dis_shm_open are only the initial ones: a slot whose
+ * value grows is moved to a larger area, and when the slots or the data
+ * area run out the server copies the region into a larger one under the
+ * same name and sets 'moved' in the old header, clients then map the new
+ * region on their next lookup or read. A reader gives up after a bounded
+ * number of spins on a slot that is being written, dic_shm_get_value then
+ * falls back to a DIM request over TCP.
+ */
+
+#define DIM_SHM_MAGIC		0xd1d5c0de
+#define DIM_SHM_VERSION		2
+#define DIM_SHM_NAME_LEN	132	/* same as MAX_NAME */
+
+/* slot flags */
+#define DIM_SHM_OVERSIZE	0x1	/* value did not fit, use DIM */
+#define DIM_SHM_REMOVED		0x2	/* service was removed */
+
+typedef struct {
+	char name[DIM_SHM_NAME_LEN];
+	char def[DIM_SHM_NAME_LEN];
+	unsigned int hash;
+	int service_id;
+	int offset;
+	int capacity;
+	volatile unsigned int seq;
+	int size;
+	int flags;
+	int quality;
+	int time_stamp[2];
+} DIM_SHM_SLOT;
+
+typedef struct {
+	unsigned int magic;
+	int version;
+	int pid;
+	int max_slots;
+	volatile int n_slots;
+	int data_size;
+	int data_used;
+	volatile unsigned int n_updates;
+	volatile int moved;		/* replaced by a larger region */
+} DIM_SHM_HEADER;
+
+typedef struct {
+	DIM_SHM_HEADER *header;
+	DIM_SHM_SLOT *slots;
+	char *data;
+	int map_size;
+	int event_fd;
+	int sock_fd;
+	char name[DIM_SHM_NAME_LEN];
+} DIM_SHM;
+
+/* server side */
+_DIM_PROTOE( int dis_shm_open,		(char *task_name, int max_services,
+					 int data_size) );
+_DIM_PROTOE( void dis_shm_close,	() );
+_DIM_PROTOE( int dis_shm_is_open,	() );
+_DIM_PROTOE( int dis_shm_publish,	(int *slotp, char *name, char *def,
+					 int service_id, void *buffer, int size,
+					 int quality, int secs, int millisecs) );
+_DIM_PROTOE( void dis_shm_invalidate,	(int slot) );
+
+/* client side */
+_DIM_PROTOE( DIM_SHM *dic_shm_attach,	(char *task_name) );
+_DIM_PROTOE( void dic_shm_detach,	(DIM_SHM *shmp) );
+_DIM_PROTOE( int dic_shm_find_service,	(DIM_SHM *shmp, char *service_name) );
+_DIM_PROTOE( unsigned int dic_shm_read_begin, (DIM_SHM *shmp, int slot) );
+_DIM_PROTOE( int dic_shm_read_retry,	(DIM_SHM *shmp, int slot, 
+					 unsigned int seq) );
+_DIM_PROTOE( void *dic_shm_get_address,	(DIM_SHM *shmp, int slot, int *size) );
+_DIM_PROTOE( int dic_shm_read,		(DIM_SHM *shmp, int slot, void *buffer,
+					 int size) );
+_DIM_PROTOE( int dic_shm_wait,		(DIM_SHM *shmp, int timeout_ms) );
+_DIM_PROTOE( int dic_shm_get_fd,	(DIM_SHM *shmp) );
+_DIM_PROTOE( int dic_shm_get_value,	(DIM_SHM *shmp, char *service_name,
+					 void *buffer, int size, int timeout) );
+
+#endif
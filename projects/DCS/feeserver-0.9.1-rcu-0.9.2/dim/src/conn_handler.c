@@ -33,10 +33,23 @@ DllExp DIM_NOSHARE NET_CONNECTION *Net_conns = 0;
 DllExp DIM_NOSHARE int Curr_N_Conns = 0;
 #endif
 
+/*
+ * Ids are handed out from a FIFO free list. Every slot carries a
+ * generation counter which is incremented when the id is freed and
+ * encoded above ID_INDEX_BITS in the id, so id_get_ptr() does not
+ * return the new owner of a recycled slot for a stale id. Ids stay
+ * below 0x10000000, the DNS uses that bit to flag commands.
+ */
+#define ID_INDEX_BITS	20
+#define ID_INDEX_MASK	((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK	0xFF
+
 typedef struct id_item
 {
 	void *ptr;
 	SRC_TYPES type;
+	int generation;
+	int next_free;
 }ID_ITEM;
 
 static ID_ITEM *Id_arr;
@@ -44,7 +57,25 @@ static ID_ITEM *Id_arr;
 static void **Id_arr;
 */
 static int Curr_N_Ids = 0;
-static int Curr_id = 1;
+static int Id_free_head = 0;
+static int Id_free_tail = 0;
+
+/* stack of free connection ids, index 0 is never used */
+static int *Conn_free_list = 0;
+static int N_free_conns = 0;
+
+static void conn_free_list_add(first, last)
+int first, last;
+{
+	register int i;
+
+	Conn_free_list = (int *)realloc( Conn_free_list, 
+		Curr_N_Conns * sizeof(int) );
+	for( i = last; i >= first; i-- )
+	{
+		Conn_free_list[N_free_conns++] = i;
+	}
+}
 
 void conn_arr_create(type)
 SRC_TYPES type;
@@ -70,6 +101,8 @@ SRC_TYPES type;
 				calloc( Curr_N_Conns, sizeof(DNA_CONNECTION) );
 		Net_conns = (NET_CONNECTION *)
 				calloc( Curr_N_Conns, sizeof(NET_CONNECTION) );
+		N_free_conns = 0;
+		conn_free_list_add( 1, Curr_N_Conns - 1 );
 		break;
 	default:
 		break;
@@ -79,18 +112,15 @@ SRC_TYPES type;
 
 int conn_get()
 {
-	register DNA_CONNECTION *dna_connp;
-	int i, n_conns, conn_id;
+	int n_conns, conn_id;
 
 	DISABLE_AST
-	for( i = 1, dna_connp = &Dna_conns[1]; i < Curr_N_Conns; i++, dna_connp++ )
+	if( N_free_conns )
 	{
-		if( !dna_connp->busy )
-		{
-			dna_connp->busy = TRUE;
-			ENABLE_AST
-			return(i);
-		}
+		conn_id = Conn_free_list[--N_free_conns];
+		Dna_conns[conn_id].busy = TRUE;
+		ENABLE_AST
+		return(conn_id);
 	}
 	n_conns = Curr_N_Conns + CONN_BLOCK;
 	Dna_conns = arr_increase( Dna_conns, sizeof(DNA_CONNECTION), n_conns );
@@ -110,6 +140,7 @@ int conn_get()
 	}
 	conn_id = Curr_N_Conns;
 	Curr_N_Conns = n_conns;
+	conn_free_list_add( conn_id + 1, n_conns - 1 );
 	Dna_conns[conn_id].busy = TRUE;
 	ENABLE_AST
 	return(conn_id);
@@ -120,7 +151,11 @@ void conn_free(conn_id)
 int conn_id;
 {
 	DISABLE_AST
-	Dna_conns[conn_id].busy = FALSE;
+	if( Dna_conns[conn_id].busy )
+	{
+		Dna_conns[conn_id].busy = FALSE;
+		Conn_free_list[N_free_conns++] = conn_id;
+	}
 	ENABLE_AST
 }
 
@@ -136,11 +171,26 @@ int conn_size, n_conns;
 	return(new_ptr);
 }
 
+static void id_free_list_append(index)
+int index;
+{
+	Id_arr[index].next_free = 0;
+	if(Id_free_tail)
+		Id_arr[Id_free_tail].next_free = index;
+	else
+		Id_free_head = index;
+	Id_free_tail = index;
+}
+
 void id_arr_create()
 {
+	register int i;
 
 	Curr_N_Ids = ID_BLOCK;
 	Id_arr = (void *) calloc( Curr_N_Ids, sizeof(ID_ITEM));
+	Id_free_head = Id_free_tail = 0;
+	for( i = 1; i < Curr_N_Ids; i++ )
+		id_free_list_append(i);
 }
 
 
@@ -167,24 +217,27 @@ SRC_TYPES type;
 	{
 		id_arr_create();
 	}
-	for( i = Curr_id, idp = &Id_arr[Curr_id]; i < Curr_N_Ids; i++, idp++ )
+	if(!Id_free_head)
 	{
-		if( !idp->type )
+		if( Curr_N_Ids + ID_BLOCK > ID_INDEX_MASK + 1 )
 		{
-			idp->ptr = ptr;
-			idp->type = type;
-			Curr_id = i;
 			ENABLE_AST
-			return(i);
+			return(0);
 		}
+		Id_arr = id_arr_increase( Id_arr, sizeof(ID_ITEM), 
+			Curr_N_Ids + ID_BLOCK );
+		for( i = Curr_N_Ids; i < Curr_N_Ids + ID_BLOCK; i++ )
+			id_free_list_append(i);
+		Curr_N_Ids += ID_BLOCK;
 	}
-	Id_arr = id_arr_increase( Id_arr, sizeof(ID_ITEM), Curr_N_Ids + ID_BLOCK );
-	id = Curr_N_Ids;
-	idp = &Id_arr[id];
+	i = Id_free_head;
+	idp = &Id_arr[i];
+	Id_free_head = idp->next_free;
+	if(!Id_free_head)
+		Id_free_tail = 0;
 	idp->ptr = ptr;
 	idp->type = type;
-	Curr_N_Ids += ID_BLOCK;
-	Curr_id = id;
+	id = (idp->generation << ID_INDEX_BITS) | i;
 	ENABLE_AST
 	return(id);
 }
@@ -195,15 +248,18 @@ SRC_TYPES type;
 {
 	ID_ITEM *idp;
 	void *ptr;
+	int index;
 	DISABLE_AST
 
-	if(id >= Curr_N_Ids)
+	index = id & ID_INDEX_MASK;
+	if((id < 0) || (index >= Curr_N_Ids))
 	{
 		ENABLE_AST
 		return(0);
 	}
-	idp = &Id_arr[id];
-	if(idp->type == type)
+	idp = &Id_arr[index];
+	if((idp->type == type) && 
+	   (idp->generation == ((id >> ID_INDEX_BITS) & ID_GEN_MASK)))
 	{
 		ptr = idp->ptr;
 		ENABLE_AST
@@ -218,14 +274,23 @@ int id;
 SRC_TYPES type;
 {
 	ID_ITEM *idp;
+	int index;
 	DISABLE_AST
 
-	idp = &Id_arr[id];
-	if(idp->type == type)
+	index = id & ID_INDEX_MASK;
+	if((id < 0) || (index == 0) || (index >= Curr_N_Ids))
+	{
+		ENABLE_AST
+		return;
+	}
+	idp = &Id_arr[index];
+	if((idp->type == type) && 
+	   (idp->generation == ((id >> ID_INDEX_BITS) & ID_GEN_MASK)))
 	{
 		idp->type = 0;
 		idp->ptr = 0;
+		idp->generation = (idp->generation + 1) & ID_GEN_MASK;
+		id_free_list_append(index);
 	}
-	Curr_id = 1;
 	ENABLE_AST
 }
@@ -0,0 +1,868 @@
+/*
+ * Shared memory transport for DIM clients on the same host.
+ *
+ * The server side is fed from do_update_service() in dis.c, see
+ * dim_shm.h for the layout of the region and the read protocol.
+ */
+
+#define DIMLIB
+#include <dim.h>
+#include <dic.h>
+#include <dim_shm.h>
+
+#define DIM_SHM_READ_SPINS	65536	/* polls of a slot being written */
+#define DIM_SHM_READ_TRIES	64	/* reads overtaken by the writer */
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#define DIM_SHM_MAX_CLIENTS	16
+#define DIM_SHM_ALIGN		8
+#define DIM_SHM_DIR		"/dev/shm"
+#define DIM_SHM_SOCK_LEN	108	/* sun_path of sockaddr_un */
+
+static DIM_SHM Dis_shm = {0, 0, 0, 0, -1, -1, ""};
+static char Dis_shm_name[DIM_SHM_NAME_LEN];
+static char Dis_shm_tmp_name[DIM_SHM_NAME_LEN + 4];
+static char Dis_shm_sock_path[DIM_SHM_SOCK_LEN];
+static int Dis_shm_listen_fd = -1;
+static int Dis_shm_client_sock[DIM_SHM_MAX_CLIENTS];
+static int Dis_shm_client_event[DIM_SHM_MAX_CLIENTS];
+static int Dis_shm_n_clients = 0;
+static int Dis_shm_running = 0;
+static pthread_t Dis_shm_thread;
+static pthread_mutex_t Dis_shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void dim_shm_names(task_name, shm_name, sock_path)
+char *task_name, *shm_name, *sock_path;
+{
+	char *ptr;
+
+	snprintf(shm_name, DIM_SHM_NAME_LEN, "%s/dim_shm_%s", DIM_SHM_DIR,
+		task_name);
+	for( ptr = shm_name + strlen(DIM_SHM_DIR) + 1; *ptr; ptr++ )
+	{
+		if(*ptr == '/')
+			*ptr = '_';
+	}
+	snprintf(sock_path, DIM_SHM_SOCK_LEN, "/tmp/%.*s.sock", 
+		DIM_SHM_SOCK_LEN - 11, shm_name + strlen(DIM_SHM_DIR) + 1);
+}
+
+static int dim_shm_align(size)
+int size;
+{
+	size = (size + DIM_SHM_ALIGN - 1) & ~(DIM_SHM_ALIGN - 1);
+	if(size < DIM_SHM_ALIGN)
+		size = DIM_SHM_ALIGN;
+	return(size);
+}
+
+static int dim_shm_map_size(max_slots, data_size)
+int max_slots, data_size;
+{
+	return(sizeof(DIM_SHM_HEADER) + max_slots * sizeof(DIM_SHM_SLOT) + 
+		data_size);
+}
+
+static void dim_shm_set_pointers(shmp, base)
+DIM_SHM *shmp;
+char *base;
+{
+	shmp->header = (DIM_SHM_HEADER *)base;
+	shmp->slots = (DIM_SHM_SLOT *)(base + sizeof(DIM_SHM_HEADER));
+	shmp->data = base + sizeof(DIM_SHM_HEADER) + 
+		shmp->header->max_slots * sizeof(DIM_SHM_SLOT);
+}
+
+/* receive the notification pipe of a new client, SCM_RIGHTS message */
+static int dis_shm_recv_fd(sock)
+int sock;
+{
+	struct msghdr msg;
+	struct iovec iov;
+	char dummy;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &dummy;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if(recvmsg(sock, &msg, 0) <= 0)
+		return(-1);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if( cmsg && (cmsg->cmsg_level == SOL_SOCKET) && 
+		(cmsg->cmsg_type == SCM_RIGHTS) )
+	{
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return(fd);
+}
+
+static void dis_shm_drop_client(i)
+int i;
+{
+	close(Dis_shm_client_sock[i]);
+	close(Dis_shm_client_event[i]);
+	Dis_shm_n_clients--;
+	Dis_shm_client_sock[i] = Dis_shm_client_sock[Dis_shm_n_clients];
+	Dis_shm_client_event[i] = Dis_shm_client_event[Dis_shm_n_clients];
+}
+
+/* accept clients and watch their connections */
+static void *dis_shm_task(arg)
+void *arg;
+{
+	struct pollfd fds[DIM_SHM_MAX_CLIENTS + 1];
+	int i, n, sock, fd;
+
+	while(Dis_shm_running)
+	{
+		pthread_mutex_lock(&Dis_shm_mutex);
+		fds[0].fd = Dis_shm_listen_fd;
+		fds[0].events = POLLIN;
+		n = Dis_shm_n_clients;
+		for( i = 0; i < n; i++ )
+		{
+			fds[i+1].fd = Dis_shm_client_sock[i];
+			fds[i+1].events = POLLIN;
+		}
+		pthread_mutex_unlock(&Dis_shm_mutex);
+		if(poll(fds, n + 1, 1000) <= 0)
+			continue;
+		pthread_mutex_lock(&Dis_shm_mutex);
+		for( i = n; i > 0; i-- )
+		{
+			if(fds[i].revents)
+				dis_shm_drop_client(i - 1);
+		}
+		if(fds[0].revents & POLLIN)
+		{
+			sock = accept(Dis_shm_listen_fd, 0, 0);
+			if(sock >= 0)
+			{
+				fd = dis_shm_recv_fd(sock);
+				if( (fd >= 0) && (Dis_shm_n_clients < DIM_SHM_MAX_CLIENTS) )
+				{
+					Dis_shm_client_sock[Dis_shm_n_clients] = sock;
+					Dis_shm_client_event[Dis_shm_n_clients] = fd;
+					Dis_shm_n_clients++;
+				}
+				else
+				{
+					if(fd >= 0)
+						close(fd);
+					close(sock);
+				}
+			}
+		}
+		pthread_mutex_unlock(&Dis_shm_mutex);
+	}
+	return(0);
+}
+
+/* create and map a region under a temporary name, see dis_shm_commit */
+static int dis_shm_create(shmp, max_slots, data_size)
+DIM_SHM *shmp;
+int max_slots, data_size;
+{
+	int fd, map_size;
+	char *base;
+
+	map_size = dim_shm_map_size(max_slots, data_size);
+	unlink(Dis_shm_tmp_name);
+	fd = open(Dis_shm_tmp_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0)
+		return(0);
+	if(ftruncate(fd, map_size) < 0)
+	{
+		close(fd);
+		unlink(Dis_shm_tmp_name);
+		return(0);
+	}
+	base = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		unlink(Dis_shm_tmp_name);
+		return(0);
+	}
+	memset(base, 0, sizeof(DIM_SHM_HEADER));
+	shmp->header = (DIM_SHM_HEADER *)base;
+	shmp->header->pid = getpid();
+	shmp->header->max_slots = max_slots;
+	shmp->header->n_slots = 0;
+	shmp->header->data_size = data_size;
+	shmp->header->data_used = 0;
+	shmp->header->version = DIM_SHM_VERSION;
+	dim_shm_set_pointers(shmp, base);
+	shmp->map_size = map_size;
+	return(1);
+}
+
+/* publish a region made by dis_shm_create under the name of the server */
+static int dis_shm_commit(shmp)
+DIM_SHM *shmp;
+{
+	__sync_synchronize();
+	shmp->header->magic = DIM_SHM_MAGIC;
+	if(rename(Dis_shm_tmp_name, Dis_shm_name) < 0)
+	{
+		munmap(shmp->header, shmp->map_size);
+		unlink(Dis_shm_tmp_name);
+		return(0);
+	}
+	return(1);
+}
+
+/*
+ * Copy the region into a larger one with room for min_slots slots and
+ * min_data bytes of values. Slot indices and offsets stay the same, the
+ * clients switch over when they see the moved flag of the old header.
+ */
+static int dis_shm_grow(min_slots, min_data)
+int min_slots, min_data;
+{
+	DIM_SHM_HEADER *headp = Dis_shm.header;
+	DIM_SHM new_shm;
+	int max_slots, data_size;
+
+	max_slots = headp->max_slots;
+	while(max_slots < min_slots)
+		max_slots *= 2;
+	data_size = headp->data_size;
+	while(data_size < min_data)
+		data_size *= 2;
+	if(!dis_shm_create(&new_shm, max_slots, data_size))
+		return(0);
+	memcpy(new_shm.slots, Dis_shm.slots, 
+		headp->n_slots * sizeof(DIM_SHM_SLOT));
+	memcpy(new_shm.data, Dis_shm.data, headp->data_used);
+	new_shm.header->n_slots = headp->n_slots;
+	new_shm.header->data_used = headp->data_used;
+	new_shm.header->n_updates = headp->n_updates;
+	if(!dis_shm_commit(&new_shm))
+		return(0);
+	__sync_synchronize();
+	headp->moved = 1;
+	munmap(headp, Dis_shm.map_size);
+	Dis_shm.header = new_shm.header;
+	Dis_shm.slots = new_shm.slots;
+	Dis_shm.data = new_shm.data;
+	Dis_shm.map_size = new_shm.map_size;
+	return(1);
+}
+
+/*
+ * max_services and data_size only size the region initially, it grows
+ * when services are added later or values get larger.
+ */
+int dis_shm_open(task_name, max_services, data_size)
+char *task_name;
+int max_services, data_size;
+{
+	struct sockaddr_un addr;
+
+	if(Dis_shm.header)
+		return(1);
+	if( (max_services <= 0) || (data_size <= 0) )
+		return(0);
+	dim_shm_names(task_name, Dis_shm_name, Dis_shm_sock_path);
+	sprintf(Dis_shm_tmp_name, "%s.new", Dis_shm_name);
+	unlink(Dis_shm_name);
+	if(!dis_shm_create(&Dis_shm, max_services, data_size))
+		return(0);
+	if(!dis_shm_commit(&Dis_shm))
+	{
+		Dis_shm.header = 0;
+		return(0);
+	}
+
+	/* clients register their notification pipe through the unix socket */
+	unlink(Dis_shm_sock_path);
+	Dis_shm_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(Dis_shm_listen_fd >= 0)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, Dis_shm_sock_path);
+		if( (bind(Dis_shm_listen_fd, (struct sockaddr *)&addr, 
+			sizeof(addr)) < 0) || (listen(Dis_shm_listen_fd, 4) < 0) )
+		{
+			close(Dis_shm_listen_fd);
+			Dis_shm_listen_fd = -1;
+		}
+	}
+	if(Dis_shm_listen_fd >= 0)
+	{
+		Dis_shm_running = 1;
+		if(pthread_create(&Dis_shm_thread, 0, dis_shm_task, 0))
+		{
+			Dis_shm_running = 0;
+			close(Dis_shm_listen_fd);
+			Dis_shm_listen_fd = -1;
+		}
+	}
+	return(1);
+}
+
+void dis_shm_close()
+{
+	int i;
+
+	if(!Dis_shm.header)
+		return;
+	if(Dis_shm_running)
+	{
+		Dis_shm_running = 0;
+		pthread_join(Dis_shm_thread, 0);
+	}
+	if(Dis_shm_listen_fd >= 0)
+	{
+		close(Dis_shm_listen_fd);
+		Dis_shm_listen_fd = -1;
+		unlink(Dis_shm_sock_path);
+	}
+	for( i = Dis_shm_n_clients - 1; i >= 0; i-- )
+		dis_shm_drop_client(i);
+	Dis_shm.header->magic = 0;
+	munmap(Dis_shm.header, Dis_shm.map_size);
+	unlink(Dis_shm_name);
+	Dis_shm.header = 0;
+	Dis_shm.slots = 0;
+	Dis_shm.data = 0;
+}
+
+int dis_shm_is_open()
+{
+	return(Dis_shm.header != 0);
+}
+
+/*
+ * Copy the value of a service into its slot, the slot is allocated
+ * on the first update and its index is kept by the caller in *slotp.
+ * A value larger than its slot moves the slot to an area of at least
+ * twice the size, the region grows if there is no room left.
+ */
+int dis_shm_publish(slotp, name, def, service_id, buffer, size, quality,
+		    secs, millisecs)
+int *slotp;
+char *name, *def;
+int service_id;
+void *buffer;
+int size, quality, secs, millisecs;
+{
+	DIM_SHM_HEADER *headp = Dis_shm.header;
+	DIM_SHM_SLOT *slotptr;
+	int capacity, offset = -1, i;
+	char one = 1;
+
+	if(!headp)
+		return(0);
+	capacity = dim_shm_align(size);
+	if(*slotp < 0)
+	{
+		if( ((headp->n_slots == headp->max_slots) ||
+			(headp->data_used + capacity > headp->data_size)) &&
+			!dis_shm_grow(headp->n_slots + 1, headp->data_used + capacity) )
+			return(0);
+		headp = Dis_shm.header;
+		slotptr = &Dis_shm.slots[headp->n_slots];
+		strncpy(slotptr->name, name, DIM_SHM_NAME_LEN - 1);
+		slotptr->name[DIM_SHM_NAME_LEN - 1] = '\0';
+		strncpy(slotptr->def, def, DIM_SHM_NAME_LEN - 1);
+		slotptr->def[DIM_SHM_NAME_LEN - 1] = '\0';
+		slotptr->hash = HashString(slotptr->name);
+		slotptr->service_id = service_id;
+		slotptr->offset = headp->data_used;
+		slotptr->capacity = capacity;
+		slotptr->seq = 0;
+		slotptr->size = 0;
+		slotptr->flags = 0;
+		headp->data_used += capacity;
+		*slotp = headp->n_slots;
+		__sync_synchronize();
+		headp->n_slots++;
+	}
+	else if(size > Dis_shm.slots[*slotp].capacity)
+	{
+		if(capacity < 2 * Dis_shm.slots[*slotp].capacity)
+			capacity = 2 * Dis_shm.slots[*slotp].capacity;
+		if( (headp->data_used + capacity <= headp->data_size) ||
+			dis_shm_grow(0, headp->data_used + capacity) )
+		{
+			headp = Dis_shm.header;
+			offset = headp->data_used;
+			headp->data_used += capacity;
+		}
+	}
+	slotptr = &Dis_shm.slots[*slotp];
+	slotptr->seq++;
+	__sync_synchronize();
+	if(offset >= 0)
+	{
+		slotptr->offset = offset;
+		slotptr->capacity = capacity;
+	}
+	if(size > slotptr->capacity)
+	{
+		slotptr->flags |= DIM_SHM_OVERSIZE;
+		slotptr->size = 0;
+	}
+	else
+	{
+		memcpy(Dis_shm.data + slotptr->offset, buffer, size);
+		slotptr->size = size;
+		slotptr->flags &= ~DIM_SHM_OVERSIZE;
+	}
+	slotptr->quality = quality;
+	slotptr->time_stamp[0] = millisecs;
+	slotptr->time_stamp[1] = secs;
+	__sync_synchronize();
+	slotptr->seq++;
+	headp->n_updates++;
+	if(Dis_shm_n_clients)
+	{
+		pthread_mutex_lock(&Dis_shm_mutex);
+		for( i = 0; i < Dis_shm_n_clients; i++ )
+		{
+			if(write(Dis_shm_client_event[i], &one, sizeof(one)) < 0)
+				continue;
+		}
+		pthread_mutex_unlock(&Dis_shm_mutex);
+	}
+	return(1);
+}
+
+/* the service is gone, readers fall back to DIM */
+void dis_shm_invalidate(slot)
+int slot;
+{
+	DIM_SHM_SLOT *slotptr;
+
+	if( (!Dis_shm.header) || (slot < 0) )
+		return;
+	slotptr = &Dis_shm.slots[slot];
+	slotptr->seq++;
+	__sync_synchronize();
+	slotptr->flags |= DIM_SHM_REMOVED;
+	slotptr->size = 0;
+	__sync_synchronize();
+	slotptr->seq++;
+	Dis_shm.header->n_updates++;
+}
+
+/* client side */
+
+/* map the region named in shmp read-only, 0 if there is none */
+static int dic_shm_map(shmp)
+DIM_SHM *shmp;
+{
+	DIM_SHM_HEADER header;
+	char *base;
+	int fd, map_size;
+
+	fd = open(shmp->name, O_RDONLY);
+	if(fd < 0)
+		return(0);
+	if( (read(fd, &header, sizeof(header)) != sizeof(header)) ||
+		(header.magic != DIM_SHM_MAGIC) || 
+		(header.version != DIM_SHM_VERSION) )
+	{
+		close(fd);
+		return(0);
+	}
+	map_size = dim_shm_map_size(header.max_slots, header.data_size);
+	base = mmap(0, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return(0);
+	dim_shm_set_pointers(shmp, base);
+	shmp->map_size = map_size;
+	return(1);
+}
+
+/* follow the server to a larger region, the old one is kept on failure */
+static void dic_shm_remap(shmp)
+DIM_SHM *shmp;
+{
+	DIM_SHM new_shm;
+
+	if(!shmp->header->moved)
+		return;
+	strcpy(new_shm.name, shmp->name);
+	if(!dic_shm_map(&new_shm))
+		return;
+	munmap(shmp->header, shmp->map_size);
+	shmp->header = new_shm.header;
+	shmp->slots = new_shm.slots;
+	shmp->data = new_shm.data;
+	shmp->map_size = new_shm.map_size;
+}
+
+DIM_SHM *dic_shm_attach(task_name)
+char *task_name;
+{
+	DIM_SHM *shmp;
+	char sock_path[DIM_SHM_SOCK_LEN];
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	char dummy = 0;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	int pipe_fds[2] = {-1, -1};
+
+	shmp = (DIM_SHM *)malloc(sizeof(DIM_SHM));
+	dim_shm_names(task_name, shmp->name, sock_path);
+	if(!dic_shm_map(shmp))
+	{
+		free(shmp);
+		return((DIM_SHM *)0);
+	}
+	shmp->event_fd = -1;
+	shmp->sock_fd = -1;
+
+	/* hand a pipe to the server, without it dic_shm_wait polls */
+	shmp->sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(shmp->sock_fd >= 0)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, sock_path);
+		if(!pipe(pipe_fds))
+		{
+			shmp->event_fd = pipe_fds[0];
+			fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+			fcntl(pipe_fds[1], F_SETFL, O_NONBLOCK);
+		}
+		if( (shmp->event_fd >= 0) &&
+			(connect(shmp->sock_fd, (struct sockaddr *)&addr, 
+			sizeof(addr)) == 0) )
+		{
+			memset(&msg, 0, sizeof(msg));
+			iov.iov_base = &dummy;
+			iov.iov_len = 1;
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = cbuf;
+			msg.msg_controllen = sizeof(cbuf);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+			memcpy(CMSG_DATA(cmsg), &pipe_fds[1], sizeof(int));
+			if(sendmsg(shmp->sock_fd, &msg, 0) == 1)
+			{
+				close(pipe_fds[1]);
+				return(shmp);
+			}
+		}
+		if(pipe_fds[0] >= 0)
+		{
+			close(pipe_fds[0]);
+			close(pipe_fds[1]);
+		}
+		close(shmp->sock_fd);
+		shmp->event_fd = -1;
+		shmp->sock_fd = -1;
+	}
+	return(shmp);
+}
+
+void dic_shm_detach(shmp)
+DIM_SHM *shmp;
+{
+	if(!shmp)
+		return;
+	if(shmp->sock_fd >= 0)
+		close(shmp->sock_fd);
+	if(shmp->event_fd >= 0)
+		close(shmp->event_fd);
+	munmap(shmp->header, shmp->map_size);
+	free(shmp);
+}
+
+/* wait for the next update, returns 1 if there was one */
+int dic_shm_wait(shmp, timeout_ms)
+DIM_SHM *shmp;
+int timeout_ms;
+{
+	struct pollfd pfd;
+	char count[64];
+	unsigned int n_updates;
+
+	if(shmp->event_fd < 0)
+	{
+		n_updates = shmp->header->n_updates;
+		for( ; timeout_ms > 0; timeout_ms -= 10 )
+		{
+			dim_usleep(10000);
+			if(shmp->header->n_updates != n_updates)
+				return(1);
+		}
+		return(0);
+	}
+	pfd.fd = shmp->event_fd;
+	pfd.events = POLLIN;
+	if(poll(&pfd, 1, timeout_ms) <= 0)
+		return(0);
+	while(read(shmp->event_fd, count, sizeof(count)) == sizeof(count))
+		;
+	return(1);
+}
+
+#else
+
+int dis_shm_open(task_name, max_services, data_size)
+char *task_name;
+int max_services, data_size;
+{
+	return(0);
+}
+
+void dis_shm_close()
+{
+}
+
+int dis_shm_is_open()
+{
+	return(0);
+}
+
+int dis_shm_publish(slotp, name, def, service_id, buffer, size, quality,
+		    secs, millisecs)
+int *slotp;
+char *name, *def;
+int service_id;
+void *buffer;
+int size, quality, secs, millisecs;
+{
+	return(0);
+}
+
+DIM_SHM *dic_shm_attach(task_name)
+char *task_name;
+{
+	return((DIM_SHM *)0);
+}
+
+void dic_shm_detach(shmp)
+DIM_SHM *shmp;
+{
+}
+
+void dis_shm_invalidate(slot)
+int slot;
+{
+}
+
+static void dic_shm_remap(shmp)
+DIM_SHM *shmp;
+{
+}
+
+int dic_shm_wait(shmp, timeout_ms)
+DIM_SHM *shmp;
+int timeout_ms;
+{
+	return(0);
+}
+
+#endif
+
+/* reading the region itself needs no system support */
+
+int dic_shm_find_service(shmp, service_name)
+DIM_SHM *shmp;
+char *service_name;
+{
+	unsigned int hash;
+	int i, n_slots;
+
+	dic_shm_remap(shmp);
+	hash = HashString(service_name);
+	n_slots = shmp->header->n_slots;
+	__sync_synchronize();
+	for( i = 0; i < n_slots; i++ )
+	{
+		if( (shmp->slots[i].hash == hash) && 
+			!strcmp(shmp->slots[i].name, service_name) )
+			return(i);
+	}
+	return(-1);
+}
+
+/*
+ * Zero-copy read: 
+ *	do {
+ *		seq = dic_shm_read_begin(shmp, slot);
+ *		if(seq & 1)
+ *			... the writer holds the slot, read through DIM ...
+ *		ptr = dic_shm_get_address(shmp, slot, &size);
+ *		... use ptr ...
+ *	} while(dic_shm_read_retry(shmp, slot, seq));
+ * An odd sequence number is returned after DIM_SHM_READ_SPINS polls,
+ * so a server that stopped in the middle of an update can not hang
+ * its readers.
+ */
+unsigned int dic_shm_read_begin(shmp, slot)
+DIM_SHM *shmp;
+int slot;
+{
+	unsigned int seq = 1;
+	int i;
+
+	dic_shm_remap(shmp);
+	for( i = 0; i < DIM_SHM_READ_SPINS; i++ )
+	{
+		if( !((seq = shmp->slots[slot].seq) & 1) )
+			break;
+	}
+	__sync_synchronize();
+	return(seq);
+}
+
+int dic_shm_read_retry(shmp, slot, seq)
+DIM_SHM *shmp;
+int slot;
+unsigned int seq;
+{
+	__sync_synchronize();
+	return(shmp->slots[slot].seq != seq);
+}
+
+void *dic_shm_get_address(shmp, slot, size)
+DIM_SHM *shmp;
+int slot;
+int *size;
+{
+	DIM_SHM_SLOT *slotptr = &shmp->slots[slot];
+
+	if(slotptr->flags)
+	{
+		*size = -1;
+		return((void *)0);
+	}
+	*size = slotptr->size;
+	return(shmp->data + slotptr->offset);
+}
+
+/* copy the value, returns the size, -1 if the slot can not be used */
+int dic_shm_read(shmp, slot, buffer, size)
+DIM_SHM *shmp;
+int slot;
+void *buffer;
+int size;
+{
+	unsigned int seq;
+	void *ptr;
+	int curr_size, tries;
+
+	if( (slot < 0) || (slot >= shmp->header->n_slots) )
+		return(-1);
+	for( tries = 0; tries < DIM_SHM_READ_TRIES; tries++ )
+	{
+		seq = dic_shm_read_begin(shmp, slot);
+		if(seq & 1)
+			return(-1);
+		ptr = dic_shm_get_address(shmp, slot, &curr_size);
+		if(curr_size > size)
+			curr_size = size;
+		if(ptr && (curr_size > 0))
+			memcpy(buffer, ptr, curr_size);
+		if(!dic_shm_read_retry(shmp, slot, seq))
+			return(curr_size);
+	}
+	return(-1);
+}
+
+int dic_shm_get_fd(shmp)
+DIM_SHM *shmp;
+{
+	return(shmp->event_fd);
+}
+
+static volatile int Dic_shm_fetch_done;
+static int Dic_shm_fetch_size;
+static void *Dic_shm_fetch_buffer;
+/* DIM hands a copy of the fill data to the callback, the marker is
+   recognized by its content */
+static char Dic_shm_no_link[] = "DIM_SHM_NO_LINK";
+
+static void dic_shm_fetch_rout(tag, buffer, size)
+long *tag;
+int *buffer;
+int *size;
+{
+	if( (*size == sizeof(Dic_shm_no_link)) &&
+		!memcmp(buffer, Dic_shm_no_link, sizeof(Dic_shm_no_link)) )
+		Dic_shm_fetch_size = -1;
+	else
+	{
+		if(*size < Dic_shm_fetch_size)
+			Dic_shm_fetch_size = *size;
+		memcpy(Dic_shm_fetch_buffer, buffer, Dic_shm_fetch_size);
+	}
+	Dic_shm_fetch_done = 1;
+}
+
+/*
+ * One DIM request for the current value, waits for the answer or the
+ * timeout (in seconds). Not reentrant and not for DIM callbacks.
+ */
+static int dic_shm_fetch(service_name, buffer, size, timeout)
+char *service_name;
+void *buffer;
+int size, timeout;
+{
+	Dic_shm_fetch_done = 0;
+	Dic_shm_fetch_size = size;
+	Dic_shm_fetch_buffer = buffer;
+	if(timeout <= 0)
+		timeout = 10;
+	if(!dic_info_service(service_name, ONCE_ONLY, timeout, 0, 0,
+		dic_shm_fetch_rout, 0, Dic_shm_no_link, sizeof(Dic_shm_no_link)))
+		return(-1);
+	while(!Dic_shm_fetch_done)
+		dim_usleep(1000);
+	return(Dic_shm_fetch_size);
+}
+
+/*
+ * Read a value from the region if possible, otherwise (no region, unknown
+ * slot, oversized value or a stalled writer) with a DIM request over TCP.
+ * Returns the size of the value or -1.
+ */
+int dic_shm_get_value(shmp, service_name, buffer, size, timeout)
+DIM_SHM *shmp;
+char *service_name;
+void *buffer;
+int size, timeout;
+{
+	int slot, ret;
+
+	if(shmp)
+	{
+		slot = dic_shm_find_service(shmp, service_name);
+		if(slot >= 0)
+		{
+			ret = dic_shm_read(shmp, slot, buffer, size);
+			if(ret >= 0)
+				return(ret);
+		}
+	}
+	return(dic_shm_fetch(service_name, buffer, size, timeout));
+}
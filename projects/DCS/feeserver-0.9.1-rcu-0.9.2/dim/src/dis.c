@@ -26,6 +26,7 @@
 #define DIMLIB
 #include <dim.h>
 #include <dis.h>
+#include <dim_shm.h>
 
 #define ALL 0
 #define MORE 1
@@ -46,12 +47,15 @@ typedef struct req_ent {
 	int to_delete;
 	TIMR_ENT *timr_ent;
 	struct reqp_ent *reqpp;
+	struct req_ent *del_next;
+	struct req_ent *del_prev;
 } REQUEST;
 
 typedef struct serv {
 	struct serv *next;
 	struct serv *prev;
 	char name[MAX_NAME];
+	unsigned int hash;
 	int id;
 	int type;
 	char def[MAX_NAME];
@@ -66,6 +70,13 @@ typedef struct serv {
 	int user_millisecs;
 	int tid;
 	REQUEST *request_head;
+	struct serv *reg_next;
+	struct serv *reg_prev;
+	int reg_pending;
+	int shm_slot;
+	REQUEST *delete_head;
+	unsigned int *client_mask;
+	int client_mask_words;
 } SERVICE;
 
 typedef struct reqp_ent {
@@ -98,8 +109,9 @@ static void (*Client_exit_user_routine)() = 0;
 static void (*Exit_user_routine)() = 0;
 static void (*Error_user_routine)() = 0;
 static int Error_conn_id = 0;
-static SERVICE *Unregistered_services[MAX_REGISTRATION_UNIT];
-static int N_unregistered_services;
+static SERVICE *Service_list = 0;
+static SERVICE *Reg_pending_head = 0;
+static SERVICE *Reg_pending_tail = 0;
 
 typedef struct exit_ent {
 	struct exit_ent *next;
@@ -115,9 +127,28 @@ static int Dis_timer_q = 0;
 static int Threads_off = 0;
 
 static unsigned int Dis_service_id, Dis_client_id;
-static int Updating_service_list = 0;
 static int Last_client;
 
+/*
+ * Registration with the DNS
+ *
+ * A full registration (DNS (re)connect or DNS request) is sent in steps
+ * of DNS_SYNC_STEP_UNITS packets, the position is kept in
+ * Dns_sync_cursor and the next step is queued to the timer thread,
+ * so service updates are not blocked while thousands of services are
+ * registered. Services added later are collected in the pending list
+ * for DNS_REG_WINDOW seconds and sent as one delta.
+ */
+#define DNS_SYNC_STEP_UNITS	4
+#define DNS_REG_WINDOW		1
+
+static SERVICE *Dns_sync_cursor = 0;
+static int Dns_sync_running = 0;
+static int Dns_sync_id = 0;
+static int Dns_sync_n_services = 0;
+static int Dns_delta_scheduled = 0;
+static int Dns_reg_n_services = 0;
+
 _DIM_PROTO( static void dis_insert_request, (int conn_id, DIC_PACKET *dic_packet,
 				  int size, int status ) );
 _DIM_PROTO( int execute_service,	(int req_id) );
@@ -134,6 +165,10 @@ _DIM_PROTO( SERVICE *find_service,   (char *name) );
 _DIM_PROTO( CLIENT *find_client,   (int conn_id) );
 _DIM_PROTO( static int get_format_data, (FORMAT_STR *format_data, char *def) );
 _DIM_PROTO( static int release_conn, (int conn_id, int print_flag) );
+_DIM_PROTO( static void request_delete_pending, (REQUEST *reqp) );
+_DIM_PROTO( static void request_delete_remove, (REQUEST *reqp) );
+_DIM_PROTO( static void release_pending_requests, (SERVICE *servp) );
+_DIM_PROTO( static void do_update_service_list, (int service_id) );
 _DIM_PROTO( SERVICE *dis_hash_service_exists, (char *name) );
 _DIM_PROTO( SERVICE *dis_hash_service_get_next, (int start) );
 
@@ -145,6 +180,11 @@ void dis_no_threads()
 static DIS_STAMPED_PACKET *Dis_packet = 0;
 static int Dis_packet_size = 0;
 
+/* value of the first request served by an update, for dis_shm_update */
+static int Dis_shm_capture = 0;
+static int *Dis_shm_buffp;
+static int Dis_shm_size;
+
 int dis_set_buffer_size(size)
 int size;
 {
@@ -225,6 +265,10 @@ long tag;
 	new_serv->quality = 0;
 	new_serv->user_secs = 0;
 	new_serv->tid = 0;
+	new_serv->shm_slot = -1;
+	new_serv->delete_head = 0;
+	new_serv->client_mask = 0;
+	new_serv->client_mask_words = 0;
 	service_id = id_get((void *)new_serv, SRC_DIS);
 	new_serv->id = service_id;
 	new_serv->request_head = (REQUEST *)malloc(sizeof(REQUEST));
@@ -344,6 +388,10 @@ long tag;
 	new_serv->registered = 0;
 	new_serv->quality = 0;
 	new_serv->user_secs = 0;
+	new_serv->shm_slot = -1;
+	new_serv->delete_head = 0;
+	new_serv->client_mask = 0;
+	new_serv->client_mask_words = 0;
 	service_id = id_get((void *)new_serv, SRC_DIS);
 	new_serv->id = service_id;
 	new_serv->request_head = (REQUEST *)malloc(sizeof(REQUEST));
@@ -497,6 +545,7 @@ DNS_DIS_PACKET *packet;
 	switch(status)
 	{
 	case STA_DISC:	   /* connection broken */
+		Dns_sync_running = 0;
 		if( Dns_timr_ent ) {
 			dtq_rem_entry( Dis_timer_q, Dns_timr_ent );
 			Dns_timr_ent = NULL;
@@ -703,123 +752,192 @@ int send_dns_update_packet()
 }
 
 
-void register_services(flag)
-register int flag;
+static void dns_reg_packet_init()
 {
 	register DIS_DNS_PACKET *dis_dns_p = &Dis_dns_packet;
-	register int n_services, tot_n_services;
-	register SERVICE *servp;
-	register SERVICE_REG *serv_regp;
-	SERVICE *dis_hash_service_get_next_register();
 	extern int get_node_addr();
-	int dis_hash_service_registered();
 
 	if(!dis_dns_p->src_type)
 	{
 		get_node_name( dis_dns_p->node_name );
-/*
-		strcpy( dis_dns_p->task_name, Task_name );
-*/
 		strncpy( dis_dns_p->task_name, Task_name,
 			MAX_TASK_NAME-4 );
 		dis_dns_p->task_name[MAX_TASK_NAME-4-1] = '\0';
 		get_node_addr( dis_dns_p->node_addr );
-/*
-		dis_dns_p->port = htovl(Port_number);
-*/
 		dis_dns_p->pid = htovl(getpid());
 		dis_dns_p->protocol = htovl(Protocol);
 		dis_dns_p->src_type = htovl(SRC_DIS);
 		dis_dns_p->format = htovl(MY_FORMAT);
 	}
-
 	dis_dns_p->port = htovl(Port_number);
-	serv_regp = dis_dns_p->services;
-	n_services = 0;
-	tot_n_services = 0;
-	if( flag == NONE ) {
-		dis_dns_p->n_services = htovl(n_services);
-		dis_dns_p->size = htovl( DIS_DNS_HEADER + 
-			(n_services*sizeof(SERVICE_REG)));
-		if(Dns_dis_conn_id > 0)
+	Dns_reg_n_services = 0;
+}
+
+/* send the services collected in Dis_dns_packet */
+static int dns_reg_packet_flush()
+{
+	register DIS_DNS_PACKET *dis_dns_p = &Dis_dns_packet;
+	int n_services;
+
+	n_services = Dns_reg_n_services;
+	Dns_reg_n_services = 0;
+	if(!n_services)
+		return(0);
+	dis_dns_p->n_services = htovl(n_services);
+	dis_dns_p->size = htovl(DIS_DNS_HEADER +
+				n_services * sizeof(SERVICE_REG));
+	if(Dns_dis_conn_id > 0)
+	{
+		if( !dna_write(Dns_dis_conn_id, &Dis_dns_packet,
+			DIS_DNS_HEADER + n_services * sizeof(SERVICE_REG)))
 		{
-			if(!dna_write(Dns_dis_conn_id, &Dis_dns_packet, 
-				DIS_DNS_HEADER + n_services*sizeof(SERVICE_REG)))
-			{
-				release_conn(Dns_dis_conn_id,0);
-			}
+			release_conn(Dns_dis_conn_id,0);
 		}
-		return;
 	}
-	if(flag == ALL)
+	return(n_services);
+}
+
+/* add a service to Dis_dns_packet, returns 1 if a full packet was sent */
+static int dns_reg_packet_add(servp)
+register SERVICE *servp;
+{
+	register SERVICE_REG *serv_regp;
+	int dis_hash_service_registered();
+
+	serv_regp = &Dis_dns_packet.services[Dns_reg_n_services];
+	strcpy( serv_regp->service_name, servp->name );
+	strcpy( serv_regp->service_def, servp->def );
+	if(servp->type == COMMAND)
+		serv_regp->service_id = htovl( servp->id | 0x10000000);
+	else
+		serv_regp->service_id = htovl( servp->id );
+	Dns_reg_n_services++;
+	dis_hash_service_registered(servp);
+	if( Dns_reg_n_services == MAX_SERVICE_UNIT )
 	{
-		servp = 0;
-		while( (servp = dis_hash_service_get_next(servp)))
-		{
-			servp->registered  = 0;
-		}
+		dns_reg_packet_flush();
+		return(1);
 	}
-	servp = 0;
-	while( (servp = dis_hash_service_get_next_register(servp)))
+	return(0);
+}
+
+/* one step of the full registration, called from the timer thread */
+void dis_dns_sync_step(tag)
+long tag;
+{
+	register SERVICE *servp;
+	int n_units = 0;
+
+	DISABLE_AST
+	if( !Dns_sync_running || (tag != Dns_sync_id) || 
+		(Dns_dis_conn_id <= 0) )
 	{
-		if( flag == MORE ) 
+		ENABLE_AST
+		return;
+	}
+	dns_reg_packet_init();
+	servp = Dns_sync_cursor ? Dns_sync_cursor : Service_list;
+	while( (servp = (SERVICE *) dll_get_next((DLL *) Service_list, 
+		(DLL *) servp)) )
+	{
+		if( servp->registered )
+			continue;
+		Dns_sync_n_services++;
+		if( dns_reg_packet_add(servp) )
 		{
-			if( servp->registered )
+			if( !Dns_sync_running )
 			{
-				continue;
+				ENABLE_AST
+				return;
 			}
+			if( ++n_units == DNS_SYNC_STEP_UNITS )
+				break;
 		}
+	}
+	if(servp)
+	{
+		Dns_sync_cursor = servp;
+		dtq_start_timer(0, dis_dns_sync_step, tag);
+		ENABLE_AST
+		return;
+	}
+	dns_reg_packet_flush();
+	Dns_sync_running = 0;
+	Dns_sync_cursor = 0;
+	if(Dns_sync_n_services >= MAX_REGISTRATION_UNIT)
+	{
+	  send_dns_update_packet();
+	}
+	ENABLE_AST
+}
 
-		strcpy( serv_regp->service_name, servp->name );
-		strcpy( serv_regp->service_def, servp->def );
-		if(servp->type == COMMAND)
-			serv_regp->service_id = htovl( servp->id | 0x10000000);
-		else
-			serv_regp->service_id = htovl( servp->id );
+/* send the services added since the last registration as one delta */
+void dis_dns_register_delta(tag)
+long tag;
+{
+	register SERVICE *servp;
+	int n_services = 0;
 
-		serv_regp++;
-		n_services++;
-		dis_hash_service_registered(servp);
-		if( n_services == MAX_SERVICE_UNIT )
+	DISABLE_AST
+	Dns_delta_scheduled = 0;
+	if( (Dns_dis_conn_id > 0) && Reg_pending_head )
+	{
+		dns_reg_packet_init();
+		while( (servp = Reg_pending_head) )
 		{
-			dis_dns_p->n_services = htovl(n_services);
-			dis_dns_p->size = htovl(DIS_DNS_HEADER +
-				n_services * sizeof(SERVICE_REG));
-			if(Dns_dis_conn_id > 0)
-			{
-				if( !dna_write(Dns_dis_conn_id,
-					   &Dis_dns_packet, 
-					   DIS_DNS_HEADER + n_services *
-						sizeof(SERVICE_REG)) )
-				{
-					release_conn(Dns_dis_conn_id,0);
-				}
-			}
-			serv_regp = dis_dns_p->services;
-			tot_n_services += MAX_SERVICE_UNIT;
-			n_services = 0;
-			continue;
+			n_services++;
+			dns_reg_packet_add(servp);
+			if(Dns_dis_conn_id <= 0)
+				break;
+		}
+		dns_reg_packet_flush();
+		if(n_services >= MAX_REGISTRATION_UNIT)
+		{
+		  send_dns_update_packet();
 		}
 	}
-	if( n_services ) 
-	{
-		dis_dns_p->n_services = htovl(n_services);
-		dis_dns_p->size = htovl(DIS_DNS_HEADER +
-					n_services * sizeof(SERVICE_REG));
+	ENABLE_AST
+	if(n_services && Dis_service_id)
+		do_update_service_list(Dis_service_id);
+}
+
+void register_services(flag)
+register int flag;
+{
+	register SERVICE *servp;
+
+	dns_reg_packet_init();
+	if( flag == NONE ) {
+		Dis_dns_packet.n_services = htovl(0);
+		Dis_dns_packet.size = htovl(DIS_DNS_HEADER);
 		if(Dns_dis_conn_id > 0)
 		{
-			if( !dna_write(Dns_dis_conn_id, &Dis_dns_packet,
-				DIS_DNS_HEADER + n_services * sizeof(SERVICE_REG)))
+			if(!dna_write(Dns_dis_conn_id, &Dis_dns_packet, 
+				DIS_DNS_HEADER))
 			{
 				release_conn(Dns_dis_conn_id,0);
 			}
-
 		}
-		tot_n_services += n_services;
+		return;
 	}
-	if(tot_n_services >= MAX_REGISTRATION_UNIT)
+	if(flag == ALL)
 	{
-	  send_dns_update_packet();
+		servp = 0;
+		while( (servp = dis_hash_service_get_next(servp)))
+		{
+			servp->registered  = 0;
+		}
+		Dns_sync_cursor = 0;
+		Dns_sync_n_services = 0;
+		Dns_sync_running = 1;
+		Dns_sync_id++;
+		dis_dns_sync_step(Dns_sync_id);
+		return;
+	}
+	if(!Dns_delta_scheduled)
+	{
+		Dns_delta_scheduled = 1;
+		dtq_start_timer(DNS_REG_WINDOW, dis_dns_register_delta, 0);
 	}
 }
 
@@ -869,10 +987,9 @@ register SERVICE *servp;
 	}
 }
 
-void do_update_service_list(service_id)
+static void do_update_service_list(service_id)
 int service_id;
 {
-	Updating_service_list = 0;
 	dis_update_service(service_id);
 }
 
@@ -962,17 +1079,6 @@ char *task;
 	else
 	{
 		register_services(MORE);
-		if(Dis_service_id)
-		{
-/*
-			dis_update_service(Dis_service_id);
-*/
-			if(!Updating_service_list)
-			{
-				dtq_start_timer(1, do_update_service_list, Dis_service_id);
-				Updating_service_list = 1;
-			}
-		}
 	}	
 	ENABLE_AST
 	}
@@ -1049,6 +1155,7 @@ register int size, status;
 		if(type == ONCE_ONLY) 
 		{
 			execute_service(newp->req_id);
+			request_delete_remove(newp);
 			id_free(newp->req_id, SRC_DIS);
 			free(newp);
 			return;
@@ -1162,6 +1269,12 @@ int req_id;
 		size = servp->size;
 	}
 	Curr_conn_id = last_conn_id;
+	if( Dis_shm_capture && (servp->type != COMMAND) )
+	{
+		Dis_shm_buffp = buffp;
+		Dis_shm_size = size;
+		Dis_shm_capture = 0;
+	}
 /* send even if no data but not if negative */
 	if( size  < 0)
 	{
@@ -1221,7 +1334,7 @@ int req_id;
 	Dis_packet->size = htovl(header_size + size);
 	if( !dna_write_nowait(reqp->conn_id, Dis_packet, header_size + size) ) 
 	{
-		reqp->to_delete = 1;
+		request_delete_pending(reqp);
 	}
 /*
 	else
@@ -1322,7 +1435,6 @@ char *serv_name;
 {
 	register SERVICE *servp;
 	register REQUEST *reqp;
-	int to_delete = 0, more;
 
 	
 	DISABLE_AST
@@ -1334,28 +1446,9 @@ char *serv_name;
 		if((reqp->type & 0xFFF) != TIMED_ONLY)
 		{
 			execute_service(reqp->req_id);
-			if(reqp->to_delete)
-				to_delete = 1;
 		}
 	}
-	if(to_delete)
-	{
-		do
-		{
-			more = 0;
-			reqp = servp->request_head;
-			while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
-				(DLL *) reqp)) )
-			{
-				if(reqp->to_delete)
-				{
-					more = 1;
-					release_conn(reqp->conn_id, 1);
-					break;
-				}
-			}
-		}while(more);
-	}
+	release_pending_requests(servp);
 	ENABLE_AST
 }
 
@@ -1376,21 +1469,160 @@ int do_update_service();
 	return(do_update_service(service_id, client_ids));
 }
 
-int check_client(reqp, client_ids)
+/* 
+	Requests which could not be written to are queued on their service,
+	their connections are released when the update of the service is done.
+*/
+static void request_delete_pending(reqp)
 REQUEST *reqp;
+{
+	SERVICE *servp = reqp->service_ptr;
+
+	if(reqp->to_delete)
+		return;
+	reqp->to_delete = 1;
+	reqp->del_prev = 0;
+	reqp->del_next = servp->delete_head;
+	if(servp->delete_head)
+		servp->delete_head->del_prev = reqp;
+	servp->delete_head = reqp;
+}
+
+static void request_delete_remove(reqp)
+REQUEST *reqp;
+{
+	if(!reqp->to_delete)
+		return;
+	if(reqp->del_prev)
+		reqp->del_prev->del_next = reqp->del_next;
+	else
+		reqp->service_ptr->delete_head = reqp->del_next;
+	if(reqp->del_next)
+		reqp->del_next->del_prev = reqp->del_prev;
+	reqp->del_next = reqp->del_prev = 0;
+	reqp->to_delete = 0;
+}
+
+/* releasing a connection frees its requests, which leave the list */
+static void release_pending_requests(servp)
+SERVICE *servp;
+{
+	register REQUEST *reqp;
+
+	while( (reqp = servp->delete_head) )
+	{
+		request_delete_remove(reqp);
+		release_conn(reqp->conn_id, 1);
+	}
+}
+
+/*
+ * Copy the new value to the shared memory region, if there is one. The
+ * value the update fetched for its first request is reused, the user
+ * routine is only called here if no request was served.
+ */
+static void dis_shm_update(servp)
+SERVICE *servp;
+{
+	int *buffp = 0, size = -1, first_time = 0;
+	int last_conn_id, secs, millisecs;
+#ifdef WIN32
+	struct timeb timebuf;
+#else
+	struct timeval tv;
+	struct timezone *tz;
+#endif
+
+	if( (!dis_shm_is_open()) || (servp->type == COMMAND) )
+		return;
+	if( !Dis_shm_capture )
+	{
+		buffp = Dis_shm_buffp;
+		size = Dis_shm_size;
+	}
+	else if( servp->user_routine != 0 ) 
+	{
+		last_conn_id = Curr_conn_id;
+		Curr_conn_id = 0;
+		(servp->user_routine)( &servp->tag, &buffp, &size,
+					&first_time );
+		Curr_conn_id = last_conn_id;
+	} 
+	else 
+	{
+		buffp = servp->address;
+		size = servp->size;
+	}
+	if( (size < 0) || (!buffp && size) )
+		return;
+	if(!servp->user_secs)
+	{
+#ifdef WIN32
+		ftime(&timebuf);
+		secs = timebuf.time;
+		millisecs = timebuf.millitm;
+#else
+		tz = 0;
+		gettimeofday(&tv, tz);
+		secs = tv.tv_sec;
+		millisecs = tv.tv_usec / 1000;
+#endif
+	}
+	else
+	{
+		secs = servp->user_secs;
+		millisecs = servp->user_millisecs;
+	}
+	dis_shm_publish(&servp->shm_slot, servp->name, servp->def, servp->id,
+		buffp, size, servp->quality, secs, millisecs);
+}
+
+/* mark the selected clients in the connection bitmask of the service */
+static int set_client_mask(servp, client_ids, value)
+SERVICE *servp;
 int *client_ids;
+int value;
 {
-	if(!client_ids)
-		return(1);
-	while(*client_ids)
+	int conn_id, words, max_id = 0;
+	int *idp;
+
+	if(value)
 	{
-		if(reqp->conn_id == *client_ids)
+		for( idp = client_ids; *idp; idp++ )
+		{
+			if(*idp > max_id)
+				max_id = *idp;
+		}
+		words = (max_id / 32) + 1;
+		if(words > servp->client_mask_words)
 		{
-			return(1);
+			servp->client_mask = (unsigned int *)realloc(servp->client_mask,
+				words * sizeof(unsigned int));
+			memset(&servp->client_mask[servp->client_mask_words], 0,
+				(words - servp->client_mask_words) * sizeof(unsigned int));
+			servp->client_mask_words = words;
 		}
-		client_ids++;
 	}
-	return(0);
+	for( idp = client_ids; *idp; idp++ )
+	{
+		conn_id = *idp;
+		if(conn_id < 0)
+			continue;
+		if(value)
+			servp->client_mask[conn_id / 32] |= (1U << (conn_id % 32));
+		else
+			servp->client_mask[conn_id / 32] &= ~(1U << (conn_id % 32));
+	}
+	return(1);
+}
+
+static int check_client_mask(servp, conn_id)
+SERVICE *servp;
+int conn_id;
+{
+	if( (conn_id < 0) || (conn_id / 32 >= servp->client_mask_words) )
+		return(0);
+	return((servp->client_mask[conn_id / 32] >> (conn_id % 32)) & 1);
 }
 
 int do_update_service(service_id, client_ids)
@@ -1400,7 +1632,6 @@ int *client_ids;
 	register REQUEST *reqp;
 	register SERVICE *servp;
 	register int found = 0;
-	int to_delete = 0, more;
 	char str[128];
 
 	DISABLE_AST
@@ -1422,61 +1653,35 @@ int *client_ids;
 		ENABLE_AST
 		return(found);
 	}
+	if(!client_ids)
+		Dis_shm_capture = dis_shm_is_open();
+	else
+		set_client_mask(servp, client_ids, 1);
+	/* 
+	   The list is walked once with the AST disabled, a failed write only
+	   queues the request, so no request can disappear under the walk.
+	*/
 	reqp = servp->request_head;
 	while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
 		(DLL *) reqp)) ) 
 	{
-		reqp->delay_delete = 1;
-	}
-	ENABLE_AST
-	reqp = servp->request_head;
-	while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
-		(DLL *) reqp)) ) 
-	{
-		if(check_client(reqp, client_ids))
+		if( (client_ids) && (!check_client_mask(servp, reqp->conn_id)) )
+			continue;
+		if( (reqp->type & 0xFFF) != TIMED_ONLY ) 
 		{
-			if( (reqp->type & 0xFFF) != TIMED_ONLY ) 
-			{
-				DISABLE_AST
-				execute_service(reqp->req_id);
-				found++;
-				ENABLE_AST
-			}
+			execute_service(reqp->req_id);
+			found++;
 		}
 	}
+	if(client_ids)
+		set_client_mask(servp, client_ids, 0);
+	else
 	{
-	DISABLE_AST
-	reqp = servp->request_head;
-	while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
-		(DLL *) reqp)) ) 
-	{
-		reqp->delay_delete = 0;
-		if(reqp->to_delete)
-			to_delete = 1;
+		dis_shm_update(servp);
+		Dis_shm_capture = 0;
 	}
+	release_pending_requests(servp);
 	ENABLE_AST
-	}
-	if(to_delete)
-	{
-		DISABLE_AST
-		do
-		{
-			more = 0;
-			reqp = servp->request_head;
-			while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
-				(DLL *) reqp)) ) 
-			{
-				if(reqp->to_delete)
-				{
-					more = 1;
-					reqp->to_delete = 0;
-					release_conn(reqp->conn_id, 1);
-					break;
-				}
-			}
-		}while(more);
-		ENABLE_AST
-	}
 	return(found);
 }
 
@@ -1675,9 +1880,12 @@ unsigned service_id;
 	  Dis_service_id = 0;
 	if(servp->id == (int)Dis_client_id)
 	  Dis_client_id = 0;
+	dis_shm_invalidate(servp->shm_slot);
 	dis_hash_service_remove(servp);
 	id_free(servp->id, SRC_DIS);
 	free(servp->request_head);
+	if(servp->client_mask)
+		free(servp->client_mask);
 	free(servp);
 	ENABLE_AST
 	Dis_n_services--;
@@ -1805,7 +2013,7 @@ int conn_id;
 			reqp = (REQUEST *) reqpp->reqp;
 			if(reqp->delay_delete)
 			{
-				reqp->to_delete = 1;
+				request_delete_pending(reqp);
 				ENABLE_AST;
 				return((CLIENT *)-1);
 			}
@@ -1938,6 +2146,7 @@ int remove;
 
 	DISABLE_AST
 	conn_id = reqp->conn_id;
+	request_delete_remove(reqp);
 	if(reqpp)
 		dll_remove((DLL *)reqpp);
 	dll_remove((DLL *)reqp);
@@ -2452,93 +2661,234 @@ char *reason;
 	}
 }
 
-#define MAX_HASH_ENTRIES 2000
+/*
+ * Service hash table
+ *
+ * Open addressing with linear probing, the hash of the name is cached
+ * in the SERVICE structure. The table grows incrementally: while
+ * growing, the previous table stays active and every insert/remove
+ * moves another HASH_MIGRATE_STEP slots into the new table, lookups
+ * check both tables. All services are in addition linked into
+ * Service_list, which is used for iterating over the services.
+ */
+#define HASH_INIT_SIZE		1024
+#define HASH_MIGRATE_STEP	32
 
-static SERVICE *Service_hash_table[MAX_HASH_ENTRIES];
+typedef struct {
+	SERVICE **slots;
+	int size;
+	int used;
+	int deleted;
+} SERVICE_HASH;
 
-int dis_hash_service_init()
-{
-  int i;
-  static int done = 0;
+static SERVICE_HASH Service_hash = {0, 0, 0, 0};
+static SERVICE_HASH Service_hash_old = {0, 0, 0, 0};
+static int Service_hash_migrate_index = 0;
+static int Service_hash_deleted_mark;
 
-  if(!done)
-  {
-	N_unregistered_services = -1;
-	for( i = 0; i < MAX_REGISTRATION_UNIT; i++)
+#define HASH_DELETED	((SERVICE *) &Service_hash_deleted_mark)
+
+static int service_hash_alloc(tabp, size)
+SERVICE_HASH *tabp;
+int size;
+{
+	tabp->slots = (SERVICE **) calloc(size, sizeof(SERVICE *));
+	if(!tabp->slots)
 	{
-		Unregistered_services[i] = 0;
+		tabp->size = 0;
+		return(0);
 	}
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
+	tabp->size = size;
+	tabp->used = 0;
+	tabp->deleted = 0;
+	return(1);
+}
+
+static SERVICE **service_hash_lookup(tabp, name, hash)
+SERVICE_HASH *tabp;
+char *name;
+unsigned int hash;
+{
+	register int index, mask;
+	register SERVICE *servp;
+
+	if(!tabp->slots)
+		return((SERVICE **) 0);
+	mask = tabp->size - 1;
+	index = (int)(hash & (unsigned int)mask);
+	while( (servp = tabp->slots[index]) )
 	{
-		Service_hash_table[i] = (SERVICE *) malloc(8);
-		dll_init((DLL *) Service_hash_table[i]);
+		if( (servp != HASH_DELETED) && (servp->hash == hash) &&
+			!strcmp(servp->name, name) )
+		{
+			return(&tabp->slots[index]);
+		}
+		index = (index + 1) & mask;
 	}
-	done = 1;
-  }
-  return(1);
+	return((SERVICE **) 0);
 }
 
-
-int dis_hash_service_insert(servp)
+static void service_hash_put(tabp, servp)
+SERVICE_HASH *tabp;
 SERVICE *servp;
 {
-	int index, i;
-/*
-	for( i = 0; i < MAX_REGISTRATION_UNIT; i++)
+	register int index, mask;
+
+	mask = tabp->size - 1;
+	index = (int)(servp->hash & (unsigned int)mask);
+	while( tabp->slots[index] && (tabp->slots[index] != HASH_DELETED) )
 	{
-		if(Unregistered_services[i] == 0)
-		{
-			Unregistered_services[i] = servp;
-			break;
-		}
+		index = (index + 1) & mask;
 	}
-	if(N_unregistered_services == -1)
-		N_unregistered_services = 0;
-	N_unregistered_services++;
-*/
+	if(tabp->slots[index] == HASH_DELETED)
+		tabp->deleted--;
+	tabp->slots[index] = servp;
+	tabp->used++;
+}
 
-	if(N_unregistered_services == -1)
-		N_unregistered_services = 0;
-	if(N_unregistered_services == MAX_REGISTRATION_UNIT)
+static void service_hash_migrate(n_slots)
+int n_slots;
+{
+	register SERVICE *servp;
+
+	if(!Service_hash_old.slots)
+		return;
+	while( (n_slots-- > 0) && 
+		(Service_hash_migrate_index < Service_hash_old.size) )
 	{
-		for( i = 0; i < MAX_REGISTRATION_UNIT; i++)
+		servp = Service_hash_old.slots[Service_hash_migrate_index];
+		if( servp && (servp != HASH_DELETED) )
 		{
-			Unregistered_services[i] = 0;
+			service_hash_put(&Service_hash, servp);
+			/* the moved service must not be found in the old table any
+			   more, the slot stays used for the probing of the others */
+			Service_hash_old.slots[Service_hash_migrate_index] = 
+				HASH_DELETED;
+			Service_hash_old.used--;
+			Service_hash_old.deleted++;
 		}
+		Service_hash_migrate_index++;
 	}
-	else if(N_unregistered_services < MAX_REGISTRATION_UNIT)
+	if(Service_hash_migrate_index == Service_hash_old.size)
 	{
-		Unregistered_services[N_unregistered_services] = servp;	
+		free(Service_hash_old.slots);
+		Service_hash_old.slots = 0;
+		Service_hash_old.size = 0;
+		Service_hash_old.used = 0;
+		Service_hash_old.deleted = 0;
 	}
-	N_unregistered_services++;
-	index = HashFunction(servp->name, MAX_HASH_ENTRIES);
-	dll_insert_queue((DLL *) Service_hash_table[index], 
-			 (DLL *) servp);
+}
+
+static void service_hash_grow()
+{
+	int size;
+
+	/* finish an ongoing migration before starting the next one */
+	if(Service_hash_old.slots)
+		service_hash_migrate(Service_hash_old.size);
+	size = Service_hash.size;
+	if(Service_hash.used * 4 >= Service_hash.size)
+		size *= 2;
+	Service_hash_old = Service_hash;
+	if(!service_hash_alloc(&Service_hash, size))
+	{
+		/* keep the old table */
+		Service_hash = Service_hash_old;
+		Service_hash_old.slots = 0;
+		Service_hash_old.size = 0;
+		return;
+	}
+	Service_hash_migrate_index = 0;
+	service_hash_migrate(HASH_MIGRATE_STEP);
+}
+
+int dis_hash_service_init()
+{
+  static int done = 0;
+
+  if(!done)
+  {
+	service_hash_alloc(&Service_hash, HASH_INIT_SIZE);
+	Service_list = (SERVICE *) malloc(sizeof(DLL));
+	dll_init((DLL *) Service_list);
+	done = 1;
+  }
+  return(1);
+}
+
+
+static void reg_pending_remove(servp)
+SERVICE *servp;
+{
+	if(!servp->reg_pending)
+		return;
+	if(servp->reg_prev)
+		servp->reg_prev->reg_next = servp->reg_next;
+	else
+		Reg_pending_head = servp->reg_next;
+	if(servp->reg_next)
+		servp->reg_next->reg_prev = servp->reg_prev;
+	else
+		Reg_pending_tail = servp->reg_prev;
+	servp->reg_next = servp->reg_prev = 0;
+	servp->reg_pending = 0;
+}
+
+int dis_hash_service_insert(servp)
+SERVICE *servp;
+{
+	servp->reg_next = 0;
+	servp->reg_prev = Reg_pending_tail;
+	if(Reg_pending_tail)
+		Reg_pending_tail->reg_next = servp;
+	else
+		Reg_pending_head = servp;
+	Reg_pending_tail = servp;
+	servp->reg_pending = 1;
+	servp->hash = HashString(servp->name);
+	service_hash_migrate(HASH_MIGRATE_STEP);
+	if( (Service_hash.used + Service_hash.deleted + 1) * 2 > 
+		Service_hash.size )
+	{
+		service_hash_grow();
+	}
+	service_hash_put(&Service_hash, servp);
+	dll_insert_queue((DLL *) Service_list, (DLL *) servp);
 	return(1);
 }
 
 int dis_hash_service_registered(servp)
 SERVICE *servp;
 {
-	int i;
-
 	servp->registered = 1;
-	N_unregistered_services--;
-	for( i = 0; i < MAX_REGISTRATION_UNIT; i++)
-	{
-		if(Unregistered_services[i] == servp)
-		{
-			Unregistered_services[i] = 0;
-			break;
-		}
-	}
+	reg_pending_remove(servp);
 	return 1;
 }
 
 int dis_hash_service_remove(servp)
 SERVICE *servp;
 {
+	SERVICE **slotp;
+
+	if( (slotp = service_hash_lookup(&Service_hash, servp->name, 
+		servp->hash)) )
+	{
+		*slotp = HASH_DELETED;
+		Service_hash.used--;
+		Service_hash.deleted++;
+	}
+	else if( (slotp = service_hash_lookup(&Service_hash_old, servp->name,
+		servp->hash)) )
+	{
+		*slotp = HASH_DELETED;
+		Service_hash_old.used--;
+		Service_hash_old.deleted++;
+	}
+	reg_pending_remove(servp);
+	if(servp == Dns_sync_cursor)
+		Dns_sync_cursor = servp->prev;
 	dll_remove( (DLL *) servp );
+	service_hash_migrate(HASH_MIGRATE_STEP);
 	return(1);
 }
 
@@ -2546,15 +2896,17 @@ SERVICE *servp;
 SERVICE *dis_hash_service_exists(name)
 char *name;
 {
-	int index;
-	SERVICE *servp;
+	unsigned int hash;
+	SERVICE **slotp;
 
-	index = HashFunction(name, MAX_HASH_ENTRIES);
-	if( (servp = (SERVICE *) dll_search(
-					(DLL *) Service_hash_table[index],
-			      		name, strlen(name)+1)) )
+	hash = HashString(name);
+	if( (slotp = service_hash_lookup(&Service_hash, name, hash)) )
+	{
+		return(*slotp);
+	}
+	if( (slotp = service_hash_lookup(&Service_hash_old, name, hash)) )
 	{
-		return(servp);
+		return(*slotp);
 	}
 	return((SERVICE *)0);
 }			
@@ -2562,146 +2914,51 @@ char *name;
 SERVICE *dis_hash_service_get_next(prevp)
 SERVICE *prevp;
 {
-	static int index;
-	SERVICE *servp;
-
 	if(!prevp)
 	{
-		index = -1;
-	}
-	if(index == -1)
-	{
-		index++;
-		prevp = Service_hash_table[index];
+		prevp = Service_list;
 	}
-	do
-	{
-		servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[index],
-						(DLL *) prevp);
-		if(servp)
-			break;
-		index++;
-		if(index == MAX_HASH_ENTRIES)
-		{
-			return((SERVICE *) 0);
-		}
-		prevp = Service_hash_table[index];
-	} while(!servp);
-	return(servp);
-}
-
-SERVICE *dis_hash_service_get_next_register(prevp)
-SERVICE *prevp;
-{
-	static int index;
-	SERVICE *servp;
-	int i;
-
-	if(!prevp)
-	{
-		index = -1;
-	}
-	if(index == -1)
-	{
-		index++;
-		prevp = Service_hash_table[index];
-	}
-	if( (N_unregistered_services != -1) && 
-		(N_unregistered_services < MAX_REGISTRATION_UNIT))
-	{
-		for( i = 0; i < MAX_REGISTRATION_UNIT; i++)
-		{
-			if(Unregistered_services[i])
-			{
-				return(Unregistered_services[i]);
-			}
-		}
-		if(!N_unregistered_services)
-		{
-			N_unregistered_services = -1;
-			return((SERVICE *) 0);
-		}
-	}
-	do
-	{
-		servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[index],
-						(DLL *) prevp);
-		if(servp)
-			break;
-		index++;
-		if(index == MAX_HASH_ENTRIES)
-		{
-			return((SERVICE *) 0);
-		}
-		prevp = Service_hash_table[index];
-	} while(!servp);
-	return(servp);
+	return((SERVICE *) dll_get_next((DLL *) Service_list, (DLL *) prevp));
 }
 
+/* the previous service has been removed, continue from the list head */
 SERVICE *dis_hash_service_get_next_remove(prevp)
 SERVICE *prevp;
 {
-	static int index;
-	SERVICE *servp;
-
-	if(!prevp)
-	{
-		index = -1;
-	}
-	if(index == -1)
-	{
-		index++;
-		prevp = Service_hash_table[index];
-	}
-	prevp = Service_hash_table[index];
-	do
-	{
-		servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[index],
-						(DLL *) prevp);
-		if(servp)
-			break;
-		index++;
-		if(index == MAX_HASH_ENTRIES)
-		{
-			return((SERVICE *) 0);
-		}
-		prevp = Service_hash_table[index];
-	} while(!servp);
-	return(servp);
+	return((SERVICE *) dll_get_next((DLL *) Service_list, 
+		(DLL *) Service_list));
 }
 
 
 void dis_print_hash_table()
 {
-	SERVICE *servp;
-	int i;
-	int n_entries, max_entry_index;
-	int max_entries = 0;
+	SERVICE_HASH *tabp;
+	int i, n_probes, max_probes, max_entry_index = 0;
 
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
+	for( tabp = &Service_hash; tabp; 
+		tabp = (tabp == &Service_hash) ? &Service_hash_old : 0 )
 	{
-		n_entries = 0;
-		servp = Service_hash_table[i];
-		while( (servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[i],
-						(DLL *) servp)) )
-		{
-			n_entries++;
-			if(n_entries == 1)
-				printf("    Name = %s\n",servp->name);
-		}
-		if(n_entries != 0)
-			printf("HASH[%d] - %d entries\n", i, n_entries);
-		if(n_entries > max_entries)
+		if(!tabp->slots)
+			continue;
+		max_probes = 0;
+		for( i = 0; i < tabp->size; i++ ) 
 		{
-			max_entries = n_entries;
-			max_entry_index = i;
+			if( !tabp->slots[i] || (tabp->slots[i] == HASH_DELETED) )
+				continue;
+			n_probes = (i - (int)(tabp->slots[i]->hash & 
+				(unsigned int)(tabp->size - 1))) & (tabp->size - 1);
+			if(n_probes > max_probes)
+			{
+				max_probes = n_probes;
+				max_entry_index = i;
+			}
 		}
+		printf("%s : %d slots, %d entries, %d deleted\n",
+			(tabp == &Service_hash) ? "HASH" : "HASH (old)",
+			tabp->size, tabp->used, tabp->deleted);
+		printf("Maximum : HASH[%d] - %d probes\n", max_entry_index, 
+			max_probes);
 	}
-	printf("Maximum : HASH[%d] - %d entries\n", max_entry_index, max_entries);  
 	fflush(stdout);
 }
 
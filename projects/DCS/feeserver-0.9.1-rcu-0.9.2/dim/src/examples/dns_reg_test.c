@@ -0,0 +1,180 @@
+/*
+ * dns_reg_test.c
+ *
+ * Registration of a server with many services at a stand-in name server.
+ *
+ * The test listens on a local port in place of the DIM DNS and forks a
+ * server which publishes DNS_TEST_SERVICES services, starts serving and
+ * adds DNS_TEST_LATE services afterwards. The stand-in collects the
+ * DIS_DNS_PACKETs and checks that every service has been registered,
+ * both the stepwise full registration and the delta of the late services.
+ *
+ * Exit code 0 if all services have been registered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dim.h>
+#include <dis.h>
+
+#define DNS_TEST_SERVICES	5000
+#define DNS_TEST_LATE		250
+#define DNS_TEST_TIMEOUT	30
+#define DNS_TEST_TASK		"DNSTEST"
+
+static int Values[DNS_TEST_SERVICES+DNS_TEST_LATE];
+
+static void run_server(port)
+int port;
+{
+	char str[MAX_NAME];
+	int i;
+
+	sprintf(str, "%d", port);
+	setenv("DIM_DNS_NODE", "localhost", 1);
+	setenv("DIM_DNS_PORT", str, 1);
+	for(i = 0; i < DNS_TEST_SERVICES; i++)
+	{
+		sprintf(str, "%s/SVC_%05d", DNS_TEST_TASK, i);
+		dis_add_service(str, "I", &Values[i], sizeof(int), 0, 0);
+	}
+	dis_start_serving(DNS_TEST_TASK);
+	sleep(2);
+	for(i = DNS_TEST_SERVICES; i < DNS_TEST_SERVICES+DNS_TEST_LATE; i++)
+	{
+		sprintf(str, "%s/SVC_%05d", DNS_TEST_TASK, i);
+		dis_add_service(str, "I", &Values[i], sizeof(int), 0, 0);
+	}
+	dis_start_serving(DNS_TEST_TASK);
+	while(1)
+		sleep(10);
+}
+
+static int read_full(fd, buffer, size)
+int fd;
+char *buffer;
+int size;
+{
+	int n, done = 0;
+
+	while(done < size)
+	{
+		if( (n = read(fd, buffer+done, size-done)) <= 0 )
+			return -1;
+		done += n;
+	}
+	return done;
+}
+
+/*
+ * Mark the services of one registration packet, returns the number of
+ * services seen for the first time.
+ */
+static int scan_packet(packet, size, seen)
+DIS_DNS_PACKET *packet;
+int size;
+char *seen;
+{
+	int i, n, index, count = 0;
+	char *name;
+	char prefix[MAX_NAME];
+
+	if(size < DIS_DNS_HEADER || vtohl(packet->src_type) != SRC_DIS)
+		return 0;
+	n = vtohl(packet->n_services);
+	sprintf(prefix, "%s/SVC_", DNS_TEST_TASK);
+	for(i = 0; i < n && DIS_DNS_HEADER+(i+1)*(int)sizeof(SERVICE_REG) <= size; i++)
+	{
+		name = packet->services[i].service_name;
+		if(strncmp(name, prefix, strlen(prefix)))
+			continue;
+		index = atoi(name+strlen(prefix));
+		if(index >= 0 && index < DNS_TEST_SERVICES+DNS_TEST_LATE && !seen[index])
+		{
+			seen[index] = 1;
+			count++;
+		}
+	}
+	return count;
+}
+
+int main()
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	struct timeval start, now, tmo;
+	DNA_HEADER header;
+	char *buffer = 0;
+	int buffer_size = 0;
+	char seen[DNS_TEST_SERVICES+DNS_TEST_LATE];
+	int listen_fd, fd, size, registered = 0, packets = 0;
+	int on = 1;
+	pid_t pid;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	   listen(listen_fd, 1) ||
+	   getsockname(listen_fd, (struct sockaddr *)&addr, &len))
+	{
+		perror("dns_reg_test: stand-in DNS");
+		return 1;
+	}
+	if( (pid = fork()) == 0 )
+	{
+		close(listen_fd);
+		run_server(ntohs(addr.sin_port));
+		exit(0);
+	}
+	if( (fd = accept(listen_fd, 0, 0)) < 0 )
+	{
+		perror("dns_reg_test: accept");
+		kill(pid, SIGKILL);
+		return 1;
+	}
+	tmo.tv_sec = DNS_TEST_TIMEOUT;
+	tmo.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+	memset(seen, 0, sizeof(seen));
+	gettimeofday(&start, 0);
+	while(registered < DNS_TEST_SERVICES+DNS_TEST_LATE)
+	{
+		if(read_full(fd, (char *)&header, sizeof(header)) < 0)
+			break;
+		if(vtohl(header.header_magic) == TST_MAGIC ||
+		   vtohl(header.header_magic) == TRP_MAGIC)
+			continue;
+		size = vtohl(header.data_size);
+		if(size > buffer_size)
+		{
+			buffer = realloc(buffer, size);
+			buffer_size = size;
+		}
+		if(read_full(fd, buffer, size) < 0)
+			break;
+		packets++;
+		registered += scan_packet((DIS_DNS_PACKET *)buffer, size, seen);
+	}
+	gettimeofday(&now, 0);
+	kill(pid, SIGKILL);
+	waitpid(pid, 0, 0);
+	close(fd);
+	close(listen_fd);
+	printf("dns_reg_test: %d of %d services registered in %d packets, %ld ms\n",
+	       registered, DNS_TEST_SERVICES+DNS_TEST_LATE, packets,
+	       (now.tv_sec-start.tv_sec)*1000+(now.tv_usec-start.tv_usec)/1000);
+	return registered == DNS_TEST_SERVICES+DNS_TEST_LATE ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+/*
+ * hash_test.c
+ *
+ * Service hash table of the server while it grows.
+ *
+ * The test adds services until the table grows and the migration into the
+ * new table starts. Services in the first slots of the old table, which
+ * have already been moved, are removed and added again while the migration
+ * is still going on. Both tables are looked up meanwhile, a removed service
+ * must neither be found nor block the name for the next add.
+ * Afterwards every service has to be found exactly once.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dim.h>
+#include <dis.h>
+
+#define HASH_TEST_TASK		"HASHTEST"
+#define HASH_TEST_SERVICES	513	/* one more than half of the initial table */
+#define HASH_TEST_OLD_SLOTS	1024
+#define HASH_TEST_VICTIMS	8
+
+static int Failures = 0;
+static int Duplicates = 0;
+
+static void check(cond, what)
+int cond;
+char *what;
+{
+	printf("%s: %s\n", cond ? "ok  " : "FAIL", what);
+	if(!cond)
+		Failures++;
+}
+
+static void count_duplicates(severity, code, msg)
+int severity;
+int code;
+char *msg;
+{
+	if(code == DIMSVCDUPLC)
+		Duplicates++;
+}
+
+int main()
+{
+	char name[MAX_NAME];
+	unsigned ids[HASH_TEST_SERVICES];
+	int values[HASH_TEST_SERVICES];
+	int victims[HASH_TEST_VICTIMS];
+	int i, n_victims = 0, readded = 0, found;
+
+	dis_add_error_handler(count_duplicates);
+	for(i = 0; i < HASH_TEST_SERVICES; i++)
+	{
+		sprintf(name, "%s/SVC_%05d", HASH_TEST_TASK, i);
+		values[i] = i;
+		ids[i] = dis_add_service(name, "I", &values[i], sizeof(int), 0, 0);
+		if( (n_victims < HASH_TEST_VICTIMS) &&
+			((HashString(name) & (HASH_TEST_OLD_SLOTS-1)) < 16) )
+			victims[n_victims++] = i;
+	}
+	check(Duplicates == 0, "services added");
+	check(n_victims > 0, "services in the first slots of the old table");
+
+	/* the last add started the migration, the first slots are moved */
+	for(i = 0; i < n_victims; i++)
+	{
+		sprintf(name, "%s/SVC_%05d", HASH_TEST_TASK, victims[i]);
+		dis_remove_service(ids[victims[i]]);
+		ids[victims[i]] = dis_add_service(name, "I", &values[victims[i]],
+			sizeof(int), 0, 0);
+		if(ids[victims[i]])
+			readded++;
+	}
+	check(readded == n_victims && Duplicates == 0,
+		"removed services added again during the migration");
+
+	found = Duplicates;
+	for(i = 0; i < HASH_TEST_SERVICES; i++)
+	{
+		sprintf(name, "%s/SVC_%05d", HASH_TEST_TASK, i);
+		dis_add_service(name, "I", &values[i], sizeof(int), 0, 0);
+	}
+	check(Duplicates - found == HASH_TEST_SERVICES, "every service found");
+
+	printf("hash_test: %d failures\n", Failures);
+	return Failures ? 1 : 0;
+}
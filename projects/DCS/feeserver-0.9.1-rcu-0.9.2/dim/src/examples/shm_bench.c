@@ -0,0 +1,442 @@
+/*
+ * shm_bench.c
+ *
+ * Shared memory transport against DIM over TCP loopback.
+ *
+ * The program is its own name server: it listens on a local port in place
+ * of the DIM DNS, forks a server publishing one SHM_BENCH_SIZE byte service
+ * with the shared memory region open, and answers the lookups of two
+ * clients, forked once the service is registered:
+ *  - the DIM client subscribes to the service (MONITORED, over TCP),
+ *  - the shm client waits on the notification pipe and reads the slot.
+ * The server stamps every update with its sequence number and time, both
+ * clients report the latency from the update to the value in the client.
+ * The shm client then times single reads: dic_shm_read against a ONCE_ONLY
+ * DIM request (dic_shm_get_value without region, including the lookup at
+ * the name server).
+ *
+ * Exit code 0 if both clients received the updates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dim.h>
+#include <dic.h>
+#include <dis.h>
+#include <dim_shm.h>
+
+#define SHM_BENCH_TASK		"SHMBENCH"
+#define SHM_BENCH_SERVICE	SHM_BENCH_TASK"/VALUE"
+#define SHM_BENCH_SIZE		4096
+#define SHM_BENCH_UPDATES	2000
+#define SHM_BENCH_PERIOD	1000	/* us between updates */
+#define SHM_BENCH_READS		10000
+#define SHM_BENCH_DIM_READS	200
+#define SHM_BENCH_TIMEOUT	60
+#define SHM_BENCH_MAX_CONNS	8
+#define SHM_BENCH_MAX_SERVICES	32
+
+static int Value[SHM_BENCH_SIZE/sizeof(int)];
+static int Latency[SHM_BENCH_UPDATES];
+static volatile int N_latency = 0;
+
+static long now_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec*1000000L+tv.tv_usec;
+}
+
+static void stamp(seq)
+int seq;
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	Value[0] = seq;
+	Value[1] = tv.tv_sec;
+	Value[2] = tv.tv_usec;
+}
+
+static void record(buffer)
+int *buffer;
+{
+	struct timeval tv;
+
+	if( (buffer[0] <= 0) || (N_latency >= SHM_BENCH_UPDATES) )
+		return;
+	gettimeofday(&tv, 0);
+	Latency[N_latency++] = (tv.tv_sec-buffer[1])*1000000+(tv.tv_usec-buffer[2]);
+}
+
+static int cmp_int(a, b)
+const void *a, *b;
+{
+	return *(int *)a - *(int *)b;
+}
+
+static void report(what)
+char *what;
+{
+	long sum = 0;
+	int i, n = N_latency;
+
+	if(!n)
+	{
+		printf("shm_bench: %-22s no updates received\n", what);
+		return;
+	}
+	qsort(Latency, n, sizeof(int), cmp_int);
+	for(i = 0; i < n; i++)
+		sum += Latency[i];
+	printf("shm_bench: %-22s %5d updates, latency mean %5ld us, median %5d us, 99%% %5d us\n",
+	       what, n, sum/n, Latency[n/2], Latency[(n*99)/100]);
+}
+
+static void set_dns(port)
+int port;
+{
+	char str[16];
+
+	sprintf(str, "%d", port);
+	setenv("DIM_DNS_NODE", "localhost", 1);
+	setenv("DIM_DNS_PORT", str, 1);
+}
+
+static void run_server(port)
+int port;
+{
+	int id, i;
+
+	set_dns(port);
+	dis_shm_open(SHM_BENCH_TASK, 4, SHM_BENCH_SIZE);
+	id = dis_add_service(SHM_BENCH_SERVICE, "I", Value, SHM_BENCH_SIZE, 0, 0);
+	dis_start_serving(SHM_BENCH_TASK);
+	dis_update_service(id);
+	sleep(2);
+	for(i = 1; i <= SHM_BENCH_UPDATES; i++)
+	{
+		stamp(i);
+		dis_update_service(id);
+		dim_usleep(SHM_BENCH_PERIOD);
+	}
+	while(1)
+		sleep(10);
+}
+
+static void dim_rout(tag, buffer, size)
+long *tag;
+int *buffer;
+int *size;
+{
+	if(*size >= 3*(int)sizeof(int))
+		record(buffer);
+}
+
+static void run_dim_client(port)
+int port;
+{
+	int no_link = -1;
+	long start = now_us();
+
+	set_dns(port);
+	dic_info_service(SHM_BENCH_SERVICE, MONITORED, 0, 0, 0, dim_rout, 0,
+			 &no_link, sizeof(int));
+	while( (N_latency < SHM_BENCH_UPDATES) &&
+	       (now_us() - start < SHM_BENCH_TIMEOUT/2*1000000L) )
+		dim_usleep(100000);
+	report("DIM (TCP loopback)");
+	exit(N_latency ? 0 : 1);
+}
+
+static void run_shm_client(port)
+int port;
+{
+	DIM_SHM *shmp = 0;
+	int buffer[SHM_BENCH_SIZE/sizeof(int)];
+	int slot = -1, last = 0, i, ok = 0;
+	long start = now_us(), t;
+
+	set_dns(port);
+	while( (!shmp || (slot < 0)) && (now_us() - start < 5000000L) )
+	{
+		if(!shmp)
+			shmp = dic_shm_attach(SHM_BENCH_TASK);
+		if(shmp)
+			slot = dic_shm_find_service(shmp, SHM_BENCH_SERVICE);
+		if(slot < 0)
+			dim_usleep(10000);
+	}
+	if(slot < 0)
+	{
+		printf("shm_bench: no shared memory slot for %s\n", SHM_BENCH_SERVICE);
+		exit(1);
+	}
+	while( (last < SHM_BENCH_UPDATES) &&
+	       (now_us() - start < SHM_BENCH_TIMEOUT/2*1000000L) )
+	{
+		dic_shm_wait(shmp, 100);
+		if( (dic_shm_read(shmp, slot, buffer, sizeof(buffer)) < 3*(int)sizeof(int)) ||
+		    (buffer[0] == last) )
+			continue;
+		record(buffer);
+		last = buffer[0];
+	}
+	report("shared memory");
+
+	t = now_us();
+	for(i = 0; i < SHM_BENCH_READS; i++)
+		ok += (dic_shm_read(shmp, slot, buffer, sizeof(buffer)) == SHM_BENCH_SIZE);
+	t = now_us() - t;
+	printf("shm_bench: %-22s %5d reads of %d bytes, %7.2f us per read\n",
+	       "dic_shm_read", ok, SHM_BENCH_SIZE, (double)t/SHM_BENCH_READS);
+	ok = 0;
+	t = now_us();
+	for(i = 0; i < SHM_BENCH_DIM_READS; i++)
+		ok += (dic_shm_get_value(0, SHM_BENCH_SERVICE, buffer, sizeof(buffer), 5)
+		       == SHM_BENCH_SIZE);
+	t = now_us() - t;
+	printf("shm_bench: %-22s %5d reads of %d bytes, %7.2f us per read\n",
+	       "DIM ONCE_ONLY request", ok, SHM_BENCH_SIZE, (double)t/SHM_BENCH_DIM_READS);
+	dic_shm_detach(shmp);
+	exit(N_latency && (ok == SHM_BENCH_DIM_READS) ? 0 : 1);
+}
+
+/* the stand-in name server */
+
+typedef struct {
+	char name[MAX_NAME];
+	char def[MAX_NAME];
+} BENCH_SERVICE;
+
+static DIS_DNS_PACKET Server;
+static BENCH_SERVICE Services[SHM_BENCH_MAX_SERVICES];
+static int N_services = 0;
+
+static int read_full(fd, buffer, size)
+int fd;
+char *buffer;
+int size;
+{
+	int n, done = 0;
+
+	while(done < size)
+	{
+		if( (n = read(fd, buffer+done, size-done)) <= 0 )
+			return -1;
+		done += n;
+	}
+	return done;
+}
+
+static void register_services(packet, size)
+DIS_DNS_PACKET *packet;
+int size;
+{
+	int i, n;
+
+	memcpy(&Server, packet, DIS_DNS_HEADER);
+	n = vtohl(packet->n_services);
+	for(i = 0; i < n && DIS_DNS_HEADER+(i+1)*(int)sizeof(SERVICE_REG) <= size &&
+		    N_services < SHM_BENCH_MAX_SERVICES; i++)
+	{
+		strcpy(Services[N_services].name, packet->services[i].service_name);
+		strcpy(Services[N_services].def, packet->services[i].service_def);
+		N_services++;
+	}
+}
+
+static void answer_lookup(fd, packet)
+int fd;
+DIC_DNS_PACKET *packet;
+{
+	struct {
+		DNA_HEADER header;
+		DNS_DIC_PACKET packet;
+	} reply;
+	int i;
+
+	if(vtohl(packet->service.service_id) & 0x80000000)
+		return;
+	memset(&reply, 0, sizeof(reply));
+	reply.header.header_size = htovl(sizeof(DNA_HEADER));
+	reply.header.data_size = htovl(sizeof(DNS_DIC_PACKET));
+	reply.header.header_magic = htovl(HDR_MAGIC);
+	reply.packet.size = htovl(DNS_DIC_HEADER);
+	reply.packet.service_id = packet->service.service_id;
+	for(i = 0; i < N_services; i++)
+	{
+		if(strcmp(Services[i].name, packet->service.service_name))
+			continue;
+		strcpy(reply.packet.service_def, Services[i].def);
+		strcpy(reply.packet.node_name, Server.node_name);
+		strcpy(reply.packet.task_name, Server.task_name);
+		memcpy(reply.packet.node_addr, Server.node_addr, 4);
+		reply.packet.pid = Server.pid;
+		reply.packet.port = Server.port;
+		reply.packet.protocol = Server.protocol;
+		reply.packet.format = Server.format;
+		break;
+	}
+	if(write(fd, &reply, sizeof(reply)) != sizeof(reply))
+		perror("shm_bench: name server reply");
+}
+
+/* serve the name server connections for up to timeout_ms */
+static void serve_dns(listen_fd, conns, n_conns, timeout_ms)
+int listen_fd;
+int *conns;
+int *n_conns;
+int timeout_ms;
+{
+	struct pollfd fds[SHM_BENCH_MAX_CONNS+1];
+	DNA_HEADER header;
+	static char *buffer = 0;
+	static int buffer_size = 0;
+	int i, n, size, fd;
+
+	fds[0].fd = listen_fd;
+	fds[0].events = POLLIN;
+	for(i = 0; i < *n_conns; i++)
+	{
+		fds[i+1].fd = conns[i];
+		fds[i+1].events = POLLIN;
+	}
+	n = *n_conns;
+	if(poll(fds, n+1, timeout_ms) <= 0)
+		return;
+	for(i = n; i > 0; i--)
+	{
+		if(!fds[i].revents)
+			continue;
+		fd = fds[i].fd;
+		if(read_full(fd, (char *)&header, sizeof(header)) < 0)
+		{
+			close(fd);
+			conns[i-1] = conns[--(*n_conns)];
+			continue;
+		}
+		if(vtohl(header.header_magic) == TST_MAGIC ||
+		   vtohl(header.header_magic) == TRP_MAGIC)
+			continue;
+		size = vtohl(header.data_size);
+		if(size > buffer_size)
+		{
+			buffer = realloc(buffer, size);
+			buffer_size = size;
+		}
+		if(read_full(fd, buffer, size) < 0)
+			continue;
+		if( (size < 2*(int)sizeof(int)) ||
+		    (vtohl(((int *)buffer)[0]) == (int)OPN_MAGIC) )
+			continue;
+		if(vtohl(((DIS_DNS_PACKET *)buffer)->src_type) == SRC_DIS)
+			register_services((DIS_DNS_PACKET *)buffer, size);
+		else if(vtohl(((DIC_DNS_PACKET *)buffer)->src_type) == SRC_DIC)
+			answer_lookup(fd, (DIC_DNS_PACKET *)buffer);
+	}
+	if( (fds[0].revents & POLLIN) && (*n_conns < SHM_BENCH_MAX_CONNS) )
+	{
+		if( (fd = accept(listen_fd, 0, 0)) >= 0 )
+			conns[(*n_conns)++] = fd;
+	}
+}
+
+static int registered()
+{
+	int i;
+
+	for(i = 0; i < N_services; i++)
+	{
+		if(!strcmp(Services[i].name, SHM_BENCH_SERVICE))
+			return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int conns[SHM_BENCH_MAX_CONNS];
+	int listen_fd, n_conns = 0, on = 1, status, running, failed = 0;
+	pid_t server, clients[2];
+	long start;
+	int port, i;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	   listen(listen_fd, SHM_BENCH_MAX_CONNS) ||
+	   getsockname(listen_fd, (struct sockaddr *)&addr, &len))
+	{
+		perror("shm_bench: stand-in DNS");
+		return 1;
+	}
+	port = ntohs(addr.sin_port);
+	if( (server = fork()) == 0 )
+	{
+		close(listen_fd);
+		run_server(port);
+	}
+	start = now_us();
+	while(!registered() && (now_us() - start < 10000000L))
+		serve_dns(listen_fd, conns, &n_conns, 100);
+	if(!registered())
+	{
+		printf("shm_bench: %s was not registered\n", SHM_BENCH_SERVICE);
+		kill(server, SIGKILL);
+		return 1;
+	}
+	if( (clients[0] = fork()) == 0 )
+	{
+		close(listen_fd);
+		run_dim_client(port);
+	}
+	if( (clients[1] = fork()) == 0 )
+	{
+		close(listen_fd);
+		run_shm_client(port);
+	}
+	running = 2;
+	while(running && (now_us() - start < SHM_BENCH_TIMEOUT*1000000L))
+	{
+		serve_dns(listen_fd, conns, &n_conns, 100);
+		for(i = 0; i < 2; i++)
+		{
+			if( clients[i] && (waitpid(clients[i], &status, WNOHANG) == clients[i]) )
+			{
+				if(!WIFEXITED(status) || WEXITSTATUS(status))
+					failed++;
+				clients[i] = 0;
+				running--;
+			}
+		}
+	}
+	for(i = 0; i < 2; i++)
+	{
+		if(clients[i])
+		{
+			kill(clients[i], SIGKILL);
+			failed++;
+		}
+	}
+	kill(server, SIGKILL);
+	waitpid(server, 0, 0);
+	return failed ? 1 : 0;
+}
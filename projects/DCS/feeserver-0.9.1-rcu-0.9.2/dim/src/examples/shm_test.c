@@ -0,0 +1,162 @@
+/*
+ * shm_test.c
+ *
+ * Shared memory transport, server and client side in one process.
+ *
+ * The region is opened with room for two small values. The test adds
+ * more services than that and lets values outgrow their slots, a client
+ * attached before has to follow the region and read the new values.
+ * A slot left locked by the writer has to make the read fail instead of
+ * hanging, dic_shm_get_value then falls back to DIM, which times out
+ * here since there is no name server.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <dim.h>
+#include <dim_shm.h>
+
+#define SHM_TEST_TASK		"SHMTEST"
+#define SHM_TEST_SERVICES	40
+#define SHM_TEST_BIG		4096
+
+static int Failures = 0;
+
+static void check(cond, what)
+int cond;
+char *what;
+{
+	printf("%s: %s\n", cond ? "ok  " : "FAIL", what);
+	if(!cond)
+		Failures++;
+}
+
+static long elapsed_ms(start)
+struct timeval *start;
+{
+	struct timeval now;
+
+	gettimeofday(&now, 0);
+	return (now.tv_sec-start->tv_sec)*1000+(now.tv_usec-start->tv_usec)/1000;
+}
+
+int main()
+{
+	DIM_SHM *shmp;
+	DIM_SHM_HEADER header;
+	DIM_SHM_SLOT *slotp;
+	struct timeval start;
+	char name[MAX_NAME];
+	int slots[SHM_TEST_SERVICES];
+	int values[SHM_TEST_SERVICES];
+	int big[SHM_TEST_BIG/sizeof(int)], buffer[SHM_TEST_BIG/sizeof(int)];
+	int i, fd, slot, size, ok;
+	char *base;
+
+	setenv("DIM_DNS_NODE", "localhost", 1);
+	setenv("DIM_DNS_PORT", "1", 1);
+	if(!dis_shm_open(SHM_TEST_TASK, 2, 16))
+	{
+		printf("shm_test: can not open the region\n");
+		return 1;
+	}
+	for(i = 0; i < SHM_TEST_SERVICES; i++)
+	{
+		slots[i] = -1;
+		values[i] = 1000 + i;
+	}
+	dis_shm_publish(&slots[0], SHM_TEST_TASK"/SVC_0", "I", 1,
+		&values[0], sizeof(int), 0, 0, 0);
+	shmp = dic_shm_attach(SHM_TEST_TASK);
+	check(shmp != 0, "client attached");
+	if(!shmp)
+		return 1;
+
+	/* more services than the region was opened for */
+	for(i = 1; i < SHM_TEST_SERVICES; i++)
+	{
+		sprintf(name, "%s/SVC_%d", SHM_TEST_TASK, i);
+		dis_shm_publish(&slots[i], name, "I", i + 1, &values[i],
+			sizeof(int), 0, 0, 0);
+	}
+	ok = 1;
+	for(i = 0; i < SHM_TEST_SERVICES; i++)
+	{
+		sprintf(name, "%s/SVC_%d", SHM_TEST_TASK, i);
+		slot = dic_shm_find_service(shmp, name);
+		if( (slot < 0) ||
+			(dic_shm_read(shmp, slot, buffer, sizeof(int)) != sizeof(int)) ||
+			(buffer[0] != values[i]) )
+			ok = 0;
+	}
+	check(ok, "services added after opening are readable");
+	check(shmp->header->max_slots >= SHM_TEST_SERVICES, "client follows the region");
+
+	/* a value outgrowing its slot */
+	for(i = 0; i < SHM_TEST_BIG/(int)sizeof(int); i++)
+		big[i] = i;
+	for(size = 64; size <= SHM_TEST_BIG; size *= 4)
+	{
+		big[0] = size;
+		dis_shm_publish(&slots[0], SHM_TEST_TASK"/SVC_0", "I", 1,
+			big, size, 0, 0, 0);
+		slot = dic_shm_find_service(shmp, SHM_TEST_TASK"/SVC_0");
+		memset(buffer, 0, sizeof(buffer));
+		ok = (dic_shm_read(shmp, slot, buffer, sizeof(buffer)) == size) &&
+			!memcmp(buffer, big, size);
+		sprintf(name, "value of %d bytes moved to a larger slot", size);
+		check(ok, name);
+	}
+	sprintf(name, "%s/SVC_%d", SHM_TEST_TASK, SHM_TEST_SERVICES - 1);
+	slot = dic_shm_find_service(shmp, name);
+	check( (dic_shm_read(shmp, slot, buffer, sizeof(int)) == sizeof(int)) &&
+		(buffer[0] == values[SHM_TEST_SERVICES - 1]), "other slots kept");
+
+	/* a writer stopped in the middle of an update */
+	fd = open("/dev/shm/dim_shm_"SHM_TEST_TASK, O_RDWR);
+	base = MAP_FAILED;
+	if( (fd >= 0) && (read(fd, &header, sizeof(header)) == sizeof(header)) )
+		base = mmap(0, sizeof(header) + header.max_slots * sizeof(DIM_SHM_SLOT),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	check(base != MAP_FAILED, "region mapped for writing");
+	if(base != MAP_FAILED)
+	{
+		slotp = (DIM_SHM_SLOT *)(base + sizeof(DIM_SHM_HEADER));
+		slot = dic_shm_find_service(shmp, SHM_TEST_TASK"/SVC_1");
+		slotp[slot].seq++;
+		gettimeofday(&start, 0);
+		check(dic_shm_read(shmp, slot, buffer, sizeof(int)) == -1,
+			"read of a locked slot fails");
+		check((dic_shm_read_begin(shmp, slot) & 1) != 0,
+			"read_begin reports the locked slot");
+		check(elapsed_ms(&start) < 1000, "locked slot does not block");
+		gettimeofday(&start, 0);
+		check(dic_shm_get_value(shmp, SHM_TEST_TASK"/SVC_1", buffer,
+			sizeof(int), 1) == -1, "fallback to DIM without a name server");
+		check(elapsed_ms(&start) < 5000, "fallback times out");
+		slotp[slot].seq++;
+		check( (dic_shm_get_value(shmp, SHM_TEST_TASK"/SVC_1", buffer,
+			sizeof(int), 1) == sizeof(int)) && (buffer[0] == values[1]),
+			"slot readable after the update completed");
+		munmap(base, sizeof(header) + header.max_slots * sizeof(DIM_SHM_SLOT));
+	}
+	if(fd >= 0)
+		close(fd);
+
+	dis_shm_invalidate(slots[2]);
+	sprintf(name, "%s/SVC_2", SHM_TEST_TASK);
+	check(dic_shm_read(shmp, dic_shm_find_service(shmp, name), buffer,
+		sizeof(int)) == -1, "removed service is not served");
+	dic_shm_detach(shmp);
+	dis_shm_close();
+	check(access("/dev/shm/dim_shm_"SHM_TEST_TASK, F_OK) != 0, "region removed");
+	printf("shm_test: %d failures\n", Failures);
+	return Failures ? 1 : 0;
+}
@@ -19,23 +19,54 @@ int	max;
 	return (code % max);
 }
 */
-int HashFunction(name, max)
+
+/*
+ * Word-at-a-time string hash: the length is taken first, the name is
+ * then consumed in 4 byte chunks, the last (partial) chunk is assembled
+ * byte by byte, so no byte behind the terminating zero is read.
+ * The result does not depend on the alignment of the string.
+ */
+#define HASH_ROTL(x,r)		(((x) << (r)) | ((x) >> (32 - (r))))
+
+unsigned int HashString(name)
 char	*name;
-int	max;
 {
-   unsigned int b    = 378551;
-   unsigned int a    = 63689;
-   unsigned int hash = 0;
-   int i    = 0;
-   int len;
+	register unsigned int hash = 0x9747b28cU;
+	unsigned int w;
+	register unsigned int len;
+	register unsigned int n;
+	unsigned char last[4];
+	int i;
 
-   len = strlen(name);
-
-   for(i = 0; i < len; name++, i++)
-   {
-      hash = hash*a+(*name);
-      a = a*b;
-   }
+	len = (unsigned int)strlen(name);
+	for( n = len; n >= 4; n -= 4 )
+	{
+		memcpy(&w, name, 4);
+		w *= 0xcc9e2d51U;
+		hash ^= HASH_ROTL(w, 15) * 0x1b873593U;
+		hash = HASH_ROTL(hash, 13) * 5 + 0xe6546b64U;
+		name += 4;
+	}
+	if(n)
+	{
+		for( i = 0; i < 4; i++ )
+			last[i] = (i < (int)n) ? (unsigned char)name[i] : 0;
+		memcpy(&w, last, 4);
+		w *= 0xcc9e2d51U;
+		hash ^= HASH_ROTL(w, 15) * 0x1b873593U;
+	}
+	hash ^= len;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return(hash);
+}
 
-   return (hash % max);
+int HashFunction(name, max)
+char	*name;
+int	max;
+{
+   return ((int)(HashString(name) % (unsigned int)max));
 }
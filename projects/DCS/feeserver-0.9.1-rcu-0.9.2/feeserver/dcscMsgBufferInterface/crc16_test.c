@@ -0,0 +1,60 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+/*
+ * crc16_test.c
+ *
+ * The table driven CRC16 compared with the bit-by-bit implementation by
+ * @ref crc16Benchmark.
+ *
+ * Short buffers cover the tails of the slicing loop, the larger ones the
+ * sizes of message buffer blocks. The times of both implementations are
+ * printed for each size.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#define __BENCHMARK /* the benchmark functions of the interface */
+#include <stdio.h>
+#include "dcscMsgBufferInterface.h"
+
+#define CRC16_TEST_MAX_SHORT 16
+#define CRC16_TEST_CYCLES    100
+
+static int g_failures=0;
+
+static void check(int cond, const char* what, int iSize)
+{
+  printf("%s: %s, %d bytes\n", cond?"ok  ":"FAIL", what, iSize);
+  if (!cond) g_failures++;
+}
+
+int main()
+{
+  int sizes[]={64, 1000, 4096, 65536};
+  int i=0;
+  for (i=1; i<=CRC16_TEST_MAX_SHORT; i++) {
+    check(crc16Benchmark(i, CRC16_TEST_CYCLES)>=0, "crc16 checksums", i);
+  }
+  for (i=0; i<(int)(sizeof(sizes)/sizeof(int)); i++) {
+    check(crc16Benchmark(sizes[i], CRC16_TEST_CYCLES)>=0, "crc16 checksums", sizes[i]);
+  }
+  printf("crc16_test: %d failures\n", g_failures);
+  return g_failures?1:0;
+}
@@ -30,9 +30,12 @@
 //#include <unistd.h>
 #include "dcs_driver.h"
 #include "dcscMsgBufferInterface.h"
+#include "crc16table.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
 
 // format and location of firmware versions
 // introduced May 2005, RCU4 card
@@ -264,6 +267,7 @@ int g_oldval[4];
 // local copy of driver access space - used to write to and read from the DCS board
 __u32* pBuffer=NULL;
 __u32* pMib=NULL;
+__u32* pMibStaging=NULL; // second MIB image to prepare the next block of a multi-block transfer
 __u32* pMrb=NULL;
 __u32* pReg=NULL;
 __u32 bufferSize=0;
@@ -271,7 +275,40 @@ __u32 mibSize=0;
 __u32 mrbSize=0;
 __u32 regSize=0;
 
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ * slicing-by-4: four bytes are folded into the register by four independent table
+ * lookups, the bytes are assembled individually and the data needs no alignment
+ */
+unsigned short crc16Update(unsigned short crc, const char *data_p, int length){
+  const unsigned char* p=(const unsigned char*)data_p;
+  unsigned int x;
+  if (p==NULL) return crc;
+  for (; length>=4; length-=4, p+=4) {
+    x=crc^(p[0]|(p[1]<<8));
+    crc=g_crc16Table[3][x&0xff]^g_crc16Table[2][(x>>8)&0xff]^
+      g_crc16Table[1][p[2]]^g_crc16Table[0][p[3]];
+  }
+  for (; length>0; length--, p++) {
+    crc=(crc>>8)^g_crc16Table[0][(crc^*p)&0xff];
+  }
+  return crc;
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+unsigned short crc16Final(unsigned short crc){
+  crc = ~crc;
+  return (crc << 8) | ((crc >> 8) & 0xff);
+}
+
 unsigned short crc16(char *data_p, int length){
+  return crc16Final(crc16Update(CRC16_INIT, data_p, length));
+}
+
+#ifdef __BENCHMARK
+/* the original bit-by-bit implementation, reference for the benchmark
+ */
+static unsigned short crc16Bitwise(char *data_p, int length){
   
   unsigned char i;
   unsigned int data;
@@ -299,6 +336,43 @@ unsigned short crc16(char *data_p, int length){
   return (crc);
 }
 
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int crc16Benchmark(int iSize, int iCycles){
+  int iResult=0;
+  int i=0, cycle=0;
+  unsigned short crcBitwise=0, crcTable=0;
+  if (iSize<=0 || iCycles<=0) return -EINVAL;
+  char* pData=(char*)malloc(iSize);
+  if (pData==NULL) return -ENOMEM;
+  for (i=0; i<iSize; i++) pData[i]=(char)(i*7+(i>>8));
+  struct timeval start, bitwise, table;
+  gettimeofday(&start, NULL);
+  // the previous checksum is fed back into the data to keep the calls in the loop
+  for (cycle=0; cycle<iCycles; cycle++) {
+    pData[0]=(char)crcBitwise;
+    crcBitwise=crc16Bitwise(pData, iSize);
+  }
+  gettimeofday(&bitwise, NULL);
+  for (cycle=0; cycle<iCycles; cycle++) {
+    pData[0]=(char)crcTable;
+    crcTable=crc16(pData, iSize);
+  }
+  gettimeofday(&table, NULL);
+  // the unaligned tail has to give the same result
+  for (i=1; i<4 && i<iSize && iResult>=0; i++) {
+    if (crc16Bitwise(pData+i, iSize-i)!=crc16(pData+i, iSize-i)) iResult=-EFAULT;
+  }
+  free(pData);
+  if (crcBitwise!=crcTable) iResult=-EFAULT;
+  long usecBitwise=(bitwise.tv_sec-start.tv_sec)*1000000+(bitwise.tv_usec-start.tv_usec);
+  long usecTable=(table.tv_sec-bitwise.tv_sec)*1000000+(table.tv_usec-bitwise.tv_usec);
+  fprintf(stderr, "crc16 %d bytes x %d: bitwise %ld ns, slicing-by-4 %ld ns, checksums %s (0x%04x)\n",
+	  iSize, iCycles, usecBitwise*1000/iCycles, usecTable*1000/iCycles, iResult>=0?"match":"differ", crcTable);
+  return iResult;
+}
+#endif //__BENCHMARK
+
 __u32 mkFrstWrd(unsigned short numWords, unsigned short blockNum, unsigned short format, unsigned short mode, unsigned short cmdId){ 
  unsigned short extension = 0x0000;
  __u32 frstWrd = 0;
@@ -489,11 +563,12 @@ int openDevice(const char* pDeviceName)
     mibSize=message_in_buffer_size/4;
     mrbSize=message_out_buffer_size/4;
     regSize=message_regfile_size/4;
-    bufferSize=mibSize+mrbSize+regSize;
+    bufferSize=mibSize+mrbSize+regSize+mibSize;
     pBuffer = (__u32*)malloc(bufferSize*4); 
     pMib=pBuffer;
     pMrb=pBuffer+mibSize;
     pReg=pMrb+mrbSize;
+    pMibStaging=pReg+regSize;
  
     if (iResult<0) {
       closeDevice(); // close device in case of error
@@ -540,6 +615,7 @@ int closeDevice()
   regSize=0;
   bufferSize=0;
   pMib=NULL;
+  pMibStaging=NULL;
   pMrb=NULL;
   pReg=NULL;
   free(pBuffer);
@@ -672,13 +748,36 @@ int read_dcsc(void *ptr, size_t size, size_t nmemb)
 }
 
 /* basic device lock functions
+ * the driver lock serializes the processes, the recursive mutex the threads of
+ * this process; the driver is only locked by the outermost lock_device call,
+ * nested calls within a session just count the level
  */
 int g_AppID=0;
+static pthread_mutex_t g_deviceMutex;
+static pthread_once_t g_deviceMutexOnce=PTHREAD_ONCE_INIT;
+static int g_iLockLevel=0;    // nesting level of the device lock, protected by g_deviceMutex
+static pthread_t g_lockOwner; // thread holding the device lock, valid if g_iLockLevel>0
+static int g_iDriverLocks=0;  // number of driver lock operations, statistics
+
+static void initDeviceMutex()
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_deviceMutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
 int lock_device()
 {
   int iResult=0;
+  pthread_once(&g_deviceMutexOnce, initDeviceMutex);
+  pthread_mutex_lock(&g_deviceMutex);
+  if (g_iLockLevel++>0) return 0;
+  g_lockOwner=pthread_self();
   if (g_file) {
     iResult=ioctl(g_file, IOCTL_LOCK_DRIVER, g_AppID);
+    g_iDriverLocks++;
   } else {
     iResult=-EBADF;
     fprintf(stderr,"lock_device: internal error: device not opened\n");
@@ -689,15 +788,58 @@ int lock_device()
 int unlock_device()
 {
   int iResult=0;
-  if (g_file)
-    iResult=ioctl(g_file, IOCTL_UNLOCK_DRIVER, g_AppID);
-  else {
-    iResult=-EBADF;
-    fprintf(stderr,"unlock_device: internal error: device not opened\n");
+  pthread_once(&g_deviceMutexOnce, initDeviceMutex);
+  // only the owner can release the lock, the mutex is busy if another thread holds it
+  if (pthread_mutex_trylock(&g_deviceMutex)!=0) {
+    fprintf(stderr,"unlock_device: device locked by another thread\n");
+    return -EPERM;
+  }
+  if (g_iLockLevel<=0 || !pthread_equal(g_lockOwner, pthread_self())) {
+    pthread_mutex_unlock(&g_deviceMutex);
+    fprintf(stderr,"unlock_device: internal error: device not locked\n");
+    return -ENOLCK;
+  }
+  if (--g_iLockLevel==0) {
+    if (g_file)
+      iResult=ioctl(g_file, IOCTL_UNLOCK_DRIVER, g_AppID);
+    else {
+      iResult=-EBADF;
+      fprintf(stderr,"unlock_device: internal error: device not opened\n");
+    }
+  }
+  // release the level of this call and the one of the matching lock_device
+  pthread_mutex_unlock(&g_deviceMutex);
+  pthread_mutex_unlock(&g_deviceMutex);
+  return iResult;
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int dcscBeginSession()
+{
+  int iResult=lock_device();
+  if (iResult<0) {
+    // the driver lock has not been taken, the session is not opened
+    g_iLockLevel--;
+    pthread_mutex_unlock(&g_deviceMutex);
   }
   return iResult;
 }
 
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int dcscEndSession()
+{
+  return unlock_device();
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int dcscDriverLockCount()
+{
+  return g_iDriverLocks;
+}
+
 int seize_device()
 {
   int iResult=0;
@@ -765,7 +907,22 @@ int dcscLockCtrl(int cmd)
     iResult=lock_device();
     break;
   case eUnlock:
-    iResult=unlock_device();
+    pthread_once(&g_deviceMutexOnce, initDeviceMutex);
+    if (pthread_mutex_trylock(&g_deviceMutex)!=0) {
+      // the lock of another thread is not released
+      fprintf(stderr,"dcscLockCtrl: device locked by another thread\n");
+      iResult=-EPERM;
+      break;
+    }
+    if (g_iLockLevel>0) {
+      iResult=unlock_device();
+    } else if (g_file) {
+      // no lock held by this process, release the driver lock directly
+      iResult=ioctl(g_file, IOCTL_UNLOCK_DRIVER, g_AppID);
+    } else {
+      iResult=-EBADF;
+    }
+    pthread_mutex_unlock(&g_deviceMutex);
     break;
   case eSeize:
     iResult=seize_device();
@@ -1069,17 +1226,14 @@ int getCmdResult(__u32 u32CmdWord, char* pMessage)
   return iNofWords;
 }
 
-/* internal function for debugging purpose
- * read back the content of the MIB and compare it to the originally written buffer
- * the option can be turned on by the CHECK_COMMAND_BUFFER flag, a message is printed to std output
- * and the operation is terminated in case of missmatch, to continue the flag IGNORE_BUFFER_CHECK
- * can be set
+/* read back the content of the MIB and compare it to the originally written buffer
  * to read back the buffer first an internal multiplexer in the dcs board firmware has to be switched
  * by setting the BUFFER_REREAD bit in the GENERAL_CTRL_REG
+ * internal function, used by checkMsginBuffer if the CHECK_COMMAND_BUFFER_FULL flag is set
  * return: 0 case of success
  *    <0 in case of error
  */
-int checkMsginBuffer(char* pCmdBuffer, int iCmdBufferSize, int iSilent) 
+int checkMsginBufferFull(char* pCmdBuffer, int iCmdBufferSize, int iSilent) 
 {
   int iResult=0;
   if (pCmdBuffer && iCmdBufferSize>0){
@@ -1115,6 +1269,80 @@ int checkMsginBuffer(char* pCmdBuffer, int iCmdBufferSize, int iSilent)
   return iResult;
 }
 
+/* number of words in addition to the header and the end marker checked by the sampled reread
+ */
+#define MIB_CHECK_SAMPLES 4
+
+/* read back a few words of the MIB and compare them to the originally written buffer
+ * the header word and the last word of the block are always checked, the other samples
+ * move on with every call so that consecutive blocks cover all positions
+ * internal function, default method of checkMsginBuffer
+ * return: 0 case of success
+ *    <0 in case of error
+ */
+int checkMsginBufferSampled(char* pCmdBuffer, int iCmdBufferSize, int iSilent) 
+{
+  static int iSampleOffset=0;
+  int iResult=0;
+  int iNofWords=iCmdBufferSize/sizeof(__u32);
+  if (pCmdBuffer && iNofWords>0){
+    if (iNofWords<=MIB_CHECK_SAMPLES+2) {
+      // small block, the full reread is as cheap as the sampling
+      return checkMsginBufferFull(pCmdBuffer, iNofWords*sizeof(__u32), iSilent);
+    }
+    int positions[MIB_CHECK_SAMPLES+2];
+    int i=0;
+    positions[0]=0;
+    positions[1]=iNofWords-1;
+    // spread the samples over the inner words, with an offset moving from call to call
+    int stride=(iNofWords-2)/MIB_CHECK_SAMPLES;
+    for (i=0; i<MIB_CHECK_SAMPLES; i++) {
+      positions[i+2]=1+(i*stride+iSampleOffset%stride);
+    }
+    iSampleOffset++;
+    iResult=setDcscRegisterBit(GENERAL_CTRL_REG_ADDR, BUFFER_REREAD);
+    for (i=0; i<MIB_CHECK_SAMPLES+2 && iResult>=0; i++) {
+      __u32 word=0;
+      if (seek_dcsc(positions[i]*sizeof(__u32), 0)<0) {
+	fprintf(stderr,"checkMsginBuffer: seek failed\n");
+	iResult=-1;
+      } else if (read_dcsc(&word, 1, sizeof(__u32))!=sizeof(__u32)) {
+	fprintf(stderr,"checkMsginBuffer: failed to read word %d from message in buffer\n", positions[i]);
+	iResult=-1;
+      } else if (word!=((__u32*)pCmdBuffer)[positions[i]]) {
+	printf("checkMsginBuffer: message in buffer word %d (0x%08x) does not match original command buffer (0x%08x)\n",
+	       positions[i], word, ((__u32*)pCmdBuffer)[positions[i]]);
+	iResult=-EFAULT;
+      } else {
+	iResult=0;
+      }
+    }
+    if (iResult>=0 && iSilent!=1)
+      printf("checkMsginBuffer: command sampled and checked\n");
+    clearDcscRegisterBit(GENERAL_CTRL_REG_ADDR, BUFFER_REREAD);
+  } else
+    iResult=-EFAULT;
+  return iResult;
+}
+
+/* internal function for debugging purpose
+ * verify the content of the MIB against the originally written buffer
+ * the option can be turned on by the CHECK_COMMAND_BUFFER flag, a message is printed to std output
+ * and the operation is terminated in case of missmatch, to continue the flag IGNORE_BUFFER_CHECK
+ * can be set
+ * the verification method is chosen by the option flags:
+ * - CHECK_COMMAND_BUFFER_FULL: the complete MIB is read back
+ * - default:                   the header, the last word and a few sampled words are read back
+ * return: 0 case of success
+ *    <0 in case of error
+ */
+int checkMsginBuffer(char* pCmdBuffer, int iCmdBufferSize, int iSilent) 
+{
+  if (g_options&CHECK_COMMAND_BUFFER_FULL)
+    return checkMsginBufferFull(pCmdBuffer, iCmdBufferSize, iSilent);
+  return checkMsginBufferSampled(pCmdBuffer, iCmdBufferSize, iSilent);
+}
+
 /* write a buffer to the MIB 
  * internal function
  * return: number of data words written
@@ -1140,25 +1368,20 @@ int writeToMsgInBuffer(char* pBuffer, int iBufferSize)
   return iResult;
 } 
 
-/* backbone for all rcu access methods, the function writes a fully encoded block to the MIB,
- * reads it back and checks it if desired, sets the COMMAND_EXECUTE flag and waits for the
- * interface to be ready 
+/* first half of @ref sendRcuCommand: writes a fully encoded block to the MIB, reads it back
+ * and checks it if desired and sets the COMMAND_EXECUTE flag
  * internal function
  * @param pCmdBuffer
  * @param iCmdBufferSize
- * @param iTimeout  time out in seconds
  * @return: 
- *    -ETIMEDOUT - time out while waiting for the interface
+ *    >=0 if the execution was launched or the block was encoded
  *    <0 in case of error
  */
-int sendRcuCommand(char* pCmdBuffer, int iCmdBufferSize, int iTimeout)
+int startRcuCommand(char* pCmdBuffer, int iCmdBufferSize)
 {
   int iResult=0;
   int bSkipTest=(g_options&CHECK_COMMAND_BUFFER)==0; // the MIB reread function shall be skipped
   int bIgnoreTest=(g_options&IGNORE_BUFFER_CHECK)!=0; // the result of the MIB reread shall be ignored
-  int i;
-  int iDefaultTimeout=2;
-  int iSleepPeriod=10;
   if (pCmdBuffer && iCmdBufferSize>0){
     // debug option: print command sequence
     if (g_options&PRINT_COMMAND_BUFFER)
@@ -1169,35 +1392,8 @@ int sendRcuCommand(char* pCmdBuffer, int iCmdBufferSize, int iTimeout)
       if ((iResult=writeToMsgInBuffer(pCmdBuffer, iCmdBufferSize))>=0){
 	if ((g_dcscFlags&DCSC_INIT_ENCODE)==0) {
 	  if (bSkipTest || (iResult=checkMsginBuffer(pCmdBuffer, iCmdBufferSize, 0))>=0 || bIgnoreTest==1) {
-	    time_t startedTime, currentTime;
-	    float fLastDiff=0;
-	    time(&startedTime);
 	    // set the 'execute' flag to launch interpretation of the command sequence
 	    iResult=setDcscRegisterBit(GENERAL_CTRL_REG_ADDR, COMMAND_EXECUTE);
-	    if (iResult>=0 ) {
-	      // wait for the firmware to clear the 'execute' flag
-	      do {
-		if ((iResult=readDcscRegister(GENERAL_CTRL_REG_ADDR, 1))>0 && ((iResult&COMMAND_EXECUTE)==0)) {
-		  // print the content of the register if termination is not during the first loop, this is just for debugging purpose
-		  if (iResult>=0 && fLastDiff>=1.0 &&(g_options&PRINT_REGISTER_ACCESS)==0) {
-		    fprintf(stderr, "\n"); // print a terminating newline after the dots
-		  }
-		  break;
-		}
-		usleep(iSleepPeriod);
-		// check for time out
-		time(&currentTime);
-		float fDiff=difftime(currentTime, startedTime);
-		if (fDiff>=(iTimeout==0?iDefaultTimeout:iTimeout)) {
-		  if ((g_options&PRINT_REGISTER_ACCESS)==0 && fLastDiff>=1.0)
-		    fprintf(stderr, "\n");
-		  iResult=-ETIMEDOUT;
-		} else if (fDiff>=fLastDiff+1) {
-		  fLastDiff=fDiff;
-		  fprintf(stderr, ".");
-		}
-	      } while (iResult>=0);
-	    }
 	  } else {
 	    fprintf(stderr,"sendRcuCommand: command aborted\n");
 	  }
@@ -1211,6 +1407,67 @@ int sendRcuCommand(char* pCmdBuffer, int iCmdBufferSize, int iTimeout)
   return iResult;
 }
 
+/* second half of @ref sendRcuCommand: waits for the firmware to clear the COMMAND_EXECUTE flag
+ * internal function
+ * @param iTimeout  time out in seconds
+ * @return: 
+ *    -ETIMEDOUT - time out while waiting for the interface
+ *    <0 in case of error
+ */
+int waitRcuCommand(int iTimeout)
+{
+  int iResult=0;
+  int iDefaultTimeout=2;
+  int iSleepPeriod=10;
+  if (g_dcscFlags&DCSC_INIT_ENCODE) return 0;
+  time_t startedTime, currentTime;
+  float fLastDiff=0;
+  time(&startedTime);
+  // wait for the firmware to clear the 'execute' flag
+  do {
+    if ((iResult=readDcscRegister(GENERAL_CTRL_REG_ADDR, 1))>0 && ((iResult&COMMAND_EXECUTE)==0)) {
+      // print the content of the register if termination is not during the first loop, this is just for debugging purpose
+      if (iResult>=0 && fLastDiff>=1.0 &&(g_options&PRINT_REGISTER_ACCESS)==0) {
+	fprintf(stderr, "\n"); // print a terminating newline after the dots
+      }
+      break;
+    }
+    usleep(iSleepPeriod);
+    // check for time out
+    time(&currentTime);
+    float fDiff=difftime(currentTime, startedTime);
+    if (fDiff>=(iTimeout==0?iDefaultTimeout:iTimeout)) {
+      if ((g_options&PRINT_REGISTER_ACCESS)==0 && fLastDiff>=1.0)
+	fprintf(stderr, "\n");
+      iResult=-ETIMEDOUT;
+    } else if (fDiff>=fLastDiff+1) {
+      fLastDiff=fDiff;
+      fprintf(stderr, ".");
+    }
+  } while (iResult>=0);
+  return iResult;
+}
+
+/* backbone for all rcu access methods, the function writes a fully encoded block to the MIB,
+ * reads it back and checks it if desired, sets the COMMAND_EXECUTE flag and waits for the
+ * interface to be ready 
+ * internal function
+ * @param pCmdBuffer
+ * @param iCmdBufferSize
+ * @param iTimeout  time out in seconds
+ * @return: 
+ *    -ETIMEDOUT - time out while waiting for the interface
+ *    <0 in case of error
+ */
+int sendRcuCommand(char* pCmdBuffer, int iCmdBufferSize, int iTimeout)
+{
+  int iResult=startRcuCommand(pCmdBuffer, iCmdBufferSize);
+  if (iResult>=0 && (g_dcscFlags&DCSC_INIT_ENCODE)==0) {
+    iResult=waitRcuCommand(iTimeout);
+  }
+  return iResult;
+}
+
 /******************************************************************************************************
  * extended interface methods to support the flash access via the msg buffer interface
  */
@@ -1244,17 +1501,240 @@ int rcuSingleWriteExt(__u32 address, __u32 data, unsigned short mode){
   return iResult;
 }
 
+/******************************************************************************************************
+ * pack and swap kernels for the encoding of multiple write blocks
+ * the kernels process one 32 bit word per step (SIMD within a register), on hosts with SSE2 four
+ * words per step; the arm targets of the DCS board have no vector unit
+ * all kernels work in place as well, i.e. pTgt may be equal to pSrc
+ * the message buffer format is defined for the little endian arm, the same is assumed for the host
+ */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif //__SSE2__
+
+/* expand 8 bit data to one 32 bit word per data word
+ */
+static void packExpand8(__u32* pTgt, const unsigned char* pSrc, int iCount)
+{
+  int i=0;
+#ifdef __SSE2__
+  __m128i zero=_mm_setzero_si128();
+  for (; i+16<=iCount; i+=16) {
+    __m128i v=_mm_loadu_si128((const __m128i*)(pSrc+i));
+    __m128i lo=_mm_unpacklo_epi8(v, zero);
+    __m128i hi=_mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i*)(pTgt+i),    _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(pTgt+i+4),  _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(pTgt+i+8),  _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i*)(pTgt+i+12), _mm_unpackhi_epi16(hi, zero));
+  }
+#endif //__SSE2__
+  // the source is read word-wise once it is aligned
+  for (; i<iCount && ((unsigned long)(pSrc+i)&0x3)!=0; i++) pTgt[i]=pSrc[i];
+  for (; i+4<=iCount; i+=4) {
+    __u32 w=*(const __u32*)(pSrc+i);
+    pTgt[i]=w&0xff;
+    pTgt[i+1]=(w>>8)&0xff;
+    pTgt[i+2]=(w>>16)&0xff;
+    pTgt[i+3]=w>>24;
+  }
+  for (; i<iCount; i++) pTgt[i]=pSrc[i];
+}
+
+/* expand 16 bit data to one 32 bit word per data word, the two bytes of each
+ * data word are swapped if bSwap is set
+ */
+static void packExpand16(__u32* pTgt, const unsigned char* pSrc, int iCount, int bSwap)
+{
+  int i=0;
+#ifdef __SSE2__
+  __m128i zero=_mm_setzero_si128();
+  for (; i+8<=iCount; i+=8) {
+    __m128i v=_mm_loadu_si128((const __m128i*)(pSrc+2*i));
+    if (bSwap) v=_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128((__m128i*)(pTgt+i),   _mm_unpacklo_epi16(v, zero));
+    _mm_storeu_si128((__m128i*)(pTgt+i+4), _mm_unpackhi_epi16(v, zero));
+  }
+#endif //__SSE2__
+  if (((unsigned long)(pSrc+2*i)&0x3)==0) {
+    for (; i+2<=iCount; i+=2) {
+      __u32 w=*(const __u32*)(pSrc+2*i);
+      if (bSwap) w=((w&0x00ff00ff)<<8)|((w>>8)&0x00ff00ff);
+      pTgt[i]=w&0xffff;
+      pTgt[i+1]=w>>16;
+    }
+  }
+  for (; i<iCount; i++) {
+    if (bSwap) pTgt[i]=(pSrc[2*i]<<8)|pSrc[2*i+1];
+    else pTgt[i]=pSrc[2*i]|(pSrc[2*i+1]<<8);
+  }
+}
+
+/* swap the bytes within the 16 bit words, same as swab
+ */
+static void packSwapBytes(__u32* pTgt, const __u32* pSrc, int iCount)
+{
+  int i=0;
+#ifdef __SSE2__
+  for (; i+4<=iCount; i+=4) {
+    __m128i v=_mm_loadu_si128((const __m128i*)(pSrc+i));
+    _mm_storeu_si128((__m128i*)(pTgt+i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+#endif //__SSE2__
+  for (; i<iCount; i++) {
+    __u32 w=pSrc[i];
+    pTgt[i]=((w&0x00ff00ff)<<8)|((w>>8)&0x00ff00ff);
+  }
+}
+
+/* swap the two 16 bit words of each 32 bit word
+ */
+static void packSwapHalfWords(__u32* pTgt, const __u32* pSrc, int iCount)
+{
+  int i=0;
+#ifdef __SSE2__
+  for (; i+4<=iCount; i+=4) {
+    __m128i v=_mm_loadu_si128((const __m128i*)(pSrc+i));
+    v=_mm_shufflelo_epi16(v, 0xb1);
+    _mm_storeu_si128((__m128i*)(pTgt+i), _mm_shufflehi_epi16(v, 0xb1));
+  }
+#endif //__SSE2__
+  for (; i<iCount; i++) {
+    __u32 w=pSrc[i];
+    pTgt[i]=(w<<16)|(w>>16);
+  }
+}
+
+/* reverse the byte order of the 32 bit words, i.e. @ref packSwapBytes and
+ * @ref packSwapHalfWords in one pass
+ */
+static void packSwapWords(__u32* pTgt, const __u32* pSrc, int iCount)
+{
+  int i=0;
+#ifdef __SSE2__
+  for (; i+4<=iCount; i+=4) {
+    __m128i v=_mm_loadu_si128((const __m128i*)(pSrc+i));
+    v=_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v=_mm_shufflelo_epi16(v, 0xb1);
+    _mm_storeu_si128((__m128i*)(pTgt+i), _mm_shufflehi_epi16(v, 0xb1));
+  }
+#endif //__SSE2__
+  for (; i<iCount; i++) {
+    __u32 w=pSrc[i];
+    w=((w&0x00ff00ff)<<8)|((w>>8)&0x00ff00ff);
+    pTgt[i]=(w<<16)|(w>>16);
+  }
+}
+
+#ifdef __BENCHMARK
+/* the previous scalar pack code, reference for the conformance check and the benchmark
+ * iDataSize 1 and 2: expand to 32 bit words, iDataSize 4: swab and 16 bit word swap
+ * the data is read as unsigned char, as the arm compiler does for char
+ */
+static void packReference(__u32* pTgt, const __u32* pSrc, int iCount, int iDataMode)
+{
+  int iDataSize=iDataMode<0?-iDataMode:iDataMode;
+  int i=0;
+  if (iDataSize<4) {
+    int lsbOffset=iDataMode==-2?1:0;
+    int msbOffset=iDataMode==-2?0:1;
+    for (i=0; i<iCount; i++) {
+      pTgt[i]=*(((unsigned char*)pSrc)+i*iDataSize+lsbOffset);
+      if (iDataSize==2)
+	pTgt[i]+=(*(((unsigned char*)pSrc)+i*iDataSize+msbOffset))<<8;
+    }
+  } else {
+    swab(pSrc, pTgt, iCount*sizeof(__u32));
+    __u16 tmp=0;
+    __u16* pLsb=(__u16*)pTgt;
+    __u16* pMsb=((__u16*)pTgt); pMsb++;
+    for (i=0; i<iCount; i++) {
+      tmp=*pLsb;
+      *pLsb=*pMsb; pLsb+=2;
+      *pMsb=tmp; pMsb+=2;
+    }
+  }
+}
+
+/* the pack kernel for the same cases as @ref packReference
+ */
+static void packKernel(__u32* pTgt, const __u32* pSrc, int iCount, int iDataMode)
+{
+  int iDataSize=iDataMode<0?-iDataMode:iDataMode;
+  if (iDataSize==1) packExpand8(pTgt, (const unsigned char*)pSrc, iCount);
+  else if (iDataSize==2) packExpand16(pTgt, (const unsigned char*)pSrc, iCount, iDataMode==-2);
+  else packSwapWords(pTgt, pSrc, iCount);
+}
+
 /* interface method function, refer to dcscMsgBufferInterface.h for details
- * 
  */
-int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, unsigned short mode){
+int packBenchmark(int iSize, int iCycles)
+{
   int iResult=0;
-  if (pMib && mibSize>=6) {
-  if (pData==NULL) {
-    fprintf(stderr,"rcuMultipleWrite: invalid parameter\n");
-    return -EINVAL;
+  int modes[]={1, 2, -2, -4};
+  const char* names[]={"8 bit", "16 bit", "16 bit swapped", "32 bit swapped"};
+  int m=0, i=0, cycle=0, offset=0;
+  if (iSize<=0 || iCycles<=0) return -EINVAL;
+  // source with some slack for the unaligned conformance check
+  __u32* pSrc=(__u32*)malloc((iSize+4)*sizeof(__u32));
+  __u32* pRef=(__u32*)malloc(iSize*sizeof(__u32));
+  __u32* pTgt=(__u32*)malloc(iSize*sizeof(__u32));
+  if (pSrc && pRef && pTgt) {
+    for (i=0; i<(iSize+4)*(int)sizeof(__u32); i++) ((unsigned char*)pSrc)[i]=(unsigned char)(i*13+(i>>8));
+    for (m=0; m<(int)(sizeof(modes)/sizeof(int)) && iResult>=0; m++) {
+      int iDataSize=modes[m]<0?-modes[m]:modes[m];
+      // conformance for all source alignments and for counts which are not a multiple of
+      // the vector width, at least one word left for the check
+      for (offset=0; offset<4 && offset<iSize && iResult>=0; offset++) {
+	int iCount=iSize-offset;
+	const __u32* pSrcOffset=(const __u32*)(((unsigned char*)pSrc)+(iDataSize<4?offset:0));
+	packReference(pRef, pSrcOffset, iCount, modes[m]);
+	packKernel(pTgt, pSrcOffset, iCount, modes[m]);
+	if (memcmp(pRef, pTgt, iCount*sizeof(__u32))!=0) {
+	  fprintf(stderr, "pack %s: kernel differs from reference at offset %d\n", names[m], offset);
+	  iResult=-EFAULT;
+	}
+      }
+      struct timeval start, reference, kernel;
+      gettimeofday(&start, NULL);
+      for (cycle=0; cycle<iCycles; cycle++) packReference(pRef, pSrc, iSize, modes[m]);
+      gettimeofday(&reference, NULL);
+      for (cycle=0; cycle<iCycles; cycle++) packKernel(pTgt, pSrc, iSize, modes[m]);
+      gettimeofday(&kernel, NULL);
+      long usecReference=(reference.tv_sec-start.tv_sec)*1000000+(reference.tv_usec-start.tv_usec);
+      long usecKernel=(kernel.tv_sec-reference.tv_sec)*1000000+(kernel.tv_usec-reference.tv_usec);
+      fprintf(stderr, "pack %s %d words x %d: scalar %ld ns, kernel %ld ns\n",
+	      names[m], iSize, iCycles, usecReference*1000/iCycles, usecKernel*1000/iCycles);
+    }
+  } else {
+    iResult=-ENOMEM;
   }
+  if (pSrc) free(pSrc);
+  if (pRef) free(pRef);
+  if (pTgt) free(pTgt);
+  return iResult;
+}
+#endif //__BENCHMARK
 
+/* encode one block of a multiple write operation
+ * internal function
+ * @param pBlock           target buffer of size mibSize
+ * @param address          start address of the whole transfer
+ * @param pData            data of the whole transfer
+ * @param iSize            number of words of the whole transfer
+ * @param iDataMode        data size, negative if the data has to be swapped
+ * @param mode             command mode
+ * @param iBlockNo         number of the block to be encoded
+ * @param iNofBlocks       total number of blocks
+ * @param iMaxDataWordsPerBlock
+ * @param iCompFactor      number of words which fit into one 32 bit data word
+ * @return: size of the encoded block in byte
+ *    <0 in case of error
+ */
+int packMultipleWriteBlock(__u32* pBlock, __u32 address, __u32* pData, int iSize, int iDataMode, unsigned short mode,
+			   int iBlockNo, int iNofBlocks, int iMaxDataWordsPerBlock, int iCompFactor)
+{
+  int iResult=0;
   /* there was a not so smart first approach of the support of compressed data by the firmware,
    * unfortunately we chose a 'big endian' approach for the representation of the compressed
    * data within the msg buffer interface. Very unlucky, considered the little endian nature
@@ -1262,42 +1742,9 @@ int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, u
    * by the following switch: 1 indicates the big endian format, -1 the little endian
    */
   int switchBigEndianConversion=-1;
-
-  // the number of words which fit into one 32 bit data word
-  int iCompFactor=1;
   int iDataSize=iDataMode<0?-iDataMode:iDataMode;
-  //fprintf(stderr,"rcuMultipleWriteExt: data mode %d data size %d\n", iDataMode, iDataSize); 
-  switch (iDataSize) {
-  case 1: iCompFactor=4; break;
-  case 2: iCompFactor=2; break;
-  case 3: iCompFactor=3; break;
-  case 4: iCompFactor=1; break;
-  default:
-    fprintf(stderr,"rcuMultipleWrite: invalid dataSize\n");
-    return -EINVAL;
-  }
-  if (!g_bCompression) iCompFactor=1; // always 1 word if compression is disabled
+  __u32* arrayCmdWords=pBlock+1;
 
-  if (iDataMode<0 && iCompFactor==3) {
-    fprintf(stderr,"rcuMultipleWrite: swap is not supported for 10  bit compressed data\n");
-    return -EINVAL;
-  }
-
-  if (iDataMode==-1) {
-    fprintf(stderr,"rcuMultipleWrite warning: data swap has no effect to 8bit data\n");
-  }
-
-  __u32* arrayCmdWords=pMib+1;
-  // calculate the maximum possible number of data words
-  int iMaxDataWordsPerBlock=message_in_buffer_size/sizeof(__u32)-5;
-  iMaxDataWordsPerBlock*=iCompFactor;
-  // calculate the number of command blocks to be executed subsequently to write all the data
-  int iNofBlocks=(iSize-1)/iMaxDataWordsPerBlock+1;
-  int iBlockNo=0;
-  if (g_options&PRINT_SPLIT_DEBUG)
-    fprintf(stderr,"rcuMultipleWrite: write %d block(s) of maximum size %d with compression factor %d\n", iNofBlocks, iMaxDataWordsPerBlock, iCompFactor);
-  // write loop
-  for (;iBlockNo<iNofBlocks && iResult>=0; iBlockNo++) {
     // write the address to the first word of the block 
     arrayCmdWords[0]=address+iBlockNo*iMaxDataWordsPerBlock;
     // determine number of words to copy, calculate number of remaining data words if it is the last block
@@ -1310,6 +1757,11 @@ int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, u
     // size of the payload in the MIB between 'count' and 'marker'
     int iPayloadSize=arrayCmdWords[1]/iCompFactor;
 
+    // additional swap of the 16 bit words applies always to 32 bit data in 
+    // swap mode and to 16/8 bit compressed data
+    int bSwapHalfWords=(g_bCompression==1 && iDataMode<3*switchBigEndianConversion) || iDataMode==-4;
+    int iHalfWordsSwapped=0; // number of payload words which already got the 16 bit word swap
+
     if (g_bCompression==0 && iDataSize<4) {
       if (iDataSize==3) {
 	fprintf(stderr, "rcuMultipleWrite: 10-bit data format not supported when hardware compression is disabled\n");
@@ -1317,33 +1769,12 @@ int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, u
       } else {
       // special handling for 8 and 16 bit data, write the data to the block, beginning with an
       // offset of 2 (these two are occupied by address and number, refer to the command format)
-      int i=0;
-      for (i=0; i<arrayCmdWords[1]; i++) {
-	int lsbOffset=0;
-	int msbOffset=1;
-	if (iDataMode==-2) {
-	  lsbOffset=1;
-	  msbOffset=0;
-	}
-        // write lsbs of the data
-        arrayCmdWords[i+2]=0; 
-        arrayCmdWords[i+2]=*(((char*)pData)+(iBlockNo*iMaxDataWordsPerBlock+i)*iDataSize+lsbOffset);
-        if (iDataSize==2) {
-          // write msbs for 16bit data  
-          arrayCmdWords[i+2]+=(*(((char*)pData)+(iBlockNo*iMaxDataWordsPerBlock+i)*iDataSize+msbOffset))<<8;
-        }
+      const unsigned char* pSrc=((const unsigned char*)pData)+iBlockNo*iMaxDataWordsPerBlock*iDataSize;
+      if (iDataSize==2) {
+	packExpand16(&arrayCmdWords[2], pSrc, arrayCmdWords[1], iDataMode==-2);
+      } else {
+	packExpand8(&arrayCmdWords[2], pSrc, arrayCmdWords[1]);
       }
-/*      // check if there were stucking bits in other bytes of the block
-      for (i=0; i<arrayCmdWords[1]; i++) {
-        __u32 testPattern=0xffff0000;
-        if (iDataSize==1)
-        testPattern=0xffffff00;
-        if ((arrayCmdWords[i+2]&(testPattern))!=0) {
-          fprintf(stderr,"rcuMultipleWrite: error in data array\n");
-          iResult=-EILSEQ;
-          break;
-        }
-      }*/
       }
     } else {
       // just copy the data
@@ -1353,8 +1784,16 @@ int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, u
       // due to the 'big endian' format of the msg buffer 8bit data has to swapped always completely
       // as well as 16 bit and 32 bit words with 'swap' option
       if (iDataMode<1.5*switchBigEndianConversion) {
-	//fprintf(stderr, "swapping bytes\n");
-	swab(pSrc, &arrayCmdWords[2], iBulkCopy*sizeof(__u32));
+	if (bSwapHalfWords) {
+	  // both swaps in one pass
+	  packSwapWords(&arrayCmdWords[2], pSrc, iBulkCopy);
+	  iHalfWordsSwapped=iBulkCopy;
+	} else {
+	  packSwapBytes(&arrayCmdWords[2], pSrc, iBulkCopy);
+	}
+      } else if (bSwapHalfWords) {
+	packSwapHalfWords(&arrayCmdWords[2], pSrc, iBulkCopy);
+	iHalfWordsSwapped=iBulkCopy;
       } else {
 	memcpy (&arrayCmdWords[2], pSrc, iBulkCopy*sizeof(__u32));
       }
@@ -1366,40 +1805,105 @@ int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, u
       }
     }
 
-    if ((g_bCompression==1 && iDataMode<3*switchBigEndianConversion) || iDataMode==-4) {
-      // additional swap of the 16 bit words applies always to 32 bit data in 
-      // swap mode and to 16/8 bit compressed data
-      //fprintf(stderr, "swapping 16bit words\n");
-      __u16 tmp=0;
-      __u16* pLsb=(__u16*)&arrayCmdWords[2];
-      __u16* pMsb=((__u16*)&arrayCmdWords[2]); pMsb++;
-      int i=0;
-      for (i=0; i<iPayloadSize; i++) {
-	//fprintf(stderr, "%#x <-> %#x\n", *pLsb, *pMsb);
-	tmp=*pLsb;
-	*pLsb=*pMsb; pLsb+=2;
-	*pMsb=tmp; pMsb+=2;
-      }
+    if (bSwapHalfWords && iPayloadSize>iHalfWordsSwapped) {
+      packSwapHalfWords(&arrayCmdWords[2+iHalfWordsSwapped], &arrayCmdWords[2+iHalfWordsSwapped],
+			iPayloadSize-iHalfWordsSwapped);
     }
     if (g_options&PRINT_SPLIT_DEBUG)
     fprintf(stderr,"rcuMultipleWrite: write block no %d, size=%d, address=%#x\n", iBlockNo, arrayCmdWords[1], arrayCmdWords[0]);
     if (iResult>=0) {
-      pMib[0] = mkFrstWrd(iPayloadSize+2, 0, iCompFactor-1, mode, MULTI_WRITE);
-      pMib[iPayloadSize+3] = mkLstWrd(0);
-      pMib[iPayloadSize+4] = mkEndMarker();
-      lock_device();
-      iResult=sendRcuCommand((unsigned char*)pMib, (iPayloadSize+5)*4,0);
-      if(iResult==-ETIMEDOUT){
-        iResult=-1;
-        fprintf(stderr,"rcuMutipleWrite: time out while waiting for ready signal\n");
-      }
-      else{
-        if(iResult>=0){
-          iResult=getCmdResult(*(unsigned char*)pMib, "rcuMultipleWrite");
-        }
+      pBlock[0] = mkFrstWrd(iPayloadSize+2, 0, iCompFactor-1, mode, MULTI_WRITE);
+      pBlock[iPayloadSize+3] = mkLstWrd(0);
+      pBlock[iPayloadSize+4] = mkEndMarker();
+      iResult=(iPayloadSize+5)*4;
+    }
+  return iResult;
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ * 
+ * The blocks are executed within one lock session of the device. Two images of the
+ * MIB are used alternately: while the firmware executes block N, block N+1 is encoded
+ * into the other image, packing and hardware execution thus overlap.
+ */
+int rcuMultipleWriteExt(__u32 address, __u32* pData, int iSize, int iDataMode, unsigned short mode){
+  int iResult=0;
+  if (pMib && pMibStaging && mibSize>=6) {
+  if (pData==NULL) {
+    fprintf(stderr,"rcuMultipleWrite: invalid parameter\n");
+    return -EINVAL;
+  }
+
+  // the number of words which fit into one 32 bit data word
+  int iCompFactor=1;
+  int iDataSize=iDataMode<0?-iDataMode:iDataMode;
+  //fprintf(stderr,"rcuMultipleWriteExt: data mode %d data size %d\n", iDataMode, iDataSize); 
+  switch (iDataSize) {
+  case 1: iCompFactor=4; break;
+  case 2: iCompFactor=2; break;
+  case 3: iCompFactor=3; break;
+  case 4: iCompFactor=1; break;
+  default:
+    fprintf(stderr,"rcuMultipleWrite: invalid dataSize\n");
+    return -EINVAL;
+  }
+  if (!g_bCompression) iCompFactor=1; // always 1 word if compression is disabled
+
+  if (iDataMode<0 && iCompFactor==3) {
+    fprintf(stderr,"rcuMultipleWrite: swap is not supported for 10  bit compressed data\n");
+    return -EINVAL;
+  }
+
+  if (iDataMode==-1) {
+    fprintf(stderr,"rcuMultipleWrite warning: data swap has no effect to 8bit data\n");
+  }
+
+  // calculate the maximum possible number of data words
+  int iMaxDataWordsPerBlock=message_in_buffer_size/sizeof(__u32)-5;
+  iMaxDataWordsPerBlock*=iCompFactor;
+  // calculate the number of command blocks to be executed subsequently to write all the data
+  int iNofBlocks=(iSize-1)/iMaxDataWordsPerBlock+1;
+  int iBlockNo=0;
+  __u32* pBlocks[2]={pMib, pMibStaging};
+  int iBlockSize[2]={0, 0};
+  struct timeval start, stop;
+  if (g_options&PRINT_SPLIT_DEBUG) {
+    fprintf(stderr,"rcuMultipleWrite: write %d block(s) of maximum size %d with compression factor %d\n", iNofBlocks, iMaxDataWordsPerBlock, iCompFactor);
+    gettimeofday(&start, NULL);
+  }
+  iResult=iBlockSize[0]=packMultipleWriteBlock(pBlocks[0], address, pData, iSize, iDataMode, mode,
+					       0, iNofBlocks, iMaxDataWordsPerBlock, iCompFactor);
+  lock_device();
+  // write loop
+  for (;iBlockNo<iNofBlocks && iResult>=0; iBlockNo++) {
+    __u32* pBlock=pBlocks[iBlockNo%2];
+    iResult=startRcuCommand((char*)pBlock, iBlockSize[iBlockNo%2]);
+    if (iResult>=0 && iBlockNo+1<iNofBlocks) {
+      // prepare the next block while the firmware executes the current one
+      iBlockSize[(iBlockNo+1)%2]=packMultipleWriteBlock(pBlocks[(iBlockNo+1)%2], address, pData, iSize, iDataMode, mode,
+							iBlockNo+1, iNofBlocks, iMaxDataWordsPerBlock, iCompFactor);
+    }
+    if (iResult>=0) {
+      iResult=waitRcuCommand(0);
+    }
+    if(iResult==-ETIMEDOUT){
+      iResult=-1;
+      fprintf(stderr,"rcuMutipleWrite: time out while waiting for ready signal\n");
+    }
+    else{
+      if(iResult>=0){
+	iResult=getCmdResult(*(unsigned char*)pBlock, "rcuMultipleWrite");
       }
-      unlock_device();
     }
+    if (iResult>=0 && iBlockNo+1<iNofBlocks && iBlockSize[(iBlockNo+1)%2]<0) {
+      iResult=iBlockSize[(iBlockNo+1)%2];
+    }
+  }
+  unlock_device();
+  if ((g_options&PRINT_SPLIT_DEBUG) && iResult>=0) {
+    gettimeofday(&stop, NULL);
+    long usec=(stop.tv_sec-start.tv_sec)*1000000+(stop.tv_usec-start.tv_usec);
+    fprintf(stderr,"rcuMultipleWrite: %d word(s) in %ld us (%.1f kwords/s)\n", iSize, usec, usec>0?(1000.*iSize)/usec:0.);
   }
   } else {
     iResult=-EBADFD;
@@ -1469,7 +1973,8 @@ int rcuMultipleReadExt(__u32 address, int iSize, __u32* pData, unsigned short mo
   if (g_options&PRINT_SPLIT_DEBUG)
     fprintf(stderr,"rcuMultipleRead: read %d block(s) of maximum size %d\n", iNofBlocks, iMaxDataWordsPerBlock);
 
-  // read loop
+  // read loop, all blocks are executed within one lock session
+  lock_device();
   for (;iBlockNo<iNofBlocks && iResult>=0; iBlockNo++) {
     // write start address of the current block to first word of command buffer 
     arrayCmdWords[0]=address+iBlockNo*iMaxDataWordsPerBlock;
@@ -1489,7 +1994,6 @@ int rcuMultipleReadExt(__u32 address, int iSize, __u32* pData, unsigned short mo
     pMib[0]=mkFrstWrd(2, 0, 0, mode, MULTI_READ);
     pMib[3]=mkLstWrd(0);
     pMib[4]=mkEndMarker();
-    lock_device();
     iResult=sendRcuCommand((unsigned char*)pMib, 5*4, 0);
     if(iResult==-ETIMEDOUT){
       fprintf(stderr,"rcuMultipleRead: time out while waiting for ready signal\n");
@@ -1511,8 +2015,8 @@ int rcuMultipleReadExt(__u32 address, int iSize, __u32* pData, unsigned short mo
 	}
       }
     }
-    unlock_device();
   }
+  unlock_device();
   } else {
     iResult=-EBADFD;
   }
@@ -1558,6 +2062,67 @@ int rcuMultipleRead(__u32 address, int iSize, __u32* pData)
   return iResult;
 }
 
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ * 
+ */
+int rcuSingleOperations(TrcuSingleOp* pOps, int iNofOps)
+{
+  int iResult=0;
+  int iSequences=0;
+  int iOp=0;
+  if (pOps==NULL || iNofOps<0) return -EINVAL;
+  if (pMib==NULL || mibSize<6) return -EBADFD;
+  // two words of the result buffer are information and status word
+  int iMaxReads=mrbSize-2;
+  while (iOp<iNofOps && iResult>=0) {
+    int iWords=0;
+    int iReads=0;
+    int iFirstRead=-1;
+    int iBlock=0;
+    // pack programming blocks as long as they fit together with the end marker
+    for (; iOp<iNofOps; iOp++, iBlock++) {
+      int bRead=pOps[iOp].pData!=NULL;
+      if (iWords+(bRead?3:4)+1>mibSize || (bRead && iReads>=iMaxReads)) break;
+      pMib[iWords++]=mkFrstWrd(bRead?1:2, iBlock, 0, MSGBUF_MODE_MEMMAPPED, bRead?SINGLE_READ:SINGLE_WRITE);
+      pMib[iWords++]=pOps[iOp].address;
+      if (bRead==0) pMib[iWords++]=pOps[iOp].data;
+      pMib[iWords++]=mkLstWrd(0);
+      if (bRead && iReads++==0) iFirstRead=iOp;
+    }
+    pMib[iWords++]=mkEndMarker();
+    if (g_options&PRINT_SPLIT_DEBUG)
+      fprintf(stderr,"rcuSingleOperations: sequence %d with %d block(s), %d read(s)\n", iSequences, iBlock, iReads);
+    lock_device();
+    iResult=sendRcuCommand((unsigned char*)pMib, iWords*sizeof(__u32), 0);
+    if(iResult==-ETIMEDOUT){
+      fprintf(stderr,"rcuSingleOperations: time out while waiting for ready signal\n");
+    } else if (iResult>=0 && (g_dcscFlags&DCSC_INIT_ENCODE)==0) {
+      if ((iResult=getCmdResult(*(unsigned char*)pMib, "rcuSingleOperations"))>=0) {
+	if (iResult!=iReads) {
+	  fprintf(stderr,"rcuSingleOperations: %d data word(s) in result buffer, %d expected\n", iResult, iReads);
+	  iResult=-EIO;
+	} else if (iReads>0) {
+	  if ((iResult=readResultBuffer((unsigned char*)(pMrb+2), iReads*sizeof(__u32), 2*sizeof(__u32)))>=0) {
+	    // scatter the data words to the read operations of the sequence
+	    int iData=2;
+	    int i=iFirstRead;
+	    for (; i<iOp; i++) {
+	      if (pOps[i].pData) *(pOps[i].pData)=pMrb[iData++];
+	    }
+	  } else {
+	    fprintf(stderr,"rcuSingleOperations: failed to read data from result buffer\n");
+	    iResult=-EIO;
+	  }
+	}
+      }
+    }
+    unlock_device();
+    if (iResult>=0) iSequences++;
+  }
+  if (iResult>=0) iResult=iSequences;
+  return iResult;
+}
+
 /* interface method function, refer to dcscMsgBufferInterface.h for details
  * not yet implemented
  */
@@ -2107,6 +2672,8 @@ int msgBufWriteRegister(int reg, unsigned char value)
 #define RCU_FLASH_ID_LADDR  0x1   // the id code is located in the address 0x1
 
 #define RCU_FLASH_NOF_SECTORS 1024// TODO fix that number!
+#define RCU_FLASH_PROGRAM_BLOCK 0x1000 // words compared and verified in one go by rcuFlashProgram
+#define RCU_FLASH_WORD_MASK     0xffff
 
 #define RCU_FLASH_STATE_IDLE 0x0
 #define RCU_FLASH_STATE_BUSY 0x4000
@@ -2123,7 +2690,7 @@ int rcuFlashWrite(__u32 address, __u32* pData, int iSize, int iDataSize)
     lock_device();
     /* check the mode */
     if (checkState(eFlash, 3)) {
-      if (address+iSize<RCU_FLASH_SIZE) {
+      if (address+iSize<=RCU_FLASH_SIZE) {
 	if (g_iFlashAccessMode==eFlashAccessDcsc) {
 	  // dcs board fw 2.2 or higher support direct flash access
 	  iResult=rcuMultipleWriteExt(address, pData, iSize, iDataSize, MSGBUF_MODE_FLASH);
@@ -2222,7 +2789,7 @@ int rcuFlashRead(__u32 address, int iSize,__u32* pData)
     /* enable the flash */
     /* check the mode */
     if (checkState(eFlash, 3)) {
-      if (address+iSize<RCU_FLASH_SIZE) {
+      if (address+iSize<=RCU_FLASH_SIZE) {
 	if (g_iFlashAccessMode==eFlashAccessDcsc) {
 	  if (g_verbosity>1)
 	    fprintf(stderr, "using flash access via dcs firmware\n");
@@ -2338,7 +2905,7 @@ int rcuFlashErase(int startSec, int count)
 	  }
 	  pMib[k++]=mkLstWrd(0);
 	  pMib[k++]=mkEndMarker();
-	  int iResult=sendRcuCommand((unsigned char*)pMib, k*4, iTimeOut);
+	  iResult=sendRcuCommand((unsigned char*)pMib, k*4, iTimeOut);
 	  if(iResult==-ETIMEDOUT){
 	    iResult=-1;
 	    fprintf(stderr,"rcuFlashErase: time out while waiting for ready signal\n");
@@ -2410,10 +2977,251 @@ int rcuFlashErase(int startSec, int count)
     } else {
       iResult=-EACCES;
     }
-    lock_device();
+    unlock_device();
+  }
+  return iResult;
+}
+
+/* the flash access functions used by @ref flashProgram
+ */
+typedef int (*TflashReadFct)(__u32 address, int iSize, __u32* pData);
+typedef int (*TflashWriteFct)(__u32 address, __u32* pData, int iSize, int iDataSize);
+
+/* program an image into the flash by means of the given access functions
+ * internal function, the implementation of @ref rcuFlashProgram
+ *
+ * All flash words are kept in 32 bit words in the block buffers, this is the format
+ * of @ref rcuFlashRead and both flash access modes accept it for writing.
+ * Programming can only clear bits, a word which needs a bit to be set again
+ * requires an erase. The sector layout of the flash is not known reliably,
+ * the function thus never erases but refuses such an image.
+ */
+static int flashProgram(__u32 address, __u32* pData, int iSize, int iDataSize, TrcuFlashProgramStat* pStat,
+			TflashReadFct pfRead, TflashWriteFct pfWrite)
+{
+  int iResult=0;
+  TrcuFlashProgramStat stat;
+  memset(&stat, 0, sizeof(stat));
+  if (pData==NULL || iSize<=0 || (iDataSize!=2 && iDataSize!=4)) {
+    fprintf(stderr, "rcuFlashProgram error: invalid parameter\n");
+    return -EINVAL;
+  }
+  if (address+iSize>RCU_FLASH_SIZE) {
+    fprintf(stderr, "rcuFlashProgram error: image exceeds flash address range (address=%#x count=%d flash size %#x \n", address, iSize, RCU_FLASH_SIZE);
+    return -EINVAL;
+  }
+  __u32* pFlash=(__u32*)malloc(RCU_FLASH_PROGRAM_BLOCK*sizeof(__u32));
+  __u32* pImage=(__u32*)malloc(RCU_FLASH_PROGRAM_BLOCK*sizeof(__u32));
+  if (pFlash==NULL || pImage==NULL) {
+    free(pFlash);
+    free(pImage);
+    return -ENOMEM;
+  }
+  struct timeval start, now;
+  gettimeofday(&start, NULL);
+  int offset=0;
+  for (; offset<iSize && iResult>=0; offset+=RCU_FLASH_PROGRAM_BLOCK) {
+    __u32 blockAddress=address+offset;
+    int blockSize=iSize-offset;
+    if (blockSize>RCU_FLASH_PROGRAM_BLOCK) blockSize=RCU_FLASH_PROGRAM_BLOCK;
+    int i=0;
+    for (i=0; i<blockSize; i++) {
+      if (iDataSize==2) pImage[i]=((__u16*)pData)[offset+i];
+      else pImage[i]=pData[offset+i]&RCU_FLASH_WORD_MASK;
+    }
+    stat.nofBlocks++;
+
+    // read back the block, only the words of the image are touched
+    if ((iResult=(*pfRead)(blockAddress, blockSize, pFlash))<0) {
+      fprintf(stderr, "rcuFlashProgram error: can not read %d words at %#x (%d)\n", blockSize, blockAddress, iResult);
+      break;
+    }
+    int nofDiffer=0;
+    for (i=0; i<blockSize; i++) {
+      pFlash[i]&=RCU_FLASH_WORD_MASK;
+      if (pFlash[i]==pImage[i]) continue;
+      if ((pFlash[i]&pImage[i])!=pImage[i]) {
+	fprintf(stderr, "rcuFlashProgram error: word %#x needs an erase (flash %#x, image %#x), erase the flash first\n", blockAddress+i, pFlash[i], pImage[i]);
+	iResult=-ENOTEMPTY;
+	break;
+      }
+      nofDiffer++;
+    }
+    if (iResult<0) break;
+    if (nofDiffer==0) {
+      stat.nofSkipped++;
+      continue;
+    }
+    unsigned short crcImage=crc16((char*)pImage, blockSize*sizeof(__u32));
+
+    // write only the words which differ from the flash content, in maximal runs
+    int first=0;
+    while (first<blockSize && iResult>=0) {
+      for (; first<blockSize && pImage[first]==pFlash[first]; first++) {/* skip */}
+      int last=first;
+      for (; last<blockSize && pImage[last]!=pFlash[last]; last++) {/* count */}
+      if (last>first) {
+	if ((iResult=(*pfWrite)(blockAddress+first, pImage+first, last-first, 4))<0) {
+	  fprintf(stderr, "rcuFlashProgram error: can not write %d words at %#x (%d)\n", last-first, blockAddress+first, iResult);
+	}
+	stat.nofWords+=last-first;
+      }
+      first=last;
+    }
+    if (iResult<0) break;
+    stat.nofWritten++;
+
+    // verify the block by the checksum of the read back data
+    if ((iResult=(*pfRead)(blockAddress, blockSize, pFlash))>=0) {
+      for (i=0; i<blockSize; i++) pFlash[i]&=RCU_FLASH_WORD_MASK;
+      if (crc16((char*)pFlash, blockSize*sizeof(__u32))!=crcImage) {
+	fprintf(stderr, "rcuFlashProgram error: verification of %d words at %#x failed\n", blockSize, blockAddress);
+	iResult=-EIO;
+      }
+    } else {
+      fprintf(stderr, "rcuFlashProgram error: can not read back %d words at %#x (%d)\n", blockSize, blockAddress, iResult);
+    }
+  }
+  gettimeofday(&now, NULL);
+  stat.totalTime=(now.tv_sec-start.tv_sec)*1000000+(now.tv_usec-start.tv_usec);
+  free(pFlash);
+  free(pImage);
+  if (g_verbosity>0) {
+    fprintf(stderr, "rcuFlashProgram: %d block(s), %d unchanged, %d written (%d words) in %ld us\n",
+	    stat.nofBlocks, stat.nofSkipped, stat.nofWritten, stat.nofWords, stat.totalTime);
+  }
+  if (pStat) memcpy(pStat, &stat, sizeof(stat));
+  if (iResult>=0) iResult=stat.nofWritten;
+  return iResult;
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int rcuFlashProgram(__u32 address, __u32* pData, int iSize, int iDataSize, TrcuFlashProgramStat* pStat)
+{
+  return flashProgram(address, pData, iSize, iDataSize, pStat, rcuFlashRead, rcuFlashWrite);
+}
+
+#ifdef __BENCHMARK
+/* flash model for @ref flashProgramBenchmark, a write can only clear bits
+ */
+static __u32* g_pFlashModel=NULL;
+static int g_flashModelSize=0;
+static int g_flashModelWrites=0;
+static int g_flashModelAccesses=0;
+
+static int flashModelRead(__u32 address, int iSize, __u32* pData)
+{
+  int i=0;
+  if (address+iSize>(__u32)g_flashModelSize) return -EINVAL;
+  for (i=0; i<iSize; i++) pData[i]=g_pFlashModel[address+i];
+  g_flashModelAccesses++;
+  return iSize;
+}
+
+static int flashModelWrite(__u32 address, __u32* pData, int iSize, int iDataSize)
+{
+  int i=0;
+  if (address+iSize>(__u32)g_flashModelSize || iDataSize!=4) return -EINVAL;
+  for (i=0; i<iSize; i++) g_pFlashModel[address+i]&=pData[i]&RCU_FLASH_WORD_MASK;
+  g_flashModelWrites+=iSize;
+  g_flashModelAccesses++;
+  return iSize;
+}
+
+/* program the image into the model and check the content
+ * the words outside [address, address+iSize) have to stay erased
+ */
+static int flashProgramModel(__u32 address, __u16* pImage, int iSize, TrcuFlashProgramStat* pStat)
+{
+  int iResult=0;
+  int i=0;
+  g_flashModelWrites=0;
+  g_flashModelAccesses=0;
+  if ((iResult=flashProgram(address, (__u32*)pImage, iSize, 2, pStat, flashModelRead, flashModelWrite))>=0) {
+    for (i=0; i<g_flashModelSize && iResult>=0; i++) {
+      if ((__u32)i>=address && (__u32)i<address+iSize) {
+	if (g_pFlashModel[i]!=pImage[i-address]) iResult=-EFAULT;
+      } else if (g_pFlashModel[i]!=RCU_FLASH_WORD_MASK) {
+	iResult=-EFAULT;
+      }
+    }
+    if (iResult<0) fprintf(stderr, "flash program: model content differs at %#x\n", i-1);
+  }
+  return iResult;
+}
+
+/* interface method function, refer to dcscMsgBufferInterface.h for details
+ */
+int flashProgramBenchmark(int iSize, int iChanged)
+{
+  int iResult=0;
+  int i=0;
+  TrcuFlashProgramStat stat;
+  // the image starts in the middle of a block, the words around have to survive
+  __u32 address=RCU_FLASH_PROGRAM_BLOCK/2+1;
+  if (iSize<=0 || iChanged<0 || iChanged>iSize) return -EINVAL;
+  g_flashModelSize=address+iSize+RCU_FLASH_PROGRAM_BLOCK;
+  g_pFlashModel=(__u32*)malloc(g_flashModelSize*sizeof(__u32));
+  __u16* pImage=(__u16*)malloc(iSize*sizeof(__u16));
+  if (g_pFlashModel && pImage) {
+    for (i=0; i<g_flashModelSize; i++) g_pFlashModel[i]=RCU_FLASH_WORD_MASK;
+    for (i=0; i<iSize; i++) pImage[i]=(__u16)(i*0x3d+(i>>4));
+
+    // erased flash: every block with words of the image is written
+    if ((iResult=flashProgramModel(address, pImage, iSize, &stat))>=0 &&
+	(stat.nofSkipped!=0 || stat.nofWritten!=stat.nofBlocks)) {
+      iResult=-EFAULT;
+    }
+    int nofWordsErased=stat.nofWords;
+    int nofAccessesErased=g_flashModelAccesses;
+
+    // the same image again: nothing is written
+    if (iResult>=0 &&
+	(iResult=flashProgramModel(address, pImage, iSize, &stat))>=0 &&
+	(stat.nofSkipped!=stat.nofBlocks || g_flashModelWrites!=0)) {
+      iResult=-EFAULT;
+    }
+
+    // an update which only clears bits: only the changed words are written
+    for (i=0; i<iChanged; i++) {
+      int k=i*(iSize/iChanged);
+      pImage[k]&=pImage[k]-1; // the lowest bit which is set
+    }
+    int nofChanged=0;
+    if (iResult>=0) {
+      for (i=0; i<iSize; i++) nofChanged+=(g_pFlashModel[address+i]!=pImage[i]);
+      if ((iResult=flashProgramModel(address, pImage, iSize, &stat))>=0 &&
+	  (stat.nofWords!=nofChanged || g_flashModelWrites!=nofChanged)) {
+	iResult=-EFAULT;
+      }
+    }
+    int nofAccessesChanged=g_flashModelAccesses;
+
+    // an image which needs a bit to be set is refused without touching the flash
+    for (i=iSize-1; i>=0 && pImage[i]==RCU_FLASH_WORD_MASK; i--) {/* search */}
+    if (iResult>=0 && i>=0) {
+      pImage[i]=RCU_FLASH_WORD_MASK;
+      if (flashProgramModel(address, pImage, iSize, &stat)!=-ENOTEMPTY ||
+	  g_flashModelWrites!=0) {
+	iResult=-EFAULT;
+      }
+    }
+
+    // the previous procedure erased the flash and wrote the whole image
+    fprintf(stderr, "flash program %d words: erased flash %d word(s) written in %d access(es), "
+	    "update %d word(s) written in %d access(es), erase and write %d word(s)\n",
+	    iSize, nofWordsErased, nofAccessesErased, nofChanged, nofAccessesChanged, iSize);
+  } else {
+    iResult=-ENOMEM;
   }
+  if (g_pFlashModel) free(g_pFlashModel);
+  g_pFlashModel=NULL;
+  g_flashModelSize=0;
+  if (pImage) free(pImage);
   return iResult;
 }
+#endif //__BENCHMARK
 
 int rcuFlashID()
 {
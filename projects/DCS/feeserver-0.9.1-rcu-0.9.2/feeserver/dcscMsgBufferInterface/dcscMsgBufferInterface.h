@@ -452,7 +452,8 @@ int rcuSingleRead(__u32 address, __u32* pData);
 /**
  * Write a number of 32bit words beginning at a location.
  * The function takes care for the size of the MIB and splits the operation if
- * the amount of data to write exceeds the MIB size.
+ * the amount of data to write exceeds the MIB size. All blocks are executed within
+ * one lock session, the next block is encoded while the current one is executed.
  * The function expects data in little endian byte order
  * @param address   16 bit address in RCU memory space
  * @param pData     buffer containing the data
@@ -475,6 +476,39 @@ int rcuMultipleWrite(__u32 address, __u32* pData, int iSize, int iDataSize);
  */
 int rcuMultipleRead(__u32 address, int iSize,__u32* pData);
 
+/**
+ * @struct rcuSingleOp_t
+ * Descriptor of a single read or write operation for @ref rcuSingleOperations.
+ * <!-- @ingroup dcsc_msg_buffer_access -->
+ */
+struct rcuSingleOp_t {
+  /** 16 bit address in RCU memory space */
+  __u32 address;
+  /** data word of a write operation */
+  __u32 data;
+  /** buffer to receive the data of a read operation, NULL for a write operation */
+  __u32* pData;
+};
+
+/**
+ * Type definition for single operation descriptors.
+ * @ingroup dcsc_msg_buffer_access
+ */
+typedef struct rcuSingleOp_t TrcuSingleOp;
+
+/**
+ * Execute a list of single read and write operations.
+ * Each operation is encoded as one programming block. As many blocks as the
+ * MIB can take (and the MRB can answer) are packed into one command sequence,
+ * which is executed with one execute/poll cycle. The data of the read operations
+ * is scattered to the buffers of the descriptors.
+ * @param pOps      array of operation descriptors
+ * @param iNofOps   number of operations
+ * @return          number of executed command sequences, neg. error code if failed
+ * @ingroup dcsc_msg_buffer_access
+ */
+int rcuSingleOperations(TrcuSingleOp* pOps, int iNofOps);
+
 /**
  * Provide the message buffer for direct access.
  * Creation and destruction of the buffer is handled by the interface internally
@@ -589,11 +623,117 @@ enum {
 
 /**
  * Lock the driver
+ * An @ref eUnlock releases the lock of the calling thread; it fails with
+ * -EPERM if another thread of the process holds the lock.
  * @param cmd   operation id   
  * @ingroup dcsc_msg_buffer_access
  */
 int dcscLockCtrl(int cmd);
 
+/**
+ * Begin a session on the device.
+ * The device is locked for the calling thread until the matching
+ * @ref dcscEndSession. All transactions within the session use the lock
+ * of the session, the driver lock is taken only once for a sequence of
+ * operations. Other threads of the process are blocked until the session
+ * ends, other processes by the driver lock. Sessions can be nested.
+ * A failed call does not open a session and must not be matched by
+ * @ref dcscEndSession.
+ * @return neg. error code if failed
+ * @ingroup dcsc_msg_buffer_access
+ */
+int dcscBeginSession();
+
+/**
+ * End a session on the device.
+ * @return neg. error code if failed, -EPERM if the session is owned by
+ *         another thread
+ * @ingroup dcsc_msg_buffer_access
+ */
+int dcscEndSession();
+
+/**
+ * Get the number of driver lock operations.
+ * Statistics for the efficiency of sessions.
+ * @return number of driver lock operations since start
+ * @ingroup dcsc_msg_buffer_access
+ */
+int dcscDriverLockCount();
+
+/** initial value of the CRC16 register */
+#define CRC16_INIT 0xffff
+
+/**
+ * Calculate the CRC16 checksum of a buffer.
+ * Reflected CRC16 with polynomial 0x8408, table driven (slicing-by-4).
+ * @param data_p    the data
+ * @param length    size of the data in bytes
+ * @return checksum
+ * @ingroup dcsc_msg_buffer_access
+ */
+unsigned short crc16(char *data_p, int length);
+
+/**
+ * Fold data into a CRC16 register.
+ * The checksum of data which is available in pieces is calculated by
+ * starting with @ref CRC16_INIT, calling the function for each piece and
+ * applying @ref crc16Final to the register.
+ * @param crc       the current register
+ * @param data_p    the data
+ * @param length    size of the data in bytes
+ * @return the updated register
+ * @ingroup dcsc_msg_buffer_access
+ */
+unsigned short crc16Update(unsigned short crc, const char *data_p, int length);
+
+/**
+ * Convert a CRC16 register to the checksum.
+ * @param crc       the register
+ * @return checksum, same as the one of @ref crc16
+ * @ingroup dcsc_msg_buffer_access
+ */
+unsigned short crc16Final(unsigned short crc);
+
+#ifdef __BENCHMARK
+/**
+ * Compare the bit-by-bit and the table driven CRC16.
+ * Prints the time per checksum of iSize bytes for both implementations and
+ * checks that the results agree.
+ * @param iSize     number of bytes
+ * @param iCycles   number of checksums to average
+ * @return neg. error code if failed, -EFAULT if the checksums differ
+ * @ingroup dcsc_msg_buffer_access
+ */
+int crc16Benchmark(int iSize, int iCycles);
+
+/**
+ * Check and benchmark the pack kernels of the multiple write.
+ * Compares the kernels for 8 bit, 16 bit, swapped 16 bit and swapped 32 bit
+ * data with the previous scalar code for all source alignments and prints
+ * the time per block of iSize words for both.
+ * @param iSize     number of data words
+ * @param iCycles   number of blocks to average
+ * @return neg. error code if failed, -EFAULT if the results differ
+ * @ingroup dcsc_msg_buffer_access
+ */
+int packBenchmark(int iSize, int iCycles);
+
+/**
+ * Check @ref rcuFlashProgram against a model of the flash.
+ * The image is programmed into the erased flash, programmed again without
+ * change, updated in iChanged words which only clear bits, and finally
+ * changed in a word which needs an erase. Each run checks the statistics,
+ * the written words and that no word outside the image is touched.
+ * Prints the number of written words and flash accesses compared with an
+ * erase and write of the whole image.
+ * @param iSize     number of words of the image
+ * @param iChanged  number of words changed by the update
+ * @return neg. error code if failed, -EFAULT if a check failed
+ * @ingroup dcsc_msg_buffer_access
+ */
+int flashProgramBenchmark(int iSize, int iChanged);
+#endif //__BENCHMARK
+
 /**
  * Set debug flags for the driver
  * @param flags driver debug message id
@@ -705,6 +845,46 @@ int rcuFlashRead(__u32 address, int iSize,__u32* pData);
  */
 int rcuFlashErase(int startSec, int stopSec);
 
+/**
+ * @struct rcuFlashProgramStat_t
+ * Statistics of an @ref rcuFlashProgram operation.
+ * <!-- @ingroup dcsc_msg_buffer_access -->
+ */
+struct rcuFlashProgramStat_t {
+  /** number of blocks of the image */
+  int nofBlocks;
+  /** number of blocks which already contained the image */
+  int nofSkipped;
+  /** number of blocks which have been written */
+  int nofWritten;
+  /** number of words which have been written */
+  int nofWords;
+  /** total time of the operation in micro seconds */
+  long totalTime;
+};
+typedef struct rcuFlashProgramStat_t TrcuFlashProgramStat;
+
+/**
+ * Program an image into the RCU flash.
+ * The image is processed in blocks of 4k words. Each block is read back and
+ * compared to the image, blocks which already contain the image are skipped.
+ * Only the words which differ are written, in maximal runs. Programming can
+ * only clear bits, the function does not erase: if a word of the image
+ * needs a bit which is cleared in the flash, it fails with -ENOTEMPTY and
+ * the flash has to be erased by @ref rcuFlashErase first. Blocks before the
+ * failing one are already programmed in that case. Words outside the image
+ * are not touched. Each written block is verified by the checksum of the
+ * read back data.
+ * @param address    start location
+ * @param pData      buffer containing the image
+ * @param iSize      number of words in the image
+ * @param iDataSize  size of one word in bytes, allowed 2,4
+ * @param pStat      optional target for the statistics of the operation
+ * @return number of written blocks, neg. error code if failed
+ * @ingroup dcsc_msg_buffer_access
+ */
+int rcuFlashProgram(__u32 address, __u32* pData, int iSize, int iDataSize, TrcuFlashProgramStat* pStat);
+
 /************************************************************************************************************/
 
 /**
@@ -783,6 +963,7 @@ void printBufferHexFormatted(unsigned char *pBuffer, int iBufferSize, int iWordS
 #define PRINT_RESULT_BUFFER         0x02
 /**
  * Test the MIB after writing the command buffer to it.
+ * See @ref CHECK_COMMAND_BUFFER_FULL for the verification methods.
  * @ingroup dcsc_msg_buffer_access
  */
 #define CHECK_COMMAND_BUFFER        0x04
@@ -821,6 +1002,13 @@ void printBufferHexFormatted(unsigned char *pBuffer, int iBufferSize, int iWordS
  * @ingroup dcsc_msg_buffer_access
  */
 #define DBG_CHECK_COMMAND           0x400
+/**
+ * Read back the complete MIB for the check of the command buffer.
+ * By default, the @ref CHECK_COMMAND_BUFFER check reads back the header,
+ * the last word and a few sampled words of the block.
+ * @ingroup dcsc_msg_buffer_access
+ */
+#define CHECK_COMMAND_BUFFER_FULL   0x800
 
 /**
  * The default debug flags.
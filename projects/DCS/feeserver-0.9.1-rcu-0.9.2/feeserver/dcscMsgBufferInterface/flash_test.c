@@ -0,0 +1,57 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+/*
+ * flash_test.c
+ *
+ * Programming of the RCU flash without sector erase, checked by
+ * @ref flashProgramBenchmark against a model of the flash.
+ *
+ * Images shorter than one block of rcuFlashProgram, spanning a block
+ * boundary and spanning several blocks are programmed into the erased
+ * flash, programmed again, updated and finally refused because of a word
+ * which needs an erase. The written words and flash accesses are printed
+ * for each image.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#define __BENCHMARK /* the benchmark functions of the interface */
+#include <stdio.h>
+#include "dcscMsgBufferInterface.h"
+
+static int g_failures=0;
+
+static void check(int cond, const char* what, int iSize)
+{
+  printf("%s: %s, %d words\n", cond?"ok  ":"FAIL", what, iSize);
+  if (!cond) g_failures++;
+}
+
+int main()
+{
+  int sizes[]={1, 100, 0x1000, 0x1001, 0x3000};
+  int changed[]={0, 3, 16, 16, 100};
+  int i=0;
+  for (i=0; i<(int)(sizeof(sizes)/sizeof(int)); i++) {
+    check(flashProgramBenchmark(sizes[i], changed[i])>=0, "flash programmed without erase", sizes[i]);
+  }
+  printf("flash_test: %d failures\n", g_failures);
+  return g_failures?1:0;
+}
@@ -0,0 +1,60 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+/*
+ * pack_test.c
+ *
+ * The pack kernels of the multiple write compared with the previous scalar
+ * code by @ref packBenchmark.
+ *
+ * All block sizes up to a few vector widths are checked, including the
+ * ones shorter than the source alignments, and some larger blocks. The
+ * times of both implementations are printed for each size.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#define __BENCHMARK /* the benchmark functions of the interface */
+#include <stdio.h>
+#include "dcscMsgBufferInterface.h"
+
+#define PACK_TEST_MAX_SHORT 33
+#define PACK_TEST_CYCLES    100
+
+static int g_failures=0;
+
+static void check(int cond, const char* what, int iSize)
+{
+  printf("%s: %s, %d words\n", cond?"ok  ":"FAIL", what, iSize);
+  if (!cond) g_failures++;
+}
+
+int main()
+{
+  int sizes[]={256, 1000, 4096};
+  int i=0;
+  for (i=1; i<=PACK_TEST_MAX_SHORT; i++) {
+    check(packBenchmark(i, PACK_TEST_CYCLES)>=0, "pack kernels", i);
+  }
+  for (i=0; i<(int)(sizeof(sizes)/sizeof(int)); i++) {
+    check(packBenchmark(sizes[i], PACK_TEST_CYCLES)>=0, "pack kernels", sizes[i]);
+  }
+  printf("pack_test: %d failures\n", g_failures);
+  return g_failures?1:0;
+}
@@ -26,13 +26,21 @@
 #include <linux/errno.h> /* error codes */
 #include <sys/ioctl.h> /*ioctl() */
 #include <sys/stat.h> /* S_IWUSR etc */
+#include <unistd.h> /* close() */
+#ifdef __BENCHMARK
+#include <stdlib.h> /* malloc() */
+#include <sys/time.h> /* gettimeofday() */
+#endif //__BENCHMARK
 #include "selectmapInterface.h"
 #include "virtex_io.h" /* ioctl commands */
 
 #define SM_REG_WRITE 0
 #define SM_REG_READ 1
+#define SM_T1_MAX_WORDS 2047      // word count limit of a type 1 packet
+#define SM_T2_MAX_WORDS 134217727 // word count limit of a type 2 packet
 
 static int g_SmFile;
+static int g_bSmPseudoDevice=0; // a regular file stands in for the device, no ioctls
 
 #ifndef DCSC_TEST
 const char* g_pDefaultSmDevice="/dev/virtex";
@@ -53,9 +61,11 @@ int initSmAccess(const char* pDeviceName)
 	else
 		pDevice=g_pDefaultSmDevice;
 	/* checking for actual device or pseudo-device (file) */
-	if (strncmp(pDevice, "/dev/", 4 != 0)) {
+	g_bSmPseudoDevice = 0;
+	if (strncmp(pDevice, "/dev/", 5) != 0) {
 		flags |= O_CREAT; //create the file
 		mode = S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP; //setting file mode
+		g_bSmPseudoDevice = 1;
 	}		
 	fprintf(stderr, "initialize selectmap access interface: device %s\n", pDevice);
 	// opening..
@@ -156,4 +166,109 @@ int smRegisterRead(__u32 address, __u32 *pData)
 	return iResult;
 }
 
+/* set the packet header for a block transfer of iSize words,
+ * a type 2 packet follows a type 1 packet with zero word count if the
+ * count exceeds the type 1 limit
+ */
+static int smSetBlockHeader(__u8 rdwr, __u32 address, int iSize)
+{
+	int iResult=0;
+	if (iSize <= SM_T1_MAX_WORDS) {
+		iResult = ioctl(g_SmFile, VIRTEX_SET_REG, smMakeT1Header(rdwr, address, iSize));
+	} else {
+		if ((iResult = ioctl(g_SmFile, VIRTEX_SET_REG, smMakeT1Header(rdwr, address, 0))) >= 0)
+			iResult = ioctl(g_SmFile, VIRTEX_SET_REG, smMakeT2Header(rdwr, iSize));
+	}
+	if (iResult < 0)
+		iResult = -EIO;
+	return iResult;
+}
+
+int smBlockWrite(__u32 address, __u32* pData, int iSize)
+{
+	int iResult=0;
+	int i=0;
+	if (pData == NULL || iSize <= 0 || iSize > SM_T2_MAX_WORDS)
+		return -EINVAL;
+	if ((iResult = smSetBlockHeader(SM_REG_WRITE, address, iSize)) < 0) {
+		fprintf(stderr, "smBlockWrite: can not set packet header\n");
+		return iResult;
+	}
+	/* the header is set once, the data words follow without a header */
+	for (i=0; i<iSize; i++) {
+		if (ioctl(g_SmFile, VIRTEX_WRITE_WORD, pData[i]) < 0) {
+			fprintf(stderr, "smBlockWrite: write failed after %d of %d words\n", i, iSize);
+			return -EIO;
+		}
+	}
+	return iSize;
+}
+
+int smBlockRead(__u32 address, __u32* pData, int iSize)
+{
+	int iResult=0;
+	int count=0;
+	if (pData == NULL || iSize <= 0 || iSize > SM_T2_MAX_WORDS)
+		return -EINVAL;
+	/* the driver reads the number of words of the header set before, the
+	 * block is read in packets of the type 1 limit */
+	while (count < iSize) {
+		int chunk = iSize-count;
+		if (chunk > SM_T1_MAX_WORDS)
+			chunk = SM_T1_MAX_WORDS;
+		if ((iResult = smSetBlockHeader(SM_REG_READ, address, chunk)) < 0) {
+			fprintf(stderr, "smBlockRead: can not set packet header\n");
+			return iResult;
+		}
+		if (ioctl(g_SmFile, VIRTEX_READ_FRAMES, pData+count) < 0) {
+			fprintf(stderr, "smBlockRead: read failed after %d of %d words\n", count, iSize);
+			return -EIO;
+		}
+		count += chunk;
+	}
+	return iSize;
+}
+
+#ifdef __BENCHMARK
+int smBenchmarkBlockTransfer(int iSize, int iCycles)
+{
+	int iResult=0;
+	if (iSize <= 0 || iCycles <= 0)
+		return -EINVAL;
+	/* ioctls on a file standing in for the device fail, nothing to measure */
+	if (g_bSmPseudoDevice) {
+		fprintf(stderr, "smBenchmarkBlockTransfer: needs the selectmap device\n");
+		return -ENODEV;
+	}
+	__u32* pBuffer = (__u32*)malloc(iSize*sizeof(__u32));
+	if (pBuffer == NULL)
+		return -ENOMEM;
+	int i=0, cycle=0;
+	for (i=0; i<iSize; i++) pBuffer[i] = i;
+	struct timeval start, single, blockw, blockr;
+	gettimeofday(&start, NULL);
+	for (cycle=0; cycle<iCycles && iResult>=0; cycle++)
+		for (i=0; i<iSize && iResult>=0; i++)
+			iResult = smRegisterWrite(SM_REG_FDRI, pBuffer[i]);
+	gettimeofday(&single, NULL);
+	for (cycle=0; cycle<iCycles && iResult>=0; cycle++)
+		iResult = smBlockWrite(SM_REG_FDRI, pBuffer, iSize);
+	gettimeofday(&blockw, NULL);
+	for (cycle=0; cycle<iCycles && iResult>=0; cycle++)
+		iResult = smBlockRead(SM_REG_FDRO, pBuffer, iSize);
+	gettimeofday(&blockr, NULL);
+	free(pBuffer);
+	if (iResult < 0) {
+		fprintf(stderr, "smBenchmarkBlockTransfer: transfer failed (%d), no result\n", iResult);
+		return iResult;
+	}
+	long usecSingle = (single.tv_sec-start.tv_sec)*1000000+(single.tv_usec-start.tv_usec);
+	long usecBlockW = (blockw.tv_sec-single.tv_sec)*1000000+(blockw.tv_usec-single.tv_usec);
+	long usecBlockR = (blockr.tv_sec-blockw.tv_sec)*1000000+(blockr.tv_usec-blockw.tv_usec);
+	fprintf(stderr, "selectmap %d words x %d: register write %ld us, block write %ld us, block read %ld us\n",
+		iSize, iCycles, usecSingle/iCycles, usecBlockW/iCycles, usecBlockR/iCycles);
+	return iResult;
+}
+#endif //__BENCHMARK
+
 
@@ -92,6 +92,65 @@ int smRegisterWrite(__u32 address, __u32 data);
  */
 int smRegisterRead(__u32 address, __u32* pData);
 
+/**
+ * @name Configuration registers and commands of the Xilinx
+ * @ingroup selectmap_access
+ */
+/** CRC register */
+#define SM_REG_CRC   0
+/** frame address register */
+#define SM_REG_FAR   1
+/** frame data input register */
+#define SM_REG_FDRI  2
+/** frame data output register */
+#define SM_REG_FDRO  3
+/** command register */
+#define SM_REG_CMD   4
+/** command: write configuration data */
+#define SM_CMD_WCFG  0x1
+/** command: read configuration data */
+#define SM_CMD_RCFG  0x4
+
+/**
+ * Write a block of words to a register of the selectmap interface.
+ * The packet header is set once, the data words follow with one
+ * VIRTEX_WRITE_WORD ioctl each instead of a header and a register write
+ * per word. Word counts above the type 1 packet limit are sent with a
+ * type 2 packet.
+ * @param address   register number, usually @ref SM_REG_FDRI
+ * @param pData     buffer containing the data
+ * @param iSize     number of words
+ * @return number of words written, neg. error code if failed
+ * @ingroup selectmap_access
+ */
+int smBlockWrite(__u32 address, __u32* pData, int iSize);
+
+/**
+ * Read a block of words from a register of the selectmap interface.
+ * The words are read with the VIRTEX_READ_FRAMES ioctl in packets of the
+ * type 1 limit (2047 words).
+ * @param address   register number, usually @ref SM_REG_FDRO
+ * @param pData     buffer to receive the data
+ * @param iSize     number of words
+ * @return number of words read, neg. error code if failed
+ * @ingroup selectmap_access
+ */
+int smBlockRead(__u32 address, __u32* pData, int iSize);
+
+#ifdef __BENCHMARK
+/**
+ * Compare register and block transfers.
+ * Prints the time per transfer of iSize words for single register writes,
+ * block writes and block reads. Needs the selectmap device, fails with
+ * -ENODEV if a file stands in for it.
+ * @param iSize     number of words per transfer
+ * @param iCycles   number of transfers to average
+ * @return neg. error code if failed
+ * @ingroup selectmap_access
+ */
+int smBenchmarkBlockTransfer(int iSize, int iCycles);
+#endif //__BENCHMARK
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,60 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+
+/*
+ * sm_bench.c
+ *
+ * Register against block transfers of the selectmap interface, timed by
+ * @ref smBenchmarkBlockTransfer.
+ *
+ * usage: sm_bench [device [words [cycles]]]
+ * The device defaults to the one of @ref initSmAccess. The benchmark needs
+ * the selectmap device of the DCS board, a file standing in for it is
+ * refused. Not run by make check.
+ *
+ * Exit code 0 if the transfers succeeded.
+ */
+
+#define __BENCHMARK /* the benchmark functions of the interface */
+#include <stdio.h>
+#include <stdlib.h>
+#include "selectmapInterface.h"
+
+#define SM_BENCH_WORDS  1024
+#define SM_BENCH_CYCLES 100
+
+int main(int argc, char** argv)
+{
+  int iResult=0;
+  const char* pDevice=argc>1?argv[1]:NULL;
+  int iSize=argc>2?atoi(argv[2]):SM_BENCH_WORDS;
+  int iCycles=argc>3?atoi(argv[3]):SM_BENCH_CYCLES;
+  if (argc>4 || iSize<=0 || iCycles<=0) {
+    fprintf(stderr, "usage: %s [device [words [cycles]]]\n", argv[0]);
+    return 2;
+  }
+  if ((iResult=initSmAccess(pDevice))<0) {
+    fprintf(stderr, "sm_bench: can not open the selectmap device (%d)\n", iResult);
+    return 1;
+  }
+  iResult=smBenchmarkBlockTransfer(iSize, iCycles);
+  releaseSmAccess();
+  return iResult<0?1:0;
+}
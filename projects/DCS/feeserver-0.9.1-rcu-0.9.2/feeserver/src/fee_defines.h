@@ -138,6 +138,21 @@
  */
 #define DEFAULT_UPDATE_RATE 1000
 
+/**
+ * Number of value bytes reserved initially per service in the shared memory
+ * region, which is opened if the environment variable FEE_SHM_TRANSPORT is
+ * set. The region grows for larger values and services added later.
+ * @ingroup feesrv_core
+ */
+#define FEE_SHM_BYTES_PER_SERVICE 16
+
+/**
+ * Services beside the item channels (ACK, message, command and the DIM
+ * internal ones) reserved initially in the shared memory region.
+ * @ingroup feesrv_core
+ */
+#define FEE_SHM_EXTRA_SERVICES 16
+
 /**
  * This value multiplied with the deadband checker updateRate and the amount
  * of nodes in the service list defines the time amount, after that each
@@ -500,6 +500,15 @@ void provideUpdateRate();
 //MessageStruct copyMessage(const MessageStruct* const orgMsg);
 
 
+/**
+ * Opens the shared memory region, through which clients on the same host
+ * can read the service values without a DIM connection. Called after
+ * dis_start_serving, if the environment variable FEE_SHM_TRANSPORT is set.
+ * The initial size covers the current services, the region grows later.
+ * @ingroup feesrv_core
+ */
+void startShmTransport();
+
 /**
  * This function cleans up everything when finishing the server.
  * It also calls a cleanUp  for the control engine.
@@ -24,6 +24,7 @@
 #include <unistd.h>				// for pause() necessary
 #include <string.h>
 #include <dim/dis.h>				// dimserver library
+#include <dim/dim_shm.h>			// shared memory transport for local clients
 #include <math.h>				// for fabsf
 
 #include <time.h>				// time for threads
@@ -1288,6 +1289,9 @@ void ack_service(int* tag, char** address, int* size) {
 #		endif
 		createLogMessage(MSG_WARNING, "DIM Framework called wrong ACK channel.",
 				0);
+		// nothing to send, DIM uses the values on return
+		*address = 0;
+		*size = 0;
 		return;
 	}
 // use the line below for checking flags of an outgoing feePacket!
@@ -1752,6 +1756,9 @@ int start(int initState) {
 		//-- now start serving --
 		if (dis_start_serving(serverName) == 1) {
 			// if start server was successful
+			if (getenv("FEE_SHM_TRANSPORT")) {
+				startShmTransport();
+			}
 			if (initState == FEE_OK) {
 				state = RUNNING;
 				// start monitoring thread now
@@ -3087,6 +3094,20 @@ void dim_dummy_exit_handler(int* bufp) {
 	}
 }
 
+void startShmTransport() {
+	int services = nodesAmount + intNodesAmount + FEE_SHM_EXTRA_SERVICES;
+
+	// the message channel is the largest value, reserve room for it
+	if (dis_shm_open(serverName, services,
+			(services * FEE_SHM_BYTES_PER_SERVICE) + sizeof(message)) == 1) {
+		createLogMessage(MSG_INFO,
+				"Shared memory transport for local clients opened.", 0);
+	} else {
+		createLogMessage(MSG_WARNING,
+				"Unable to open shared memory transport, serving via DIM only.", 0);
+	}
+}
+
 void cleanUp() {
 	// the order of the clean up sequence here is important to evade seg faults
 	cleanUpCE();
@@ -3105,6 +3126,7 @@ void cleanUp() {
 	}
 
 	dis_stop_serving();
+	dis_shm_close();
 
 	deleteItemList();
 	// new since version 0.8.1 -> int channels
@@ -21,6 +21,12 @@
 
 #include <cerrno>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include "ce_base.h"
 #include "RCU_ControlEngine.hpp"
 #include "dev_rcu.hpp"
@@ -60,7 +66,11 @@ RCUControlEngine::RCUControlEngine()
   :
   fpRCU(new CErcu),
   fpACTEL(new CEactel),
-  fIndent(0)
+  fIndent(0),
+  fConfigCacheLimit(0),
+  fConfigCacheSize(0),
+  fConfigCacheInit(0),
+  fApplyingCache(0)
 {
   SetTranslationScheme(&g_PVSSStateMapper);
   if (fpRCU) {
@@ -343,9 +353,13 @@ int RCUControlEngine::CheckCommand(__u32 cmd, __u32 parameter)
   int iResult=0;
   switch (cmd) {
   case FEE_CONFIGURE:
+  case FEE_CONFIGURE|FEE_CONFIGURE_DIFFERENTIAL:
+  case FEE_CONFIGURE|FEE_CONFIGURE_SEQUENCER:
+  case FEE_CONFIGURE|FEE_CONFIGURE_DIFFERENTIAL|FEE_CONFIGURE_SEQUENCER:
   case FEE_CONFIGURE_END:
   case FEE_VERIFICATION:
   case FEE_EXTERNAL_CONFIGURATION:
+  case FEE_CONFIGURE_CACHED:
     iResult=1;
     break;
   default:
@@ -388,7 +402,7 @@ RCUControlEngine::FeeConfigureDesc RCUControlEngine::CreateFeeConfigureDesc(__u3
   return desc;
 }
 
-int RCUControlEngine::ExecFeeConfigure(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb)
+int RCUControlEngine::ExecFeeConfigure(__u32 cmd, __u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb)
 {
   int iResult=0;
   int iProcessed=0;
@@ -441,14 +455,47 @@ int RCUControlEngine::ExecFeeConfigure(__u32 parameter, const char* pData, int i
 
     int i=0;
     int iCmdWords=0; // counter for processed words
+    int nofWords=parameter;
     if (iResult>=0 && Check(eStateConfiguring)) {
+      // a nested differential or sequencer block is part of the enclosing one
+      int bDifferential=(cmd&FEE_CONFIGURE_DIFFERENTIAL)!=0 &&
+	fpRCU!=NULL && fpRCU->BeginDifferentialWrite()>=0;
+      int bSequencer=(cmd&FEE_CONFIGURE_SEQUENCER)!=0;
+      int bFecStat=fpRCU!=NULL && fpRCU->BeginSequencerCompile(bSequencer)>=0;
+      struct timeval start;
+      gettimeofday(&start, NULL);
       iProcessed=2*sizeof(__u32);
-      for (i=0; iCmdWords<parameter && iResult>=0; i++) {
+      for (i=0; iCmdWords<nofWords && iResult>=0; i++) {
 	if ((iResult=translateCommand((char*)pData+iProcessed, iDataSize-iProcessed, rb, 1))>=0) {
 	  iCmdWords+=iResult/sizeof(__u32);
 	  iProcessed+=iResult; // this is the byte counter
 	}
       }
+      if (bFecStat) {
+	int writes=0, fecs=0, programs=0;
+	int iFlush=fpRCU->EndSequencerCompile(&writes, &fecs, &programs);
+	if (iResult>=0) iResult=iFlush;
+	if (writes>0) {
+	  // benchmark of the FEC configuration for the two access paths
+	  struct timeval end;
+	  gettimeofday(&end, NULL);
+	  long usec=(end.tv_sec-start.tv_sec)*1000000+(end.tv_usec-start.tv_usec);
+	  CE_Info("%*sFEC configuration via %s: %d register write(s) to %d FEC(s) in %d program(s), %ld us, %ld us per FEC\n",
+		  fIndent, "", bSequencer?"sequencer":"message buffer", writes, fecs, programs,
+		  usec, fecs>0?usec/fecs:usec);
+	}
+      }
+      if (bDifferential) {
+	int elided=0, written=0, blocks=0;
+	int iFlush=fpRCU->EndDifferentialWrite(&elided, &written, &blocks);
+	if (iResult>=0) iResult=iFlush;
+	CE_Info("%*sdifferential FEE_CONFIGURE: %d write(s) skipped, %d word(s) written in %d access(es)\n",
+		fIndent, "", elided, written, blocks);
+      }
+      if (iResult>=0 && checksum!=0 && fApplyingCache==0) {
+	// the block has been executed successfully and can be replayed
+	StoreConfiguration(cmd, parameter, pData, iProcessed);
+      }
     } else {
       CE_Error("can not switch main state machine to configuration mode, error %d\n", iResult);
     }
@@ -462,13 +509,225 @@ int RCUControlEngine::ExecFeeConfigure(__u32 parameter, const char* pData, int i
   return iResult;
 }
 
+/** magic word of the configuration cache files */
+#define FEE_CONFIGURE_CACHE_MAGIC 0xfeecc003
+
+/**
+ * number of header words of the configuration cache files:
+ * magic, hw address, checksum, parameter with the mode flags, block size,
+ * Adler-32 of the block
+ */
+#define FEE_CONFIGURE_CACHE_HEADER 6
+
+/**
+ * Adler-32 of a configuration block, the algorithm of the FeeServer
+ * command checksum.
+ */
+static __u32 FeeConfigureChecksum(const char* pData, int iSize)
+{
+  __u32 part1=1;
+  __u32 part2=0;
+  for (int i=0; i<iSize; i++) {
+    part1=(part1+(unsigned char)pData[i])%65521;
+    part2=(part2+part1)%65521;
+  }
+  return (part2<<16)|part1;
+}
+
+int RCUControlEngine::InitConfigurationCache()
+{
+  if (fConfigCacheInit!=0) return fConfigCacheInit;
+  const char* dir=getenv("FEESERVER_CONF_CACHE");
+  fConfigCacheDir=dir?dir:"/tmp/feeserver-confcache";
+  fConfigCacheLimit=1024;
+  if (getenv("FEESERVER_CONF_CACHE_SIZE")) {
+    sscanf(getenv("FEESERVER_CONF_CACHE_SIZE"), "%d", &fConfigCacheLimit);
+  }
+  fConfigCacheLimit*=1024;
+  if (fConfigCacheLimit<=0 || fConfigCacheDir.empty()) {
+    CE_Info("configuration cache disabled\n");
+    return fConfigCacheInit=-ENOSYS;
+  }
+  if (mkdir(fConfigCacheDir.c_str(), 0755)<0 && errno!=EEXIST) {
+    CE_Warning("can not create configuration cache %s (%d), cache disabled\n", fConfigCacheDir.c_str(), errno);
+    return fConfigCacheInit=-errno;
+  }
+
+  // take over the blocks of a previous instance
+  DIR* pDir=opendir(fConfigCacheDir.c_str());
+  if (pDir) {
+    struct dirent* pEntry=NULL;
+    while ((pEntry=readdir(pDir))!=NULL) {
+      FeeConfigureCacheEntry entry;
+      struct stat st;
+      __u32 header[FEE_CONFIGURE_CACHE_HEADER];
+      if (sscanf(pEntry->d_name, "conf_%x_%x.bin", &entry.hwAddress, &entry.checksum)!=2) continue;
+      string filename=GetCacheFileName(entry.hwAddress, entry.checksum);
+      if (stat(filename.c_str(), &st)<0) continue;
+      FILE* fp=fopen(filename.c_str(), "r");
+      int bValid=fp!=NULL && fread(header, sizeof(header), 1, fp)==1 &&
+	header[0]==FEE_CONFIGURE_CACHE_MAGIC && header[1]==entry.hwAddress &&
+	header[2]==entry.checksum && (off_t)(header[4]+sizeof(header))==st.st_size;
+      if (fp) fclose(fp);
+      if (!bValid) {
+	// files of older versions or incomplete files
+	unlink(filename.c_str());
+	continue;
+      }
+      entry.content=header[5];
+      entry.size=st.st_size;
+      entry.lastUse=st.st_mtime;
+      fConfigCache.push_back(entry);
+      fConfigCacheSize+=entry.size;
+    }
+    closedir(pDir);
+  }
+  CE_Info("configuration cache %s: %d block(s), %d of %d byte(s)\n", fConfigCacheDir.c_str(),
+	  (int)fConfigCache.size(), fConfigCacheSize, fConfigCacheLimit);
+  return fConfigCacheInit=1;
+}
+
+string RCUControlEngine::GetCacheFileName(__u32 hwAddress, __u32 checksum)
+{
+  char name[40];
+  snprintf(name, sizeof(name), "/conf_%08x_%08x.bin", hwAddress, checksum);
+  return fConfigCacheDir+name;
+}
+
+int RCUControlEngine::FindCachedConfiguration(__u32 hwAddress, __u32 checksum)
+{
+  int iResult=(int)fConfigCache.size();
+  while (--iResult>=0) {
+    if (fConfigCache[iResult].hwAddress==hwAddress && fConfigCache[iResult].checksum==checksum)
+      break;
+  }
+  if (iResult==-1) iResult=-ENOENT;
+  return iResult;
+}
+
+int RCUControlEngine::DropCachedConfiguration(int pos)
+{
+  if (pos<0 || pos>=(int)fConfigCache.size()) return -EINVAL;
+  unlink(GetCacheFileName(fConfigCache[pos].hwAddress, fConfigCache[pos].checksum).c_str());
+  fConfigCacheSize-=fConfigCache[pos].size;
+  fConfigCache.erase(fConfigCache.begin()+pos);
+  return 0;
+}
+
+int RCUControlEngine::StoreConfiguration(__u32 cmd, __u32 parameter, const char* pData, int iSize)
+{
+  int iResult=0;
+  if (InitConfigurationCache()<0) return 0;
+  if (iSize<(int)(2*sizeof(__u32))) return -EINVAL;
+  __u32 header[FEE_CONFIGURE_CACHE_HEADER];
+  header[0]=FEE_CONFIGURE_CACHE_MAGIC;
+  header[1]=*((__u32*)pData);     // hw address
+  header[2]=*(((__u32*)pData)+1); // checksum
+  header[3]=(cmd&(FEE_CONFIGURE_DIFFERENTIAL|FEE_CONFIGURE_SEQUENCER))|parameter;
+  header[4]=iSize;
+  header[5]=FeeConfigureChecksum(pData, iSize);
+  int iFileSize=sizeof(header)+iSize;
+  int pos=FindCachedConfiguration(header[1], header[2]);
+  if (pos>=0 && fConfigCache[pos].content==header[5] && fConfigCache[pos].size==iFileSize) {
+    // known block, only the time of use is updated
+    fConfigCache[pos].lastUse=time(NULL);
+    return 0;
+  }
+  if (pos>=0) {
+    CE_Warning("configuration block %#x: checksum %#x used for different content, cached block replaced\n", header[1], header[2]);
+    DropCachedConfiguration(pos);
+  }
+  if (iFileSize>fConfigCacheLimit) {
+    CE_Debug("configuration block %#x of size %d exceeds cache size\n", header[1], iSize);
+    return 0;
+  }
+  // drop the least recently used blocks
+  while (fConfigCacheSize+iFileSize>fConfigCacheLimit && fConfigCache.size()>0) {
+    size_t oldest=0;
+    for (size_t i=1; i<fConfigCache.size(); i++) {
+      if (fConfigCache[i].lastUse<fConfigCache[oldest].lastUse) oldest=i;
+    }
+    DropCachedConfiguration(oldest);
+  }
+
+  // the block is written to a temporary file and renamed, a cache file is
+  // thus either complete or not existing
+  string filename=GetCacheFileName(header[1], header[2]);
+  string tmpname=filename+".tmp";
+  FILE* fp=fopen(tmpname.c_str(), "w");
+  if (fp) {
+    if (fwrite(header, sizeof(header), 1, fp)!=1 ||
+	fwrite(pData, iSize, 1, fp)!=1) {
+      iResult=-EIO;
+    }
+    if (fclose(fp)!=0) iResult=-EIO;
+    if (iResult>=0 && rename(tmpname.c_str(), filename.c_str())<0) iResult=-errno;
+    if (iResult<0) unlink(tmpname.c_str());
+  } else {
+    iResult=-errno;
+  }
+  if (iResult>=0) {
+    FeeConfigureCacheEntry entry;
+    entry.hwAddress=header[1];
+    entry.checksum=header[2];
+    entry.content=header[5];
+    entry.size=iFileSize;
+    entry.lastUse=time(NULL);
+    fConfigCache.push_back(entry);
+    fConfigCacheSize+=iFileSize;
+    CE_Debug("configuration block %#x checksum %#x stored in cache (%d byte(s))\n", header[1], header[2], iSize);
+  } else {
+    CE_Warning("can not write configuration cache file %s (%d)\n", filename.c_str(), iResult);
+  }
+  return iResult;
+}
+
+int RCUControlEngine::ApplyCachedConfiguration(__u32 hwAddress, __u32 checksum, CEResultBuffer& rb)
+{
+  int iResult=0;
+  if (InitConfigurationCache()<0) return -ENOENT;
+  int pos=FindCachedConfiguration(hwAddress, checksum);
+  if (pos<0) return -ENOENT;
+
+  vector<char> buffer(fConfigCache[pos].size);
+  __u32 header[FEE_CONFIGURE_CACHE_HEADER];
+  int iSize=fConfigCache[pos].size-sizeof(header);
+  FILE* fp=fopen(GetCacheFileName(hwAddress, checksum).c_str(), "r");
+  if (fp==NULL || iSize<(int)(2*sizeof(__u32)) ||
+      fread(header, sizeof(header), 1, fp)!=1 ||
+      fread(&buffer[0], iSize, 1, fp)!=1 ||
+      header[0]!=FEE_CONFIGURE_CACHE_MAGIC || header[1]!=hwAddress ||
+      header[2]!=checksum || header[4]!=(__u32)iSize ||
+      header[5]!=fConfigCache[pos].content ||
+      FeeConfigureChecksum(&buffer[0], iSize)!=header[5]) {
+    CE_Error("corrupted configuration cache file for block %#x checksum %#x, dropped\n", hwAddress, checksum);
+    iResult=-ENOENT;
+  }
+  if (fp) fclose(fp);
+  if (iResult<0) {
+    DropCachedConfiguration(pos);
+    return iResult;
+  }
+
+  fConfigCache[pos].lastUse=time(NULL);
+  CE_Info("%*sapply cached configuration %#x checksum %#x\n", fIndent+1, "", hwAddress, checksum);
+  fApplyingCache++;
+  iResult=ExecFeeConfigure(FEE_CONFIGURE|(header[3]&(FEE_CONFIGURE_DIFFERENTIAL|FEE_CONFIGURE_SEQUENCER)),
+			   header[3]&FEESERVER_CMD_PARAM_MASK, &buffer[0], iSize, rb);
+  fApplyingCache--;
+  return iResult;
+}
+
 int RCUControlEngine::issue(__u32 cmd, __u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb)
 {
   int iResult=0;
   int iProcessed=0;
   switch (cmd) {
   case FEE_CONFIGURE:
-    if ((iResult=ExecFeeConfigure(parameter, pData, iDataSize, rb))>=0) {
+  case FEE_CONFIGURE|FEE_CONFIGURE_DIFFERENTIAL:
+  case FEE_CONFIGURE|FEE_CONFIGURE_SEQUENCER:
+  case FEE_CONFIGURE|FEE_CONFIGURE_DIFFERENTIAL|FEE_CONFIGURE_SEQUENCER:
+    if ((iResult=ExecFeeConfigure(cmd, parameter, pData, iDataSize, rb))>=0) {
       iProcessed+=iResult;
       CE_Debug("%d %d\n", iResult, iProcessed);
     }
@@ -541,6 +800,22 @@ int RCUControlEngine::issue(__u32 cmd, __u32 parameter, const char* pData, int i
     CE_Debug("got FEE_EXTERNAL_CONFIGURATION hw address %#x\n", parameter);
     iResult=ActionHandler((CETransitionId)eGoConfDDL);
     break;
+  case FEE_CONFIGURE_CACHED:
+    if (iDataSize>=(int)(2*sizeof(__u32))) {
+      __u32 hwAddress=*((__u32*)pData);
+      __u32 checksum=*(((__u32*)pData)+1);
+      if ((iResult=ApplyCachedConfiguration(hwAddress, checksum, rb))>=0) {
+	iProcessed=2*sizeof(__u32);
+      } else if (iResult==-ENOENT) {
+	// not an error of the device, the block has to be sent completely
+	CE_Warning("configuration %#x with checksum %#x not in cache\n", hwAddress, checksum);
+	return iResult;
+      }
+    } else {
+      CE_Error("missing hardware address and checksum for FEE_CONFIGURE_CACHED\n");
+      iResult=-EPROTO;
+    }
+    break;
   default:
     CE_Warning("unrecognized command id (%#x)\n", cmd);
     iResult=-ENOSYS;
@@ -566,6 +841,18 @@ int RCUControlEngine::PreUpdate()
   return iResult;
 }
 
+int RCUControlEngine::PostUpdate()
+{
+  int iResult=0;
+  if (fpRCU) {
+    fpRCU->DropPrefetchedRegisters();
+  }
+  if (fpACTEL) {
+    iResult=fpACTEL->ScrubScheduler(IssuePending()==0);
+  }
+  return iResult;
+}
+
 int RCUControlEngine::SetRcuBranchLayout(RcuBranchLayout* pLayout)
 {
   int iResult=0;
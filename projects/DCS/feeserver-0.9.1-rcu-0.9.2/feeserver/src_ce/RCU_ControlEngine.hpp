@@ -29,6 +29,8 @@
 #include "issuehandler.hpp"
 #include "dev_actel.hpp"
 #include <vector>
+#include <string>
+#include <ctime>
 
 class RcuBranchLayout;
 /**
@@ -245,6 +247,22 @@ public:
     __u32 channel;
   };
 
+  /**
+   * Descriptor of a @ref FEE_CONFIGURE block in the configuration cache.
+   */
+  struct FeeConfigureCacheEntry {
+    /** hardware address of the block */
+    __u32 hwAddress;
+    /** checksum of the block as sent by the client, key of the cache */
+    __u32 checksum;
+    /** Adler-32 of the stored block, computed by the CE */
+    __u32 content;
+    /** size of the cache file in byte */
+    int size;
+    /** time of the last use, the oldest entries are dropped first */
+    time_t lastUse;
+  };
+
   /**
    * Evaluate a part of the @ref FEE_CONFIGURE hardware address.
    * The funtion masks and shifts the hwAddress according to the mask
@@ -446,6 +464,12 @@ private:
    */
   int PreUpdate();
 
+  /**
+   * Handler called after the service udate loop.
+   * Runs the background scrubbing of the ACTEL device.
+   */
+  int PostUpdate();
+
   /**
    * Find a configuration descriptor.
    * @param tag          search tag
@@ -465,9 +489,56 @@ private:
 
   /**
    * Execute the @ref FEE_CONFIGURE command.
+   * The command may carry the flags @ref FEE_CONFIGURE_DIFFERENTIAL and
+   * @ref FEE_CONFIGURE_SEQUENCER.
    * @see CEIssueHandler::issue for parameters and return values.
    */
-  int ExecFeeConfigure(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb);
+  int ExecFeeConfigure(__u32 cmd, __u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb);
+
+  /**
+   * Init the configuration cache.
+   * The cache directory is scanned for blocks stored by a previous
+   * instance of the FeeServer.
+   * @return neg. error code if the cache is disabled
+   */
+  int InitConfigurationCache();
+
+  /**
+   * Store a @ref FEE_CONFIGURE block in the configuration cache.
+   * The checksum of the client is only used as key, the block is verified
+   * by its Adler-32. A cached block with the same key but different
+   * content is replaced.
+   * @param cmd          the FEE_CONFIGURE command including the mode flags
+   * @param parameter    parameter of the FEE_CONFIGURE command
+   * @param pData        the block starting with hardware address and checksum
+   * @param iSize        size of the block in byte
+   * @return neg. error code if failed
+   */
+  int StoreConfiguration(__u32 cmd, __u32 parameter, const char* pData, int iSize);
+
+  /**
+   * Execute a @ref FEE_CONFIGURE block from the configuration cache.
+   * The block is only executed if its Adler-32 matches the one computed
+   * when it was stored, corrupted files are dropped.
+   * @return >=0 success, -ENOENT if not in the cache, neg. error code if failed
+   */
+  int ApplyCachedConfiguration(__u32 hwAddress, __u32 checksum, CEResultBuffer& rb);
+
+  /**
+   * Find a block in the configuration cache.
+   * @return position in the array, -ENOENT if not found
+   */
+  int FindCachedConfiguration(__u32 hwAddress, __u32 checksum);
+
+  /**
+   * Remove a block from the configuration cache.
+   */
+  int DropCachedConfiguration(int pos);
+
+  /**
+   * Get the file name of a cached block.
+   */
+  std::string GetCacheFileName(__u32 hwAddress, __u32 checksum);
 
 
   /** the RCU sub device */
@@ -482,6 +553,24 @@ private:
   /** debug printout indent*/
   int fIndent;
 
+  /** the configuration cache */
+  std::vector<FeeConfigureCacheEntry> fConfigCache;
+
+  /** directory of the configuration cache */
+  std::string fConfigCacheDir;
+
+  /** size limit of the configuration cache in byte, 0 disabled */
+  int fConfigCacheLimit;
+
+  /** current size of the configuration cache in byte */
+  int fConfigCacheSize;
+
+  /** 0 cache not yet initialized, 1 initialized, neg. error if disabled */
+  int fConfigCacheInit;
+
+  /** a cached block is executed, no blocks are stored */
+  int fApplyingCache;
+
 #endif //RCU
 };
 
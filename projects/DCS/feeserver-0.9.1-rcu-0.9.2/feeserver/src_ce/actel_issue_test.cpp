@@ -0,0 +1,309 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+/*
+ * actel_issue_test.cpp
+ *
+ * The commands of the Actel group sent through the command translation of
+ * the CE.
+ *
+ * The message buffer and selectmap interfaces are replaced by a model of
+ * the flash and of the configuration memory. Each command is sent in a
+ * command block, several of them followed by another command, the block
+ * is only processed completely if every handler reports the size of its
+ * payload.
+ * The results are checked against the model.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "fee_errors.h"
+#include "ce_command.h"
+#include "dcscMsgBufferInterface.h"
+#include "selectmapInterface.h"
+#include "rcu_issue.h"
+#include "dev_actel.hpp"
+#include "dev_rcu.hpp"
+
+using namespace std;
+
+int translateCommand(char* buffer, int size, CEResultBuffer& rb, int bSingleCmd);
+
+#define TEST_FLASH_SIZE 0x10000
+#define TEST_CONF_SIZE  0x1000
+
+static int g_failures=0;
+static int g_busState=eEnableMsgBuf;
+static vector<__u32> g_flash(TEST_FLASH_SIZE, 0xffff);
+static vector<__u32> g_conf(TEST_CONF_SIZE, 0);
+static __u32 g_far=0;
+
+static void check(int cond, const char* what)
+{
+  printf("%s: %s\n", cond?"ok  ":"FAIL", what);
+  if (!cond) g_failures++;
+}
+
+/*******************************************************************************
+ * the FeeServer core
+ */
+extern "C" {
+void createLogMessage(unsigned int type, char* description, char* origin) {}
+int publish(Item* item) {return 0;}
+void signalCEready(int ceState) {}
+int updateFeeService(char* serviceName) {return 0;}
+int allocateMemory(unsigned int size, char type, char* module, char prefixPurpose, void** ptr) {return FEE_FAILED;}
+void feeserverCompileInfo(char** date, char** time) {if (date) *date=""; if (time) *time="";}
+}
+
+/*******************************************************************************
+ * model of the message buffer and selectmap interfaces
+ */
+int rcuBusControlCmd(int iCmd)
+{
+  switch (iCmd) {
+  case eEnableSelectmap:
+  case eEnableFlash:
+  case eEnableMsgBuf:
+    g_busState=iCmd;
+    return 0;
+  case eCheckSelectmap: return g_busState==eEnableSelectmap;
+  case eCheckFlash:     return g_busState==eEnableFlash;
+  case eCheckMsgBuf:    return g_busState==eEnableMsgBuf;
+  }
+  return -EINVAL;
+}
+
+int rcuSingleRead(__u32 address, __u32* pData) {if (pData) *pData=0; return 1;}
+int rcuSingleWrite(__u32 address, __u32 data) {return 1;}
+void printBufferHex(unsigned char *pBuffer, int iBufferSize, int wordSize, const char* pMessage) {}
+
+int rcuFlashRead(__u32 address, int iSize, __u32* pData)
+{
+  if (g_busState!=eEnableFlash) return -EACCES;
+  if (address+iSize>TEST_FLASH_SIZE) return -EINVAL;
+  for (int i=0; i<iSize; i++) pData[i]=g_flash[address+i];
+  return iSize;
+}
+
+int rcuFlashErase(int startSec, int stopSec)
+{
+  if (g_busState!=eEnableFlash) return -EACCES;
+  if (startSec>=0) return -ENOSYS;
+  g_flash.assign(TEST_FLASH_SIZE, 0xffff);
+  return 0;
+}
+
+int rcuFlashProgram(__u32 address, __u32* pData, int iSize, int iDataSize, TrcuFlashProgramStat* pStat)
+{
+  if (g_busState!=eEnableFlash) return -EACCES;
+  if (address+iSize>TEST_FLASH_SIZE || iDataSize!=2) return -EINVAL;
+  for (int i=0; i<iSize; i++) {
+    __u32 word=((__u16*)pData)[i];
+    if ((g_flash[address+i]&word)!=word) return -ENOTEMPTY;
+    g_flash[address+i]=word;
+  }
+  if (pStat) {
+    memset(pStat, 0, sizeof(TrcuFlashProgramStat));
+    pStat->nofBlocks=1;
+    pStat->nofWritten=1;
+    pStat->nofWords=iSize;
+  }
+  return 1;
+}
+
+int initSmAccess(const char* pDeviceName) {return 0;}
+int releaseSmAccess() {return 0;}
+
+int smRegisterWrite(__u32 address, __u32 data)
+{
+  if (g_busState!=eEnableSelectmap) return -EACCES;
+  if (address==SM_REG_FAR) g_far=data;
+  return 0;
+}
+
+int smBlockWrite(__u32 address, __u32* pData, int iSize)
+{
+  if (g_busState!=eEnableSelectmap || address!=SM_REG_FDRI) return -EACCES;
+  if (g_far+iSize>TEST_CONF_SIZE) return -EINVAL;
+  for (int i=0; i<iSize; i++) g_conf[g_far+i]=pData[i];
+  return iSize;
+}
+
+int smBlockRead(__u32 address, __u32* pData, int iSize)
+{
+  if (g_busState!=eEnableSelectmap || address!=SM_REG_FDRO) return -EACCES;
+  if (g_far+iSize>TEST_CONF_SIZE) return -EINVAL;
+  for (int i=0; i<iSize; i++) pData[i]=g_conf[g_far+i];
+  return iSize;
+}
+
+void CErcu::FirmwareReconfigured() {}
+
+/*******************************************************************************
+ * command blocks
+ */
+class CommandBlock {
+public:
+  void Command(__u32 cmd, __u32 parameter) {fBlock.push_back(cmd|(parameter&FEESERVER_CMD_PARAM_MASK));}
+  void Word(__u32 word) {fBlock.push_back(word);}
+  void Words16(const __u16* pData, int iSize) {
+    int offset=fBlock.size();
+    fBlock.resize(offset+(iSize+1)/2, 0);
+    memcpy(&fBlock[offset], pData, iSize*sizeof(__u16));
+  }
+  void End() {fBlock.push_back(CE_CMD_TAILER);}
+
+  /** send the block, returns 1 if the block was processed completely */
+  int Issue(CEResultBuffer& result) {
+    int size=fBlock.size()*sizeof(__u32);
+    result.clear();
+    int iResult=translateCommand((char*)&fBlock[0], size, result, 0);
+    fBlock.clear();
+    return iResult==size;
+  }
+private:
+  vector<__u32> fBlock;
+};
+
+static __u32 adler32(const __u16* pData, int iSize)
+{
+  const unsigned char* p=(const unsigned char*)pData;
+  __u32 a=1, b=0;
+  for (int i=0; i<iSize*(int)sizeof(__u16); i++) {
+    a=(a+p[i])%65521;
+    b=(b+a)%65521;
+  }
+  return (b<<16)|a;
+}
+
+int main()
+{
+  CEactel actel;
+  CommandBlock block;
+  CEResultBuffer result;
+  int iResult=0;
+  int i=0;
+
+  // flash: odd number of words with the padding, followed by the dump of it
+  __u16 image[5]={0x1234, 0x5678, 0x9abc, 0xdef0, 0x0f0f};
+  block.Command(RCU_WRITE_FLASH, 5);
+  block.Word(0x100);
+  block.Words16(image, 5);
+  block.End();
+  block.Command(RCU_READ_FLASH, 0);
+  block.Word(0x100);
+  block.Word(5);
+  block.Word(0);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult, "write flash followed by read flash accepted");
+  check(result.size()==5+5+3, "statistics and dump chunk returned");
+  check(g_flash[0x100]==0x1234 && g_flash[0x104]==0x0f0f && g_flash[0x105]==0xffff,
+	"image programmed");
+  if (result.size()==5+5+3) {
+    check(result[3]==5, "number of written words");
+    check(result[5]==0 && result[6]==1 && result[7]==0x100 && result[8]==5,
+	  "dump chunk header");
+    check(memcmp(&result[10], image, sizeof(image))==0, "dump chunk data");
+    check(result[9]==adler32(image, 5), "dump chunk checksum");
+  }
+
+  // flash: the whole payload is the image
+  __u16 image2[4]={0x0001, 0x0002, 0x0003, 0x0004};
+  block.Command(RCU_WRITE_FLASH, 0);
+  block.Word(0x200);
+  block.Words16(image2, 4);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult && g_flash[0x200]==1 && g_flash[0x203]==4, "write flash of the whole payload");
+  block.Command(RCU_WRITE_FLASH, 0);
+  block.Word(0x100);
+  block.Words16(image2, 4);
+  block.End();
+  check(!block.Issue(result), "write flash needing an erase refused");
+
+  // erase, followed by a dump
+  block.Command(RCU_ERASE_FLASH, 0);
+  block.End();
+  block.Command(RCU_READ_FLASH, 0);
+  block.Word(0x100);
+  block.Word(2);
+  block.Word(0);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult, "erase flash followed by read flash accepted");
+  check(result.size()==5+1 && result[5]==0xffffffff, "flash erased");
+  check(g_busState==eEnableMsgBuf, "bus state restored");
+
+  // configuration: write, read back and verify in one block
+  __u32 frame[3]={0xaa995566, 0x30008001, 0x00000007};
+  block.Command(RCU_WRITE_FPGA_CONF, 3);
+  block.Word(0x40);
+  for (i=0; i<3; i++) block.Word(frame[i]);
+  block.End();
+  block.Command(RCU_READ_FPGA_CONF, 0);
+  block.Word(0x40);
+  block.Word(3);
+  block.End();
+  block.Command(RCU_READ_FPGA_CONF, 1);
+  block.Word(0x40);
+  block.Word(3);
+  block.Word(frame[0]);
+  block.Word(frame[1]);
+  block.Word(frame[2]^0x1);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult, "write, read and verify configuration accepted");
+  check(result.size()==3+2, "read back data and verification result returned");
+  if (result.size()==3+2) {
+    check(memcmp(&result[0], frame, sizeof(frame))==0, "read back data");
+    check(result[3]==1 && result[4]==2, "differing word found by verification");
+  }
+  block.Command(RCU_WRITE_FPGA_CONF, 0);
+  block.Word(0x80);
+  for (i=0; i<3; i++) block.Word(frame[i]);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult && g_conf[0x80]==frame[0] && g_conf[0x82]==frame[2],
+	"write configuration of the whole payload");
+  block.Command(RCU_WRITE_FPGA_CONF, 4);
+  block.Word(0x80);
+  for (i=0; i<3; i++) block.Word(frame[i]);
+  block.End();
+  check(!block.Issue(result), "configuration word count beyond payload refused");
+
+  // commands without payload
+  block.Command(RCU_ACTEL_READBACK, 0);
+  block.End();
+  block.Command(RCU_INIT_CONF, 0);
+  block.End();
+  block.Command(RCU_SCRUBBING, 0);
+  block.End();
+  iResult=block.Issue(result);
+  check(iResult && result.size()==0, "commands without payload accepted");
+
+  printf("actel_issue_test: %d failures\n", g_failures);
+  return g_failures?1:0;
+}
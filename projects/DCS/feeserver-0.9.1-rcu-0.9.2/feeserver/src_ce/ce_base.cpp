@@ -25,16 +25,25 @@
 #include <stdarg.h>        // varargs
 #include <string.h>
 #include <stdio.h>
+#include <sys/time.h>     // gettimeofday
 #include <sys/types.h>    // exec
 #include <unistd.h>       // fork/exec
 #include <sys/wait.h>     // wait command
+#include <poll.h>         // poll
+#include <fcntl.h>        // fcntl
 #include "ce_command.h"
 #include "fee_errors.h"
 #include "ce_base.h"
 #include "rcu_issue.h"
 #include "device.hpp"     // CEResultBuffer
 #include <cstring>
+#include <ctime>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
 #include "issuehandler.hpp"
+#include "lockguard.hpp"
 #include "rcu_issue.h"
 
 using namespace std;
@@ -69,6 +78,7 @@ int ceCheckOptionFlag(int of)
 }
 
 int g_iMaxBufferPrintSize=4;
+int g_iShellStreamPeriod=0; // period of the shell output streaming in ms, 0 disables streaming
 //int g_printError=0;
 
 /******************************************************************************************/
@@ -89,6 +99,8 @@ int g_iMaxBufferPrintSize=4;
  *  CEDBG_EN_SERVICE_UPDATE  <0,1>
  *  CE_SET_LOGGING_LEVEL     <level>
  *  CE_RELAX_CMD_VERS_CHECK
+ *  CE_BENCHMARK_UPDATE      <count>   (only with __BENCHMARK)
+ *  CE_BENCHMARK_PUBLISH     <count> <usec>   (only with __BENCHMARK)
  * </pre>
  *
  * @ingroup rcu_ce_base_services
@@ -146,6 +158,7 @@ int CEPropertiesCommandHandler::CheckCommand(__u32 cmd, __u32 parameter)
   case CE_RELAX_CMD_VERS_CHECK:
   case CE_SET_LOGGING_LEVEL:
   case CE_GET_HIGHLEVEL_CMDS:
+  case CE_SET_SHELL_STREAMING:
     return 1;
   }
   return 0;
@@ -199,6 +212,13 @@ int CEPropertiesCommandHandler::issue(__u32 cmd, __u32 parameter, const char* pD
     iResult=ceSetLogLevel(parameter);
     CE_Info("set logging level to %d\n", iResult);
     break;
+  case CE_SET_SHELL_STREAMING:
+    g_iShellStreamPeriod=parameter;
+    if (g_iShellStreamPeriod>0)
+      CE_Info("streaming output of shell programs every %d ms\n", g_iShellStreamPeriod);
+    else
+      CE_Info("streaming of shell program output disabled\n");
+    break;
   case CE_GET_HIGHLEVEL_CMDS:
     if (pData && parameter<=iDataSize) {
       CE_Debug("CE_GET_HIGHLEVEL_CMDS %s\n", pData);
@@ -233,6 +253,25 @@ int CEPropertiesCommandHandler::HighLevelHandler(const char* pCommand, CEResultB
       cmd=CE_SET_LOGGING_LEVEL;
     else if (strncmp(pCommand, "CE_RELAX_CMD_VERS_CHECK", keySize=strlen("CE_RELAX_CMD_VERS_CHECK"))==0)
       cmd=CE_RELAX_CMD_VERS_CHECK;
+    else if (strncmp(pCommand, "CE_SET_SHELL_STREAMING", keySize=strlen("CE_SET_SHELL_STREAMING"))==0)
+      cmd=CE_SET_SHELL_STREAMING;
+#ifdef __BENCHMARK
+    else if (strncmp(pCommand, "CE_BENCHMARK_UPDATE", keySize=strlen("CE_BENCHMARK_UPDATE"))==0) {
+      int count=5000;
+      sscanf(pCommand+keySize, "%d", &count);
+      if ((iResult=ceBenchmarkUpdateServices(count, 100))>=0)
+	iResult=1;
+      return iResult;
+    }
+    else if (strncmp(pCommand, "CE_BENCHMARK_PUBLISH", keySize=strlen("CE_BENCHMARK_PUBLISH"))==0) {
+      int count=200;
+      int usec=50;
+      sscanf(pCommand+keySize, "%d %d", &count, &usec);
+      if ((iResult=ceBenchmarkPublishStage(count, 100, usec))>=0)
+	iResult=1;
+      return iResult;
+    }
+#endif //__BENCHMARK
 
     if (cmd>0 && keySize>0) {
       pBuffer+=keySize;
@@ -250,6 +289,17 @@ int CEPropertiesCommandHandler::HighLevelHandler(const char* pCommand, CEResultB
 	  iResult=-EPROTO;
 	}
 	break;
+      case CE_SET_SHELL_STREAMING:
+	{
+	  int period=0;
+	  if (sscanf(pBuffer, "%d", &period)>0 && period>=0 && period<=0xffff) {
+	    data=period;
+	  } else {
+	    CE_Error("error scanning high-level command %s\n", pCommand);
+	    iResult=-EPROTO;
+	  }
+	}
+	break;
       }
       if (iResult>=0) {
 	if ((iResult=issue(cmd, data, NULL, 0, rb))>=0) {
@@ -269,6 +319,72 @@ CEPropertiesCommandHandler g_PropertyCommandHandler;
  * list handling
  */
 TceServiceDesc* g_anchor=NULL; // list of services
+
+/**
+ * Services selected by a name pattern.
+ * Devices update their services by the base name on every state change,
+ * the matching entries are resolved once and kept until the list of
+ * services changes.
+ */
+struct ceServiceGroup_t {
+  /** hash of the pattern */
+  unsigned int hash;
+  /** the pattern */
+  string pattern;
+  /** matching services in list order */
+  vector<TceServiceDesc*> members;
+};
+vector<ceServiceGroup_t*> g_serviceGroups;
+
+/**
+ * FNV-1a hash of a string, the length is returned in addition.
+ */
+static unsigned int ceHashString(const char* str, int& length)
+{
+  unsigned int hash=2166136261U;
+  const char* p=str;
+  for (; *p!=0; p++) {
+    hash^=(unsigned char)*p;
+    hash*=16777619U;
+  }
+  length=p-str;
+  return hash;
+}
+
+static void ceClearServiceGroups()
+{
+  vector<ceServiceGroup_t*>::iterator element=g_serviceGroups.begin();
+  for (; element!=g_serviceGroups.end(); element++) {
+    delete *element;
+  }
+  g_serviceGroups.clear();
+}
+
+static ceServiceGroup_t* ceResolveServiceGroup(const char* pattern)
+{
+  int len=0;
+  unsigned int hash=ceHashString(pattern, len);
+  vector<ceServiceGroup_t*>::iterator element=g_serviceGroups.begin();
+  for (; element!=g_serviceGroups.end(); element++) {
+    if ((*element)->hash==hash && (*element)->pattern.compare(pattern)==0) {
+      return *element;
+    }
+  }
+  ceServiceGroup_t* pGroup=new ceServiceGroup_t;
+  if (pGroup) {
+    pGroup->hash=hash;
+    pGroup->pattern=pattern;
+    for (TceServiceDesc* pDesc=g_anchor; pDesc!=NULL; pDesc=pDesc->pNext) {
+      if (pDesc->pFctUpdate && pDesc->pName &&
+	  ((string*)pDesc->pName)->compare(0, len, pattern)==0) {
+	pGroup->members.push_back(pDesc);
+      }
+    }
+    g_serviceGroups.push_back(pGroup);
+  }
+  return pGroup;
+}
+
 int ceInsertService(TceServiceDesc* pEntry) {
   int iResult=0;
   if (pEntry) {
@@ -276,6 +392,7 @@ int ceInsertService(TceServiceDesc* pEntry) {
       pEntry->pNext=g_anchor;
     }
     g_anchor=pEntry;
+    ceClearServiceGroups();
   } else {
     iResult=-EINVAL;
   }
@@ -302,8 +419,10 @@ TceServiceDesc* ceFindService(const char* name) {
 
 int ceCleanupServices() {
   int iResult=0;
+  ceStopPublishStage();
   TceServiceDesc* pDesc=g_anchor;
   g_anchor=NULL;
+  ceClearServiceGroups();
   while (pDesc!=NULL) {
     TceServiceDesc* pNext=pDesc->pNext;
     // the item and the name is released by the feeserver core
@@ -325,63 +444,582 @@ void ceAbortUpdate()
   g_abort=1;
 }
 
+/**
+ * Publish a service on DIM.
+ */
+static void cePublishServiceDesc(TceServiceDesc* pDesc, int bForce)
+{
+  const char* name="unknown";
+  if (pDesc->pName) name=((string*)pDesc->pName)->c_str();
+  int count=0;
+  if (pDesc->dimid>0) {
+    count=ce_dis_update_service(pDesc->dimid);
+  } else {
+    count=UpdateFeeService(name);      
+  }
+  if (count>=0 && bForce) {
+    CE_Info("service %s updated to %d client(s)\n", name, count);
+  }
+}
+
+/**
+ * Publish stage for int services.
+ * The value becomes the published one and is published if it changed.
+ */
+static void cePublishValue(TceServiceDesc* pDesc, const TceServiceData& value, int bForce)
+{
+  int doUpdate=bForce;
+  if (pDesc->data.iVal!=value.iVal) doUpdate=1;
+  pDesc->data=value;
+  if (doUpdate) cePublishServiceDesc(pDesc, bForce);
+}
+
+/**
+ * Read the value of one service from the hardware.
+ */
+static int ceReadServiceDesc(TceServiceDesc* pDesc, TceServiceData* pData)
+{
+  int iResult=0;
+  int iTempres=0;
+  if ((iTempres=(*pDesc->pFctUpdate)(pData, pDesc->major, pDesc->minor, pDesc->parameter))<0) {
+    const char* name="unknown";
+    if (pDesc->pName) name=((string*)pDesc->pName)->c_str();
+    CE_Warning("update for entry %p (%s) returned %d\n", pDesc, name, iTempres);
+    iResult=-EREMOTEIO;
+  }
+  return iResult;
+}
+
+/**
+ * Check whether a string value changed since the last publication.
+ * Strings are compared by hash and length.
+ */
+static int ceStringChanged(TceServiceDesc* pDesc)
+{
+  if (pDesc->data.strVal==NULL) return 0;
+  int length=0;
+  unsigned int hash=ceHashString(((string*)pDesc->data.strVal)->c_str(), length);
+  if (hash==pDesc->valuehash && length==pDesc->valuelength) return 0;
+  pDesc->valuehash=hash;
+  pDesc->valuelength=length;
+  return 1;
+}
+
+/**
+ * Update one service, used if the publish stage is not running.
+ * Only changed values are published, float values are checked against
+ * the deadband by the core.
+ */
+static int ceUpdateServiceDesc(TceServiceDesc* pDesc, int bForce)
+{
+  int iResult=0;
+  if (pDesc->datatype==eDataTypeInt) {
+    if ((iResult=ceReadServiceDesc(pDesc, &pDesc->staged))>=0) {
+      cePublishValue(pDesc, pDesc->staged, bForce);
+    }
+  } else if ((iResult=ceReadServiceDesc(pDesc, &pDesc->data))>=0) {
+    int doUpdate=bForce;
+    if (pDesc->datatype==eDataTypeString && ceStringChanged(pDesc)) doUpdate=1;
+    if (doUpdate) cePublishServiceDesc(pDesc, bForce);
+  }
+  return iResult;
+}
+
+/**
+ * @name publish stage
+ * The hardware reads of the update loop are decoupled from the DIM
+ * publication. The update loop hands the services to be published in
+ * batches to the publish thread and continues with the next reads.
+ * - int values are read into the staging field, the publish thread makes
+ *   them the published value and publishes them if they changed
+ * - float values are written directly by the update loop, the deadband
+ *   check and publication is done by the core, the publish thread only
+ *   handles forced updates
+ * - string values are written and compared by the update loop, the
+ *   publish thread publishes changed strings. A string service is not
+ *   read again before its pending publication is done.
+ *
+ * The stage runs only while the update loop or a command has exclusive
+ * access to the ControlEngine, it is flushed before the update cycle
+ * ends and when a command starts (see @ref ControlEngine::BeginIssue).
+ */
+
+/** entry of the publish queue */
+struct cePublishEntry_t {
+  /** the service */
+  TceServiceDesc* pDesc;
+  /** the value read by the update loop, int services only */
+  TceServiceData value;
+  /** force the publication */
+  int bForce;
+};
+
+/** number of services read before the batch is handed to the publish stage */
+#define CE_PUBLISH_BATCH_SIZE 16
+
+CE_Mutex g_publishMutex;
+CE_Condition g_publishCondition;
+/** values waiting for the publish thread */
+vector<cePublishEntry_t> g_publishQueue;
+/** current batch of the read stage */
+vector<cePublishEntry_t> g_readBatch;
+/** 1 publish thread running, 0 not yet started, -1 publish directly */
+int g_publishState=0;
+/** the publish thread is processing a batch */
+int g_publishBusy=0;
+/** termination request for the publish thread */
+int g_publishTerminate=0;
+pthread_t g_publishThread;
+
+/**
+ * Publish one entry of the publish queue.
+ */
+static void cePublishEntry(const cePublishEntry_t& entry)
+{
+  if (entry.pDesc->datatype==eDataTypeInt) {
+    cePublishValue(entry.pDesc, entry.value, entry.bForce);
+  } else {
+    cePublishServiceDesc(entry.pDesc, entry.bForce);
+  }
+}
+
+static void* cePublishThread(void*)
+{
+  vector<cePublishEntry_t> batch;
+  g_publishMutex.Lock();
+  while (g_publishTerminate==0 || g_publishQueue.size()>0) {
+    if (g_publishQueue.size()==0) {
+      g_publishCondition.Wait(g_publishMutex);
+      continue;
+    }
+    batch.swap(g_publishQueue);
+    g_publishBusy=1;
+    g_publishMutex.Unlock();
+    vector<cePublishEntry_t>::iterator element=batch.begin();
+    for (; element!=batch.end(); element++) {
+      cePublishEntry(*element);
+    }
+    g_publishMutex.Lock();
+    for (element=batch.begin(); element!=batch.end(); element++) {
+      element->pDesc->pending=0;
+    }
+    batch.clear();
+    g_publishBusy=0;
+    g_publishCondition.Broadcast();
+  }
+  g_publishMutex.Unlock();
+  return NULL;
+}
+
+static int ceStartPublishStage()
+{
+  int iResult=0;
+  g_publishTerminate=0;
+  // the lazy initialization is not thread safe
+  g_publishMutex.Init();
+  g_publishCondition.Init();
+  if ((iResult=pthread_create(&g_publishThread, NULL, cePublishThread, NULL))==0) {
+    g_publishState=1;
+  } else {
+    CE_Warning("can not start publish thread (%d), values are published by the update loop\n", iResult);
+    g_publishState=-1;
+    iResult=-iResult;
+  }
+  return iResult;
+}
+
+/**
+ * Hand the current batch of the read stage to the publish thread.
+ */
+static void ceQueueReadBatch()
+{
+  if (g_readBatch.size()==0) return;
+  CE_LockGuard g(g_publishMutex);
+  g_publishQueue.insert(g_publishQueue.end(), g_readBatch.begin(), g_readBatch.end());
+  g_readBatch.clear();
+  g_publishCondition.Broadcast();
+}
+
+int ceFlushPublishStage()
+{
+  ceQueueReadBatch();
+  CE_LockGuard g(g_publishMutex);
+  while (g_publishState>0 && (g_publishQueue.size()>0 || g_publishBusy)) {
+    g_publishCondition.Wait(g_publishMutex);
+  }
+  return 0;
+}
+
+void ceStopPublishStage()
+{
+  if (g_publishState>0) {
+    ceQueueReadBatch();
+    {
+      CE_LockGuard g(g_publishMutex);
+      g_publishTerminate=1;
+      g_publishCondition.Broadcast();
+    }
+    pthread_join(g_publishThread, NULL);
+  }
+  g_publishState=-1;
+}
+
+/**
+ * Check whether the publish stage still holds a string value of the service.
+ */
+static int ceStringPending(TceServiceDesc* pDesc)
+{
+  CE_LockGuard g(g_publishMutex);
+  return pDesc->pending;
+}
+
+/**
+ * Read stage of the update loop.
+ * Services are read and queued for the publish thread if they have to be
+ * published, services are updated directly if the publish thread is not
+ * available.
+ */
+static int ceReadStageServiceDesc(TceServiceDesc* pDesc, int bForce)
+{
+  int iResult=0;
+  if (g_publishState<=0) {
+    return ceUpdateServiceDesc(pDesc, bForce);
+  }
+  cePublishEntry_t entry;
+  entry.pDesc=pDesc;
+  entry.bForce=bForce;
+  switch (pDesc->datatype) {
+  case eDataTypeInt:
+    if ((iResult=ceReadServiceDesc(pDesc, &pDesc->staged))<0) return iResult;
+    entry.value=pDesc->staged;
+    break;
+  case eDataTypeString:
+    // the string object is published by the publish thread, it is not
+    // changed before the publication is done
+    if (ceStringPending(pDesc)) ceFlushPublishStage();
+    if ((iResult=ceReadServiceDesc(pDesc, &pDesc->data))<0) return iResult;
+    if (ceStringChanged(pDesc)==0 && bForce==0) return iResult;
+    {
+      CE_LockGuard g(g_publishMutex);
+      pDesc->pending=1;
+    }
+    entry.value=pDesc->data;
+    break;
+  default:
+    if ((iResult=ceReadServiceDesc(pDesc, &pDesc->data))<0) return iResult;
+    if (bForce==0) return iResult;
+    entry.value=pDesc->data;
+  }
+  g_readBatch.push_back(entry);
+  if (g_readBatch.size()>=CE_PUBLISH_BATCH_SIZE) ceQueueReadBatch();
+  return iResult;
+}
+
+/** time budget of the periodic update cycle in us */
+int g_updateBudget=1000000;
+/** the last periodic cycle did not poll all due services */
+int g_budgetExceeded=0;
+/** due services of the periodic cycle, kept to avoid allocation */
+vector<TceServiceDesc*> g_dueServices;
+
+void ceSetUpdateBudget(int usec)
+{
+  if (usec>0) g_updateBudget=usec;
+}
+
+/**
+ * Check whether a service name starts with the whole name segments of the
+ * pattern, segments are separated by '_'. "RCU_STATE" matches "RCU_STATE"
+ * and "RCU_STATE_X", but not "RCU_STATENAME".
+ */
+static int ceMatchNameSegments(const string& name, const char* pattern, int len)
+{
+  if (name.compare(0, len, pattern)!=0) return 0;
+  if (len==0 || (int)name.length()==len) return 1;
+  return pattern[len-1]=='_' || name[len]=='_';
+}
+
+int ceSetServiceSchedule(const char* pattern, int period, int priority, int flags)
+{
+  int count=0;
+  if (pattern==NULL) return -EINVAL;
+  int len=strlen(pattern);
+  for (TceServiceDesc* pDesc=g_anchor; pDesc!=NULL; pDesc=pDesc->pNext) {
+    if (pDesc->pName && ceMatchNameSegments(*((string*)pDesc->pName), pattern, len)) {
+      pDesc->period=period>0?period:0;
+      pDesc->priority=priority;
+      pDesc->flags=flags;
+      pDesc->nextpoll=0;
+      count++;
+    }
+  }
+  return count;
+}
+
+static unsigned int ceElapsedUsec(const struct timespec& start, const struct timespec& now)
+{
+  return (now.tv_sec-start.tv_sec)*1000000+(now.tv_nsec-start.tv_nsec)/1000;
+}
+
+/**
+ * Order of the due services, higher priority first and the longest
+ * overdue first within the same priority.
+ */
+static bool ceServiceDueOrder(const TceServiceDesc* a, const TceServiceDesc* b)
+{
+  if (a->priority!=b->priority) return a->priority>b->priority;
+  return (int)(a->nextpoll-b->nextpoll)<0;
+}
+
+/**
+ * The periodic update cycle.
+ * Services are polled according to period and priority within the time
+ * budget.
+ */
+static int ceUpdateScheduledServices()
+{
+  int iResult=0;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unsigned int startMs=start.tv_sec*1000+start.tv_nsec/1000000;
+  int minPriority=INT_MAX;
+  int maxPriority=INT_MIN;
+  g_dueServices.clear();
+  for (TceServiceDesc* pDesc=g_anchor; pDesc!=NULL; pDesc=pDesc->pNext) {
+    if (pDesc->pFctUpdate==NULL || (pDesc->flags&CE_SERVICE_ON_DEMAND)!=0) continue;
+    if (pDesc->period>0 && (int)(startMs-pDesc->nextpoll)<0) continue;
+    g_dueServices.push_back(pDesc);
+    if (pDesc->priority<minPriority) minPriority=pDesc->priority;
+    if (pDesc->priority>maxPriority) maxPriority=pDesc->priority;
+  }
+  // the list order is kept as long as all due services fit into the budget
+  if (minPriority!=maxPriority || g_budgetExceeded) {
+    sort(g_dueServices.begin(), g_dueServices.end(), ceServiceDueOrder);
+  }
+  int skipped=0;
+  now=start;
+  vector<TceServiceDesc*>::iterator element=g_dueServices.begin();
+  for (; element!=g_dueServices.end(); element++) {
+    if (g_abort) {
+      CE_Info("abort of update loop requested, terminate\n");
+      break;
+    }
+    TceServiceDesc* pDesc=*element;
+    unsigned int elapsed=ceElapsedUsec(start, now);
+    if (element!=g_dueServices.begin() && elapsed+pDesc->cost>(unsigned int)g_updateBudget) {
+      skipped=g_dueServices.end()-element;
+      break;
+    }
+    if (ceReadStageServiceDesc(pDesc, 0)<0)
+      iResult=-EREMOTEIO;
+    struct timespec last=now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pDesc->cost=(3*pDesc->cost+(int)ceElapsedUsec(last, now))/4;
+    pDesc->nextpoll=startMs+pDesc->period;
+  }
+  if ((skipped>0)!=(g_budgetExceeded!=0)) {
+    if (skipped>0) {
+      CE_Warning("update cycle exceeds its time budget of %d us, %d service(s) delayed\n", g_updateBudget, skipped);
+    } else {
+      CE_Info("update cycle back within its time budget\n");
+    }
+  }
+  g_budgetExceeded=skipped>0;
+  return iResult;
+}
+
 int ceUpdateServices(const char* pattern, int bForce) {
   int iResult=0;
   if (ceCheckOptionFlag(DEBUG_DISABLE_SRV_UPDT)==0) {
-    TceServiceDesc* pDesc=g_anchor;
     g_abort=0;
-    for (pDesc=g_anchor; pDesc!=NULL; pDesc=pDesc->pNext) {
-      if (g_abort) {
-	CE_Info("abort of update loop requested, terminate\n");
-	break;
-      }
-      string name("unknown");
-      if (pDesc->pName) name=*((string*)pDesc->pName);
-      //CE_Debug("updating service %s\n", name.c_str());
-      if (pDesc->pFctUpdate && (pattern==NULL ||
-				name.compare(0, strlen(pattern), pattern)==0)) {
-	string strBackup("");
-	int iBackup=0;
-	switch (pDesc->datatype) {
-	case eDataTypeInt: iBackup=pDesc->data.iVal; break;
-	case eDataTypeString: 
-	  if (pDesc->data.strVal) {
-	    strBackup=*((string*)pDesc->data.strVal);
-	  }
+    ceServiceGroup_t* pGroup=NULL;
+    if (g_publishState==0) ceStartPublishStage();
+    if (pattern==NULL && bForce==0) {
+      iResult=ceUpdateScheduledServices();
+    } else if (pattern==NULL) {
+      for (TceServiceDesc* pDesc=g_anchor; pDesc!=NULL; pDesc=pDesc->pNext) {
+	if (g_abort) {
+	  CE_Info("abort of update loop requested, terminate\n");
 	  break;
 	}
-	int iTempres=0;
-	if ((iTempres=(*pDesc->pFctUpdate)(&pDesc->data, pDesc->major, pDesc->minor, pDesc->parameter))<0) {
-	  CE_Warning("update for entry %p (%s) returned %d\n", pDesc, name.c_str(), iTempres);
+	if (pDesc->pFctUpdate && ceReadStageServiceDesc(pDesc, bForce)<0)
 	  iResult=-EREMOTEIO;
-	} else {
-	  int doUpdate=bForce;
-	  switch (pDesc->datatype) {
-	  case eDataTypeInt: doUpdate=(iBackup!=pDesc->data.iVal); break;
-	  case eDataTypeString:
-	    if (pDesc->data.strVal) {
-	      doUpdate|=strBackup.compare(*((string*)pDesc->data.strVal));
-	    }
-	    break;
-	  }
-	  if (doUpdate) {
-	    int count=0;
-	    if (pDesc->dimid>0) {
-	      count=ce_dis_update_service(pDesc->dimid);
-	    } else {
-	      count=UpdateFeeService(name.c_str());      
-	    }
-	    if (count>=0 && bForce) {
-	      CE_Info("service %s updated to %d client(s)\n", name.c_str(), count);
-	    }
-	  }
+      }
+    } else if ((pGroup=ceResolveServiceGroup(pattern))!=NULL) {
+      vector<TceServiceDesc*>::iterator element=pGroup->members.begin();
+      for (; element!=pGroup->members.end(); element++) {
+	if (g_abort) {
+	  CE_Info("abort of update loop requested, terminate\n");
+	  break;
 	}
+	if (ceReadStageServiceDesc(*element, bForce)<0)
+	  iResult=-EREMOTEIO;
       }
+    } else {
+      iResult=-ENOMEM;
     }
+    // the periodic cycle leaves the publication to the publish thread, the
+    // stage is flushed before the ControlEngine ends the cycle; explicit
+    // updates return when the values are published
+    if (pattern==NULL && bForce==0) ceQueueReadBatch();
+    else ceFlushPublishStage();
+  }
+  return iResult;
+}
+
+#ifdef __BENCHMARK
+static int ceBenchmarkUpdate(TceServiceData* data, int major, int minor, void* parameter)
+{
+  // the value does not change, nothing is published
+  return 0;
+}
+
+int ceBenchmarkUpdateServices(int count, int cycles)
+{
+  int iResult=0;
+  if (count<=0 || cycles<=0) return -EINVAL;
+  TceServiceDesc* pSaveAnchor=g_anchor;
+  vector<ceServiceGroup_t*> saveGroups=g_serviceGroups;
+  g_anchor=NULL;
+  g_serviceGroups.clear();
+  int groups=(count+31)/32;
+  char name[40];
+  for (int i=0; i<count && iResult>=0; i++) {
+    TceServiceDesc* pEntry=(TceServiceDesc*)malloc(sizeof(TceServiceDesc));
+    if (pEntry) {
+      memset(pEntry, 0, sizeof(TceServiceDesc));
+      sprintf(name, "BENCH_%04d_%02d", i/32, i%32);
+      pEntry->pName=new string(name);
+      pEntry->pFctUpdate=ceBenchmarkUpdate;
+      pEntry->major=i;
+      switch (i%3) {
+      case 0:
+	pEntry->datatype=eDataTypeFloat;
+	break;
+      case 1:
+	pEntry->datatype=eDataTypeInt;
+	break;
+      default:
+	pEntry->datatype=eDataTypeString;
+	pEntry->data.strVal=new string("benchmark string value");
+	pEntry->valuehash=ceHashString(((string*)pEntry->data.strVal)->c_str(), pEntry->valuelength);
+      }
+      pEntry->pNext=g_anchor;
+      g_anchor=pEntry;
+    } else {
+      iResult=-ENOMEM;
+    }
+  }
+  struct timeval start, full, group;
+  if (iResult>=0) {
+    gettimeofday(&start, NULL);
+    for (int cycle=0; cycle<cycles; cycle++) {
+      ceUpdateServices(NULL, 0);
+    }
+    ceFlushPublishStage();
+    gettimeofday(&full, NULL);
+    for (int cycle=0; cycle<cycles; cycle++) {
+      for (int i=0; i<groups; i++) {
+	sprintf(name, "BENCH_%04d_", i);
+	ceUpdateServices(name, 0);
+      }
+    }
+    gettimeofday(&group, NULL);
+    long usecFull=(full.tv_sec-start.tv_sec)*1000000+(full.tv_usec-start.tv_usec);
+    long usecGroup=(group.tv_sec-full.tv_sec)*1000000+(group.tv_usec-full.tv_usec);
+    char msg[200];
+    sprintf(msg, "CE update loop, %d services: %ld us per full cycle, %ld us per cycle over %d groups",
+	    count, usecFull/cycles, usecGroup/cycles, groups);
+    CE_Info("%s\n", msg);
+    createBenchmark(msg);
+  }
+  ceFlushPublishStage();
+  ceClearServiceGroups();
+  while (g_anchor) {
+    TceServiceDesc* pNext=g_anchor->pNext;
+    if (g_anchor->datatype==eDataTypeString) delete (string*)g_anchor->data.strVal;
+    delete (string*)g_anchor->pName;
+    free(g_anchor);
+    g_anchor=pNext;
   }
+  g_anchor=pSaveAnchor;
+  g_serviceGroups=saveGroups;
   return iResult;
 }
 
+static int ceBenchmarkRead(TceServiceData* data, int major, int minor, void* parameter)
+{
+  // busy wait in place of the hardware access, the value changes in every cycle
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((int)ceElapsedUsec(start, now)<minor);
+  data->iVal++;
+  return 0;
+}
+
+int ceBenchmarkPublishStage(int count, int cycles, int usec)
+{
+  int iResult=0;
+  if (count<=0 || cycles<=0 || usec<0) return -EINVAL;
+  ceFlushPublishStage();
+  TceServiceDesc* pSaveAnchor=g_anchor;
+  int saveState=g_publishState;
+  int saveBudget=g_updateBudget;
+  g_anchor=NULL;
+  g_updateBudget=INT_MAX;
+  char name[40];
+  for (int i=0; i<count && iResult>=0; i++) {
+    TceServiceDesc* pEntry=(TceServiceDesc*)malloc(sizeof(TceServiceDesc));
+    if (pEntry) {
+      memset(pEntry, 0, sizeof(TceServiceDesc));
+      sprintf(name, "BENCH_PUBLISH_%04d", i);
+      pEntry->pName=new string(name);
+      pEntry->pFctUpdate=ceBenchmarkRead;
+      pEntry->datatype=eDataTypeInt;
+      pEntry->major=i;
+      pEntry->minor=usec;
+      pEntry->pNext=g_anchor;
+      g_anchor=pEntry;
+    } else {
+      iResult=-ENOMEM;
+    }
+  }
+  long usecStage[2]={0, 0};
+  if (iResult>=0) {
+    // 0: publish thread, 1: publication by the update loop
+    for (int mode=0; mode<2; mode++) {
+      if (mode==1) g_publishState=-1;
+      else if (g_publishState==0) ceStartPublishStage();
+      struct timeval start, stop;
+      gettimeofday(&start, NULL);
+      for (int cycle=0; cycle<cycles; cycle++) {
+	ceUpdateServices(NULL, 0);
+	ceFlushPublishStage();
+      }
+      gettimeofday(&stop, NULL);
+      usecStage[mode]=(stop.tv_sec-start.tv_sec)*1000000+(stop.tv_usec-start.tv_usec);
+    }
+    char msg[200];
+    sprintf(msg, "CE publish stage, %d services, %d us per read: %ld us per cycle with publish thread, %ld us without",
+	    count, usec, usecStage[0]/cycles, usecStage[1]/cycles);
+    CE_Info("%s\n", msg);
+    createBenchmark(msg);
+  }
+  g_publishState=saveState;
+  g_updateBudget=saveBudget;
+  while (g_anchor) {
+    TceServiceDesc* pNext=g_anchor->pNext;
+    delete (string*)g_anchor->pName;
+    free(g_anchor);
+    g_anchor=pNext;
+  }
+  g_anchor=pSaveAnchor;
+  return iResult;
+}
+#endif //__BENCHMARK
+
 int ceSetValue(const char* name, float value) {
   int iResult=0;
   if (name) {
@@ -498,16 +1136,10 @@ int RegisterService(enum ceServiceDataType type, const char* name, float defDead
 	  char* sn=(char*)serviceName.c_str();
 	  string* pStrData=new string("");
 	  if (pStrData) {
-	    string* pStrBackup=new string("backup"); // publish at least once
-	    if (pStrBackup) {
-	      pEntry->data.strVal=pStrData;
-	      pEntry->databackup.strVal=pStrBackup;
-	      pEntry->dimid=ce_dis_add_service(sn, "C", 0, 0, 
-					       updateStringService, (long int)pEntry->data.strVal);
-	    } else {
-	      delete pStrData;
-	      iResult=-ENOMEM;
-	    }
+	    pEntry->data.strVal=pStrData;
+	    pEntry->valuelength=-1; // publish at least once
+	    pEntry->dimid=ce_dis_add_service(sn, "C", 0, 0, 
+					     updateStringService, (long int)pEntry->data.strVal);
 	  } else {
 	    iResult=-ENOMEM;
 	  }
@@ -524,6 +1156,7 @@ int RegisterService(enum ceServiceDataType type, const char* name, float defDead
 	pEntry->major=major;
 	pEntry->minor=minor;
 	pEntry->parameter=parameter;
+	pEntry->staged=pEntry->data;
 	ceInsertService(pEntry);
       } else {
 	if (pEntry) free(pEntry);
@@ -594,6 +1227,7 @@ int RegisterServiceGroup(enum ceServiceDataType type, const char* basename, int
  *  - @ref FEESVR_SET_FERO_DATA16
  *  - @ref FEESVR_SET_FERO_DATA8
  *  - @ref CE_FORCE_CH_UPDATE
+ *  - @ref CE_SET_SERVICE_SCHEDULE
  * 
  * High-Level commands
  * <pre>
@@ -601,6 +1235,7 @@ int RegisterServiceGroup(enum ceServiceDataType type, const char* basename, int
  *  FEESVR_SET_FERO_DATA16 <value>
  *  FEESVR_SET_FERO_DATA8  <value>
  *  CE_FORCE_CH_UPDATE
+ *  CE_SET_SERVICE_SCHEDULE <pattern> <period ms> [<priority> [<flags>]]
  * </pre>
  *
  * @ingroup rcu_ce_base_services
@@ -623,7 +1258,7 @@ class CEServiceCommandHandler : public CEIssueHandler
   /**
    * Enhanced selector method.
    * The handler is for the FEESVR_SET_FERO_DATA group and the 
-   * CE_FORCE_CH_UPDATE command.
+   * CE_FORCE_CH_UPDATE and CE_SET_SERVICE_SCHEDULE commands.
    * @return          1 if the handler can process the cmd with the parameter
    */
   int CheckCommand(__u32 cmd, __u32 parameter);
@@ -647,11 +1282,20 @@ class CEServiceCommandHandler : public CEIssueHandler
    * @see CEIssueHandler::HighLevelHandler for parameters and return values.
    */
   int HighLevelHandler(const char* pCommand, CEResultBuffer& rb);
+
+ private:
+  /**
+   * Set the poll schedule of the services matching the pattern.
+   * @see CE_SET_SERVICE_SCHEDULE for the payload.
+   * @return number of processed bytes, neg. error code if failed
+   */
+  int SetSchedule(__u32 parameter, const char* pData, int iDataSize);
 };
 
 int CEServiceCommandHandler::CheckCommand(__u32 cmd, __u32 parameter)
 {
   if (cmd==CE_FORCE_CH_UPDATE) return 1;
+  if (cmd==CE_SET_SERVICE_SCHEDULE) return 1;
   if ((cmd&(FEESERVER_CMD_ID_MASK|FEESERVER_CMD_MASK))==FEESVR_SET_FERO_DATA) return 1;
   return 0;
 }
@@ -660,6 +1304,9 @@ int CEServiceCommandHandler::GetPayloadSize(__u32 cmd, __u32 parameter)
 {
   int iWordSize=0;
   switch (cmd) {
+  case CE_SET_SERVICE_SCHEDULE:
+    iWordSize=3*sizeof(__u32);
+    break;
   case FEESVR_SET_FERO_DFLOAT:
     iWordSize=sizeof(float)/sizeof(__u32);
     //fall through
@@ -687,6 +1334,8 @@ int CEServiceCommandHandler::issue(__u32 cmd, __u32 parameter, const char* pData
   CE_Debug("setFeroData cmd=%#x parameter=%#x datasize=%d\n", cmd, parameter, iDataSize);
   int iWordSize=0;
   switch (cmd) {
+  case CE_SET_SERVICE_SCHEDULE:
+    return SetSchedule(parameter, pData, iDataSize);
   case FEESVR_SET_FERO_DFLOAT:
     iWordSize=sizeof(float)/sizeof(__u32);
     //fall through
@@ -745,6 +1394,33 @@ int CEServiceCommandHandler::issue(__u32 cmd, __u32 parameter, const char* pData
   return iResult;
 }
 
+int CEServiceCommandHandler::SetSchedule(__u32 parameter, const char* pData, int iDataSize)
+{
+  int iResult=0;
+  // period, priority and flags precede the zero terminated pattern
+  const int iHeaderSize=3*sizeof(__u32);
+  if (pData==NULL || parameter==0 || iDataSize<(int)parameter+iHeaderSize) {
+    CE_Error("service schedule: data size missmatch, %d byte(s) available, but %d expected\n", iDataSize, parameter+iHeaderSize);
+    return -EPROTO;
+  }
+  const __u32* pSchedule=(const __u32*)pData;
+  const char* pattern=pData+iHeaderSize;
+  if (pattern[parameter-1]!=0) {
+    CE_Error("service schedule: pattern is not zero terminated\n");
+    return -EPROTO;
+  }
+  int count=ceSetServiceSchedule(pattern, pSchedule[0], (int)pSchedule[1], pSchedule[2]);
+  if (count>0) {
+    CE_Info("poll schedule of %d service(s) matching %s: period %d ms, priority %d, flags %#x\n",
+	    count, pattern, pSchedule[0], (int)pSchedule[1], pSchedule[2]);
+    iResult=parameter+iHeaderSize;
+  } else {
+    CE_Warning("service schedule: no service matches %s\n", pattern);
+    iResult=-ENOENT;
+  }
+  return iResult;
+}
+
 int CEServiceCommandHandler::HighLevelHandler(const char* pCommand, CEResultBuffer& rb)
 {
   int iResult=0;
@@ -752,6 +1428,28 @@ int CEServiceCommandHandler::HighLevelHandler(const char* pCommand, CEResultBuff
   int keySize=0;
   int len=strlen(pCommand);
   const char* pBuffer=pCommand;
+  if (pCommand && strncmp(pCommand, "CE_SET_SERVICE_SCHEDULE", keySize=strlen("CE_SET_SERVICE_SCHEDULE"))==0) {
+    // <pattern> <period ms> [<priority> [<flags>]]
+    char pattern[256];
+    int period=0, priority=CE_SERVICE_PRIORITY_DEFAULT, flags=0;
+    if (sscanf(pCommand+keySize, "%255s %d %d %i", pattern, &period, &priority, &flags)<2) {
+      CE_Error("invalid high-level command %s\n", pCommand);
+      return -EPROTO;
+    }
+    int iNameLen=strlen(pattern)+1;
+    int iBufferSize=3+(iNameLen+3)/sizeof(__u32);
+    __u32* cmdBuffer=new __u32[iBufferSize];
+    if (cmdBuffer==NULL) return -ENOMEM;
+    memset(cmdBuffer, 0, iBufferSize*sizeof(__u32));
+    cmdBuffer[0]=period;
+    cmdBuffer[1]=priority;
+    cmdBuffer[2]=flags;
+    strcpy((char*)&cmdBuffer[3], pattern);
+    iResult=issue(CE_SET_SERVICE_SCHEDULE, iNameLen, (const char*)cmdBuffer, iBufferSize*sizeof(__u32), rb);
+    delete [] cmdBuffer;
+    return iResult;
+  }
+  keySize=0;
   if (pCommand) {
     //CE_Debug("CEServiceCommandHandler checks command %s\n", pCommand);
     if (strncmp(pCommand, "FEESVR_SET_FERO_DATA32", keySize=strlen("FEESVR_SET_FERO_DATA32"))==0)
@@ -1268,111 +1966,186 @@ int writeBufferToFile(const char* pFileName, const char* pData, int iDataSize)
   return iResult;
 }
 
+/* size of the read chunks from the pipes of a child process
+ * @ingroup CE_shex
+ */
+#define SHELL_READ_CHUNK 1024
+
+/* size of pending streamed output which is published without waiting for the period
+ * @ingroup CE_shex
+ */
+#define SHELL_STREAM_SIZE 4096
+
+/* publish the complete lines of a byte buffer via the standard log channel as info
+ * the characters after the last newline are kept at the beginning of the buffer
+ * unless bComplete is true
+ * @param buffer              the buffer
+ * @param bComplete           publish completely
+ * @param pMsg                message header
+ * @ingroup CE_shex
+ */
+static int publishStreamLines(vector<char>& buffer, int bComplete, const char* pMsg)
+{
+  unsigned int start=0;
+  unsigned int i=0;
+  for (i=0; i<buffer.size(); i++) {
+    if (buffer[i]!='\n') continue;
+    CE_Info("%s:\n%.*s\n", pMsg, (int)(i-start), &buffer[start]);
+    start=i+1;
+  }
+  if (bComplete && start<buffer.size()) {
+    CE_Info("%s:\n%.*s\n", pMsg, (int)(buffer.size()-start), &buffer[start]);
+    start=buffer.size();
+  }
+  buffer.erase(buffer.begin(), buffer.begin()+start);
+  return 0;
+}
+
 /* spawn a child process and run a program as the child
+ * The child is created by vfork, which is available on MMU-less systems and does
+ * not copy the address space. The stdout and stderr channels are multiplexed by
+ * poll and read while the child is running, the stdout data goes directly into the
+ * result buffer. In streaming mode (@ref CE_SET_SHELL_STREAMING) the stdout is
+ * published line by line via the log channel as soon as the period has expired or
+ * SHELL_STREAM_SIZE bytes are pending, the result buffer is not filled.
  * @param  argv           program name and arguments 
  * @param  bNonBlocking   return immediately, not yet implemented
  * @param  pRB            pointer to issue result buffer
- * @param  iVerbosity     0: don't read the stderr channel of the child and neither print info messages
+ * @param  iVerbosity     0: don't forward the stderr channel of the child and neither print info messages
  * @ingroup CE_shex
  */
 int spawnShellProgram(char const **argv, int bNonBlocking, CEResultBuffer* pRB, int iVerbosity)
 {
   int iResult=0;
   if (argv) {
-/*     const char** pArg=(const char**)argv; */
-/*     while (pArg && *pArg) { */
-/*       CE_Debug("argument: %s\n", *pArg); */
-/*       pArg++; */
-/*     } */
     pid_t child_pid=0;
     int result_pipe[2]; // childs stdout channel -> parents result buffer
     int error_pipe[2];  // childs stderr channel -> parents CE logging
-    int abnorm_pipe[2]; // childs exit value in case of execution error 
-    iResult=pipe(result_pipe);
-    if (iResult<0) {
+    int abnorm_pipe[2]; // childs errno in case of execution error, closed by a successful exec
+    if (pipe(result_pipe)<0) {
+      iResult=-errno;
       CE_Error("can not create pipe: error %d\n", iResult);
       return iResult;
     }
-    iResult=pipe(error_pipe);
-    if (iResult<0)  {
+    if (pipe(error_pipe)<0)  {
+      iResult=-errno;
       CE_Error("can not create pipe: error %d\n", iResult);
+      close(result_pipe[0]); close(result_pipe[1]);
       return iResult;
     }
-    iResult=pipe(abnorm_pipe);
-    if (iResult<0)  {
+    if (pipe(abnorm_pipe)<0)  {
+      iResult=-errno;
       CE_Error("can not create pipe: error %d\n", iResult);
+      close(result_pipe[0]); close(result_pipe[1]);
+      close(error_pipe[0]); close(error_pipe[1]);
       return iResult;
     }
-    child_pid=fork();
+    fcntl(abnorm_pipe[1], F_SETFD, FD_CLOEXEC);
+    child_pid=vfork();
     if (child_pid==0) {
-      // child process
+      // child process, shares the memory of the parent until exec
+      // only system calls are allowed here
       close(result_pipe[0]); // close read end of the pipe
       close(error_pipe[0]); // close read end of the pipe
       close(abnorm_pipe[0]); // close read end of the pipe
       dup2(result_pipe[1], STDOUT_FILENO);
       dup2(error_pipe[1], STDERR_FILENO);
-      // write a value to the pipe in order to avoid blocking
-      // when parent reads from the pipe
-      FILE* abnormStream=fdopen(abnorm_pipe[1], "w");
-      fwrite(&iResult, sizeof(int), 1, abnormStream);
-      fclose(abnormStream);
       execvp(argv[0], (char* const*)argv);
       // here we should never get if the exec was succesfull
-      fprintf(stderr, "error executing child process %s\n", argv[0]);
+      write(abnorm_pipe[1], &errno, sizeof(int));
+      _exit(127);
+    }
+    // parent process
+    close(result_pipe[1]); // close write end of the pipe
+    close(error_pipe[1]); // close write end of the pipe
+    close(abnorm_pipe[1]); // close write end of the pipe
+    if (child_pid<0) {
+      iResult=-errno;
+      CE_Error("can not create child process for %s: error %d\n", argv[0], iResult);
+      close(result_pipe[0]);
+      close(error_pipe[0]);
+      close(abnorm_pipe[0]);
+      return iResult;
+    }
+    // the pipe is closed by the exec, data is only available if the exec failed
+    int execErrno=0;
+    if (read(abnorm_pipe[0], &execErrno, sizeof(int))==sizeof(int)) {
+      CE_Error("error executing child process %s: %s\n", argv[0], strerror(execErrno));
       iResult=-EIO;
-      abnormStream=fdopen(abnorm_pipe[1], "w");
-      fwrite(&iResult, sizeof(int), 1, abnormStream);
-      fclose(abnormStream);
-      exit(iResult);
-    } else {
-      // parent process
-      close(result_pipe[1]); // close write end of the pipe
-      close(error_pipe[1]); // close write end of the pipe
-      close(abnorm_pipe[1]); // close write end of the pipe
-      FILE* resStream=fdopen(result_pipe[0], "r");
-      FILE* errStream=fdopen(error_pipe[0], "r");
-      // check the childs system status, but the child returns properly
-      // even if the execution failed. So the direct pipe for the 
-      // announcement of the failure was created
-      int child_status=0;
-      wait(&child_status);
-      // check the direct pipe for the return value
-      FILE* abnormStream=fdopen(abnorm_pipe[0], "r");
-      if (abnormStream) {
-	fread(&iResult, sizeof(int), 1, abnormStream);
-      } else {
-	CE_Error("severe internal system error, can not get file descriptor\n");
+    }
+    close(abnorm_pipe[0]);
+
+    // read the stdout and stderr channels until both are closed by the child
+    int bStream=g_iShellStreamPeriod>0;
+    int iResultSize=0; // bytes in the result buffer
+    vector<char> stream;
+    vector<char> errChannel;
+    string header="output of program "; header+=argv[0];
+    struct timeval lastPublish;
+    gettimeofday(&lastPublish, NULL);
+    char chunk[SHELL_READ_CHUNK];
+    struct pollfd fds[2];
+    fds[0].fd=result_pipe[0]; fds[0].events=POLLIN;
+    fds[1].fd=error_pipe[0];  fds[1].events=POLLIN;
+    if (pRB) pRB->resize(0);
+    while (fds[0].fd>=0 || fds[1].fd>=0) {
+      int iTimeout=-1;
+      if (bStream && stream.size()>0) iTimeout=g_iShellStreamPeriod;
+      int iReady=poll(fds, 2, iTimeout);
+      if (iReady<0) {
+	if (errno==EINTR) continue;
+	CE_Error("poll on pipes of child process %s failed: error %d\n", argv[0], errno);
+	break;
       }
-      fclose(abnormStream);
-      if(iResult>=0 && WIFEXITED(child_status)) {
-	char retCode=WEXITSTATUS(child_status);
-	if (iVerbosity>0) CE_Info("program %s finished with exit code %d\n", argv[0], retCode);
-	if (pRB) {
-	  // read the stdout of the child
-	  iResult=readStreamIntoVector(resStream, 1024, pRB);
+      int i=0;
+      for (i=0; i<2; i++) {
+	if (fds[i].fd<0 || (fds[i].revents&(POLLIN|POLLHUP|POLLERR))==0) continue;
+	int iRead=read(fds[i].fd, chunk, sizeof(chunk));
+	if (iRead<0 && errno==EINTR) continue;
+	if (iRead<=0) {
+	  // end of file or error, the channel is done
+	  close(fds[i].fd);
+	  fds[i].fd=-1;
+	  continue;
 	}
-      } else {
-	CE_Error("program %s exited abnormally\n", argv[0]);
-      }
-	if (iVerbosity>0) {
-	  // read the stderr of the child
-#ifdef OLD_PIPE_READ
-	  TstreamBuffer anchor;
-	  memset(&anchor, 0, sizeof(TstreamBuffer));
-	  int errSize=readStream(errStream, 0, &anchor);
-	  if (errSize>0) {
-	    flushStreamBuffer(&anchor, NULL, 1, NULL);
-	  }
-	  cleanStreamBuffers(&anchor);
-#else // OLD_PIPE_READ
-	  CEResultBuffer errChannel;
-	  if (readStreamIntoVector(errStream, 1024, &errChannel)>0) {
-	    flushStreamBuffer(&errChannel, NULL, 1, NULL);
+	if (i==1) {
+	  if (iVerbosity>0) {
+	    errChannel.insert(errChannel.end(), chunk, chunk+iRead);
+	    publishStreamLines(errChannel, 0, "message from program stderr channel");
 	  }
-#endif //OLD_PIPE_READ
+	} else if (bStream) {
+	  stream.insert(stream.end(), chunk, chunk+iRead);
+	} else if (pRB) {
+	  pRB->resize((iResultSize+iRead+sizeof(CEResultBuffer::value_type)-1)/sizeof(CEResultBuffer::value_type), 0);
+	  memcpy(((char*)&(*pRB)[0])+iResultSize, chunk, iRead);
+	  iResultSize+=iRead;
+	}
+      }
+      if (bStream && stream.size()>0) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	long msec=(now.tv_sec-lastPublish.tv_sec)*1000+(now.tv_usec-lastPublish.tv_usec)/1000;
+	if (msec>=g_iShellStreamPeriod || stream.size()>=SHELL_STREAM_SIZE) {
+	  publishStreamLines(stream, stream.size()>=SHELL_STREAM_SIZE, header.c_str());
+	  lastPublish=now;
 	}
-	if (resStream) fclose(resStream);
-	if (errStream) fclose(errStream);
+      }
+    }
+    if (fds[0].fd>=0) close(fds[0].fd);
+    if (fds[1].fd>=0) close(fds[1].fd);
+    if (bStream) publishStreamLines(stream, 1, header.c_str());
+    if (iVerbosity>0) publishStreamLines(errChannel, 1, "message from program stderr channel");
+
+    // the child has closed its channels, collect the exit status
+    int child_status=0;
+    while (waitpid(child_pid, &child_status, 0)<0 && errno==EINTR) {}
+    if(iResult>=0 && WIFEXITED(child_status)) {
+      char retCode=WEXITSTATUS(child_status);
+      if (iVerbosity>0) CE_Info("program %s finished with exit code %d\n", argv[0], retCode);
+      if (pRB) iResult=pRB->size()*sizeof(CEResultBuffer::value_type);
+    } else {
+      CE_Error("program %s exited abnormally\n", argv[0]);
+      if (pRB) pRB->resize(0);
     }
   } else {
     CE_Error("invalid pointer\n");
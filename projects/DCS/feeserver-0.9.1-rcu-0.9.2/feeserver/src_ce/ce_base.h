@@ -194,6 +194,24 @@ struct ceServiceDesc_t {
   int minor;
   /** pointer to user defined data */
   void* parameter;
+  /** hash of the last published string value */
+  unsigned int valuehash;
+  /** length of the last published string value, -1 if not yet published */
+  int valuelength;
+  /** poll period in ms, 0 polls in every update cycle */
+  int period;
+  /** poll priority, services with higher priority are polled first */
+  int priority;
+  /** schedule flags, see @ref CE_SERVICE_ON_DEMAND */
+  int flags;
+  /** time of the next poll in ms of the monotonic clock */
+  unsigned int nextpoll;
+  /** average duration of the update function in us */
+  int cost;
+  /** value of the last hardware read, owned by the read stage */
+  TceServiceData staged;
+  /** string value waiting for the publish stage, protected by the publish mutex */
+  int pending;
 };
 
 /***************************************************************************/
@@ -299,6 +317,50 @@ int ceCleanupServices();
  */
 int ceUpdateServices(const char* pattern, int bForce);
 
+/**
+ * Wait until the publish stage has published all values read so far.
+ * The update loop reads the services and hands the DIM publication to a
+ * separate thread. The function is called before the update cycle or a
+ * command releases the ControlEngine, before the published values are
+ * evaluated and before the service descriptors are released.
+ * @ingroup rcu_ce_base_services
+ */
+int ceFlushPublishStage();
+
+/**
+ * Flush and terminate the publish stage.
+ * Values read afterwards are published directly by the update loop.
+ * @ingroup rcu_ce_base_services
+ */
+void ceStopPublishStage();
+
+#ifdef __BENCHMARK
+/**
+ * Benchmark of the service update loop.
+ * A private list of services with dummy update functions is created
+ * and updated for the specified number of cycles, once completely and
+ * once for each group of 32 services selected by name pattern. The
+ * registered services are not affected, no DIM channel is updated.
+ * @param count      number of services
+ * @param cycles     number of update cycles
+ * @ingroup rcu_ce_base_services
+ */
+int ceBenchmarkUpdateServices(int count, int cycles);
+
+/**
+ * Benchmark of the publish stage.
+ * A private list of int services is created, the update functions
+ * change the value in every cycle and spend the specified time as
+ * hardware access. The cycle time is measured with the publish thread
+ * and with the publication done by the update loop.
+ * @param count      number of services
+ * @param cycles     number of update cycles
+ * @param usec       duration of the simulated hardware read
+ * @ingroup rcu_ce_base_services
+ */
+int ceBenchmarkPublishStage(int count, int cycles, int usec);
+#endif //__BENCHMARK
+
 /**
  * call the set function for a service 
  * this sets the value for a data point in the FEE
@@ -313,6 +375,50 @@ int ceSetValue(const char* name, float value);
  */
 int ceWriteService(const char* name, float value);
 
+/**
+ * The service is not polled in the periodic update cycle but only by
+ * @ref ceUpdateServices with a pattern or the force flag.
+ * @ingroup rcu_ce_base_services
+ */
+#define CE_SERVICE_ON_DEMAND 0x1
+
+/**
+ * Default poll priority of services.
+ * @ingroup rcu_ce_base_services
+ */
+#define CE_SERVICE_PRIORITY_DEFAULT 0
+
+/**
+ * Poll priority for cheap status services which should never be delayed.
+ * @ingroup rcu_ce_base_services
+ */
+#define CE_SERVICE_PRIORITY_HIGH 10
+
+/**
+ * Set the poll schedule of services.
+ * The periodic update cycle polls all due services in the order of their
+ * priority until the time budget (@ref ceSetUpdateBudget) is used up, the
+ * remaining services are polled first in the next cycle.
+ * The pattern matches whole name segments separated by '_', "FEC_01" selects
+ * "FEC_01" and "FEC_01_TEMP" but not "FEC_010". The schedule can also be set
+ * by the @ref CE_SET_SERVICE_SCHEDULE command.
+ * @param pattern    name or leading name segments of the services
+ * @param period     poll period in ms, 0 to poll in every cycle
+ * @param priority   poll priority, see @ref CE_SERVICE_PRIORITY_DEFAULT
+ * @param flags      schedule flags, see @ref CE_SERVICE_ON_DEMAND
+ * @return number of services changed
+ * @ingroup rcu_ce_base_services
+ */
+int ceSetServiceSchedule(const char* pattern, int period, int priority, int flags);
+
+/**
+ * Set the time budget of the periodic update cycle.
+ * The budget is adapted to the update rate of the FeeServer.
+ * @param usec       time budget in us
+ * @ingroup rcu_ce_base_services
+ */
+void ceSetUpdateBudget(int usec);
+
 /*******************************************************************************/
 
 /**
@@ -108,7 +108,7 @@ CEfecFMD::~CEfecFMD()
 
 const CEfec::service_t CEfecFMD::fServiceDesc[]={
   // add services here, see CEfecTPC::fServiceDesc in ce_tpc.cpp
-  {"TEMP",    6, 0.25  , 0.5  , 40  ,  50, 0}
+  {"TEMP",    6, 0.25  , 0.5  , 40  ,  50, 0, 5000}
 };
 
 int CEfecFMD::ArmorDevice()
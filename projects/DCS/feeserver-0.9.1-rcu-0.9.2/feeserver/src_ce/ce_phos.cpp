@@ -214,7 +214,7 @@ CEfecPHOS::~CEfecPHOS()
 
 const CEfec::service_t CEfecPHOS::fServiceDesc[]={
   // add services here, see CEfecTPC::fServiceDesc in ce_tpc.cpp
-  {"TEMP",    6, 0.25  , 0.5  , 40  ,  50, 0}
+  {"TEMP",    6, 0.25  , 0.5  , 40  ,  50, 0, 5000}
 };
 
 int CEfecPHOS::ArmorDevice()
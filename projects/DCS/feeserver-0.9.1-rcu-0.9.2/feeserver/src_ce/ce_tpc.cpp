@@ -124,12 +124,13 @@ const CEfec::service_t CEfecTPC::fServiceDesc[]={
 //   {"DSTBCNT",14,   1   , 0.0  , 0   , -1, 0},
 //   {"TSMWORD",15,   1   , 0.0  , 0   , -1, 0},
 //   {"USRATIO",16,   1   , 0.0  , 0   , -1, 0},
-  // the default services
-  {"TEMP",    6, 0.25  , 1.0  , 40  ,  50, 0},
-  {"AV",      7, 0.0043, 0.05 , 3.61, -1, 0},
-  {"AC",      8, 0.017 , 0.5 , 0.75, -1, 0},
-  {"DV",      9, 0.0043, 0.05 , 2.83, -1, 0},
-  {"DC",     10, 0.03  , 0.5 , 1.92, -1, 0}
+  // the default services, the MSM reads of the slowly changing values are
+  // spread over several update cycles by the poll period (ms)
+  {"TEMP",    6, 0.25  , 1.0  , 40  ,  50, 0, 5000},
+  {"AV",      7, 0.0043, 0.05 , 3.61, -1, 0, 10000},
+  {"AC",      8, 0.017 , 0.5 , 0.75, -1, 0, 2000},
+  {"DV",      9, 0.0043, 0.05 , 2.83, -1, 0, 10000},
+  {"DC",     10, 0.03  , 0.5 , 1.92, -1, 0, 2000}
 };
 
 int CEfecTPC::GetServiceDescription(const CEfec::service_t*  &pArray) const
@@ -203,6 +203,19 @@
 #define MSMCommand_branch	9
 #define MSMCommand_FECAdr	5
 #define MSMCommand_BCRegAdr	0
+
+// Instruction set of the RCU sequencer (ALTRO instruction memory)
+// The Altro bus address of an instruction is composed of
+// {bcast, bc/altro, branch, FEC, altro, channel, register}
+#define RCUSeq_WRITE		0x600000 // register write, followed by data word
+#define RCUSeq_DATA		0x700000 // data word of a register write
+#define RCUSeq_DATA_MASK	0x0fffff
+#define RCUSeq_END		0x390000 // end of sequence
+#define RCUSeq_bcast		18
+#define RCUSeq_bcal		17
+#define RCUSeq_branch		16
+#define RCUSeq_FECAdr		12
+#define RCUSeq_RegAdr		0
 		
 		
 //Defines for the Actel Device
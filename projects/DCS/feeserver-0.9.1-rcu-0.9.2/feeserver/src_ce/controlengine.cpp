@@ -20,8 +20,10 @@
 *************************************************************************/
 
 #include <cerrno>
+#include <climits>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include "ce_base.h"
 #include "controlengine.hpp"
 #include "rcu_issue.h" // temporary, for RCUce_Issue
@@ -41,7 +43,8 @@ ControlEngine::ControlEngine(std::string name)
   CEDimDevice(name),
   fSleepSec(1),
   fSleepUsec(0),
-  fProcFlags(0)
+  fProcFlags(0),
+  fPendingIssues(0)
 {
   SetInstance(this);
 }
@@ -52,6 +55,7 @@ ControlEngine::~ControlEngine() {
 
 ControlEngine* ControlEngine::fpInstance=NULL;
 CE_Mutex ControlEngine::fMutex;
+CE_Condition ControlEngine::fCondition;
 
 int ControlEngine::Run()
 {
@@ -85,16 +89,11 @@ int ControlEngine::RunCE()
 	ceClearOptionFlag(DEBUG_DISABLE_SRV_UPDT);
 	time_t fLastTimestamp;
 	time(&fLastTimestamp);
-	while ((fProcFlags&eTerminate)==0) {
-	  { // dont remove, its part of the lock guard
-	    CE_LockGuard g(ControlEngine::fMutex);
-	    // skip updating in this loop when other processes are active
-	    if (fProcFlags!=0) {
-	      CE_Info("active command interpretation, skip update\n");
-	      continue;
-	    }
-	    fProcFlags|=eUpdate;
-	  }
+	// the update cycles are scheduled on absolute deadlines, the period
+	// does not drift by the time the update itself takes
+	struct timespec deadline;
+	fCondition.GetTime(&deadline);
+	while (WaitForUpdate(deadline)>=0) {
 	  // dont leave the function according to the specifications
 #ifndef DISABLE_SERVICES
 	  if (ceCheckOptionFlag(DEBUG_DISABLE_SRV_UPDT)==0) {
@@ -103,10 +102,28 @@ int ControlEngine::RunCE()
 	    PostUpdate();
 	  }
 #endif //!DISABLE_SERVICES
-	  fProcFlags&=~eUpdate;
-	  if (fSleepSec>0) ce_sleep(fSleepSec);
-	  else if (fSleepUsec) ce_usleep(fSleepUsec);
-	  else ce_sleep(1);
+	  // the publish thread must not run while commands access the services
+	  ceFlushPublishStage();
+	  struct timespec now;
+	  {
+	    CE_LockGuard g(ControlEngine::fMutex);
+	    fProcFlags&=~eUpdate;
+	    fCondition.Broadcast();
+	  }
+	  time_t periodSec=fSleepSec;
+	  long periodNsec=fSleepUsec*1000L;
+	  if (periodSec==0 && periodNsec==0) periodSec=1;
+	  fCondition.GetTime(&now);
+	  // skip the cycles which have been missed by a long update or command
+	  do {
+	    deadline.tv_sec+=periodSec;
+	    deadline.tv_nsec+=periodNsec;
+	    if (deadline.tv_nsec>=1000000000) {
+	      deadline.tv_sec++;
+	      deadline.tv_nsec-=1000000000;
+	    }
+	  } while (deadline.tv_sec<now.tv_sec || 
+		   (deadline.tv_sec==now.tv_sec && deadline.tv_nsec<=now.tv_nsec));
 	  if (difftime(time(NULL),fLastTimestamp)>=10) {
 	    time(&fLastTimestamp);
 	    string timeString=ctime(&fLastTimestamp);
@@ -117,15 +134,94 @@ int ControlEngine::RunCE()
       }
     }
   }
+  // publish the last values, later updates are published directly
+  ceStopPublishStage();
   if (bRunning) {
     CE_Debug("ControlEngine::RunCE terminated (%d)\n", iResult);
   } else {
     ce_ready(FEE_FAILED);
   }
+  CE_LockGuard g(ControlEngine::fMutex);
   fProcFlags|=eUpdateTerminated;
+  fCondition.Broadcast();
   return iResult;
 }
 
+int ControlEngine::WaitForUpdate(const struct timespec& deadline)
+{
+  CE_LockGuard g(ControlEngine::fMutex);
+  while ((fProcFlags&eTerminate)==0) {
+    // commands have priority, the CPU is left to them and the DIM threads
+    if (fPendingIssues>0 || (fProcFlags&eIssue)!=0) {
+      fCondition.Wait(ControlEngine::fMutex);
+      continue;
+    }
+    struct timespec now;
+    fCondition.GetTime(&now);
+    if (now.tv_sec>deadline.tv_sec ||
+	(now.tv_sec==deadline.tv_sec && now.tv_nsec>=deadline.tv_nsec)) {
+      fProcFlags|=eUpdate;
+      return 0;
+    }
+    fCondition.TimedWait(ControlEngine::fMutex, &deadline);
+  }
+  return -ECANCELED;
+}
+
+int ControlEngine::BeginIssue()
+{
+  {
+    CE_LockGuard g(ControlEngine::fMutex);
+    fPendingIssues++;
+    ceAbortUpdate();
+    while ((fProcFlags&eTerminate)==0 && (fProcFlags&(eUpdate|eIssue))!=0) {
+      fCondition.Wait(ControlEngine::fMutex);
+    }
+    fPendingIssues--;
+    if (fProcFlags&eTerminate) {
+      fCondition.Broadcast();
+      return -ECANCELED;
+    }
+    fProcFlags|=eIssue;
+  }
+  // values of a previous explicit update are published before the command
+  // accesses the services
+  ceFlushPublishStage();
+  return 0;
+}
+
+int ControlEngine::EndIssue()
+{
+  CE_LockGuard g(ControlEngine::fMutex);
+  fProcFlags&=~eIssue;
+  fCondition.Broadcast();
+  return 0;
+}
+
+int ControlEngine::YieldIssue()
+{
+  {
+    CE_LockGuard g(ControlEngine::fMutex);
+    if ((fProcFlags&eIssue)==0) return -ENOLCK;
+    if (fPendingIssues==0) return 0;
+    fProcFlags&=~eIssue;
+    fCondition.Broadcast();
+    // the waiting commands go first, a new update cycle is aborted
+    while ((fProcFlags&eTerminate)==0 &&
+	   (fPendingIssues>0 || (fProcFlags&(eUpdate|eIssue))!=0)) {
+      if (fProcFlags&eUpdate) ceAbortUpdate();
+      fCondition.Wait(ControlEngine::fMutex);
+    }
+    if (fProcFlags&eTerminate) {
+      fCondition.Broadcast();
+      return -ECANCELED;
+    }
+    fProcFlags|=eIssue;
+  }
+  ceFlushPublishStage();
+  return 1;
+}
+
 int ControlEngine::Terminate()
 {
   int iResult=0;
@@ -137,24 +233,51 @@ int ControlEngine::Terminate()
   return iResult;
 }
 
+int ControlEngine::BeginExclusiveAccess()
+{
+  if (fpInstance==NULL) return -ENOENT;
+  return fpInstance->BeginIssue();
+}
+
+int ControlEngine::EndExclusiveAccess()
+{
+  if (fpInstance==NULL) return -ENOENT;
+  return fpInstance->EndIssue();
+}
+
+int ControlEngine::YieldExclusiveAccess()
+{
+  if (fpInstance==NULL) return -ENOENT;
+  return fpInstance->YieldIssue();
+}
+
 int ControlEngine::TerminateCE()
 {
+  {
+    CE_LockGuard g(ControlEngine::fMutex);
+    CE_Debug("ControlEngine::TerminateCE %p\n", this);
+    fProcFlags|=eTerminate;
+    fCondition.Broadcast();
+    ceAbortUpdate();
+  }
+  // the transition workers call the handlers of the devices, they are
+  // stopped while all devices are alive; workers waiting for exclusive
+  // access are released by the terminate flag
+  StopTransitionWorkers();
   CE_LockGuard g(ControlEngine::fMutex);
   int iResult=0;
-  CE_Debug("ControlEngine::TerminateCE %p\n", this);
-  fProcFlags|=eTerminate;
-  int count=0;
-  int sleeptime=fSleepSec>0?fSleepSec:1;
   // wait until the update and issue threads are finnished
+  // wait at least two update periods but maximum 60s
+  int sleeptime=fSleepSec>0?fSleepSec:1;
+  struct timespec deadline;
+  fCondition.GetTime(&deadline);
+  deadline.tv_sec+=(2*sleeptime>60)?2*sleeptime:60;
   while (fProcFlags&(eUpdate|eIssue) || (fProcFlags&eUpdateTerminated)==0) {
     CE_Debug("thraeds active (%#x), waiting ...\n", fProcFlags&(eUpdate|eIssue));
-    // wait at least two update periods but maximum 60s
-    if (count>1 && count*sleeptime>60) {
+    if (fCondition.TimedWait(ControlEngine::fMutex, &deadline)==ETIMEDOUT) {
       iResult=-ETIMEDOUT;
       break;
     }
-    ce_sleep(sleeptime);
-    count ++;
   }
   return iResult;
 }
@@ -168,14 +291,7 @@ int ControlEngine::Issue(char* command, char** result, int* size)
     *result=NULL;
     *size=0;
     if (fpInstance) {
-      CE_LockGuard g(ControlEngine::fMutex);
-      if ((fpInstance->fProcFlags&eTerminate)==0) {
-	ceAbortUpdate();
-	while (fpInstance->fProcFlags&eUpdate) {
-	  ce_usleep(200);
-	}
-
-	fpInstance->fProcFlags|=eIssue;
+      if (fpInstance->BeginIssue()>=0) {
 	char* pData=command;
 	int iProcessed=0;
 	CEResultBuffer rb;
@@ -227,7 +343,7 @@ int ControlEngine::Issue(char* command, char** result, int* size)
 	    }
 	  }
 	}
-	fpInstance->fProcFlags&=~eIssue;
+	fpInstance->EndIssue();
       }
     } else {
       iResult=-ENOENT;
@@ -298,22 +414,25 @@ int ControlEngine::SetUpdateRate(unsigned short millisec)
 {
   int iResult=0;
   if (fpInstance) {
-    if (millisec>=1000) {
-      fpInstance->SetUpdateRate(millisec/1000, 0);
-    } else {
-      fpInstance->SetUpdateRate(0, millisec*1000);
-    }
+    fpInstance->SetUpdateRate(millisec/1000, (millisec%1000)*1000);
   } else {
     iResult=-ENOENT;
   }
   return iResult;
 }
 
-int ControlEngine::SetUpdateRate(unsigned short sec, unsigned short usec)
+int ControlEngine::SetUpdateRate(unsigned short sec, unsigned int usec)
 {
   int iResult=0;
-  fSleepSec=sec;
-  fSleepUsec=usec;
+  CE_LockGuard g(ControlEngine::fMutex);
+  // full seconds of the usec argument are carried into the seconds
+  unsigned long period=sec+usec/1000000;
+  if (period>USHRT_MAX) period=USHRT_MAX;
+  fSleepSec=period;
+  fSleepUsec=usec%1000000;
+  // the service updates of one cycle have to fit into the period
+  unsigned long long budget=period*1000000ULL+fSleepUsec;
+  if (budget>0) ceSetUpdateBudget(budget>INT_MAX?INT_MAX:budget);
   return iResult;
 }
 
@@ -436,6 +555,12 @@ int ControlEngine::PostUpdate()
   return 0;
 }
 
+int ControlEngine::IssuePending()
+{
+  CE_LockGuard g(ControlEngine::fMutex);
+  return fPendingIssues>0;
+}
+
 extern "C" int ControlEngine_Run()
 {
   ControlEngine* pCE=CEagent::Create();
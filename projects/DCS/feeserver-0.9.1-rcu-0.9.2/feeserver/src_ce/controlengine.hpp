@@ -179,6 +179,30 @@ public:
    */
   static int HighLevelCommandHandler(const char* pCommand, CEResultBuffer& rb);
 
+  /**
+   * Get exclusive access for a thread which is not the issue thread.
+   * The thread is serialized with the update loop and the commands like
+   * a command, see @ref BeginIssue. Used by the transition workers of
+   * the state machines.
+   * @return 0 if ok, -ECANCELED if the CE terminates, -ENOENT if no CE is active
+   */
+  static int BeginExclusiveAccess();
+
+  /**
+   * Release the exclusive access obtained by @ref BeginExclusiveAccess.
+   */
+  static int EndExclusiveAccess();
+
+  /**
+   * Let waiting commands run before the thread continues.
+   * The exclusive access obtained by @ref BeginExclusiveAccess is released
+   * if commands are waiting for it and taken again after they have finished.
+   * Must not be called while holding a lock a command can wait for.
+   * @return 1 if commands have been served, 0 if none was waiting,
+   *         -ECANCELED if the CE terminates, the access is lost then
+   */
+  static int YieldExclusiveAccess();
+
 protected:
   /**
    * Set the instance of the active ControlEngine.
@@ -195,6 +219,14 @@ protected:
    */
   int ResetInstance(ControlEngine* pInstance);
 
+  /**
+   * Check whether commands are waiting for execution.
+   * Can be used by the @ref PostUpdate handler to leave the CPU and the
+   * hardware to the commands.
+   * @return 1 if commands are pending, 0 if not
+   */
+  int IssuePending();
+
 private:
   /**
    * Main entry point of the CE.
@@ -213,8 +245,40 @@ private:
 
   /**
    * Set the update rate.
+   * The period is sec seconds plus usec micro seconds, usec may exceed
+   * one second.
+   */
+  int SetUpdateRate(unsigned short sec, unsigned int usec);
+
+  /**
+   * Get exclusive access for a command.
+   * Commands have priority over the update loop, a running update is
+   * aborted and no new update cycle is started while commands are waiting.
+   * The function blocks until the running update or command has finished.
+   * @return 0 if the command can be executed, -ECANCELED if the CE terminates
    */
-  int SetUpdateRate(unsigned short sec, unsigned short usec);
+  int BeginIssue();
+
+  /**
+   * Release the exclusive access and wake up waiting commands and the
+   * update loop.
+   */
+  int EndIssue();
+
+  /**
+   * Give the exclusive access to the waiting commands and take it again,
+   * see @ref YieldExclusiveAccess.
+   */
+  int YieldIssue();
+
+  /**
+   * Wait for the deadline of the next update cycle.
+   * The deadline is an absolute time of the clock of @ref fCondition. The
+   * function returns earlier if the CE terminates and waits longer as long
+   * as commands are pending or running.
+   * @return 0 if the update can start, -ECANCELED if the CE terminates
+   */
+  int WaitForUpdate(const struct timespec& deadline);
 
   /**
    * Init the ControlEngine.
@@ -267,17 +331,17 @@ private:
    * @ref signalFeePropertyChanged API function. 
    * @ingroup feesrv_ce
    */
-  short fSleepSec;
+  unsigned short fSleepSec;
 
   /**
    * Sleeping time in micro seconds.
-   * If the sleeping time is smaller than a second, this variable is used for a
-   * sleep in micro seconds, ignored otherwise. <br>
+   * The fraction of a second which is added to @ref fSleepSec, always
+   * below 1000000. <br>
    * The time is adapted to the FeeServer update rate in the 
    * @ref signalFeePropertyChanged API function. 
    * @ingroup feesrv_ce
    */
-  short fSleepUsec;
+  int fSleepUsec;
 
   /**
    * Flags to indicate different stages of the processing.
@@ -296,8 +360,14 @@ private:
   /** the processing flags for thread sync */
   short fProcFlags;
 
+  /** number of commands waiting for @ref BeginIssue */
+  int fPendingIssues;
+
   /** mutex */
   static CE_Mutex fMutex;
+
+  /** signalled on every change of the processing flags, used with fMutex */
+  static CE_Condition fCondition;
 };
 
 /**
@@ -23,7 +23,10 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <vector>
 #include "dev_actel.hpp"
+#include "dev_rcu.hpp"
 #include "ce_base.h"
 #include "dcscMsgBufferInterface.h"
 #include "selectmapInterface.h"
@@ -36,6 +39,11 @@ using namespace std;
 #define TRUE 1
 #define FALSE 0
 
+/** default number of 16 bit words in one chunk of a flash dump */
+#define ACTEL_FLASH_DUMP_CHUNK 0x2000
+/** maximum number of 16 bit words in one chunk of a flash dump */
+#define ACTEL_FLASH_DUMP_MAXCHUNK 0x10000
+
 /**** SERVICE HANDLER CALLBACKS     ********************************************/
 
 int updateActelRegister(TceServiceData* pData, int address, int type, void* parameter)
@@ -48,6 +56,16 @@ int updateActelRegister(TceServiceData* pData, int address, int type, void* para
   return iResult;    
 }
 
+int updateScrubStatistics(TceServiceData* pData, int id, int type, void* parameter)
+{
+  int iResult=0;
+  CEactel* pActel=(CEactel*)parameter;
+  if (pActel) {
+    iResult=pActel->UpdateScrubStatistics(pData, id);
+  }
+  return iResult;    
+}
+
 /**** END OF SERVICE HANDLER CALLBACKS     *************************************/
 
 ActelStateMapper g_ActelStateMapper;
@@ -56,7 +74,18 @@ ActelStateMapper g_ActelStateMapper;
 CEactel::CEactel()
   :
   CEDimDevice("ACTEL"),
-  CEIssueHandler(){
+  CEIssueHandler(),
+  fScrubMinInterval(0),
+  fScrubMaxInterval(0),
+  fScrubInterval(0),
+  fLastScrub(0),
+  fScrubPending(0),
+  fScrubFrameErrors(0),
+  fScrubCount(0),
+  fScrubErrors(0),
+  fScrubDeferred(0),
+  fScrubErrorRate(0.0),
+  fSmInit(0){
 
 
   SetTranslationScheme(&g_ActelStateMapper);
@@ -77,6 +106,9 @@ CEactel::CEactel()
 
 //Destructor
 CEactel::~CEactel(){
+  // the worker calls the handlers of this class
+  StopTransitionWorker();
+  if(fSmInit) releaseSmAccess();
 }
 
 
@@ -127,6 +159,35 @@ int CEactel::ArmorDevice(){
   name=GetServiceBaseName();
   name+="_FrameErrorCount";
   RegisterService(eDataTypeInt, name.c_str(), 0.0, updateActelRegister, NULL, ACTELReadbackErrorCount, eDataTypeInt, this);
+
+  //Background scrubbing
+  const char* interval = getenv("FEESERVER_SCRUB_INTERVAL");
+  if (interval) {
+    if (sscanf(interval, "%d,%d", &fScrubMinInterval, &fScrubMaxInterval)<2) {
+      fScrubMaxInterval = 16*fScrubMinInterval;
+    }
+    if (fScrubMinInterval<0) fScrubMinInterval = 0;
+    if (fScrubMaxInterval<fScrubMinInterval) fScrubMaxInterval = fScrubMinInterval;
+    fScrubInterval = fScrubMinInterval;
+    if (fScrubMinInterval>0) {
+      CE_Info("Actel Device: background scrubbing every %d to %d s\n", fScrubMinInterval, fScrubMaxInterval);
+    }
+  }
+  name=GetServiceBaseName();
+  name+="_ScrubCount";
+  RegisterService(eDataTypeInt, name.c_str(), 0.0, updateScrubStatistics, NULL, eScrubCount, eDataTypeInt, this);
+  name=GetServiceBaseName();
+  name+="_ScrubErrors";
+  RegisterService(eDataTypeInt, name.c_str(), 0.0, updateScrubStatistics, NULL, eScrubErrors, eDataTypeInt, this);
+  name=GetServiceBaseName();
+  name+="_ScrubDeferred";
+  RegisterService(eDataTypeInt, name.c_str(), 0.0, updateScrubStatistics, NULL, eScrubDeferred, eDataTypeInt, this);
+  name=GetServiceBaseName();
+  name+="_ScrubInterval";
+  RegisterService(eDataTypeInt, name.c_str(), 0.0, updateScrubStatistics, NULL, eScrubInterval, eDataTypeInt, this);
+  name=GetServiceBaseName();
+  name+="_ScrubErrorRate";
+  RegisterService(eDataTypeFloat, name.c_str(), 0.1, updateScrubStatistics, NULL, eScrubErrorRate, eDataTypeFloat, this);
   return iResult;
 }
 
@@ -339,14 +400,16 @@ int CEactel::TranslateActelCommand(__u32 cmd, __u32 parameter, const char* pData
     //iResult=TriggerTransition((CETransitionId)eGoReadback);
     break;
   case RCU_READ_FLASH:
+    iResult = ReadFlash(parameter, pData, iDataSize, rb);
     break;
   case RCU_WRITE_FLASH:
     //program the flash memory
+    iResult = WriteFlash(parameter, pData, iDataSize, rb);
     break;
     //erase the Flash Memory
   case RCU_ERASE_FLASH:
-    EraseFlash();
     CE_Info("Actel Device: received BOB command\n");
+    if ((iResult = EraseFlash())>0) iResult = 0;
     break;
     //do one initial configuration from the passed data
   case RCU_INIT_CONF:
@@ -355,8 +418,10 @@ int CEactel::TranslateActelCommand(__u32 cmd, __u32 parameter, const char* pData
   case RCU_SCRUBBING:
     break;
   case RCU_READ_FPGA_CONF:
+    iResult = ReadFpgaConf(parameter, pData, iDataSize, rb);
     break; 
   case RCU_WRITE_FPGA_CONF:
+    iResult = WriteFpgaConf(parameter, pData, iDataSize);
     break;
   default:
     CE_Warning("unrecognized command id (%#x)\n", cmd);
@@ -449,6 +514,8 @@ int CEactel::XilinxInit(){
     iResult = EIO;
     return iResult;
   }  
+  // the RCU registers are reset with the firmware
+  CErcu::FirmwareReconfigured();
   
   return iResult;
 }
@@ -465,6 +532,8 @@ int CEactel::XilinxStartup(){
     iResult = EIO;
     return iResult;
   }  
+  // the RCU registers are reset with the firmware
+  CErcu::FirmwareReconfigured();
   
   return iResult;
 }
@@ -879,7 +948,7 @@ int CEactel::GetGroupId(){
  * we pass them on to the TranslateActelCommand
  **/
 int CEactel::issue(__u32 cmd, __u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb){
-  TranslateActelCommand(cmd, parameter, pData, iDataSize, rb);
+  return TranslateActelCommand(cmd, parameter, pData, iDataSize, rb);
 }
 
 int CEactel::CheckCommand(__u32 cmd, __u32 parameter)
@@ -960,11 +1029,47 @@ int CEactel:: enterFlashState(int oldstate){
 return iResult;
 }
 
+int CEactel:: enterSelectmapState(int oldstate){
+  int iResult = 0;
+
+  if(fSmInit == 0){
+    if((iResult = initSmAccess(NULL)) < 0){
+      CE_Error("Actel Device: can not open selectmap interface: %d\n", iResult);
+      return iResult;
+    }
+    fSmInit = 1;
+  }
+  switch(oldstate){
+  case 1: //already in Selectmap State
+    break;
+  case 2: //state was Flash
+  case 3:
+    iResult = rcuBusControlCmd(eEnableMsgBuf);
+    if(iResult >= 0) iResult = rcuBusControlCmd(eEnableSelectmap);
+    if(iResult < 0){
+      CE_Warning("Actel Device: Error entering Selectmap Mode: %d\n", iResult);
+    }
+    break;
+  default:
+    iResult = -1;
+    CE_Warning("Actel Device: Error entering Selectmap Mode, unknown bus state\n");
+    break;
+  }
+  return iResult;
+}
+
 int CEactel:: restoreBusState(int oldstate){
   int iResult = 0;
   
   switch(oldstate){
   case 2: // was already in Flash State
+    if(rcuBusControlCmd(eCheckFlash) != 1){
+      iResult = rcuBusControlCmd(eEnableMsgBuf);
+      if(iResult >= 0) iResult = rcuBusControlCmd(eEnableFlash);
+      if(iResult < 0){
+	CE_Warning("Actel Device: Error entering Flash Mode: %d\n", iResult);
+      }
+    }
     break;
   case 1:
     //State was MsgBuf or SelectMap - switching to Flash
@@ -1001,15 +1106,277 @@ int CEactel:: EraseFlash(){
   
   iOldState = getBusState();
   
-  iResult = enterFlashState(iOldState);
+  enterFlashState(iOldState);
   
   iResult = rcuFlashErase(-1, 0);
   if(iResult < 0){
-    printf("Error erasing the Flash: %d", iResult);
+    CE_Error("Actel Device: error erasing the Flash: %d\n", iResult);
   }
   
-  iResult = restoreBusState(iOldState);
+  int iRestore = restoreBusState(iOldState);
+  if (iResult>=0 && iRestore<0) iResult = iRestore;
+
+  return iResult;
+}
+
+/******************************************
+ ***** Background scrubbing             ***
+ *****************************************/
+
+int CEactel::ScrubScheduler(int bIdle){
+  int iResult = 0;
+  if (fScrubMinInterval<=0 || GetCurrentState()!=eStateOn) return 0;
+
+  time_t now = time(NULL);
+  __u32 status = 0;
+  if (fScrubPending || difftime(now, fLastScrub)>=fScrubInterval) {
+    if ((iResult = rcuSingleRead(ACTELStatusReg, &status))<0) return iResult;
+  }
+  int bBusy = (status & 0x0040) != 0;
+
+  if (fScrubPending && !bBusy) {
+    // evaluate the last cycle
+    int errors = 0;
+    if (CheckErrorReg() < 0) errors++;
+    int frameErrors = NumberOfFrameErrors();
+    if (frameErrors != fScrubFrameErrors) errors++;
+    fScrubPending = 0;
+    float hours = difftime(now, fLastScrub)/3600.;
+    if (hours<1./3600.) hours = 1./3600.;
+    fScrubErrorRate = 0.75*fScrubErrorRate + 0.25*errors/hours;
+    if (errors>0) {
+      fScrubErrors++;
+      fScrubInterval /= 2;
+      if (fScrubInterval<fScrubMinInterval) fScrubInterval = fScrubMinInterval;
+      CE_Warning("Actel Device: scrub cycle %d found errors, scrub interval %d s\n", fScrubCount, fScrubInterval);
+    } else {
+      fScrubInterval += (fScrubInterval+3)/4;
+      if (fScrubInterval>fScrubMaxInterval) fScrubInterval = fScrubMaxInterval;
+    }
+  }
+
+  if (fScrubPending || difftime(now, fLastScrub)<fScrubInterval) return 0;
+  if (!bIdle || bBusy) {
+    // the bus belongs to commands and explicit operations, try in the next gap
+    fScrubDeferred++;
+    return 0;
+  }
+  fScrubFrameErrors = NumberOfFrameErrors();
+  if ((iResult = Scrub())==0) {
+    fScrubPending = 1;
+    fScrubCount++;
+    fLastScrub = now;
+  }
+  return iResult;
+}
+
+int CEactel::UpdateScrubStatistics(TceServiceData* pData, int id){
+  if (pData==NULL) return -EINVAL;
+  switch (id) {
+  case eScrubCount:     pData->iVal = fScrubCount;     break;
+  case eScrubErrors:    pData->iVal = fScrubErrors;    break;
+  case eScrubDeferred:  pData->iVal = fScrubDeferred;  break;
+  case eScrubInterval:  pData->iVal = fScrubInterval;  break;
+  case eScrubErrorRate: pData->fVal = fScrubErrorRate; break;
+  default:
+    return -EINVAL;
+  }
+  return 0;
+}
+
+/**
+ * Adler-32 checksum of a byte stream.
+ **/
+static __u32 adler32(const unsigned char* pData, int iSize)
+{
+  __u32 a=1, b=0;
+  while (iSize>0) {
+    // 5552 is the largest block which can not overflow the 32 bit sums
+    int block=iSize<5552?iSize:5552;
+    iSize-=block;
+    while (block-->0) {
+      a+=*pData++;
+      b+=a;
+    }
+    a%=65521;
+    b%=65521;
+  }
+  return (b<<16)|a;
+}
+
+int CEactel:: ReadFlash(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb){
+  int iOldState, iResult = 0;
+  if (pData==NULL || iDataSize<3*(int)sizeof(__u32)) {
+    CE_Error("Actel Device: flash dump requires address, size and sequence number\n");
+    return -EINVAL;
+  }
+  __u32 address = ((__u32*)pData)[0];
+  int nofWords = ((__u32*)pData)[1];
+  int seq = ((__u32*)pData)[2];
+  int chunkSize = parameter&0xffff;
+  if (chunkSize==0) chunkSize = ACTEL_FLASH_DUMP_CHUNK;
+  if (chunkSize>ACTEL_FLASH_DUMP_MAXCHUNK) chunkSize = ACTEL_FLASH_DUMP_MAXCHUNK;
+  chunkSize += chunkSize%2; // two words per 32 bit word in the result
+  if (nofWords<=0) return -EINVAL;
+  int nofChunks = (nofWords-1)/chunkSize+1;
+  if (seq<0 || seq>=nofChunks) {
+    CE_Error("Actel Device: chunk %d out of range, dump has %d chunk(s)\n", seq, nofChunks);
+    return -ERANGE;
+  }
+  __u32 chunkAddress = address+seq*chunkSize;
+  int chunkWords = nofWords-seq*chunkSize;
+  if (chunkWords>chunkSize) chunkWords = chunkSize;
+
+  vector<__u32> buffer(chunkWords, 0);
+  iOldState = getBusState();
+  enterFlashState(iOldState);
+  iResult = rcuFlashRead(chunkAddress, chunkWords, &buffer[0]);
+  int iRestore = restoreBusState(iOldState);
+  if (iResult<0) {
+    CE_Error("Actel Device: error reading the Flash at %#x: %d\n", chunkAddress, iResult);
+    return iResult;
+  }
+  if (iRestore<0) return iRestore;
+
+  // header: sequence number, number of chunks, address, number of words, checksum
+  int offset = rb.size();
+  rb.resize(offset+5+(chunkWords+1)/2, 0);
+  __u16* pTarget = (__u16*)&rb[offset+5];
+  for (int i=0; i<chunkWords; i++) {
+    pTarget[i] = buffer[i]&0xffff;
+  }
+  rb[offset] = seq;
+  rb[offset+1] = nofChunks;
+  rb[offset+2] = chunkAddress;
+  rb[offset+3] = chunkWords;
+  rb[offset+4] = adler32((const unsigned char*)pTarget, chunkWords*sizeof(__u16));
+  CE_Debug("Actel Device: flash dump chunk %d of %d, %d word(s) from %#x\n", seq+1, nofChunks, chunkWords, chunkAddress);
+  return 3*sizeof(__u32);
+}
+
+int CEactel:: ReadFpgaConf(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb){
+  int iOldState, iResult = 0;
+  if (pData==NULL || iDataSize<2*(int)sizeof(__u32)) {
+    CE_Error("Actel Device: readback requires frame address and number of words\n");
+    return -EINVAL;
+  }
+  __u32 frameAddress = ((__u32*)pData)[0];
+  int nofWords = ((__u32*)pData)[1];
+  if (nofWords<=0) return -EINVAL;
+  // the reference data is part of the payload if requested by the parameter
+  const __u32* pRef = NULL;
+  int iProcessed = 2*sizeof(__u32);
+  if (parameter&0x1) {
+    if (iDataSize<(2+nofWords)*(int)sizeof(__u32)) {
+      CE_Error("Actel Device: %d byte(s) of payload too short for %d reference word(s)\n", iDataSize, nofWords);
+      return -EINVAL;
+    }
+    pRef = ((__u32*)pData)+2;
+    iProcessed += nofWords*sizeof(__u32);
+  }
+
+  vector<__u32> buffer(nofWords, 0);
+  iOldState = getBusState();
+  if ((iResult = enterSelectmapState(iOldState))>=0 &&
+      (iResult = smRegisterWrite(SM_REG_FAR, frameAddress))>=0 &&
+      (iResult = smRegisterWrite(SM_REG_CMD, SM_CMD_RCFG))>=0) {
+    iResult = smBlockRead(SM_REG_FDRO, &buffer[0], nofWords);
+  }
+  restoreBusState(iOldState);
+  if (iResult<0) {
+    CE_Error("Actel Device: readback of %d word(s) from frame %#x failed: %d\n", nofWords, frameAddress, iResult);
+    return iResult;
+  }
+
+  if (pRef) {
+    int differ = 0;
+    int first = -1;
+    for (int i=0; i<nofWords; i++) {
+      if (buffer[i]==pRef[i]) continue;
+      if (first<0) first = i;
+      differ++;
+    }
+    if (differ>0) {
+      CE_Warning("Actel Device: verification found %d differing word(s), first at %d\n", differ, first);
+    }
+    rb.push_back(differ);
+    rb.push_back(first);
+  } else {
+    rb.insert(rb.end(), buffer.begin(), buffer.end());
+  }
+  return iProcessed;
+}
+
+int CEactel:: WriteFpgaConf(__u32 parameter, const char* pData, int iDataSize){
+  int iOldState, iResult = 0;
+  int nofWords = (iDataSize-(int)sizeof(__u32))/(int)sizeof(__u32);
+  if (parameter>0) {
+    if ((int)parameter>nofWords) {
+      CE_Error("Actel Device: %d byte(s) of payload too short for %d configuration word(s)\n", iDataSize, parameter);
+      return -EINVAL;
+    }
+    nofWords = parameter;
+  }
+  if (pData==NULL || nofWords<=0) {
+    CE_Error("Actel Device: configuration requires frame address and data\n");
+    return -EINVAL;
+  }
+  __u32 frameAddress = ((__u32*)pData)[0];
+  iOldState = getBusState();
+  if ((iResult = enterSelectmapState(iOldState))>=0 &&
+      (iResult = smRegisterWrite(SM_REG_FAR, frameAddress))>=0 &&
+      (iResult = smRegisterWrite(SM_REG_CMD, SM_CMD_WCFG))>=0) {
+    iResult = smBlockWrite(SM_REG_FDRI, ((__u32*)pData)+1, nofWords);
+  }
+  restoreBusState(iOldState);
+  if (iResult<0) {
+    CE_Error("Actel Device: writing %d word(s) to frame %#x failed: %d\n", nofWords, frameAddress, iResult);
+    return iResult;
+  }
+  return (1+nofWords)*sizeof(__u32);
+}
+
+int CEactel:: WriteFlash(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb){
+  int iOldState, iResult = 0;
+  if (pData==NULL || iDataSize<(int)sizeof(__u32)+2) {
+    CE_Error("Actel Device: invalid flash image of size %d\n", iDataSize);
+    return -EINVAL;
+  }
+  __u32 address = *((__u32*)pData);
+  int nofWords = (iDataSize-sizeof(__u32))/2;
+  if (parameter>0) {
+    if ((int)parameter>nofWords) {
+      CE_Error("Actel Device: %d byte(s) of payload too short for %d flash word(s)\n", iDataSize, parameter);
+      return -EINVAL;
+    }
+    nofWords = parameter;
+  }
+  // the 16 bit words are padded to the next 32 bit word
+  int iProcessed = sizeof(__u32)+((nofWords+1)/2)*sizeof(__u32);
+  if (iProcessed>iDataSize) iProcessed = iDataSize;
+  TrcuFlashProgramStat stat;
+  memset(&stat, 0, sizeof(stat));
+
+  iOldState = getBusState();
+  enterFlashState(iOldState);
+
+  iResult = rcuFlashProgram(address, (__u32*)(pData+sizeof(__u32)), nofWords, 2, &stat);
+  if(iResult < 0){
+    CE_Error("Actel Device: error programming the Flash: %d\n", iResult);
+  } else {
+    CE_Info("Actel Device: flash programmed in %ld us: %d block(s), %d unchanged, %d written, %d word(s)\n",
+	    stat.totalTime, stat.nofBlocks, stat.nofSkipped, stat.nofWritten, stat.nofWords);
+    rb.push_back(stat.nofBlocks);
+    rb.push_back(stat.nofSkipped);
+    rb.push_back(stat.nofWritten);
+    rb.push_back(stat.nofWords);
+    rb.push_back(stat.totalTime);
+  }
+
+  int iRestore = restoreBusState(iOldState);
+  if (iResult>=0 && iRestore<0) iResult = iRestore;
 
+  if (iResult>=0) iResult = iProcessed;
   return iResult;
 }
 
@@ -563,6 +563,49 @@ public:
    *****************************************/
   
   int EraseFlash();
+
+  /**
+   * Program an image into the Flash.
+   * Unchanged blocks are skipped, see @ref rcuFlashProgram.
+   * @param parameter  number of 16 bit words, 0 for the whole payload
+   * @param pData      payload: 32 bit start address followed by 16 bit words
+   * @param iDataSize  size of the payload in byte
+   * @param rb         result buffer, receives the statistics
+   * @return number of processed bytes of the payload, neg. error code if failed
+   **/
+  int WriteFlash(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb);
+
+  /**
+   * Read one chunk of a Flash dump.
+   * @param parameter  chunk size in 16 bit words, 0 for the default
+   * @param pData      payload: 32 bit start address, number of words and
+   *                   sequence number of the chunk
+   * @param iDataSize  size of the payload in byte
+   * @param rb         result buffer, receives header and data of the chunk
+   * @return number of processed bytes of the payload, neg. error code if failed
+   **/
+  int ReadFlash(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb);
+
+  /**
+   * Read back configuration frames of the Xilinx via the selectmap
+   * interface and optionally verify them.
+   * @param parameter  bit 0 set: reference data follows
+   * @param pData      payload: frame address, number of words, optional
+   *                   reference data
+   * @param iDataSize  size of the payload in byte
+   * @param rb         result buffer, receives the data or the verification result
+   * @return number of processed bytes of the payload, neg. error code if failed
+   **/
+  int ReadFpgaConf(__u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb);
+
+  /**
+   * Write configuration frames of the Xilinx via the selectmap interface.
+   * @param parameter  number of data words, 0 for the whole payload
+   * @param pData      payload: frame address followed by the frame data
+   * @param iDataSize  size of the payload in byte
+   * @return number of processed bytes of the payload, neg. error code if failed
+   **/
+  int WriteFpgaConf(__u32 parameter, const char* pData, int iDataSize);
   
 
   
@@ -581,6 +624,13 @@ public:
    * @return 
    **/
   int enterFlashState(int oldstate);
+
+  /**
+   * switch the bus to selectmap state, opens the selectmap interface
+   * at first use
+   * @return 
+   **/
+  int enterSelectmapState(int oldstate);
   
   /**
    * Restore the bus state given in the argument
@@ -588,7 +638,65 @@ public:
    **/
   int restoreBusState(int oldstate);
   
-  
+  /**********************************************
+   ***** Background scrubbing              ******
+   *********************************************/
+
+  /**
+   * Scheduler of the background scrubbing.
+   * Called after each service update cycle. A single scrub cycle is started
+   * when the scrub interval has elapsed, the ACTEL is idle and the device is
+   * in state STANDBY. The result of the previous cycle is evaluated from the
+   * error registers: the interval is halved after errors and relaxed by 25%
+   * after clean cycles, within the limits given by the environment variable
+   * <i>FEESERVER_SCRUB_INTERVAL</i>=min[,max] in seconds. Background
+   * scrubbing is disabled if the variable is not set.
+   * @param bIdle      no commands are pending, a scrub can be started
+   * @return neg. error code if failed
+   **/
+  int ScrubScheduler(int bIdle);
+
+  /**
+   * Update handler for the scrubbing statistics services.
+   * @param pData      service data
+   * @param id         id of the statistics value
+   * @return neg. error code if failed
+   **/
+  int UpdateScrubStatistics(TceServiceData* pData, int id);
+
+  /** ids of the scrubbing statistics */
+  enum {
+    eScrubCount = 0,
+    eScrubErrors,
+    eScrubDeferred,
+    eScrubInterval,
+    eScrubErrorRate
+  };
+
+private:
+  /** minimum scrub interval in s, 0 disables background scrubbing */
+  int fScrubMinInterval;
+  /** maximum scrub interval in s */
+  int fScrubMaxInterval;
+  /** current scrub interval in s */
+  int fScrubInterval;
+  /** time of the last scrub */
+  time_t fLastScrub;
+  /** a scrub cycle was started and not yet evaluated */
+  int fScrubPending;
+  /** readback error count at the start of the pending cycle */
+  int fScrubFrameErrors;
+  /** number of started scrub cycles */
+  int fScrubCount;
+  /** number of cycles which found errors */
+  int fScrubErrors;
+  /** number of cycles deferred because of pending commands or a busy ACTEL */
+  int fScrubDeferred;
+  /** errors per hour, exponential moving average */
+  float fScrubErrorRate;
+
+  /** the selectmap interface has been opened */
+  int fSmInit;
 };
 
 
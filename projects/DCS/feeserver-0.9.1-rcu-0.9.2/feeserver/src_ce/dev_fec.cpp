@@ -25,6 +25,7 @@
 #include <cstring>
 #include "dev_fec.hpp"
 #include "dev_rcu.hpp"
+#include "dev_msgbuffer.hpp"
 
 #define SERVICE_SIM_HYST 5
 using namespace std;
@@ -46,12 +47,24 @@ CEfec::CEfec(int id, CEDevice* pParent, std::string arguments, std::string name)
     fUpdateError(-1),
     fUpdateErrorCount(0),
     fTimeAccessFailure(0),
-    fTimesRangeExcess()
+    fTimesRangeExcess(),
+    fShadowCached(0),
+    fShadowValid(0),
+    fShadowHits(0),
+    fShadowMisses(0)
 {
+  memset(fShadowValue, 0, sizeof(fShadowValue));
+  // threshold registers T_TH, AV_TH, AC_TH, DV_TH, DC_TH
+  for (int reg=1; reg<=5; reg++) SetShadowPolicy(reg, 1);
+  SetShadowPolicy(0x0f, 1); // TSMWORD
+  SetShadowPolicy(0x10, 1); // USRATIO
+  SetShadowPolicy(FECCSR2, 1);
 }
 
 CEfec::~CEfec()
 {
+  // the worker calls the handlers of this class
+  StopTransitionWorker();
 }
 
 CEState CEfec::EvaluateHardware()
@@ -78,6 +91,8 @@ int CEfec::ArmorDevice()
     name+="_";
     name+=pArray[i].name;
     RegisterService(eDataTypeFloat, name.c_str(), pArray[i].deadband, updateFecService, NULL, fecId, i, this);
+    if (pArray[i].period>0)
+      ceSetServiceSchedule(name.c_str(), pArray[i].period, CE_SERVICE_PRIORITY_DEFAULT, 0);
     fListServices.push_back(pArray[i]);
     fTimesRangeExcess.push_back(0); // reset the time for this service
   }
@@ -127,7 +142,7 @@ int CEfec::EnterStateON()
        * The <i>Monitoring and Safety</i> module of the RCU firmware is set up to start
        * continuous monitoring. CSR0 of the BC set to 0x7FF.<br>
        */
-      iResult=rcu->WriteFecRegister(0x7FF, GetDeviceId(), FECCSR0);
+      iResult=WriteRegister(FECCSR0, 0x7FF);
     }
   }
   return iResult;
@@ -165,10 +180,12 @@ int CEfec::LeaveStateRUNNING()
 
 int CEfec::EnterStateERROR()
 {
+  int iResult=0;
   CErcu* rcu=(CErcu*)GetParentDevice();
   if (rcu) {
     rcu->SwitchAFL(GetDeviceId(), 0);
   }
+  return iResult;
 }
 
 int CEfec::SwitchOn(int iParam, void* pParam)
@@ -223,6 +240,67 @@ int CEfec::InitServices()
   return 0;
 }
 
+void CEfec::SetShadowPolicy(int reg, int bCached)
+{
+  if (reg<0 || reg>=FEC_SHADOW_REGS) return;
+  if (bCached) fShadowCached|=0x1<<reg;
+  else fShadowCached&=~(0x1<<reg);
+  fShadowValid&=~(0x1<<reg);
+}
+
+void CEfec::InvalidateShadow(int reg)
+{
+  if (reg<0) fShadowValid=0;
+  else if (reg<FEC_SHADOW_REGS) fShadowValid&=~(0x1<<reg);
+}
+
+void CEfec::GetShadowStatistics(int &hits, int &misses)
+{
+  hits=fShadowHits;
+  misses=fShadowMisses;
+}
+
+int CEfec::ReadRegister(int reg, int &data)
+{
+  int iResult=0;
+  CErcu* rcu=(CErcu*)GetParentDevice();
+  if (rcu==NULL) return -EFAULT;
+  // the shadow is only valid together with the access, see the lock order at CErcu::fMutex
+  CE_LockGuard m(CErcu::fMsmMutex);
+  DCSCSession s(rcu->GetMsgBuffer());
+  CE_LockGuard g(CErcu::fMutex);
+  int bCached=reg>=0 && reg<FEC_SHADOW_REGS && (fShadowCached&(0x1<<reg))!=0;
+  if (bCached && (fShadowValid&(0x1<<reg))!=0) {
+    data=fShadowValue[reg];
+    fShadowHits++;
+    return iResult;
+  }
+  if (bCached) fShadowMisses++;
+  if ((iResult=rcu->UpdateFecService(data, GetDeviceId(), reg))>=0 &&
+      bCached && rcu->IsUpdateTempDisabled()==0) {
+    fShadowValue[reg]=data;
+    fShadowValid|=0x1<<reg;
+  }
+  return iResult;
+}
+
+int CEfec::WriteRegister(int reg, int data)
+{
+  int iResult=0;
+  CErcu* rcu=(CErcu*)GetParentDevice();
+  if (rcu==NULL) return -EFAULT;
+  CE_LockGuard m(CErcu::fMsmMutex);
+  DCSCSession s(rcu->GetMsgBuffer());
+  CE_LockGuard g(CErcu::fMutex);
+  // the RCU invalidates the shadow for the write to the FEC command space
+  if ((iResult=rcu->WriteFecRegister(data, GetDeviceId(), reg))>=0 &&
+      reg>=0 && reg<FEC_SHADOW_REGS && (fShadowCached&(0x1<<reg))!=0) {
+    fShadowValue[reg]=data;
+    fShadowValid|=0x1<<reg;
+  }
+  return iResult;
+}
+
 int CEfec::UpdateFecService(TceServiceData* pData, int id, int reg)
 {
   int iResult=0;
@@ -260,8 +338,8 @@ int CEfec::UpdateFecService(TceServiceData* pData, int id, int reg)
 	    /** this is a temporary fix for the TPC test Jun 07
 	     * set to continous measurement each time
 	     */
-	    rcu->WriteFecRegister(0x7FF, GetDeviceId(), FECCSR0);
-	    if ((iResult=rcu->UpdateFecService(data, id, fListServices[reg].regNo))>=0) {
+	    WriteRegister(FECCSR0, 0x7FF);
+	    if ((iResult=ReadRegister(fListServices[reg].regNo, data))>=0) {
 	      switch (type) {
 	      case eDataTypeInt:
 		pData->iVal=(int)data;
@@ -31,6 +31,12 @@
 #include "lockguard.hpp"
 #include "ce_base.h"
 
+/**
+ * Number of board controller registers covered by the shadow register file
+ * of a FEC.
+ */
+#define FEC_SHADOW_REGS 32
+
 /**
  * @class CEfec
  * Device implementation base class for FECs.
@@ -95,6 +101,40 @@ public:
    * @param type
    */
   int UpdateFecService(TceServiceData* pData, int id, int reg);
+
+  /**
+   * Read a register of the board controller.
+   * Cacheable registers are served from the shadow register file if the
+   * shadow is valid, all other registers are read through the RCU.
+   * @param reg          register number
+   * @param data         target to receive the value
+   * @return             neg. error code if failed
+   */
+  int ReadRegister(int reg, int &data);
+
+  /**
+   * Write a register of the board controller.
+   * The shadow of a cacheable register follows the write.
+   * @param reg          register number
+   * @param data         value to write
+   * @return             neg. error code if failed
+   */
+  int WriteRegister(int reg, int data);
+
+  /**
+   * Invalidate the shadow registers.
+   * Called by the RCU if the FEC was switched or the registers were
+   * accessed by the sequencer or a raw write.
+   * @param reg          register number, -1 for all registers
+   */
+  void InvalidateShadow(int reg=-1);
+
+  /**
+   * Get the statistics of the shadow register file.
+   * @param hits         reads served from the shadow
+   * @param misses       reads of cacheable registers from the hardware
+   */
+  void GetShadowStatistics(int &hits, int &misses);
 private:
   /**
    * Evaluate the state of the hardware.
@@ -277,6 +317,12 @@ public:
     float max;
     /** min value */
     float min;
+    /** 
+     * poll period in ms, 0 polls in every update cycle. The BC registers
+     * are read through the MSM and are expensive, slowly changing values
+     * should use a period of several update cycles.
+     */
+    int period;
   };
 
 protected:
@@ -295,6 +341,17 @@ protected:
    * @return  neg. error code if failed
    */
   virtual int InitServices();
+
+  /**
+   * Set the shadow policy of a board controller register.
+   * By default the threshold registers, TSMWORD, USRATIO and CSR2 are
+   * cached, CSR0 is not since it is re-written in each update cycle.
+   * @param reg          register number
+   * @param bCached      1 the register changes only by writes and is served
+   *                     from the shadow, 0 it is always read from the hardware
+   */
+  void SetShadowPolicy(int reg, int bCached);
+
 private:
   /** service list */
   std::vector<service_t> fListServices;
@@ -310,6 +367,21 @@ private:
 
   /** time of first occurrence of range excess */
   std::vector<time_t> fTimesRangeExcess;
+
+  /** bit mask of the cacheable registers */
+  unsigned int fShadowCached;
+
+  /** bit mask of the valid shadow registers */
+  unsigned int fShadowValid;
+
+  /** the shadow register values */
+  int fShadowValue[FEC_SHADOW_REGS];
+
+  /** reads served from the shadow */
+  int fShadowHits;
+
+  /** reads of cacheable registers from the hardware */
+  int fShadowMisses;
 };
 
 #endif //RCU
@@ -48,7 +48,11 @@ DCSCMsgBuffer::DCSCMsgBuffer()
   : 
   CEDimDevice("MSGBUFFER"), 
   CEIssueHandler(),
-  fpStateMapper(new MsgBufferStateMapper)
+  fpStateMapper(new MsgBufferStateMapper),
+  fBatch(),
+  fBatchLevel(0),
+  fBatchOwner(0),
+  fBatchMutex()
 {
   // define additional transitions
   CETransition* pActivateFlash=new CETransition(eActivateFlash, eStateUser0, "", eStateUser1, eStateOn);
@@ -106,6 +110,7 @@ int DCSCMsgBuffer::ReleaseInstance(DCSCMsgBuffer* instance)
   } else {
     iResult=-EINVAL;
   }
+  return iResult;
 }
 
 int DCSCMsgBuffer::Release()
@@ -150,6 +155,7 @@ int DCSCMsgBuffer::SingleWrite(__u32 address, __u32 data)
   if (Check(blackList)) {
     return 0;
   }
+  if (QueueOperation(address, data, NULL)>0) return 0;
   return rcuSingleWrite(address, data);
 }
 
@@ -161,6 +167,7 @@ int DCSCMsgBuffer::SingleRead(__u32 address, __u32* pData)
     *pData=~((__u32)0);
     return 0;
   }
+  if (QueueOperation(address, 0, pData)>0) return 0;
   return rcuSingleRead(address, pData);
 }
 
@@ -171,6 +178,8 @@ int DCSCMsgBuffer::MultipleWrite(__u32 address, __u32* pData, int iSize, int iDa
   if (Check(blackList)) {
     return 0;
   }
+  int iResult=FlushBatch();
+  if (iResult<0) return iResult;
   return rcuMultipleWrite(address, pData, iSize, iDataSize);
 }
 
@@ -184,9 +193,105 @@ int DCSCMsgBuffer::MultipleRead(__u32 address, int iSize,__u32* pData)
     }
     return 0;
   }
+  int iResult=FlushBatch();
+  if (iResult<0) return iResult;
   return rcuMultipleRead(address, iSize,pData);
 }
 
+int DCSCMsgBuffer::BeginBatch()
+{
+  CE_LockGuard g(fBatchMutex);
+  if (fBatchLevel>0 && !pthread_equal(fBatchOwner, pthread_self())) {
+    return -EBUSY;
+  }
+  if (fBatchLevel++==0) {
+    fBatchOwner=pthread_self();
+    fBatch.clear();
+  }
+  return 0;
+}
+
+int DCSCMsgBuffer::Commit()
+{
+  {
+    CE_LockGuard g(fBatchMutex);
+    if (fBatchLevel==0 || !pthread_equal(fBatchOwner, pthread_self())) {
+      return -EBADF;
+    }
+    if (--fBatchLevel>0) return 0;
+  }
+  // the batch is closed, only the owner thread can still access the queue
+  int iResult=0;
+  if (fBatch.size()>0) {
+    iResult=ExecuteBatch(&fBatch[0], fBatch.size());
+    if (iResult<0) {
+      CE_Error("execution of %d queued operations failed with error %d\n", (int)fBatch.size(), iResult);
+    }
+  }
+  fBatch.clear();
+  return iResult<0?iResult:0;
+}
+
+int DCSCMsgBuffer::BatchOpen()
+{
+  CE_LockGuard g(fBatchMutex);
+  return fBatchLevel>0 && pthread_equal(fBatchOwner, pthread_self());
+}
+
+int DCSCMsgBuffer::QueueOperation(__u32 address, __u32 data, __u32* pData)
+{
+  if (fBatchLevel==0 || !pthread_equal(fBatchOwner, pthread_self())) {
+    return 0;
+  }
+  TrcuSingleOp op;
+  op.address=address;
+  op.data=data;
+  op.pData=pData;
+  fBatch.push_back(op);
+  return 1;
+}
+
+int DCSCMsgBuffer::FlushBatch()
+{
+  if (fBatchLevel==0 || !pthread_equal(fBatchOwner, pthread_self()) || fBatch.size()==0) {
+    return 0;
+  }
+  int iResult=ExecuteBatch(&fBatch[0], fBatch.size());
+  if (iResult<0) {
+    CE_Error("execution of %d queued operations failed with error %d\n", (int)fBatch.size(), iResult);
+  }
+  fBatch.clear();
+  return iResult<0?iResult:0;
+}
+
+int DCSCMsgBuffer::ExecuteBatch(TrcuSingleOp* pOps, int iNofOps)
+{
+  return rcuSingleOperations(pOps, iNofOps);
+}
+
+int DCSCMsgBuffer::BeginSession()
+{
+  return dcscBeginSession();
+}
+
+int DCSCMsgBuffer::EndSession()
+{
+  return dcscEndSession();
+}
+
+DCSCSession::DCSCSession(DCSCMsgBuffer* pMsgBuffer)
+  : fpMsgBuffer(NULL)
+{
+  if (pMsgBuffer && pMsgBuffer->BeginSession()>=0) {
+    fpMsgBuffer=pMsgBuffer;
+  }
+}
+
+DCSCSession::~DCSCSession()
+{
+  if (fpMsgBuffer) fpMsgBuffer->EndSession();
+}
+
 /************************************************************************************
  *
  *    state machine related methods
@@ -404,12 +509,14 @@ DCSCMsgBufferSim::~DCSCMsgBufferSim()
 int DCSCMsgBufferSim::SingleWrite(__u32 address, __u32 data)
 {
   //CE_Debug("DCSCMsgBufferSim::SingleWrite address %#x size %#x\n", address, data);
+  if (QueueOperation(address, data, NULL)>0) return 0;
   if (address<fMemory.size()) fMemory[address]=data;
   return 0;
 }
 
 int DCSCMsgBufferSim::SingleRead(__u32 address, __u32* pData)
 {
+  if (QueueOperation(address, 0, pData)>0) return 0;
   if (pData && address<fMemory.size()) *pData=fMemory[address];
   //CE_Debug("DCSCMsgBufferSim::SingleRead address %#x data %#x\n", address, *pData);
   return 0;
@@ -417,7 +524,8 @@ int DCSCMsgBufferSim::SingleRead(__u32 address, __u32* pData)
 
 int DCSCMsgBufferSim::MultipleWrite(__u32 address, __u32* pData, int iSize, int iDataSize)
 {
-  int iResult=0;
+  int iResult=FlushBatch();
+  if (iResult<0) return iResult;
   int size=0;
   if (pData) {
     //CE_Debug("DCSCMsgBufferSim::MultipleWrite address %#x size %#x data %#x\n", address, iSize, *pData);
@@ -453,7 +561,8 @@ int DCSCMsgBufferSim::MultipleWrite(__u32 address, __u32* pData, int iSize, int
 
 int DCSCMsgBufferSim::MultipleRead(__u32 address, int iSize,__u32* pData)
 {
-  int size=0;
+  int size=FlushBatch();
+  if (size<0) return size;
   if (pData) {
     if (address<fMemory.size()) {
       if ((int)address + iSize < fMemory.size()) size=iSize;
@@ -466,5 +575,16 @@ int DCSCMsgBufferSim::MultipleRead(__u32 address, int iSize,__u32* pData)
   return size;
 }
 
+int DCSCMsgBufferSim::ExecuteBatch(TrcuSingleOp* pOps, int iNofOps)
+{
+  if (pOps==NULL) return -EINVAL;
+  for (int i=0; i<iNofOps; i++) {
+    if (pOps[i].address>=fMemory.size()) continue;
+    if (pOps[i].pData) *pOps[i].pData=fMemory[pOps[i].address];
+    else fMemory[pOps[i].address]=pOps[i].data;
+  }
+  return iNofOps;
+}
+
 #endif //RCUDUMMY
 
@@ -30,6 +30,7 @@
 #include "dimdevice.hpp"
 #include "lockguard.hpp"
 #include "ce_base.h"
+#include "dcscMsgBufferInterface.h"
 
 // forward declarations
 class MsgBufferStateMapper;
@@ -84,6 +85,27 @@ class MsgBufferStateMapper;
  * - @ref SingleRead
  * - @ref MultipleRead
  *
+ * @section DCSCMsgBuffer_batch Transaction batching
+ * Single read and write operations between @ref BeginBatch and @ref Commit
+ * are queued and executed together, packed into as few message buffer
+ * command sequences as possible. The data of queued read operations is
+ * available after @ref Commit. Multiple read and write operations execute
+ * the queue before they are executed themselves, the order of the
+ * operations is thus preserved. Only operations of the thread which has
+ * opened the batch are queued.
+ * - @ref BeginBatch
+ * - @ref Commit
+ *
+ * @section DCSCMsgBuffer_session Device sessions
+ * The driver lock of the message buffer device is usually taken and
+ * released for every single transaction. A sequence of accesses can be
+ * enclosed by @ref BeginSession and @ref EndSession in order to lock the
+ * driver only once for the whole sequence. Sessions can be nested and are
+ * exclusive for the calling thread. The @ref DCSCSession guard handles the
+ * session for a scope.
+ * - @ref BeginSession
+ * - @ref EndSession
+ *
  * @section DCSCMsgBuffer_flash_access Flash access
  * soon to be implemented
  *
@@ -177,7 +199,72 @@ public:
    */
   virtual int MultipleRead(__u32 address, int iSize,__u32* pData);
 
+  /**
+   * Open a batch of single operations.
+   * Single reads and writes of the calling thread are queued until the
+   * matching @ref Commit. Batches can be nested, the queue is executed by
+   * the outermost @ref Commit.
+   * @return neg. error code if failed, -EBUSY if another thread has an open batch
+   */
+  int BeginBatch();
+
+  /**
+   * Close a batch and execute the queued operations.
+   * The queued single operations return 0 immediately, errors of the
+   * execution are reported by this function.
+   * @return neg. error code if failed
+   */
+  int Commit();
+
+  /**
+   * Check whether the calling thread has an open batch.
+   * Queued reads are only executed by the outermost @ref Commit.
+   * @return 1 if a batch is open
+   */
+  int BatchOpen();
+
+  /**
+   * Open a device session.
+   * The driver is locked by the outermost session and stays locked until
+   * the matching @ref EndSession. Other threads block on the device until
+   * the session is closed.
+   * Overloaded by the simulation class.
+   * @return neg. error code if failed
+   */
+  virtual int BeginSession();
+
+  /**
+   * Close a device session.
+   * @return neg. error code if failed, -ENOLCK if no session is open
+   */
+  virtual int EndSession();
+
 protected:
+  /**
+   * Queue a single operation if a batch is open for the calling thread.
+   * @param address   16 bit address in memory space
+   * @param data      data word of a write operation
+   * @param pData     buffer to receive the data of a read operation, NULL for write
+   * @return 1 if queued, 0 if the operation has to be executed directly
+   */
+  int QueueOperation(__u32 address, __u32 data, __u32* pData);
+
+  /**
+   * Execute the queued operations, the batch remains open.
+   * @return neg. error code if failed
+   */
+  int FlushBatch();
+
+  /**
+   * Execute a list of single operations.
+   * Wrapper to dcscMsgBuffer method.
+   * Overloaded by the simulation class.
+   * @param pOps      array of operation descriptors
+   * @param iNofOps   number of operations
+   * @return neg. error code if failed
+   */
+  virtual int ExecuteBatch(TrcuSingleOp* pOps, int iNofOps);
+
   /**
    * Internal function called during the @ref CEStateMachine::Armor procedure.
    * See @ref CEDevice::ArmorDevice()
@@ -279,6 +366,18 @@ private:
 
   /** instance of the state mapper */
   std::auto_ptr<MsgBufferStateMapper> fpStateMapper;
+
+  /** the queued operations of the open batch */
+  std::vector<TrcuSingleOp> fBatch;
+
+  /** nesting level of the open batch */
+  int fBatchLevel;
+
+  /** the thread which has opened the batch */
+  pthread_t fBatchOwner;
+
+  /** mutex for the batch state */
+  CE_Mutex fBatchMutex;
 };
 
 class MsgBufferStateMapper: public CEStateMapper {
@@ -286,6 +385,27 @@ public:
   const char* GetMappedStateName(CEState state);
 };
 
+/**
+ * @class DCSCSession
+ * Scope guard for a @ref DCSCMsgBuffer device session.
+ * The session is opened by the constructor and closed by the destructor.
+ * A NULL message buffer is accepted and leaves the guard inactive.
+ */
+class DCSCSession {
+public:
+  DCSCSession(DCSCMsgBuffer* pMsgBuffer);
+  ~DCSCSession();
+
+private:
+  /** copy constructor prohibited */
+  DCSCSession(const DCSCSession&);
+  /** assignment operator prohibited */
+  DCSCSession& operator=(const DCSCSession&);
+
+  /** the message buffer, NULL if the session could not be opened */
+  DCSCMsgBuffer* fpMsgBuffer;
+};
+
 #ifdef RCUDUMMY
 /**
  * @class DCSCMsgBufferSim
@@ -347,6 +467,26 @@ public:
   int MultipleRead(__u32 address, int iSize,__u32* pData);
 
 private:
+  /**
+   * Execute the operations on the simulated memory.
+   * @param pOps      array of operation descriptors
+   * @param iNofOps   number of operations
+   * @return neg. error code if failed
+   */
+  int ExecuteBatch(TrcuSingleOp* pOps, int iNofOps);
+
+  /**
+   * Overload, the simulated memory needs no driver lock.
+   * @return 0
+   */
+  int BeginSession() {return 0;}
+
+  /**
+   * Overload, the simulated memory needs no driver lock.
+   * @return 0
+   */
+  int EndSession() {return 0;}
+
   /**
    * Overload and always succeed.
    * @return neg. error code if failed. -EACCES if not accessible
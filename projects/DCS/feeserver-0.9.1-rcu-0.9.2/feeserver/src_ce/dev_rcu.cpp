@@ -71,22 +71,56 @@ CErcu::CErcu()
   fAFL(0),
   fAFLmask(0),
   fpMsgBuffer(NULL),
-  fUpdateTempDisable(0)
+  fUpdateTempDisable(0),
+  fShadowAFL(0),
+  fShadowHits(0),
+  fShadowMisses(0),
+  fShadowEpoch(fFirmwareEpoch),
+  fDiffMode(0),
+  fDiffAddress(0),
+  fDiffElided(0),
+  fDiffWritten(0),
+  fDiffBlocks(0),
+  fSeqCompile(0),
+  fSeqFecs(0),
+  fSeqWrites(0),
+  fSeqPrograms(0),
+  fSeqThread(),
+  fDiffThread()
 {
   fFwVersion=-1;
   fFecIds.resize(FECActiveList_WIDTH, -1);
   fMaxFecB=FECActiveList_WIDTH/2;
   fMaxFecA=FECActiveList_WIDTH-fMaxFecB;  
   time(&fAflAccess);
+
+  // the shadow register file, all other registers are volatile
+  SetShadowPolicy(RCUFwVersion, eRegStatic);
+  SetShadowPolicy(RCUFwVersionOld, eRegStatic);
+  SetShadowPolicy(AltroTrCfg, eRegWriteThrough);
+  SetShadowPolicy(AltroPmCfg, eRegWriteThrough);
+  SetShadowPolicy(FECRDOList, eRegWriteThrough);
+  SetShadowPolicy(FECINTmode, eRegWriteThrough);
+  // the sequencer memories are only written by the DCS board
+  SetShadowMemory(ALTROInstMEM, ALTROInstMEM_SIZE);
+  SetShadowMemory(ALTROPatternMEM, ALTROPatternMEM_SIZE);
+  SetShadowMemory(ALTROACL, ALTROACL_SIZE);
 }
 
 CErcu::~CErcu() 
 {
+  // the worker calls the handlers of this class
+  StopTransitionWorker();
   if (fpMsgBuffer) DCSCMsgBuffer::ReleaseInstance(fpMsgBuffer);
   fpMsgBuffer==NULL;
 }
 
 CE_Mutex CErcu::fMutex;
+CE_Mutex CErcu::fMemMutex;
+CE_Mutex CErcu::fAflMutex;
+CE_Mutex CErcu::fMsmMutex;
+
+int CErcu::fFirmwareEpoch=0;
 
 CEState CErcu::EvaluateHardware() 
 {
@@ -129,6 +163,8 @@ int CErcu::ArmorDevice()
     // EvaluateHardware
     iResult=0;
   }
+  // the version probing might have changed the Altro Bus Master
+  InvalidateShadow();
   SingleRead(FECActiveList, &fAFL);
   ReadFECActiveList();
 
@@ -219,10 +255,15 @@ int CErcu::ArmorDevice()
   string name=GetServiceBaseName();
   name+="_AFL";
   RegisterService(eDataTypeInt, name.c_str(), 0.0, updateRcuRegister, NULL, FECActiveList, eDataTypeInt, this);
+  AddPrefetchRegister(FECActiveList);
+  // the RCU status words are cheap, they are polled before the FEC services
+  ceSetServiceSchedule(name.c_str(), 0, CE_SERVICE_PRIORITY_HIGH, 0);
 
   name=GetServiceBaseName();
   name+="_ALTRO_ERRST";
   RegisterService(eDataTypeInt, name.c_str(), 0.0, updateRcuRegister, NULL, AltroErrSt, eDataTypeInt, this);
+  AddPrefetchRegister(AltroErrSt);
+  ceSetServiceSchedule(name.c_str(), 0, CE_SERVICE_PRIORITY_HIGH, 0);
 
   return iResult;
 }
@@ -361,10 +402,10 @@ int CErcu::UpdateFecService(int &data, int FECid, int reg)
 {
   int iResult=0;
   data=0;
-  CE_LockGuard g(CErcu::fMutex);
+  CE_LockGuard g(CErcu::fMsmMutex);
+  DCSCSession s(fpMsgBuffer);
   CEState states[]={eStateOff, eStateOn, eStateConfiguring, eStateConfigured, eStateRunning, eStateInvalid};
   if (Check(states)) {
-    CE_LockGuard g(CErcu::fMutex);
     int fecPos=FindFecPosition(FECid);
     if (IsFECposActive(fecPos)) {
       // later we switch between the two versions of the SlowControl
@@ -521,7 +562,8 @@ int CErcu::ReadFecRegister8(int &data, int FEC, int reg)
 int CErcu::WriteFecRegister(int data, int FECid, int reg)
 {
   int iResult=0;
-  CE_LockGuard g(CErcu::fMutex);
+  CE_LockGuard g(CErcu::fMsmMutex);
+  DCSCSession s(fpMsgBuffer);
   // later we have to switch between the different versions of the SlowControl
   int fecPos=FindFecPosition(FECid);
   if (fecPos>=0) iResult=WriteFecRegister5(data, fecPos, reg);
@@ -545,6 +587,7 @@ int CErcu::WriteFecRegister5(int data, int FEC, int reg)
   } else {
     iResult=0;
   }
+  return iResult;
 }
 
 int CErcu::WriteFecRegister8(int data, int FEC, int reg)
@@ -585,7 +628,8 @@ int CErcu::UpdateRcuRegister(TceServiceData* pData, int address, int type)
   int iResult=0;
   if (pData) {
     __u32 data=0;
-    iResult=SingleRead(address, &data);
+    if (TakePrefetchedRegister(address, &data)==0)
+      iResult=ShadowRead(address, &data);
     if (type==eDataTypeInt) {
       pData->iVal=data;
     } else if (type==eDataTypeFloat) {
@@ -839,6 +883,20 @@ int CErcu::TranslateRcuCommand(__u32 cmd, __u32 parameter, const char* pData, in
     rb.resize(sizeof(__u32)/sizeof(CEResultBuffer::value_type), 0);
     *((__u32*)&rb[0])=fFwVersion;
     break;
+  case RCU_READ_SHADOW_STAT:
+    {
+      int rcuHits=0, rcuMisses=0, fecHits=0, fecMisses=0;
+      GetShadowStatistics(rcuHits, rcuMisses, fecHits, fecMisses);
+      rb.resize(4*sizeof(__u32)/sizeof(CEResultBuffer::value_type), 0);
+      __u32* pStat=(__u32*)&rb[0];
+      pStat[0]=rcuHits;
+      pStat[1]=rcuMisses;
+      pStat[2]=fecHits;
+      pStat[3]=fecMisses;
+      CE_Info("shadow registers: RCU %d hit(s) %d miss(es), FEC %d hit(s) %d miss(es)\n",
+	      rcuHits, rcuMisses, fecHits, fecMisses);
+    }
+    break;
   default:
     CE_Warning("unrecognized command id (%#x)\n", cmd);
     iResult=-ENOSYS;
@@ -848,30 +906,541 @@ int CErcu::TranslateRcuCommand(__u32 cmd, __u32 parameter, const char* pData, in
 
 int CErcu::SingleWrite(__u32 address, __u32 data)
 {
-  if (fpMsgBuffer)
-    return fpMsgBuffer->SingleWrite(address, data);
-  return -ENODEV;
+  int iResult=-ENODEV;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (SeqCompileActive()) {
+    if ((iResult=SequencerCompileWrite(address, &data, 1))!=0) return iResult<0?iResult:0;
+    iResult=-ENODEV;
+  }
+  if (DiffModeActive()) {
+    if ((iResult=DifferentialWrite(address, &data, 1))!=0) return iResult<0?iResult:0;
+    iResult=-ENODEV;
+  }
+  if (fpMsgBuffer) {
+    iResult=fpMsgBuffer->SingleWrite(address, data);
+    // the register content is unknown after a failed write
+    ShadowAccess(address, iResult>=0?&data:NULL, 1, 1);
+  }
+  return iResult;
 }
 
 int CErcu::SingleRead(__u32 address, __u32* pData)
 {
-  if (fpMsgBuffer)
-    return fpMsgBuffer->SingleRead(address, pData);
-  return -ENODEV;
+  int iResult=-ENODEV;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (SeqCompileActive() && (iResult=FlushSequencerProgram())<0) return iResult;
+  if (DiffModeActive() && (iResult=FlushDifferentialWrite())<0) return iResult;
+  iResult=-ENODEV;
+  if (fpMsgBuffer) {
+    iResult=fpMsgBuffer->SingleRead(address, pData);
+    if (iResult>=0) ShadowAccess(address, pData, 1, 0);
+  }
+  return iResult;
 }
 
 int CErcu::MultipleWrite(__u32 address, __u32* pData, int iSize, int iDataSize)
 {
-  if (fpMsgBuffer)
-    return fpMsgBuffer->MultipleWrite(address, pData, iSize, iDataSize);
-  return -ENODEV;
+  int iResult=-ENODEV;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (SeqCompileActive()) {
+    if (iDataSize==4) iResult=SequencerCompileWrite(address, pData, iSize);
+    else iResult=FlushSequencerProgram();
+    if (iResult!=0) return iResult<0?iResult:0;
+    iResult=-ENODEV;
+  }
+  if (DiffModeActive()) {
+    // packed data words are never compared
+    if (iDataSize==4) iResult=DifferentialWrite(address, pData, iSize);
+    else iResult=FlushDifferentialWrite();
+    if (iResult!=0) return iResult<0?iResult:0;
+    iResult=-ENODEV;
+  }
+  if (fpMsgBuffer) {
+    iResult=fpMsgBuffer->MultipleWrite(address, pData, iSize, iDataSize);
+    // only plain 32 bit words can be taken over into the shadow
+    ShadowAccess(address, (iResult>=0 && iDataSize==4)?pData:NULL, iSize, 1);
+  }
+  return iResult;
 }
 
 int CErcu::MultipleRead(__u32 address, int iSize,__u32* pData)
 {
-  if (fpMsgBuffer)
-    return fpMsgBuffer->MultipleRead(address, iSize,pData);
-  return -ENODEV;
+  int iResult=-ENODEV;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (SeqCompileActive() && (iResult=FlushSequencerProgram())<0) return iResult;
+  if (DiffModeActive() && (iResult=FlushDifferentialWrite())<0) return iResult;
+  iResult=-ENODEV;
+  if (fpMsgBuffer) {
+    iResult=fpMsgBuffer->MultipleRead(address, iSize,pData);
+    if (iResult>0) ShadowAccess(address, pData, iResult<iSize?iResult:iSize, 0);
+  }
+  return iResult;
+}
+
+int CErcu::SetShadowPolicy(__u32 address, shadow_policy_t policy)
+{
+  shadowreg_t* pReg=FindShadowRegister(address);
+  if (pReg==NULL) {
+    if (policy==eRegVolatile) return 0;
+    shadowreg_t reg;
+    reg.address=address;
+    reg.policy=policy;
+    reg.valid=0;
+    reg.value=0;
+    fShadowRegs.push_back(reg);
+  } else {
+    pReg->policy=policy;
+    pReg->valid=0;
+  }
+  return 0;
+}
+
+int CErcu::SetShadowMemory(__u32 address, int size)
+{
+  if (size<=0) return -EINVAL;
+  shadowmem_t mem;
+  mem.address=address;
+  mem.size=size;
+  mem.value.resize(size, 0);
+  mem.valid.resize(size, 0);
+  fShadowMems.push_back(mem);
+  return 0;
+}
+
+CErcu::shadowreg_t* CErcu::FindShadowRegister(__u32 address)
+{
+  vector<shadowreg_t>::iterator element=fShadowRegs.begin();
+  for (; element!=fShadowRegs.end(); element++) {
+    if (element->address==address && element->policy!=eRegVolatile) return &(*element);
+  }
+  return NULL;
+}
+
+int CErcu::GetShadowWord(__u32 address, __u32* pValue)
+{
+  vector<shadowmem_t>::iterator mem=fShadowMems.begin();
+  for (; mem!=fShadowMems.end(); mem++) {
+    if (address>=mem->address && address<mem->address+mem->size) {
+      *pValue=mem->value[address-mem->address];
+      return mem->valid[address-mem->address];
+    }
+  }
+  shadowreg_t* pReg=FindShadowRegister(address);
+  if (pReg==NULL || pReg->policy!=eRegWriteThrough) return -ENOENT;
+  *pValue=pReg->value;
+  return pReg->valid;
+}
+
+void CErcu::ShadowAccess(__u32 address, const __u32* pData, int iSize, int bWrite)
+{
+  vector<shadowreg_t>::iterator element=fShadowRegs.begin();
+  for (; element!=fShadowRegs.end(); element++) {
+    if (element->address>=address && element->address<address+iSize) {
+      if (pData) element->value=pData[element->address-address];
+      element->valid=pData!=NULL;
+    }
+  }
+  vector<shadowmem_t>::iterator mem=fShadowMems.begin();
+  for (; mem!=fShadowMems.end(); mem++) {
+    __u32 first=address>mem->address?address:mem->address;
+    __u32 last=address+iSize<mem->address+mem->size?address+iSize:mem->address+mem->size;
+    for (__u32 addr=first; addr<last; addr++) {
+      if (pData) mem->value[addr-mem->address]=pData[addr-address];
+      mem->valid[addr-mem->address]=pData!=NULL;
+    }
+  }
+  if (FECActiveList>=address && FECActiveList<address+iSize) {
+    // FECs which have been switched lost their register content
+    __u32 afl=pData?pData[FECActiveList-address]:~fShadowAFL;
+    if (afl!=fShadowAFL) InvalidateFecShadow(afl^fShadowAFL);
+    fShadowAFL=afl;
+  }
+  if (bWrite==0) return;
+  // a block write hits every register of its range
+  for (__u32 addr=address; addr<address+iSize; addr++) {
+    switch (addr) {
+    case CMDRESET:
+      InvalidateRcuShadow(0);
+      InvalidateFecShadow(~(__u32)0);
+      break;
+    case CMDRESETRCU:
+      InvalidateRcuShadow(0);
+      break;
+    case CMDRESETFEC:
+    case CMDExecALTRO:
+    case CMDExecSC:
+      // the sequencer can write to the board controllers
+      InvalidateFecShadow(~(__u32)0);
+      break;
+    default:
+      if (addr>=FECCommands && addr<FECCommands+FECCommands_SIZE &&
+	  (addr&(0x1<<MSMCommand_rnw))==0) {
+	// slow control write to a FEC register
+	int branch=(addr>>MSMCommand_branch)&0x1;
+	int fec=(addr>>MSMCommand_FECAdr)&0xf;
+	int reg=(addr>>MSMCommand_BCRegAdr)&0x1f;
+	__u32 positions=(__u32)0x1<<(16*branch+fec);
+	if (addr&(0x1<<MSMCommand_bcast)) positions=~(__u32)0;
+	InvalidateFecShadow(positions, reg);
+      }
+    }
+  }
+}
+
+int CErcu::AddPrefetchRegister(__u32 address)
+{
+  vector<prefetchreg_t>::iterator element=fPrefetchRegs.begin();
+  for (; element!=fPrefetchRegs.end(); element++) {
+    if (element->address==address) return 0;
+  }
+  prefetchreg_t reg;
+  reg.address=address;
+  reg.value=0;
+  reg.valid=0;
+  fPrefetchRegs.push_back(reg);
+  return 0;
+}
+
+int CErcu::PrefetchServiceRegisters(__u32* pAFL)
+{
+  int iResult=0;
+  DropPrefetchedRegisters();
+  if (fpMsgBuffer==NULL || fSeqCompile || fDiffMode ||
+      fpMsgBuffer->BatchOpen() || fpMsgBuffer->BeginBatch()<0) {
+    return SingleRead(FECActiveList, pAFL);
+  }
+  fpMsgBuffer->SingleRead(FECActiveList, pAFL);
+  vector<prefetchreg_t>::iterator element=fPrefetchRegs.begin();
+  for (; element!=fPrefetchRegs.end(); element++) {
+    if (element->address!=FECActiveList)
+      fpMsgBuffer->SingleRead(element->address, &element->value);
+  }
+  if ((iResult=fpMsgBuffer->Commit())<0) return iResult;
+  ShadowAccess(FECActiveList, pAFL, 1, 0);
+  for (element=fPrefetchRegs.begin(); element!=fPrefetchRegs.end(); element++) {
+    if (element->address==FECActiveList) element->value=*pAFL;
+    else ShadowAccess(element->address, &element->value, 1, 0);
+    element->valid=1;
+  }
+  return iResult;
+}
+
+int CErcu::TakePrefetchedRegister(__u32 address, __u32* pData)
+{
+  CE_LockGuard g(fMutex);
+  vector<prefetchreg_t>::iterator element=fPrefetchRegs.begin();
+  for (; element!=fPrefetchRegs.end(); element++) {
+    if (element->address==address && element->valid) {
+      *pData=element->value;
+      element->valid=0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void CErcu::DropPrefetchedRegisters()
+{
+  CE_LockGuard g(fMutex);
+  vector<prefetchreg_t>::iterator element=fPrefetchRegs.begin();
+  for (; element!=fPrefetchRegs.end(); element++) {
+    element->valid=0;
+  }
+}
+
+int CErcu::ShadowRead(__u32 address, __u32* pData)
+{
+  int iResult=0;
+  if (pData==NULL) return -EINVAL;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (fShadowEpoch!=fFirmwareEpoch) {
+    InvalidateShadow();
+    fShadowEpoch=fFirmwareEpoch;
+  }
+  if (SeqCompileActive() && (iResult=FlushSequencerProgram())<0) return iResult;
+  if (DiffModeActive() && (iResult=FlushDifferentialWrite())<0) return iResult;
+  shadowreg_t* pReg=FindShadowRegister(address);
+  if (pReg && pReg->valid) {
+    *pData=pReg->value;
+    fShadowHits++;
+    return iResult;
+  }
+  if (pReg) fShadowMisses++;
+  iResult=SingleRead(address, pData);
+  return iResult;
+}
+
+void CErcu::InvalidateRcuShadow(int bStatic)
+{
+  vector<shadowreg_t>::iterator element=fShadowRegs.begin();
+  for (; element!=fShadowRegs.end(); element++) {
+    if (bStatic || element->policy!=eRegStatic) element->valid=0;
+  }
+  vector<shadowmem_t>::iterator mem=fShadowMems.begin();
+  for (; mem!=fShadowMems.end(); mem++) {
+    mem->valid.assign(mem->size, 0);
+  }
+}
+
+void CErcu::InvalidateFecShadow(__u32 positions, int reg)
+{
+  for (size_t i=0; i<8*sizeof(__u32) && i<fFecIds.size(); i++) {
+    if ((positions&((__u32)0x1<<i))==0 || fFecIds[i]<0) continue;
+    CEfec* pFEC=dynamic_cast<CEfec*>(FindDevice(fFecIds[i]));
+    if (pFEC) pFEC->InvalidateShadow(reg);
+  }
+}
+
+void CErcu::InvalidateShadow()
+{
+  CE_LockGuard g(fMutex);
+  InvalidateRcuShadow(1);
+  InvalidateFecShadow(~(__u32)0);
+}
+
+int CErcu::BeginDifferentialWrite()
+{
+  CE_LockGuard g(fMutex);
+  if (fDiffMode) return -EBUSY;
+  if (fShadowEpoch!=fFirmwareEpoch) {
+    InvalidateShadow();
+    fShadowEpoch=fFirmwareEpoch;
+  }
+  fDiffMode=1;
+  fDiffThread=pthread_self();
+  fDiffPending.clear();
+  fDiffElided=0;
+  fDiffWritten=0;
+  fDiffBlocks=0;
+  return 0;
+}
+
+int CErcu::EndDifferentialWrite(int* pElided, int* pWritten, int* pBlocks)
+{
+  int iResult=0;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (DiffModeActive()==0) return -ENOENT;
+  iResult=FlushDifferentialWrite();
+  fDiffMode=0;
+  if (pElided) *pElided=fDiffElided;
+  if (pWritten) *pWritten=fDiffWritten;
+  if (pBlocks) *pBlocks=fDiffBlocks;
+  return iResult;
+}
+
+int CErcu::DifferentialWrite(__u32 address, const __u32* pData, int iSize)
+{
+  int iResult=0;
+  __u32 value=0;
+  int i=0;
+  for (i=0; i<iSize; i++) {
+    if (GetShadowWord(address+i, &value)<0) break;
+  }
+  if (i<iSize) {
+    // no shadow available, the caller writes to the hardware after the
+    // pending block in order to keep the sequence of the accesses
+    return FlushDifferentialWrite();
+  }
+  for (i=0; i<iSize && iResult>=0; i++) {
+    if (fDiffPending.size()>0 && address+i!=fDiffAddress+fDiffPending.size()) {
+      if ((iResult=FlushDifferentialWrite())<0) break;
+    }
+    if (GetShadowWord(address+i, &value)>0 && value==pData[i]) {
+      fDiffElided++;
+      continue;
+    }
+    if (fDiffPending.size()==0) fDiffAddress=address+i;
+    fDiffPending.push_back(pData[i]);
+  }
+  if (iResult>=0) iResult=1;
+  return iResult;
+}
+
+int CErcu::FlushDifferentialWrite()
+{
+  int iResult=0;
+  int iSize=fDiffPending.size();
+  if (iSize==0) return 0;
+  if (fpMsgBuffer==NULL) {
+    fDiffPending.clear();
+    return -ENODEV;
+  }
+  if (iSize==1) {
+    iResult=fpMsgBuffer->SingleWrite(fDiffAddress, fDiffPending[0]);
+    fDiffBlocks++;
+  } else if (ceCheckOptionFlag(DEBUG_USE_SINGLE_WRITE)) {
+    for (int i=0; i<iSize && iResult>=0; i++, fDiffBlocks++) {
+      iResult=fpMsgBuffer->SingleWrite(fDiffAddress+i, fDiffPending[i]);
+    }
+  } else {
+    iResult=fpMsgBuffer->MultipleWrite(fDiffAddress, &fDiffPending[0], iSize, 4);
+    fDiffBlocks++;
+  }
+  ShadowAccess(fDiffAddress, iResult>=0?&fDiffPending[0]:NULL, iSize, 1);
+  if (iResult>=0) {
+    fDiffWritten+=iSize;
+  } else {
+    CE_Error("deferred write of %d word(s) to rcu memory at %#x failed with error %d\n", iSize, fDiffAddress, iResult);
+  }
+  fDiffPending.clear();
+  return iResult;
+}
+
+int CErcu::BeginSequencerCompile(int bCompile)
+{
+  // the sequencer belongs to the compile mode until EndSequencerCompile
+  fMemMutex.Lock();
+  CE_LockGuard g(fMutex);
+  if (fSeqCompile) {
+    fMemMutex.Unlock();
+    return -EBUSY;
+  }
+  fSeqCompile=bCompile?2:1;
+  fSeqThread=pthread_self();
+  fSeqProgram.clear();
+  fSeqFecs=0;
+  fSeqWrites=0;
+  fSeqPrograms=0;
+  return 0;
+}
+
+int CErcu::EndSequencerCompile(int* pWrites, int* pFecs, int* pPrograms)
+{
+  int iResult=0;
+  DCSCSession s(fpMsgBuffer);
+  CE_LockGuard g(fMutex);
+  if (SeqCompileActive()==0) return -ENOENT;
+  iResult=FlushSequencerProgram();
+  fSeqCompile=0;
+  fMemMutex.Unlock();
+  if (pWrites) *pWrites=fSeqWrites;
+  if (pFecs) {
+    *pFecs=0;
+    for (__u32 mask=fSeqFecs; mask; mask>>=1) *pFecs+=mask&0x1;
+  }
+  if (pPrograms) *pPrograms=fSeqPrograms;
+  return iResult;
+}
+
+int CErcu::SequencerCompileWrite(__u32 address, const __u32* pData, int iSize)
+{
+  int iResult=0;
+  int i=0;
+  for (i=0; i<iSize; i++) {
+    __u32 addr=address+i;
+    if (addr<FECCommands || addr>=FECCommands+FECCommands_SIZE ||
+	(addr&(0x1<<MSMCommand_rnw))!=0) break;
+  }
+  if (i<iSize) {
+    // no board controller write, the pending program is executed first
+    // in order to keep the sequence of the accesses
+    return FlushSequencerProgram();
+  }
+  for (i=0; i<iSize && iResult>=0; i++) {
+    __u32 addr=address+i;
+    __u32 bcast=(addr>>MSMCommand_bcast)&0x1;
+    __u32 branch=(addr>>MSMCommand_branch)&0x1;
+    __u32 fec=(addr>>MSMCommand_FECAdr)&0xf;
+    __u32 reg=(addr>>MSMCommand_BCRegAdr)&0x1f;
+    fSeqWrites++;
+    fSeqFecs|=bcast?fAFL:((__u32)0x1<<(16*branch+fec));
+    if (fSeqCompile<2) continue;
+    // two words per write and the end marker have to fit
+    if (fSeqProgram.size()+3>ALTROInstMEM_SIZE) {
+      if ((iResult=FlushSequencerProgram())<0) break;
+    }
+    fSeqProgram.push_back(RCUSeq_WRITE | (bcast<<RCUSeq_bcast) | (0x1<<RCUSeq_bcal) |
+			  (branch<<RCUSeq_branch) | (fec<<RCUSeq_FECAdr) | (reg<<RCUSeq_RegAdr));
+    fSeqProgram.push_back(RCUSeq_DATA | (pData[i]&RCUSeq_DATA_MASK));
+  }
+  if (iResult>=0) iResult=fSeqCompile<2?0:1;
+  return iResult;
+}
+
+int CErcu::FlushSequencerProgram()
+{
+  int iResult=0;
+  if (fSeqProgram.size()==0) return 0;
+  fSeqProgram.push_back(RCUSeq_END);
+  int iSize=fSeqProgram.size();
+  // the program is loaded and executed through the normal access functions
+  int mode=fSeqCompile;
+  fSeqCompile=0;
+  // the instruction memory can hold a program uploaded by RCU_WRITE_INSTRUCTION
+  // for a later RCU_EXEC, the overwritten words are saved and restored
+  vector<__u32> saved(iSize, 0);
+  int bShadow=1;
+  for (int i=0; i<iSize && bShadow; i++) {
+    bShadow=GetShadowWord(ALTROInstMEM+i, &saved[i])==1;
+  }
+  if (!bShadow && (iResult=MultipleRead(ALTROInstMEM, iSize, &saved[0]))>=0 && iResult<iSize) {
+    iResult=-EIO;
+  }
+  int bSaved=iResult>=0;
+  if (iResult>=0 &&
+      (iResult=writeCommandBufferToRCUMem((const char*)&fSeqProgram[0], iSize, 4, ALTROInstMEM))>=0 &&
+      (iResult=SingleWrite(CMDResAltroErrSt, 0))>=0 &&
+      (iResult=SingleWrite(CMDExecALTRO, 0))>=0) {
+    // a full program runs longer than the busy loop of checkRCUError
+    __u32 status=RCU_SEQ_BUSY;
+    for (int poll=0; poll<100 && iResult>=0 && (status&RCU_SEQ_BUSY); poll++) {
+      if (poll>0) usleep(10);
+      iResult=SingleRead(AltroErrSt, &status);
+    }
+    if (iResult>=0 && (status&RCU_SEQ_BUSY)) {
+      // the instruction memory must not be written while the sequencer runs
+      CE_Error("compiled sequencer program of %d word(s) still running, aborted\n", iSize);
+      SingleWrite(CMDAbortALTRO, 0);
+      iResult=-ETIMEDOUT;
+    }
+    if (iResult>=0) iResult=checkRCUError();
+  }
+  if (bSaved) {
+    int iRestore=MultipleWrite(ALTROInstMEM, &saved[0], iSize, 4);
+    if (iRestore<0) {
+      CE_Error("can not restore %d word(s) of the instruction memory (%d)\n", iSize, iRestore);
+      if (iResult>=0) iResult=iRestore;
+    }
+  }
+  fSeqCompile=mode;
+  if (iResult>=0) {
+    fSeqPrograms++;
+  } else {
+    CE_Error("compiled sequencer program of %d word(s) failed with error %d\n", (int)fSeqProgram.size(), iResult);
+  }
+  fSeqProgram.clear();
+  return iResult;
+}
+
+void CErcu::FirmwareReconfigured()
+{
+  CE_LockGuard g(fMutex);
+  fFirmwareEpoch++;
+}
+
+void CErcu::GetShadowStatistics(int &rcuHits, int &rcuMisses, int &fecHits, int &fecMisses)
+{
+  CE_LockGuard g(fMutex);
+  rcuHits=fShadowHits;
+  rcuMisses=fShadowMisses;
+  fecHits=0;
+  fecMisses=0;
+  for (size_t i=0; i<fFecIds.size(); i++) {
+    if (fFecIds[i]<0) continue;
+    CEfec* pFEC=dynamic_cast<CEfec*>(FindDevice(fFecIds[i]));
+    if (pFEC) {
+      int hits=0, misses=0;
+      pFEC->GetShadowStatistics(hits, misses);
+      fecHits+=hits;
+      fecMisses+=misses;
+    }
+  }
 }
 
 int CErcu::checkRCUError()
@@ -923,7 +1492,8 @@ int CErcu::checkRCUError()
 int CErcu::sendRCUExecCommand(unsigned short start)
 {
   int iResult=0;
-  CE_LockGuard g(fMutex);
+  CE_LockGuard g(fMemMutex);
+  DCSCSession s(fpMsgBuffer);
   SingleWrite(CMDResAltroErrSt, 0);
   if ((iResult=SingleWrite(CMDExecALTRO, start))>=0) {
     CE_Debug("instruction buffer executed\n");
@@ -939,7 +1509,7 @@ int CErcu::sendRCUExecCommand(unsigned short start)
 int CErcu::sendStopRCUExec()
 {
   int iResult=0;
-  CE_LockGuard g(fMutex);
+  // not serialized with the memory sequences in order to abort a running one
   if ((iResult=SingleWrite(CMDAbortALTRO, 0))<0) {
     CE_Error("attemp to stop execution failed with error %d\n", iResult);
   }
@@ -953,7 +1523,10 @@ int CErcu::writeCommandBufferToRCUMem(const char* pBuffer, int iCount, int iWord
   __u32 u32Address=u32BaseAddress;
   __u32 data=0;
   int i=0;
-  CE_LockGuard g(fMutex);
+  CE_LockGuard g(fMemMutex);
+  // the AFL is ramped outside of the device session, see the lock order at CErcu::fMutex
+  int bAFL=u32BaseAddress<=FECActiveList && u32BaseAddress+iCount>FECActiveList;
+  DCSCSession s(bAFL?NULL:fpMsgBuffer);
   if (iWordSize==4 || iWordSize==2) {
     if (ceCheckOptionFlag(DEBUG_USE_SINGLE_WRITE)) {
       for (i=0;i<iCount && iResult>=0;i++) {
@@ -1083,9 +1656,13 @@ int CErcu::readRcuMemoryIntoResultBuffer(__u32 address, int size, int partSize,
   }
   int iCurrent=rb.size();
   rb.resize(iCurrent+size, 0);
-  CE_LockGuard g(fMutex);
+  CE_LockGuard g(fMemMutex);
+  DCSCSession s(fpMsgBuffer);
   int i=0;
-    if (ceCheckOptionFlag(DEBUG_USE_SINGLE_WRITE)) {
+    if (size==1) {
+      // single registers are served from the shadow register file
+      if ((iResult=ShadowRead(address, &rb[iCurrent]))>=0) iResult=size;
+    } else if (ceCheckOptionFlag(DEBUG_USE_SINGLE_WRITE)) {
       __u32 addr=address;
       for (i=0; addr<address+size && iResult>=0; addr++, i++) {
 	iResult=SingleRead(addr, &rb[iCurrent+i]);
@@ -1129,9 +1706,15 @@ int CErcu::ReadFECActiveList()
     // failure (invalid value of the error register indicating malfunction of firmware), the update
     // had been disabled for that cycle in order to avoid repeated warnings
     fUpdateTempDisable=0;
-    CE_LockGuard g(CErcu::fMutex);
+    CE_LockGuard g(CErcu::fAflMutex);
     __u32 afl=0;
-    if (SingleRead(FECActiveList, &afl)>=0) {
+    int iPrefetch=0;
+    {
+      DCSCSession s(fpMsgBuffer);
+      CE_LockGuard l(CErcu::fMutex);
+      iPrefetch=PrefetchServiceRegisters(&afl);
+    }
+    if (iPrefetch>=0) {
       //CE_Debug("afl %#x fAFL %#x\n", afl, fAFL);
       if (1/*afl!=fAFL*/) {
 	//CE_Debug("afl=%#x fAFL=%#x\n", afl, fAFL);
@@ -1178,7 +1761,8 @@ int CErcu::ReadFECActiveList()
 int CErcu::SwitchAFL(int fecid, int on)
 {
   int iResult=0;
-  CE_LockGuard g(CErcu::fMutex);
+  // no device session, the FEC power ramp below waits between the accesses
+  CE_LockGuard g(CErcu::fAflMutex);
   int pos=FindFecPosition(fecid);
   if (pos>=0) {
     __u32 afl=0;
@@ -1219,9 +1803,11 @@ int CErcu::RampAFL(__u32 setAfl)
   int iResult=0;
   __u32 afl=0;
   __u32 changedBits=0;
-  CE_LockGuard g(CErcu::fMutex);
-  if ((iResult=SingleRead(FECActiveList, &afl))>=0 &&
-      (changedBits=afl^setAfl)>0) {
+  {
+    CE_LockGuard g(CErcu::fAflMutex);
+    iResult=SingleRead(FECActiveList, &afl);
+  }
+  if (iResult>=0 && (changedBits=afl^setAfl)>0) {
     CEState tmpState=eStateUnknown;
     CEDevice* pParent=GetParentDevice();
     if (pParent) {
@@ -1244,16 +1830,39 @@ int CErcu::RampAFL(__u32 setAfl)
     CE_Debug("last AFL access %f seconds ago\n", diff);
     int wait=0;
     if (diff<1.0) wait=1;
+    int steps=0;
     for (int i=0; i<FECActiveList_WIDTH; i++) {
-      if ((afl&(0x1<<i))^(setAfl&(0x1<<i))) {
-	if (wait>0) ce_sleep(1);
-	wait=1;
-	afl^=0x1<<i;
-	CE_Debug("write afl %#x\n", afl);
-	if ((iResult=SingleWrite(FECActiveList, afl))>=0) {
-	  iResult=1; // indicate that we switched something
+      if (changedBits&(0x1<<i)) steps++;
+    }
+    int step=0;
+    for (int i=0; i<FECActiveList_WIDTH; i++) {
+      if ((changedBits&(0x1<<i))==0) continue;
+      // the hardware is not locked while waiting for the next FEC, commands
+      // are served in between and the ramp stops if the transition is cancelled
+      if (TransitionPause(wait>0?1000000:0)) {
+	CE_Warning("ramping of AFL cancelled at %#x (target %#x)\n", afl, setAfl);
+	break;
+      }
+      wait=1;
+      int bSwitched=0;
+      {
+	CE_LockGuard l(CErcu::fAflMutex);
+	DCSCSession s(fpMsgBuffer);
+	// the AFL can have been changed by another thread in the meantime
+	if ((iResult=SingleRead(FECActiveList, &afl))<0) break;
+	if (((afl^setAfl)&(0x1<<i))!=0) {
+	  afl^=0x1<<i;
+	  CE_Debug("write afl %#x\n", afl);
+	  if ((iResult=SingleWrite(FECActiveList, afl))>=0) {
+	    iResult=1; // indicate that we switched something
+	  }
+	  fAFL=afl;
+	  bSwitched=1;
 	}
-	fAFL=afl;
+      }
+      // the FEC is switched after the AFL lock is released, its service
+      // update accesses the MSM
+      if (bSwitched) {
 	CEDevice* pFEC=FindDevice(fFecIds[i]);
 	if (pFEC) {
 	  const char* transition="SwitchOn";
@@ -1267,6 +1876,7 @@ int CErcu::RampAFL(__u32 setAfl)
 	  ceUpdateServices(pFEC->GetServiceBaseName(), 0);
 	}
       }
+      SetTransitionProgress((100*(++step))/steps);
     }
     time(&fAflAccess);
   }
@@ -1543,7 +2153,8 @@ int CErcu::CheckSingleFEC(__u32 writeAddress)
   __u32 u32RawData=0;
   int result=0;
 
-  CE_LockGuard g(CErcu::fMutex);
+  CE_LockGuard g(CErcu::fMsmMutex);
+  DCSCSession s(fpMsgBuffer);
   //clear Error Register	
   if (SingleWrite(FECResetErrReg, 0x0)<0) {
     CE_Warning("CErcu::CheckSingleFEC: SingleWrite failed\n");
@@ -1595,7 +2206,8 @@ int CErcu::CheckValidFECs()
   int answer = 0;
   unsigned match = 0;
 
-
+  // the AFL must not change during the check
+  CE_LockGuard g(CErcu::fAflMutex);
   if (SingleRead(FECActiveList,&u32AFL)<0) {
     CE_Warning("detectFECs: SingleRead failed\n");
     return -EIO;
@@ -1665,6 +2277,8 @@ int CErcu::DetectFECs()
   
   CE_Info("running detectFECs\n");
 
+  // the AFL is changed for the detection and restored afterwards
+  CE_LockGuard g(CErcu::fAflMutex);
   //turn on all cards
   __u32 aflBackup=0;
   if (SingleRead(FECActiveList, &aflBackup)<0) {
@@ -1749,7 +2363,7 @@ int CErcu::CheckOptionFlag(int of)
 
 int CErcu::issue(__u32 cmd, __u32 parameter, const char* pData, int iDataSize, CEResultBuffer& rb)
 {
-  TranslateRcuCommand(cmd, parameter, pData, iDataSize, rb);
+  return TranslateRcuCommand(cmd, parameter, pData, iDataSize, rb);
 }
 
 int CErcu::GetGroupId()
@@ -1774,6 +2388,8 @@ int CErcu::HighLevelHandler(const char* pCommand, CEResultBuffer& rb)
       cmd=RCU_WRITE_MEMORY;
     else if (strncmp(pCommand, "RCU_READ_FW_VERSION", keySize=strlen("RCU_READ_FW_VERSION"))==0)
       cmd=RCU_READ_FW_VERSION;
+    else if (strncmp(pCommand, "RCU_READ_SHADOW_STAT", keySize=strlen("RCU_READ_SHADOW_STAT"))==0)
+      cmd=RCU_READ_SHADOW_STAT;
 
     if (cmd>0 && keySize>0) {
       pBuffer+=keySize;
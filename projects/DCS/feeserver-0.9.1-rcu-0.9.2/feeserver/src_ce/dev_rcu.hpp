@@ -302,6 +302,105 @@ public:
    */
   int UpdateRcuRegister(TceServiceData* pData, int address, int type);
 
+  /**
+   * Drop the register values prefetched for the update cycle.
+   * Called at the end of the update cycle, later updates of the services
+   * read the registers again.
+   */
+  void DropPrefetchedRegisters();
+
+  /**
+   * Read a single register through the shadow register file.
+   * Registers with the policy write-through or static are served from the
+   * shadow if it is valid, all other registers are read from the hardware.
+   * The function is used by the services and the read commands, internal
+   * functions which probe the hardware use @ref SingleRead.
+   * @param address   16 bit address in RCU memory space
+   * @param pData     buffer to receive the data
+   * @return neg. error code if failed
+   */
+  int ShadowRead(__u32 address, __u32* pData);
+
+  /**
+   * Invalidate the shadow registers of the RCU and all FECs.
+   */
+  void InvalidateShadow();
+
+  /**
+   * Invalidate the shadow registers of all RCU instances.
+   * To be called after the RCU firmware has been reconfigured, the shadows
+   * are invalidated with the next access.
+   */
+  static void FirmwareReconfigured();
+
+  /**
+   * Get the statistics of the shadow register file.
+   * Only reads of cacheable registers are counted.
+   * @param rcuHits     reads of RCU registers served from the shadow
+   * @param rcuMisses   reads of RCU registers which had to access the hardware
+   * @param fecHits     reads of FEC registers served from the shadow
+   * @param fecMisses   reads of FEC registers which had to access the hardware
+   */
+  void GetShadowStatistics(int &rcuHits, int &rcuMisses, int &fecHits, int &fecMisses);
+
+  /**
+   * Check whether the FEC update is disabled for the current cycle.
+   * See @ref fUpdateTempDisable.
+   */
+  int IsUpdateTempDisabled() {return fUpdateTempDisable;}
+
+  /**
+   * Get the message buffer interface, e.g. to open a @ref DCSCSession.
+   */
+  DCSCMsgBuffer* GetMsgBuffer() {return fpMsgBuffer;}
+
+  /**
+   * Enter differential write mode.
+   * Writes to the sequencer memories and to the write-through registers of
+   * the shadow register file are compared against the shadow image. Words
+   * which match a valid shadow are skipped, the remaining words are deferred
+   * and merged into contiguous block writes. Any other hardware access and
+   * @ref EndDifferentialWrite flush the pending block.
+   * The mode has to be left with @ref EndDifferentialWrite. It applies only
+   * to the accesses of the calling thread.
+   * @return neg. error code if failed
+   */
+  int BeginDifferentialWrite();
+
+  /**
+   * Leave differential write mode and flush the pending block.
+   * @param pElided   optional, receives the number of skipped words
+   * @param pWritten  optional, receives the number of words written
+   * @param pBlocks   optional, receives the number of hardware write accesses
+   * @return neg. error code if a deferred write failed
+   */
+  int EndDifferentialWrite(int* pElided=NULL, int* pWritten=NULL, int* pBlocks=NULL);
+
+  /**
+   * Enter the sequencer compile mode.
+   * Writes to the board controller registers through the slow control
+   * command space are compiled into RCU sequencer programs instead of
+   * being sent one by one via the message buffer. A program is executed
+   * when the instruction memory is full, before any other hardware access
+   * and by @ref EndSequencerCompile.<br>
+   * The register writes are counted in both modes for the benchmark of
+   * the two access paths.<br>
+   * The mode applies only to the accesses of the calling thread, which
+   * holds @ref fMemMutex until @ref EndSequencerCompile.
+   * @param bCompile  1 compile the writes, 0 only count them
+   * @return neg. error code if failed, -EBUSY if the mode is already active
+   */
+  int BeginSequencerCompile(int bCompile);
+
+  /**
+   * Leave the sequencer compile mode and execute the pending program.
+   * @param pWrites   optional, receives the number of register writes
+   * @param pFecs     optional, receives the number of addressed FECs
+   * @param pPrograms optional, receives the number of executed programs
+   * @return neg. error code if the execution of a program failed
+   */
+  int EndSequencerCompile(int* pWrites=NULL, int* pFecs=NULL, int* pPrograms=NULL);
+
   /**
    * Find out how much FECs can be attached to a branch
    * 
@@ -416,6 +515,9 @@ public:
    * Ramp the switching of the AFL bits.
    * The function changes the bits of the AFL one by one in order to realize a
    * ramped power up/down of the FECs.
+   * The hardware is locked only for the switching of each single FEC. Within
+   * a transition the progress is reported and the ramp stops between two
+   * FECs if the transition is cancelled.
    * @param setAfl     AFL target value
    */
   int RampAFL(__u32 setAfl);
@@ -723,6 +825,173 @@ private:
    */
   virtual int EvaluateFirmwareVersion();
 
+  /**
+   * Caching policy of an RCU register in the shadow register file.
+   */
+  enum shadow_policy_t {
+    /** the register is always read from the hardware */
+    eRegVolatile = 0,
+    /** the register changes only by writes, the shadow follows reads and writes */
+    eRegWriteThrough,
+    /** the register changes only with the firmware, it is read once */
+    eRegStatic
+  };
+
+  /**
+   * Entry of the shadow register file.
+   */
+  struct shadowreg_t {
+    /** address in RCU memory space */
+    __u32 address;
+    /** caching policy */
+    shadow_policy_t policy;
+    /** the shadow value is valid */
+    int valid;
+    /** the shadow value */
+    __u32 value;
+  };
+
+  /**
+   * Shadow image of an RCU memory.
+   * The memories are handled like write-through registers.
+   */
+  struct shadowmem_t {
+    /** start address in RCU memory space */
+    __u32 address;
+    /** number of words */
+    int size;
+    /** the shadow values */
+    std::vector<__u32> value;
+    /** valid flags of the shadow values */
+    std::vector<char> valid;
+  };
+
+  /**
+   * Add a register to the shadow register file.
+   */
+  int SetShadowPolicy(__u32 address, shadow_policy_t policy);
+
+  /**
+   * Find the shadow of a register.
+   * @return shadow entry, NULL if the register is not cached
+   */
+  shadowreg_t* FindShadowRegister(__u32 address);
+
+  /**
+   * Add a memory to the shadow image.
+   */
+  int SetShadowMemory(__u32 address, int size);
+
+  /**
+   * Get the shadow of a writable word.
+   * Only memories and write-through registers are considered.
+   * @param address   address in RCU memory space
+   * @param pValue    receives the shadow value
+   * @return 1 shadow valid, 0 shadow invalid, -ENOENT if the word has no shadow
+   */
+  int GetShadowWord(__u32 address, __u32* pValue);
+
+  /**
+   * Register read for the services of the update cycle.
+   */
+  struct prefetchreg_t {
+    /** address in RCU memory space */
+    __u32 address;
+    /** the value read at the beginning of the cycle */
+    __u32 value;
+    /** the value has not yet been used by the service */
+    int valid;
+  };
+
+  /**
+   * Add a register to the prefetch list of the update cycle.
+   * The register is read together with the AFL in one batch at the
+   * beginning of the update cycle, see @ref ReadFECActiveList.
+   */
+  int AddPrefetchRegister(__u32 address);
+
+  /**
+   * Read the AFL and the registers of the prefetch list in one batch.
+   * The reads are packed into one message buffer command sequence. The
+   * AFL is read directly if a batch can not be opened or other writes
+   * are pending. To be called with the device session open and
+   * @ref fMutex locked.
+   * @param pAFL      receives the AFL
+   * @return neg. error code if failed
+   */
+  int PrefetchServiceRegisters(__u32* pAFL);
+
+  /**
+   * Take the prefetched value of a register.
+   * The value is used only once.
+   * @return 1 if a value was available, 0 if not
+   */
+  int TakePrefetchedRegister(__u32 address, __u32* pData);
+
+  /**
+   * Handle a write in differential write mode.
+   * @param address   start address of the access
+   * @param pData     32 bit data words
+   * @param iSize     number of words
+   * @return 1 if the data has been skipped or deferred, 0 if the words have
+   *         no shadow and must be written by the caller, neg. error code if
+   *         the flush of the pending block failed
+   */
+  int DifferentialWrite(__u32 address, const __u32* pData, int iSize);
+
+  /**
+   * Write the pending block of the differential write mode.
+   * @return neg. error code if failed
+   */
+  int FlushDifferentialWrite();
+
+  /**
+   * Handle a write in sequencer compile mode.
+   * @param address   start address of the access
+   * @param pData     32 bit data words
+   * @param iSize     number of words
+   * @return 1 if the words have been compiled, 0 if the caller has to write
+   *         the words, neg. error code if the pending program failed
+   */
+  int SequencerCompileWrite(__u32 address, const __u32* pData, int iSize);
+
+  /**
+   * Write the pending sequencer program to the instruction memory and
+   * execute it.
+   * The words of the instruction memory which are overwritten are taken
+   * from the shadow or read back before, and restored after the execution.
+   * @return neg. error code if failed, -ETIMEDOUT if the sequencer does
+   *         not finish the program
+   */
+  int FlushSequencerProgram();
+
+  /**
+   * Keep the shadow register file consistent with a hardware access.
+   * The function is called by the access functions after a successful
+   * operation. Writes to the reset and sequencer command registers and to
+   * the FEC command space invalidate the affected shadows, for a block
+   * write every address of the block counts. A change of the AFL
+   * invalidates the shadows of the switched FECs.
+   * @param address   start address of the access
+   * @param pData     the data, NULL if unknown (shadows are invalidated)
+   * @param iSize     number of words
+   * @param bWrite    1 write access, 0 read access
+   */
+  void ShadowAccess(__u32 address, const __u32* pData, int iSize, int bWrite);
+
+  /**
+   * Invalidate the shadow registers of the RCU.
+   * @param bStatic   invalidate also the registers with policy static
+   */
+  void InvalidateRcuShadow(int bStatic);
+
+  /**
+   * Invalidate the shadow registers of FECs.
+   * @param positions  bit mask of the FEC positions
+   * @param reg        register number, -1 for all registers
+   */
+  void InvalidateFecShadow(__u32 positions, int reg=-1);
+
 public:
   /**
    * Ids for the Altro Bus Master settings
@@ -733,10 +1002,32 @@ public:
     eAbmDDLsiu   = CMDSIU_ON
   };
 
-  /** the mutex */
-  /** public until all access methods have been incorporated into rcu device */
+  /**
+   * The register state of the RCU: shadow registers, prefetched registers
+   * and the buffers of the differential write and sequencer compile modes.
+   * Held for single transactions only.<br>
+   * The access sequences are protected by the locks of their resources,
+   * sequences on different resources do not wait for each other:
+   * - @ref fMemMutex  instruction and result memory, the sequencer
+   * - @ref fAflMutex  the active FEC list
+   * - @ref fMsmMutex  the slow control bus of the MSM
+   *
+   * Lock order: fMemMutex, fAflMutex, fMsmMutex, the device session
+   * (@ref DCSCSession), fMutex. A sequence which takes fMutex and accesses
+   * the hardware opens the device session first.<br>
+   * public until all access methods have been incorporated into rcu device
+   */
   static CE_Mutex fMutex;
 
+  /** instruction and result memory and the sequencer, see @ref fMutex */
+  static CE_Mutex fMemMutex;
+
+  /** the active FEC list, see @ref fMutex */
+  static CE_Mutex fAflMutex;
+
+  /** the slow control bus of the MSM, see @ref fMutex */
+  static CE_Mutex fMsmMutex;
+
 private:
   /**
    * Set the Altro Bus Master
@@ -808,6 +1099,75 @@ private:
    * via the DDL SIU, update is disabled for the current cycle
    */
   int fUpdateTempDisable;
+
+  /** the shadow register file */
+  std::vector<shadowreg_t> fShadowRegs;
+
+  /** AFL as seen by the last access, used to detect switched FECs */
+  __u32 fShadowAFL;
+
+  /** reads served from the shadow */
+  int fShadowHits;
+
+  /** reads of cacheable registers from the hardware */
+  int fShadowMisses;
+
+  /** firmware configuration counter the shadows are valid for */
+  int fShadowEpoch;
+
+  /** firmware configuration counter, see @ref FirmwareReconfigured */
+  static int fFirmwareEpoch;
+
+  /** shadow images of the RCU memories */
+  std::vector<shadowmem_t> fShadowMems;
+
+  /** registers of the services, read in one batch per update cycle */
+  std::vector<prefetchreg_t> fPrefetchRegs;
+
+  /** differential write mode active */
+  int fDiffMode;
+
+  /** start address of the pending block in differential write mode */
+  __u32 fDiffAddress;
+
+  /** the pending block in differential write mode */
+  std::vector<__u32> fDiffPending;
+
+  /** words skipped in differential write mode */
+  int fDiffElided;
+
+  /** words written in differential write mode */
+  int fDiffWritten;
+
+  /** hardware write accesses in differential write mode */
+  int fDiffBlocks;
+
+  /** sequencer compile mode: 0 off, 1 count only, 2 compile */
+  int fSeqCompile;
+
+  /** the pending sequencer program */
+  std::vector<__u32> fSeqProgram;
+
+  /** FEC positions addressed in sequencer compile mode */
+  __u32 fSeqFecs;
+
+  /** register writes in sequencer compile mode */
+  int fSeqWrites;
+
+  /** programs executed in sequencer compile mode */
+  int fSeqPrograms;
+
+  /** thread which opened the sequencer compile mode */
+  pthread_t fSeqThread;
+
+  /** thread which opened the differential write mode */
+  pthread_t fDiffThread;
+
+  /** sequencer compile mode active for the calling thread */
+  int SeqCompileActive() {return fSeqCompile!=0 && pthread_equal(fSeqThread, pthread_self());}
+
+  /** differential write mode active for the calling thread */
+  int DiffModeActive() {return fDiffMode!=0 && pthread_equal(fDiffThread, pthread_self());}
 };
 
 /**
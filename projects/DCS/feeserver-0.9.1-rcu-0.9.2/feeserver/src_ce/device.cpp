@@ -243,12 +243,25 @@ int CEDevice::AddSubDevice(CEDevice* pDevice) {
   return iResult;
 }
 
+int CEDevice::StopTransitionWorkers() {
+  vector<CEDevice*>::iterator element=fSubDevices.begin();
+  for (; element!=fSubDevices.end(); element++) {
+    if (*element) (*element)->StopTransitionWorkers();
+  }
+  return StopTransitionWorker();
+}
+
 int CEDevice::CleanupSubDevices() {
   int iResult=0;
   vector<CEDevice*>::iterator element=fSubDevices.begin();
   while (element!=fSubDevices.end()) {
     CEDevice* pDevice=*element;
     *element=NULL;
+    if (pDevice==NULL) {
+      element++;
+      continue;
+    }
+    pDevice->StopTransitionWorkers();
     CE_Debug("Device %p (%s : %d) deleted\n", pDevice, pDevice->GetName(), pDevice->GetDeviceId());
     try {
       delete pDevice;
@@ -391,8 +404,12 @@ int DeviceCommandHandler::HighLevelHandler(const char* pCommand, CEResultBuffer&
       cmd=CE_GET_STATES;
     else if (strncmp(pCommand, "CE_GET_STATE", keySize=strlen("CE_GET_STATE"))==0)
       cmd=CE_GET_STATE;
+    else if (strncmp(pCommand, "CE_TRIGGER_TRANSITION_ASYNC", keySize=strlen("CE_TRIGGER_TRANSITION_ASYNC"))==0)
+      cmd=CE_TRIGGER_TRANSITION_ASYNC;
     else if (strncmp(pCommand, "CE_TRIGGER_TRANSITION", keySize=strlen("CE_TRIGGER_TRANSITION"))==0)
       cmd=CE_TRIGGER_TRANSITION;
+    else if (strncmp(pCommand, "CE_CANCEL_TRANSITION", keySize=strlen("CE_CANCEL_TRANSITION"))==0)
+      cmd=CE_CANCEL_TRANSITION;
 
     if (cmd>0 && keySize>0) {
       pBuffer+=keySize;
@@ -470,6 +487,12 @@ int DeviceCommandHandler::issue(__u32 cmd, __u32 parameter, const char* pData, i
     if ((iResult=fDevice->TriggerTransition(arguments.c_str())>=0))
       iResult=parameter;
     break;
+  case CE_TRIGGER_TRANSITION_ASYNC:
+    iResult=fDevice->TriggerTransition(arguments.c_str(), eTransitionAsync);
+    break;
+  case CE_CANCEL_TRANSITION:
+    fDevice->CancelTransition();
+    break;
   default:
     CE_Warning("unknown command id %#x\n", cmd);
     iResult=-ENOSYS;
@@ -106,6 +106,14 @@ public:
    */
   const char* GetServiceBaseName();
 
+  /**
+   * Stop the transition workers of the device and all sub-devices.
+   * Has to be called before a device is deleted, the destructor of the
+   * base class is too late since the worker calls the handlers of the
+   * derived class. See @ref CEStateMachine::StopTransitionWorker.
+   */
+  int StopTransitionWorkers();
+
 protected:
   /**
    * Get the parent device.
@@ -437,6 +445,8 @@ private:
  *  - @ref CE_GET_STATE
  *  - @ref CE_GET_STATENAME
  *  - @ref CE_TRIGGER_TRANSITION
+ *  - @ref CE_TRIGGER_TRANSITION_ASYNC
+ *  - @ref CE_CANCEL_TRANSITION
  * 
  * High-Level commands
  * <pre>
@@ -445,6 +455,8 @@ private:
  *  CE_GET_STATE          <target>
  *  CE_GET_STATENAME      <target>
  *  CE_TRIGGER_TRANSITION <target> <transition>
+ *  CE_TRIGGER_TRANSITION_ASYNC <target> <transition>
+ *  CE_CANCEL_TRANSITION  <target>
  * </pre>
  */
 class DeviceCommandHandler : public CEIssueHandler {
@@ -103,6 +103,33 @@ int setDimDeviceState(TceServiceData* pData, int major, int minor, void* paramet
   return iResult;
 }
 
+/**
+ * Update the value of the 'PROGRESS' service for the specific @ref CEDimDevice.
+ * This function is registerd during service registration in
+ * @ref CEDimDevice::CreateStateChannel.
+ * @param pF         location to update
+ * @param major      not used
+ * @param minor      not used
+ * @param parameter  pointer to device instance
+ * @internal
+ * @ingroup rcu_ce_base
+ */
+int updateDimDeviceProgress(TceServiceData* pData, int major, int minor, void* parameter) {
+  int iResult=0;
+  if (pData) {
+    if (parameter) {
+      pData->iVal=((CEStateMachine*)parameter)->GetTransitionProgress();
+    } else {
+      CE_Error("missing parameter for function updateDimDeviceProgress, check service registration\n");
+      iResult=-EFAULT;
+    }
+  } else {
+    CE_Error("invalid location\n");
+    iResult=-EINVAL;
+  }
+  return iResult;
+}
+
 
 /**
  * Update the value of the 'ALARM' service for the @ref CEDimDevice.
@@ -152,10 +179,18 @@ int CEDimDevice::CreateStateChannel() {
   if (name.length()>0) name+="_";
   name+="STATE";
   iResult=RegisterService(eDataTypeFloat, (const char*)&name[0], 0.5, updateDimDeviceState, setDimDeviceState, 0, eDataTypeFloat, this);
+  // no hardware access
+  ceSetServiceSchedule((const char*)&name[0], 0, CE_SERVICE_PRIORITY_HIGH, 0);
   name=GetServiceBaseName();
   if (name.length()>0) name+="_";
   name+="STATENAME";
   iResult=RegisterService(eDataTypeString, (const char*)&name[0], 0.0, updateDimDeviceState, NULL, 0, eDataTypeString, this);
+  ceSetServiceSchedule((const char*)&name[0], 0, CE_SERVICE_PRIORITY_HIGH, 0);
+  name=GetServiceBaseName();
+  if (name.length()>0) name+="_";
+  name+="PROGRESS";
+  iResult=RegisterService(eDataTypeInt, (const char*)&name[0], 0.0, updateDimDeviceProgress, NULL, 0, 0, this);
+  ceSetServiceSchedule((const char*)&name[0], 0, CE_SERVICE_PRIORITY_HIGH, 0);
   return iResult;
 }
 
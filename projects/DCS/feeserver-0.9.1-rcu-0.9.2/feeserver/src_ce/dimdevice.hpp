@@ -41,8 +41,9 @@ public:
 
   /** 
    * create a state channel for this state machine.
-   * The function will be called at initialisation and registers a DIM
-   * channel for the State.
+   * The function will be called at initialisation and registers DIM
+   * channels for the State, the name of the state and the progress of
+   * the running transition.
    */
   int CreateStateChannel();
 
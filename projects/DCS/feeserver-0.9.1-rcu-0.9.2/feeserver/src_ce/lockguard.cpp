@@ -1,5 +1,7 @@
 #include "lockguard.hpp"
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #include <cerrno>
 #include "ce_base.h"
 
@@ -18,7 +20,7 @@ CE_Mutex::~CE_Mutex()
     delete (pthread_mutex_t*)fpMutex;
   }
   if (fpMutexAttr) {
-    delete (pthread_mutexattr_t*)fpMutex;
+    delete (pthread_mutexattr_t*)fpMutexAttr;
   }
 }
 
@@ -29,6 +31,7 @@ int CE_Mutex::Init()
     if (fpMutex) {
       fpMutexAttr=new pthread_mutexattr_t;
       if (fpMutexAttr) {
+	pthread_mutexattr_init((pthread_mutexattr_t*)fpMutexAttr);
 	pthread_mutexattr_settype((pthread_mutexattr_t*)fpMutexAttr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init((pthread_mutex_t*)fpMutex, (pthread_mutexattr_t*)fpMutexAttr);
       } else {
@@ -42,7 +45,7 @@ int CE_Mutex::Init()
 
 int CE_Mutex::Lock()
 {
-  if (fpMutex==NULL && Init()<=0) return -EFAULT;
+  if (fpMutex==NULL && Init()<0) return -EFAULT;
 
   if (fpMutex)
     return pthread_mutex_lock((pthread_mutex_t*)fpMutex);
@@ -70,3 +73,77 @@ CE_LockGuard::~CE_LockGuard()
   fMutex.Unlock();
 }
 
+CE_Condition::CE_Condition()
+  :
+  fpCond(NULL),
+  fClock(CLOCK_REALTIME)
+{
+  // postpone initialization to first use or external trigger
+}
+
+CE_Condition::~CE_Condition()
+{
+  if (fpCond) {
+    pthread_cond_destroy((pthread_cond_t*)fpCond);
+    delete (pthread_cond_t*)fpCond;
+  }
+}
+
+int CE_Condition::Init()
+{
+  if (fpCond==NULL) {
+    fpCond=new pthread_cond_t;
+    if (fpCond) {
+      pthread_condattr_t attr;
+      pthread_condattr_init(&attr);
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK>=0 && defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION>=0
+      // the monotonic clock does not jump if the system time is set
+      if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)==0)
+	fClock=CLOCK_MONOTONIC;
+#endif
+      pthread_cond_init((pthread_cond_t*)fpCond, &attr);
+      pthread_condattr_destroy(&attr);
+    }
+  }
+  if (fpCond) return 0;
+  return -ENOMEM;
+}
+
+int CE_Condition::Wait(CE_Mutex& m)
+{
+  if (fpCond==NULL && Init()<0) return -EFAULT;
+  if (m.fpMutex==NULL) return -EFAULT;
+
+  return pthread_cond_wait((pthread_cond_t*)fpCond, (pthread_mutex_t*)m.fpMutex);
+}
+
+int CE_Condition::TimedWait(CE_Mutex& m, const struct timespec* abstime)
+{
+  if (fpCond==NULL && Init()<0) return -EFAULT;
+  if (m.fpMutex==NULL || abstime==NULL) return -EFAULT;
+
+  return pthread_cond_timedwait((pthread_cond_t*)fpCond, (pthread_mutex_t*)m.fpMutex, abstime);
+}
+
+int CE_Condition::Signal()
+{
+  if (fpCond==NULL && Init()<0) return -EFAULT;
+
+  return pthread_cond_signal((pthread_cond_t*)fpCond);
+}
+
+int CE_Condition::Broadcast()
+{
+  if (fpCond==NULL && Init()<0) return -EFAULT;
+
+  return pthread_cond_broadcast((pthread_cond_t*)fpCond);
+}
+
+int CE_Condition::GetTime(struct timespec* now)
+{
+  if (now==NULL) return -EINVAL;
+  // the clock is selected during initialization
+  if (fpCond==NULL && Init()<0) return -EFAULT;
+
+  return clock_gettime(fClock, now);
+}
@@ -1,8 +1,12 @@
 #ifndef __LOCKGUARD_HPP
 #define __LOCKGUARD_HPP
 
+struct timespec;
+
 class CE_Mutex
 {
+  friend class CE_Condition;
+
 public:
   CE_Mutex();
   ~CE_Mutex();
@@ -27,4 +31,31 @@ private:
   CE_Mutex& fMutex;
 };
 
+/**
+ * Condition variable to be used together with a locked CE_Mutex.
+ * Time outs are absolute times of the clock returned by @ref GetTime,
+ * which is the monotonic clock if the system supports it.
+ */
+class CE_Condition
+{
+public:
+  CE_Condition();
+  ~CE_Condition();
+
+  int Init();
+
+  int Wait(CE_Mutex& m);
+  /** @return ETIMEDOUT if the time passed without a signal */
+  int TimedWait(CE_Mutex& m, const struct timespec* abstime);
+  int Signal();
+  int Broadcast();
+
+  /** current time of the clock used for @ref TimedWait */
+  int GetTime(struct timespec* now);
+
+private:
+  void* fpCond;
+  int fClock;
+};
+
 #endif //__LOCKGUARD_HPP
@@ -309,6 +309,53 @@ extern "C" {
  */
 #define CE_GET_STATENAME         (0x0f0000 | FEESERVER_CE_CMD)
 
+/**
+ * Set the streaming mode of the shell execution commands (@ref FEESVR_CMD_SHELL).
+ * In streaming mode, the stdout of a shell program is published line by line
+ * through the log channel while the program is running instead of being
+ * returned in the result buffer. Output is published at the latest after
+ * the period or as soon as 4 kByte are pending.
+ * parameter: period in ms, 0 disables streaming <br>
+ * payload: 0
+ * @ingroup rcu_issue
+ */
+#define CE_SET_SHELL_STREAMING   (0x100000 | FEESERVER_CE_CMD)
+
+/**
+ * Queue a transition for one of the state machines.
+ * The transition is executed by the worker thread of the state machine,
+ * the command returns immediately. Intermediate states and the progress
+ * are published by the <tt>_STATE</tt> and <tt>_PROGRESS</tt> services.
+ * parameter: number of bytes in the payload <br>
+ * payload: char buffer containing service name belonging to the state
+ * machine followed by the action separated by a blank.<br>
+ * return: none<br>
+ * @ingroup rcu_issue
+ */
+#define CE_TRIGGER_TRANSITION_ASYNC (0x110000 | FEESERVER_CE_CMD)
+
+/**
+ * Cancel the queued and the running transition of a state machine.
+ * parameter: number of bytes in the payload <br>
+ * payload: char buffer containing the device name<br>
+ * return: none<br>
+ * @ingroup rcu_issue
+ */
+#define CE_CANCEL_TRANSITION     (0x120000 | FEESERVER_CE_CMD)
+
+/**
+ * Set the poll schedule of services.
+ * The schedule applies to all services whose names start with the whole
+ * name segments of the pattern (separated by '_'), see ceSetServiceSchedule.
+ * parameter: number of bytes of the pattern including the terminating 0<br>
+ * payload: 32 bit poll period in ms (0 polls in every update cycle),
+ * 32 bit priority, 32 bit flags (1 = update only on demand), followed by
+ * the zero terminated pattern<br>
+ * return: none<br>
+ * @ingroup rcu_issue
+ */
+#define CE_SET_SERVICE_SCHEDULE  (0x130000 | FEESERVER_CE_CMD)
+
 /**
  * A configure command for the FEE.
  * The command encapsulates and arbitrary sequence of other commands. The 
@@ -323,6 +370,8 @@ extern "C" {
  * parameter: number of words inside the block after the checksum, i.e. the
  *            the total number of  (including @ref FEE_VERIFICATION 
  * and @ref FEE_CONFIGURE_END)<br>
+ * The differential mode (@ref FEE_CONFIGURE_DIFFERENTIAL) and the sequencer
+ * mode (@ref FEE_CONFIGURE_SEQUENCER) are flags of the command sub id.<br>
  * payload: <br>
  * - 32 bit HW address, related to the ALTRO addressing<br>
  *   bit 11-0   ALTRO address<br>
@@ -345,6 +394,37 @@ extern "C" {
  */
 #define FEE_CONFIGURE           (0x200000 | FEESERVER_CE_CMD)
 
+/**
+ * Differential mode flag for the @ref FEE_CONFIGURE command.
+ * The flag is or'ed to the command, i.e. FEE_CONFIGURE|FEE_CONFIGURE_DIFFERENTIAL,
+ * the parameter is left to the word count.
+ * If the flag is set, writes to the RCU sequencer memories
+ * and to the cached RCU registers are compared against the shadow image of
+ * the RCU device. Words which are already in the hardware are skipped, the
+ * remaining words are merged into contiguous block writes. The number of
+ * skipped writes is reported at the end of the configuration block.<br>
+ * <b>Note:</b> The shadow image is only correct if the memories are not
+ * written through the DDL SIU.
+ * @ingroup rcu_issue
+ */
+#define FEE_CONFIGURE_DIFFERENTIAL  0x080000
+
+/**
+ * Sequencer mode flag for the @ref FEE_CONFIGURE command.
+ * The flag is or'ed to the command like @ref FEE_CONFIGURE_DIFFERENTIAL.
+ * If the flag is set, writes to the board controller
+ * registers through the slow control command space (@ref RCU_WRITE_MEMORY
+ * and @ref RCU_WRITE_MEMBLOCK to the FEC command space) are compiled into
+ * programs for the RCU instruction sequencer. Each program fills up to
+ * the size of the instruction memory and is executed by the firmware,
+ * instead of one message buffer transaction per register.
+ * The configuration time per FEC is reported at the end of the block for
+ * both access paths.<br>
+ * <b>Note:</b> The content of the instruction memory is overwritten.
+ * @ingroup rcu_issue
+ */
+#define FEE_CONFIGURE_SEQUENCER  0x100000
+
 /**
  * Device mask for @ref FEE_CONFIGURE command.
  * This is the mask for the device bits of the hardware address of the
@@ -443,6 +523,32 @@ extern "C" {
  */
 #define FEE_EXTERNAL_CONFIGURATION      (0x230000 | FEESERVER_CE_CMD)
 
+/**
+ * Apply a configuration from the configuration cache.
+ * Every @ref FEE_CONFIGURE block with a non-zero checksum which has been
+ * executed successfully is stored in the configuration cache on the board,
+ * keyed by hardware address and checksum. The command replays the stored
+ * block as if the @ref FEE_CONFIGURE command was sent again. The checksum
+ * of the client is only the key, the CE stores the Adler-32 of each block
+ * and verifies it before the block is replayed. A block sent with a known
+ * key but different content replaces the cached one.<br>
+ * The cache is located in directory <i>FEESERVER_CONF_CACHE</i> (default
+ * /tmp/feeserver-confcache), the size is limited by
+ * <i>FEESERVER_CONF_CACHE_SIZE</i> in kByte (default 1024), the least
+ * recently used blocks are dropped first. A size of 0 disables the cache.<br>
+ * <br>
+ * parameter: ignored <br>
+ * payload: <br>
+ * - 32 bit HW address as for the @ref FEE_CONFIGURE command
+ * - 32 bit checksum as for the @ref FEE_CONFIGURE command
+ *
+ * return: the output of all the sub-commands, -ENOENT if the configuration
+ * is not in the cache. The complete @ref FEE_CONFIGURE has to be sent in
+ * that case.<br>
+ * @ingroup rcu_issue
+ */
+#define FEE_CONFIGURE_CACHED    (0x240000 | FEESERVER_CE_CMD)
+
 /****************************************************************************************/
 
 /**
@@ -847,6 +953,16 @@ extern "C" {
  */
 #define RCU_READ_FW_VERSION     (0x270000 | FEESVR_CMD_RCU)
 
+/**
+ * Read the statistics of the shadow register file.
+ * parameter: ignored <br>
+ * payload: 0 <br>
+ * result: 4 32bit words: RCU shadow hits, RCU shadow misses, FEC shadow hits,
+ *         FEC shadow misses
+ * @ingroup rcu_issue
+ */
+#define RCU_READ_SHADOW_STAT    (0x280000 | FEESVR_CMD_RCU)
+
 /****************************************************************************************/
 
 /**
@@ -864,24 +980,52 @@ extern "C" {
 
 /**
  * write a configuration to the RCU FPGA
+ * The frames are written via the selectmap interface in one block transfer.<br>
+ * parameter: number of 32 bit data words, 0 for the rest of the command block <br>
+ * payload: 32 bit frame address followed by the 32 bit frame data words <br>
+ * result: none
  * @ingroup rcu_issue
  */
 #define RCU_WRITE_FPGA_CONF   (0x010000 | FEESVR_CMD_RCUCONF)
 
 /**
  * read the configuration of the RCU FPGA
+ * The frames are read via the selectmap interface in one block transfer. If
+ * reference data is given, the configuration is verified against it.<br>
+ * parameter: 1 if the reference data follows, 0 otherwise <br>
+ * payload: 32 bit frame address, 32 bit number of words, optionally followed
+ *          by the reference data words <br>
+ * result: the data words, or 2 32bit words with the number of differing
+ *         words and the index of the first one (-1 if none) in case of
+ *         verification
  * @ingroup rcu_issue
  */
 #define RCU_READ_FPGA_CONF    (0x020000 | FEESVR_CMD_RCUCONF)
 
 /**
  * write the configuration data to the Flash
+ * Blocks which already contain the data are skipped, only differing words
+ * are written. Each written block is verified by checksum. The command does
+ * not erase, it fails if the image needs an erase, see @ref RCU_ERASE_FLASH.<br>
+ * parameter: number of 16 bit words, 0 for the rest of the command block <br>
+ * payload: 32 bit start address in the Flash followed by the 16 bit data words,
+ *          padded to 32 bit <br>
+ * result: 5 32bit words: number of blocks, unchanged blocks, written blocks,
+ *         written words, total time in us
  * @ingroup rcu_issue
  */
 #define RCU_WRITE_FLASH       (0x030000 | FEESVR_CMD_RCUCONF)
 
 /**
  * read the configuration data from the Flash
+ * A dump is split into chunks which are read by one command each, a client
+ * can thus resume a dump at any chunk. Only one chunk is kept in memory.<br>
+ * parameter: chunk size in 16 bit words, 0 for the default of 8k words <br>
+ * payload: 3 32 bit words: start address of the dump, number of 16 bit words
+ *          of the dump, sequence number of the requested chunk<br>
+ * result: header of 5 32bit words: sequence number, number of chunks, address
+ *         of the chunk, number of words in the chunk, Adler-32 checksum of the
+ *         data; followed by the data as packed 16 bit words
  * @ingroup rcu_issue
  */
 #define RCU_READ_FLASH        (0x040000 | FEESVR_CMD_RCUCONF)
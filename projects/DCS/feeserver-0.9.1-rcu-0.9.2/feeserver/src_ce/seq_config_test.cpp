@@ -0,0 +1,324 @@
+// $Id$
+
+/************************************************************************
+**
+**
+** This file is property of and copyright by the Experimental Nuclear
+** Physics Group, Dep. of Physics and Technology
+** University of Bergen, Norway, 2007
+**
+** Permission to use, copy, modify and distribute this software and its
+** documentation strictly for non-commercial purposes is hereby granted
+** without fee, provided that the above copyright notice appears in all
+** copies and that both the copyright notice and this permission notice
+** appear in the supporting documentation. The authors make no claims
+** about the suitability of this software for any purpose. It is
+** provided "as is" without express or implied warranty.
+**
+*************************************************************************/
+
+/*
+ * seq_config_test.cpp
+ *
+ * The board controller configuration of the FEE_CONFIGURE sequencer mode
+ * against the writes via the message buffer.
+ *
+ * The message buffer interface is replaced by a model of the RCU memory,
+ * the board controller registers of the FECs and the RCU sequencer, which
+ * executes the register writes of the program in the instruction memory.
+ * The same register writes are sent in a block of RCU_WRITE_MEMORY and
+ * RCU_WRITE_MEMBLOCK commands, once as single message buffer accesses and
+ * once compiled into sequencer programs. Both paths have to leave the
+ * same register content and the instruction memory untouched.
+ * The number of message buffer transactions and the time per FEC is
+ * printed for both paths. The transactions are the figure which carries
+ * over to the board, each one is an execute and poll cycle of the
+ * message buffer firmware.
+ *
+ * Exit code 0 if all checks passed.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <sys/time.h>
+#include "fee_errors.h"
+#include "ce_command.h"
+#include "dcscMsgBufferInterface.h"
+#include "selectmapInterface.h"
+#include "rcu_issue.h"
+#include "codebook_rcu.h"
+#include "dev_rcu.hpp"
+
+using namespace std;
+
+int translateCommand(char* buffer, int size, CEResultBuffer& rb, int bSingleCmd);
+
+#define TEST_FECS      8   // FECs of branch A to configure
+#define TEST_REGISTERS 12  // board controller registers per FEC
+#define TEST_BC_REGS   32
+
+static int g_failures=0;
+static int g_busState=eEnableMsgBuf;
+static int g_transactions=0;
+static map<__u32, __u32> g_mem;
+static __u32 g_bc[2][16][TEST_BC_REGS];
+
+static void check(int cond, const char* what)
+{
+  printf("%s: %s\n", cond?"ok  ":"FAIL", what);
+  if (!cond) g_failures++;
+}
+
+/*******************************************************************************
+ * the FeeServer core
+ */
+extern "C" {
+void createLogMessage(unsigned int type, char* description, char* origin) {}
+int publish(Item* item) {return 0;}
+void signalCEready(int ceState) {}
+int updateFeeService(char* serviceName) {return 0;}
+int allocateMemory(unsigned int size, char type, char* module, char prefixPurpose, void** ptr) {return FEE_FAILED;}
+void feeserverCompileInfo(char** date, char** time) {if (date) *date=""; if (time) *time="";}
+}
+
+/*******************************************************************************
+ * model of the RCU behind the message buffer interface
+ */
+
+/* write to a board controller register through the FEC command space */
+static void bcWrite(__u32 address, __u32 data)
+{
+  int branch=(address>>MSMCommand_branch)&0x1;
+  int fec=(address>>MSMCommand_FECAdr)&0xf;
+  int reg=(address>>MSMCommand_BCRegAdr)&0x1f;
+  if ((address>>MSMCommand_bcast)&0x1) {
+    for (branch=0; branch<2; branch++)
+      for (fec=0; fec<16; fec++) g_bc[branch][fec][reg]=data;
+  } else {
+    g_bc[branch][fec][reg]=data;
+  }
+}
+
+/* the sequencer, only the register writes of the compiled programs */
+static void seqExecute()
+{
+  for (__u32 pc=0; pc<ALTROInstMEM_SIZE; pc++) {
+    __u32 instr=g_mem[ALTROInstMEM+pc];
+    if (instr==RCUSeq_END) break;
+    if ((instr&0xf00000)!=RCUSeq_WRITE || pc+1>=ALTROInstMEM_SIZE) continue;
+    __u32 data=g_mem[ALTROInstMEM+(++pc)]&RCUSeq_DATA_MASK;
+    __u32 address=FECCommands|
+      (((instr>>RCUSeq_bcast)&0x1)<<MSMCommand_bcast)|
+      (((instr>>RCUSeq_branch)&0x1)<<MSMCommand_branch)|
+      (((instr>>RCUSeq_FECAdr)&0xf)<<MSMCommand_FECAdr)|
+      (((instr>>RCUSeq_RegAdr)&0x1f)<<MSMCommand_BCRegAdr);
+    bcWrite(address, data);
+  }
+}
+
+static void memWrite(__u32 address, __u32 data)
+{
+  if (address>=FECCommands && address<FECCommands+FECCommands_SIZE &&
+      (address&(0x1<<MSMCommand_rnw))==0) {
+    bcWrite(address, data);
+  } else if (address==CMDExecALTRO) {
+    seqExecute();
+  } else {
+    g_mem[address]=data;
+  }
+}
+
+static __u32 memRead(__u32 address)
+{
+  switch (address) {
+  case RCUFwVersion:  return 0x020000;
+  case FECActiveList: return (0x1<<TEST_FECS)-1;
+  case AltroErrSt:    return 0; // the sequencer is never busy
+  }
+  return g_mem[address];
+}
+
+int initRcuAccess(const char* pDeviceName) {return 0;}
+int releaseRcuAccess() {return 0;}
+int dcscLockCtrl(int cmd) {return 0;}
+int dcscBeginSession() {return 0;}
+int dcscEndSession() {return 0;}
+int setDebugOptions(int options) {return 0;}
+int setDebugOptionFlag(int of) {return 0;}
+int clearDebugOptionFlag(int of) {return 0;}
+void printBufferHex(unsigned char *pBuffer, int iBufferSize, int wordSize, const char* pMessage) {}
+
+// flash and selectmap are not used by the configuration
+int rcuFlashRead(__u32 address, int iSize, __u32* pData) {return -ENOSYS;}
+int rcuFlashErase(int startSec, int stopSec) {return -ENOSYS;}
+int rcuFlashProgram(__u32 address, __u32* pData, int iSize, int iDataSize, TrcuFlashProgramStat* pStat) {return -ENOSYS;}
+int initSmAccess(const char* pDeviceName) {return -ENOSYS;}
+int releaseSmAccess() {return 0;}
+int smRegisterWrite(__u32 address, __u32 data) {return -ENOSYS;}
+int smBlockWrite(__u32 address, __u32* pData, int iSize) {return -ENOSYS;}
+int smBlockRead(__u32 address, __u32* pData, int iSize) {return -ENOSYS;}
+
+int rcuBusControlCmd(int iCmd)
+{
+  switch (iCmd) {
+  case eEnableSelectmap:
+  case eEnableFlash:
+  case eEnableMsgBuf:
+    g_busState=iCmd;
+    return 0;
+  case eCheckSelectmap: return g_busState==eEnableSelectmap;
+  case eCheckFlash:     return g_busState==eEnableFlash;
+  case eCheckMsgBuf:    return g_busState==eEnableMsgBuf;
+  }
+  return -EINVAL;
+}
+
+int rcuSingleWrite(__u32 address, __u32 data)
+{
+  g_transactions++;
+  memWrite(address, data);
+  return 1;
+}
+
+int rcuSingleRead(__u32 address, __u32* pData)
+{
+  g_transactions++;
+  if (pData) *pData=memRead(address);
+  return 1;
+}
+
+int rcuMultipleWrite(__u32 address, __u32* pData, int iSize, int iDataSize)
+{
+  if (iDataSize!=4) return -EINVAL;
+  g_transactions++;
+  for (int i=0; i<iSize; i++) memWrite(address+i, pData[i]);
+  return iSize;
+}
+
+int rcuMultipleRead(__u32 address, int iSize, __u32* pData)
+{
+  g_transactions++;
+  for (int i=0; i<iSize; i++) pData[i]=memRead(address+i);
+  return iSize;
+}
+
+int rcuSingleOperations(TrcuSingleOp* pOps, int iNofOps)
+{
+  g_transactions++;
+  for (int i=0; i<iNofOps; i++) {
+    if (pOps[i].pData) *pOps[i].pData=memRead(pOps[i].address);
+    else memWrite(pOps[i].address, pOps[i].data);
+  }
+  return iNofOps;
+}
+
+/*******************************************************************************
+ * the configuration block
+ */
+
+/* board controller register address of FEC fec on branch A */
+static __u32 bcAddress(int fec, int reg)
+{
+  return FECCommands|(fec<<MSMCommand_FECAdr)|(reg<<MSMCommand_BCRegAdr);
+}
+
+static __u32 bcValue(int fec, int reg, int pass)
+{
+  return ((pass*0x111+fec*TEST_BC_REGS+reg)*0x3d)&RCUSeq_DATA_MASK;
+}
+
+/* every FEC gets half of its registers as single writes and the other half
+ * as one block, the broadcast write goes first */
+static int configureFecs(int bCompile, int pass, CErcu& rcu, long* pUsec)
+{
+  vector<__u32> block;
+  int fec=0, reg=0;
+  block.push_back(RCU_WRITE_MEMORY|(FECCommands|(0x1<<MSMCommand_bcast)|(TEST_REGISTERS<<MSMCommand_BCRegAdr)));
+  block.push_back(bcValue(0, TEST_REGISTERS, pass));
+  block.push_back(CE_CMD_TAILER);
+  for (fec=0; fec<TEST_FECS; fec++) {
+    for (reg=0; reg<TEST_REGISTERS/2; reg++) {
+      block.push_back(RCU_WRITE_MEMORY|bcAddress(fec, reg));
+      block.push_back(bcValue(fec, reg, pass));
+      block.push_back(CE_CMD_TAILER);
+    }
+    block.push_back(RCU_WRITE_MEMBLOCK|(TEST_REGISTERS-reg));
+    block.push_back(bcAddress(fec, reg));
+    for (; reg<TEST_REGISTERS; reg++) block.push_back(bcValue(fec, reg, pass));
+    block.push_back(CE_CMD_TAILER);
+  }
+
+  CEResultBuffer result;
+  struct timeval start, end;
+  int size=block.size()*sizeof(__u32);
+  int writes=0, fecs=0, programs=0;
+  gettimeofday(&start, NULL);
+  int iResult=rcu.BeginSequencerCompile(bCompile);
+  if (iResult>=0) {
+    iResult=translateCommand((char*)&block[0], size, result, 0);
+    int iFlush=rcu.EndSequencerCompile(&writes, &fecs, &programs);
+    if (iResult==size) iResult=iFlush;
+    else if (iResult>=0) iResult=-EPROTO;
+  }
+  gettimeofday(&end, NULL);
+  *pUsec=(end.tv_sec-start.tv_sec)*1000000+(end.tv_usec-start.tv_usec);
+  if (iResult>=0 && (writes!=TEST_FECS*TEST_REGISTERS+1 || fecs!=TEST_FECS ||
+		     programs!=(bCompile?1:0))) {
+    printf("%d write(s) to %d FEC(s) in %d program(s)\n", writes, fecs, programs);
+    iResult=-EFAULT;
+  }
+  return iResult;
+}
+
+static int bcConfigured(int pass)
+{
+  for (int fec=0; fec<TEST_FECS; fec++) {
+    for (int reg=0; reg<TEST_REGISTERS; reg++) {
+      if (g_bc[0][fec][reg]!=bcValue(fec, reg, pass)) return 0;
+    }
+    if (g_bc[0][fec][TEST_REGISTERS]!=bcValue(0, TEST_REGISTERS, pass)) return 0;
+  }
+  return 1;
+}
+
+int main()
+{
+  CErcu* pRcu=new CErcu;
+  CErcu& rcu=*pRcu;
+  int i=0;
+  check(rcu.Armor()>=0, "RCU device armored");
+
+  // a user program in the instruction memory has to survive the compiled ones
+  for (i=0; i<ALTROInstMEM_SIZE; i++) g_mem[ALTROInstMEM+i]=0x100+i;
+  const char* paths[]={"message buffer", "sequencer"};
+  int transactions[2]={0, 0};
+  long usec[2]={0, 0};
+  for (int bCompile=0; bCompile<2; bCompile++) {
+    char what[80];
+    memset(g_bc, 0, sizeof(g_bc));
+    g_transactions=0;
+    snprintf(what, sizeof(what), "configuration via %s", paths[bCompile]);
+    check(configureFecs(bCompile, bCompile+1, rcu, &usec[bCompile])>=0, what);
+    transactions[bCompile]=g_transactions;
+    snprintf(what, sizeof(what), "board controller registers set via %s", paths[bCompile]);
+    check(bcConfigured(bCompile+1), what);
+  }
+  for (i=0; i<ALTROInstMEM_SIZE && g_mem[ALTROInstMEM+i]==(__u32)(0x100+i); i++);
+  check(i==ALTROInstMEM_SIZE, "instruction memory restored");
+  check(transactions[1]<transactions[0], "less message buffer transactions via sequencer");
+
+  for (i=0; i<2; i++) {
+    printf("%s: %d register write(s) per FEC, %.1f message buffer transaction(s) and %ld us per FEC\n",
+	   paths[i], TEST_REGISTERS+1, (float)transactions[i]/TEST_FECS, usec[i]/TEST_FECS);
+  }
+  // the publish thread of the services has to be gone before the static
+  // objects are destroyed
+  delete pRcu;
+  ceStopPublishStage();
+  printf("seq_config_test: %d failures\n", g_failures);
+  return g_failures?1:0;
+}
@@ -26,12 +26,24 @@
 #include "statemachine.hpp"
 #include "device.hpp"
 #include "ce_base.h"
+#include "controlengine.hpp"
 #include "strings.h"
 
 #define UNNAMED_STATE_NAME "UNNAMED"
 
 using namespace std;
 
+extern "C" void ce_usleep(int usec);
+
+/** the state machine of a transition worker thread */
+static pthread_key_t g_workerKey;
+static pthread_once_t g_workerKeyOnce=PTHREAD_ONCE_INIT;
+
+static void createWorkerKey()
+{
+  pthread_key_create(&g_workerKey, NULL);
+}
+
 CETransition CEStateMachine::fDefTrans[eLastDefaultTransition]={
   CETransition(), // eTransitionUnknown
   CETransition(eSwitchOn,     eStateOn,          "switchon", eStateOff),
@@ -52,12 +64,26 @@ CEStateMachine::CEStateMachine()
   fState(eStateUnknown),
   fName(),
   fpMapper(NULL),
-  fLogLevel(eCEDebug)
+  fLogLevel(eCEDebug),
+  fTransitionMutex(),
+  fTransitionCondition(),
+  fTransitionQueue(),
+  fWorker(),
+  fWorkerState(0),
+  fTerminateWorker(0),
+  fTransitionOwner(),
+  fTransitionLevel(0),
+  fCancel(0),
+  fProgress(100),
+  fExclusiveAccess(0)
 {
+  fTransitionMutex.Init();
+  fTransitionCondition.Init();
 }
 
 CEStateMachine::~CEStateMachine()
 {
+  StopTransitionWorker();
   CleanupTransitionList();
 }
 
@@ -206,6 +232,25 @@ int CEStateMachine::TriggerTransition(CETransitionId transition, int iMode, int
 }
 
 int CEStateMachine::TriggerTransition(CETransition* pTrans, int iMode, int iParam, void* pParam)
+{
+  int iResult=0; 
+  if (pTrans) {
+    if (iMode&eTransitionAsync) {
+      iResult=QueueTransition(pTrans, iParam, pParam);
+    } else if ((iResult=BeginTransition())>=0) {
+      iResult=ExecuteTransition(pTrans, iParam, pParam);
+      EndTransition();
+    } else {
+      CE_Warning("device %s busy: transition \'%s\' refused\n", GetName(), GetTransitionName(pTrans));
+    }
+  } else {
+    CE_Error("invalid pointer\n");
+    iResult=-EINVAL;
+  }
+  return iResult;
+}
+
+int CEStateMachine::ExecuteTransition(CETransition* pTrans, int iParam, void* pParam)
 {
   int iResult=0; 
   if (pTrans) {
@@ -235,6 +280,7 @@ int CEStateMachine::TriggerTransition(CETransition* pTrans, int iMode, int iPara
 	  ChangeState(eStateError);
 	  return iResult;
 	}
+	fProgress=100;
 	fState=final;
 	const char* name=GetName();
 	if (name) ceUpdateServices(name, 0);
@@ -254,6 +300,233 @@ int CEStateMachine::TriggerTransition(CETransition* pTrans, int iMode, int iPara
   return iResult;
 }
 
+int CEStateMachine::QueueTransition(CETransition* pTrans, int iParam, void* pParam)
+{
+  int iResult=0;
+  CE_LockGuard g(fTransitionMutex);
+  if (fWorkerState<0) {
+    CE_Warning("transition worker of device %s stopped: transition \'%s\' refused\n", GetName(), GetTransitionName(pTrans));
+    return -ECANCELED;
+  }
+  if (fWorkerState==0) {
+    fTerminateWorker=0;
+    if ((iResult=pthread_create(&fWorker, NULL, TransitionWorker, this))!=0) {
+      CE_Error("can not start transition worker for device %s (%d)\n", GetName(), iResult);
+      return -iResult;
+    }
+    fWorkerState=1;
+  }
+  CEPendingTransition entry;
+  entry.pTrans=pTrans;
+  entry.iParam=iParam;
+  entry.pParam=pParam;
+  fTransitionQueue.push_back(entry);
+  fTransitionCondition.Broadcast();
+  CE_Log(fLogLevel, "transition \'%s\' queued for device %s (%d pending)\n", GetTransitionName(pTrans), GetName(), (int)fTransitionQueue.size());
+  return iResult;
+}
+
+int CEStateMachine::BeginTransition()
+{
+  CE_LockGuard g(fTransitionMutex);
+  if (fTransitionLevel>0) {
+    if (pthread_equal(fTransitionOwner, pthread_self())==0) return -EBUSY;
+  } else {
+    // queued transitions are executed first
+    if (fTransitionQueue.size()>0) return -EBUSY;
+    fTransitionOwner=pthread_self();
+    fCancel=0;
+    fProgress=0;
+  }
+  fTransitionLevel++;
+  return 0;
+}
+
+int CEStateMachine::EndTransition()
+{
+  CE_LockGuard g(fTransitionMutex);
+  if (fTransitionLevel>0 && --fTransitionLevel==0) {
+    fCancel=0;
+    fProgress=100;
+    fTransitionCondition.Broadcast();
+  }
+  return 0;
+}
+
+void* CEStateMachine::TransitionWorker(void* pInstance)
+{
+  CEStateMachine* pSM=(CEStateMachine*)pInstance;
+  pthread_once(&g_workerKeyOnce, createWorkerKey);
+  pthread_setspecific(g_workerKey, pSM);
+  if (pSM) pSM->ProcessTransitionQueue();
+  return NULL;
+}
+
+CEStateMachine* CEStateMachine::GetWorkerInstance()
+{
+  pthread_once(&g_workerKeyOnce, createWorkerKey);
+  return (CEStateMachine*)pthread_getspecific(g_workerKey);
+}
+
+int CEStateMachine::ProcessTransitionQueue()
+{
+  fTransitionMutex.Lock();
+  while (fTerminateWorker==0) {
+    if (fTransitionQueue.size()==0 || fTransitionLevel>0) {
+      fTransitionCondition.Wait(fTransitionMutex);
+      continue;
+    }
+    // the transition accesses the hardware and the services like a command
+    fTransitionMutex.Unlock();
+    int iAccess=ControlEngine::BeginExclusiveAccess();
+    fTransitionMutex.Lock();
+    if (iAccess==-ECANCELED) {
+      if (fTransitionQueue.size()>0) {
+	CE_Warning("ControlEngine terminates: %d queued transition(s) of device %s dropped\n", (int)fTransitionQueue.size(), GetName());
+	fTransitionQueue.clear();
+      }
+      break;
+    }
+    if (fTerminateWorker || fTransitionQueue.size()==0 || fTransitionLevel>0) {
+      fTransitionMutex.Unlock();
+      if (iAccess>=0) ControlEngine::EndExclusiveAccess();
+      fTransitionMutex.Lock();
+      continue;
+    }
+    CEPendingTransition entry=fTransitionQueue.front();
+    fTransitionQueue.erase(fTransitionQueue.begin());
+    fTransitionOwner=pthread_self();
+    fTransitionLevel=1;
+    fCancel=0;
+    fProgress=0;
+    fExclusiveAccess=iAccess>=0;
+    fTransitionMutex.Unlock();
+    const char* name=GetName();
+    if (name) ceUpdateServices(name, 0);
+    int iResult=ExecuteTransition(entry.pTrans, entry.iParam, entry.pParam);
+    if (iResult<0) {
+      CE_Warning("asynchronous transition \'%s\' of device %s failed (%d)\n", GetTransitionName(entry.pTrans), GetName(), iResult);
+    } else if (fCancel) {
+      CE_Info("asynchronous transition \'%s\' of device %s cancelled\n", GetTransitionName(entry.pTrans), GetName());
+    }
+    fTransitionMutex.Lock();
+    fTransitionLevel=0;
+    fCancel=0;
+    fProgress=100;
+    fTransitionCondition.Broadcast();
+    fTransitionMutex.Unlock();
+    // the access is lost if the CE terminated during a pause
+    if (fExclusiveAccess) {
+      if (name) ceUpdateServices(name, 0);
+      ControlEngine::EndExclusiveAccess();
+      fExclusiveAccess=0;
+    }
+    fTransitionMutex.Lock();
+  }
+  fTransitionMutex.Unlock();
+  return 0;
+}
+
+int CEStateMachine::CancelTransition()
+{
+  CE_LockGuard g(fTransitionMutex);
+  int count=fTransitionQueue.size();
+  fTransitionQueue.clear();
+  if (fTransitionLevel>0) {
+    fCancel=1;
+    count++;
+    // ends a pause of the running transition
+    fTransitionCondition.Broadcast();
+  }
+  if (count>0) CE_Info("%d transition(s) of device %s cancelled\n", count, GetName());
+  return count;
+}
+
+int CEStateMachine::GetTransitionProgress()
+{
+  return fProgress;
+}
+
+int CEStateMachine::StopTransitionWorker()
+{
+  {
+    CE_LockGuard g(fTransitionMutex);
+    if (fWorkerState<=0) {
+      fWorkerState=-1;
+      return 0;
+    }
+    if (pthread_equal(fWorker, pthread_self())) {
+      CE_Error("transition worker of device %s can not stop itself\n", GetName());
+      return -EDEADLK;
+    }
+    fTransitionQueue.clear();
+    if (fTransitionLevel>0) fCancel=1;
+    fTerminateWorker=1;
+    fTransitionCondition.Broadcast();
+  }
+  pthread_join(fWorker, NULL);
+  fWorkerState=-1;
+  return 0;
+}
+
+int CEStateMachine::SetTransitionProgress(int percent)
+{
+  if (percent<0) percent=0;
+  if (percent>100) percent=100;
+  {
+    CE_LockGuard g(fTransitionMutex);
+    if (fTransitionLevel==0) return -ENOENT;
+    if (fProgress==percent) return 0;
+    fProgress=percent;
+  }
+  const char* name=GetName();
+  if (name) ceUpdateServices(name, 0);
+  return 0;
+}
+
+int CEStateMachine::TransitionCancelled()
+{
+  CEStateMachine* pWorkerSM=GetWorkerInstance();
+  return fCancel || (pWorkerSM!=NULL && pWorkerSM->fCancel);
+}
+
+int CEStateMachine::TransitionPause(int usec)
+{
+  CEStateMachine* pSM=GetWorkerInstance();
+  if (pSM==NULL || pSM->fExclusiveAccess==0) {
+    if (usec>0) ce_usleep(usec);
+    return TransitionCancelled();
+  }
+  int iAccess=0;
+  if (usec>0) {
+    ControlEngine::EndExclusiveAccess();
+    {
+      CE_LockGuard g(pSM->fTransitionMutex);
+      struct timespec deadline;
+      pSM->fTransitionCondition.GetTime(&deadline);
+      deadline.tv_sec+=usec/1000000;
+      deadline.tv_nsec+=(usec%1000000)*1000;
+      if (deadline.tv_nsec>=1000000000) {
+	deadline.tv_sec++;
+	deadline.tv_nsec-=1000000000;
+      }
+      while (pSM->fCancel==0 && pSM->fTerminateWorker==0) {
+	if (pSM->fTransitionCondition.TimedWait(pSM->fTransitionMutex, &deadline)==ETIMEDOUT) break;
+      }
+    }
+    iAccess=ControlEngine::BeginExclusiveAccess();
+  } else {
+    iAccess=ControlEngine::YieldExclusiveAccess();
+  }
+  if (iAccess<0) {
+    // the ControlEngine terminates, the transition has to stop
+    CE_LockGuard g(pSM->fTransitionMutex);
+    pSM->fExclusiveAccess=0;
+    pSM->fCancel=1;
+  }
+  return TransitionCancelled();
+}
+
 int CEStateMachine::Synchronize()
 {
   int iResult=0; 
@@ -828,6 +1101,7 @@ int CETransition::SetAttributes(CETransitionId id,
   if (initialState3!=eStateUnknown) fInitialStates.push_back(initialState3);
   if (initialState4!=eStateUnknown) fInitialStates.push_back(initialState4);
   if (initialState5!=eStateUnknown) fInitialStates.push_back(initialState5);
+  return 0;
 }
 
 CETransition::~CETransition() {
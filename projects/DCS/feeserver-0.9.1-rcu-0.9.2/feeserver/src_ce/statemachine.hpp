@@ -24,7 +24,9 @@
 
 #include <string>
 #include <vector>
+#include <pthread.h>
 #include "threadmanager.hpp"
+#include "lockguard.hpp"
 
 /** @defgroup rcu_ce_base_states The CE State Machine Framework
  * The State Machine Framework consists of a CEStateMachine base class
@@ -131,6 +133,17 @@ typedef enum {
   eLastDefaultTransition
 } CETransitionId;
 
+/**
+ * mode flags for @ref CEStateMachine::TriggerTransition.
+ * @ingroup rcu_ce_base_states
+ */
+typedef enum {
+  /** execute the transition in the calling thread */
+  eTransitionSync   = 0x0,
+  /** queue the transition for the worker thread of the state machine */
+  eTransitionAsync  = 0x1
+} CETransitionMode;
+
 /**
  * @class CEStateMachine
  * The State Machine class.
@@ -180,6 +193,17 @@ typedef enum {
  * default states and transition dynamically. 
  * <b>Note:</b> The FAILURE state and <i>notify</i> handling is forseen but not
  * implemented since it is not needed in the beginning.
+ * <br>
+ * Transitions triggered with mode @ref eTransitionAsync are queued and
+ * executed by a worker thread of the state machine, the caller returns
+ * immediately. Each state machine has its own worker. Synchronous transitions
+ * are refused with -EBUSY while the worker processes the queue. The worker
+ * executes each transition with exclusive access to the ControlEngine like a
+ * command, see @ref ControlEngine::BeginExclusiveAccess, so transitions of
+ * different devices do not run in parallel. A long running transition gives
+ * the access free at its pauses, see @ref TransitionPause: commands, e.g. to
+ * cancel the transition, and transitions of other devices are executed in
+ * between. The progress is reported by @ref SetTransitionProgress.
  *
  * @ingroup rcu_ce_base_states
  */
@@ -257,7 +281,7 @@ public:
    * If the device is in the right state for the desired action, the transition
    * dispatcher is called.
    * @param action       char string specifying the action
-   * @param iMode        mode flags
+   * @param iMode        mode flags, see @ref CETransitionMode
    * @param iParam       arbitrary integer parameter passed to dispatcher/handler
    * @param pParam       arbitrary void pointer passed to dispatcher/handler
    * @return             >=0 success, neg error code if failed
@@ -272,7 +296,7 @@ public:
    * If the device is in the right state for the desired action, the transition
    * dispatcher is called.
    * @param transition   id for the transition to be executed
-   * @param iMode        mode flags
+   * @param iMode        mode flags, see @ref CETransitionMode
    * @param iParam       arbitrary integer parameter passed to dispatcher/handler
    * @param pParam       arbitrary void pointer passed to dispatcher/handler
    * @return             >=0 success, neg error code if failed
@@ -285,9 +309,11 @@ public:
   /**
    * Start a transition.
    * If the device is in the right state for the desired action, the transition
-   * dispatcher is called.
+   * dispatcher is called.<br>
+   * An asynchronous transition is only queued, the state is checked when the
+   * worker executes it. \b Note: pParam must stay valid until then.
    * @param pTrans       transition to be executed
-   * @param iMode        mode flags
+   * @param iMode        mode flags, see @ref CETransitionMode
    * @param iParam       arbitrary integer parameter passed to dispatcher/handler
    * @param pParam       arbitrary void pointer passed to dispatcher/handler
    * @return             >=0 success, neg error code if failed
@@ -297,6 +323,33 @@ public:
    */
   int TriggerTransition(CETransition* pTrans, int iMode=0, int iParam=0, void* pParam=NULL);
 
+  /**
+   * Cancel the asynchronous transitions.
+   * Queued transitions are dropped, a running transition is notified via
+   * @ref TransitionCancelled and stops at the discretion of its handler.
+   * @return             number of cancelled transitions
+   */
+  int CancelTransition();
+
+  /**
+   * Get the progress of the running transition.
+   * @return             progress in percent, 100 if no transition is running
+   */
+  int GetTransitionProgress();
+
+  /**
+   * Stop the transition worker.
+   * The running transition is cancelled and queued transitions are dropped.
+   * The function waits for the worker to terminate, no transition can be
+   * queued afterwards. Has to be called before the device specific part is
+   * destroyed, i.e. by the most derived destructor or by
+   * @ref CEDevice::StopTransitionWorkers; the call of the base destructor
+   * only makes sure the thread is gone before the members are released.
+   * Must not be called by a thread with exclusive access to the
+   * ControlEngine, the worker can wait for it.
+   */
+  int StopTransitionWorker();
+
   /**
    * Synchronize state machine with the hardware
    * Performe a number of evaluation functions to dtermine the ste of the
@@ -524,6 +577,37 @@ protected:
    */
   int SetIntermediateState(CEState state);
 
+  /**
+   * Set the progress of the running transition.
+   * The progress is published together with the state, the function can be
+   * called by the handlers of a transition.
+   * @param percent      progress in percent
+   * @return             neg. error code if no transition is running
+   */
+  int SetTransitionProgress(int percent);
+
+  /**
+   * Check if the running transition has been cancelled.
+   * Long running handlers poll the function and stop at the next consistent
+   * point. Called by a transition worker, the cancellation of the transition
+   * the worker executes counts as well, e.g. for the handlers of a sub-device.
+   * @return             1 if cancelled, 0 if not
+   */
+  int TransitionCancelled();
+
+  /**
+   * Pause between two steps of a long running transition.
+   * Called by a transition worker, the exclusive access to the ControlEngine
+   * is released during the pause, commands and the update loop are served
+   * and the pause ends early if the transition is cancelled. Without a pause
+   * time, only commands already waiting are served. In any other thread the
+   * function just waits.<br>
+   * \b Note: Must not be called while holding a lock a command can wait for.
+   * @param usec         pause in micro seconds
+   * @return             1 if cancelled, 0 if not
+   */
+  int TransitionPause(int usec);
+
   /** 
    * Add a transition to the list.
    * The transition object must be created dynamically with \em new. The
@@ -583,6 +667,45 @@ private:
    */ 
   int ChangeState(CEState state);
 
+  /**
+   * Execute a transition in the calling thread.
+   * Leave-state handler, transition handler and enter-state handler are
+   * called, see @ref TriggerTransition for parameters and return values.
+   */
+  int ExecuteTransition(CETransition* pTrans, int iParam, void* pParam);
+
+  /**
+   * Queue a transition for the worker thread.
+   * The worker is started with the first asynchronous transition.
+   */
+  int QueueTransition(CETransition* pTrans, int iParam, void* pParam);
+
+  /**
+   * Mark a synchronous transition as running for the calling thread.
+   * Nested transitions of the same thread are allowed.
+   * @return             -EBUSY if another thread is processing a transition
+   */
+  int BeginTransition();
+
+  /** the synchronous transition is finished */
+  int EndTransition();
+
+  /** processing loop of the worker thread */
+  int ProcessTransitionQueue();
+
+  /** thread function of the worker */
+  static void* TransitionWorker(void* pInstance);
+
+  /** the state machine whose worker is the calling thread, NULL if none */
+  static CEStateMachine* GetWorkerInstance();
+
+  /** a transition waiting for the worker */
+  struct CEPendingTransition {
+    CETransition* pTrans;
+    int iParam;
+    void* pParam;
+  };
+
   /** the device instance for this state machine */
   CEDevice* fpDevice;
   /** state variable */
@@ -602,6 +725,29 @@ private:
 
   /** logging level for state notifications*/
   int fLogLevel;
+
+  /** mutex for the transition queue and the transition flags */
+  CE_Mutex fTransitionMutex;
+  /** signalled on changes of the queue and the transition flags */
+  CE_Condition fTransitionCondition;
+  /** asynchronous transitions waiting for the worker */
+  std::vector<CEPendingTransition> fTransitionQueue;
+  /** the worker thread */
+  pthread_t fWorker;
+  /** 1 worker running, 0 not yet started, -1 stopped */
+  int fWorkerState;
+  /** termination request for the worker */
+  int fTerminateWorker;
+  /** the thread processing the current transition */
+  pthread_t fTransitionOwner;
+  /** nesting level of the current transition, 0 if idle */
+  int fTransitionLevel;
+  /** the current transition has been cancelled */
+  int fCancel;
+  /** progress of the current transition in percent */
+  int fProgress;
+  /** the worker holds the exclusive access to the ControlEngine */
+  int fExclusiveAccess;
 };
 
 /**